@@ -0,0 +1,379 @@
+/*
+ * casefold.c
+ *
+ * case insensitive lowercasing, comparing and hashing, with the vector
+ * instructions of the CPU when available
+ *
+ * a Net::DNS like library for C
+ *
+ * (c) NLnet Labs, 2026
+ *
+ * See the file LICENSE for the license
+ */
+
+#include <ldns/config.h>
+
+#include <ldns/ldns.h>
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define LDNS_CASEFOLD_SSE2 1
+#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define LDNS_CASEFOLD_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define LDNS_CASEFOLD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define LDNS_CASEFOLD_ONES 0x0101010101010101ULL
+
+static inline uint8_t
+ldns_casefold_byte(uint8_t c)
+{
+	return (uint8_t) (c + ((uint8_t) (c - 'A') < 26 ? 'a' - 'A' : 0));
+}
+
+/* lowercase the 8 bytes in a word at once */
+static inline uint64_t
+ldns_casefold_word(uint64_t w)
+{
+	uint64_t low7 = w & (0x7f * LDNS_CASEFOLD_ONES);
+	uint64_t ge_a = low7 + ((0x80 - 'A') * LDNS_CASEFOLD_ONES);
+	uint64_t gt_z = low7 + ((0x80 - 'Z' - 1) * LDNS_CASEFOLD_ONES);
+	uint64_t upper = (ge_a ^ gt_z) & ~w & (0x80 * LDNS_CASEFOLD_ONES);
+
+	return w | (upper >> 2);
+}
+
+static void
+ldns_casefold_lower_word(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	uint64_t w;
+
+	for (; len >= 8; len -= 8, src += 8, dst += 8) {
+		memcpy(&w, src, 8);
+		w = ldns_casefold_word(w);
+		memcpy(dst, &w, 8);
+	}
+	for (; len > 0; len--) {
+		*dst++ = ldns_casefold_byte(*src++);
+	}
+}
+
+static int
+ldns_casefold_compare_bytes(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	uint8_t ca, cb;
+
+	for (; len > 0; len--) {
+		ca = ldns_casefold_byte(*a++);
+		cb = ldns_casefold_byte(*b++);
+		if (ca != cb) {
+			return ca < cb ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static int
+ldns_casefold_compare_word(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	uint64_t wa, wb;
+
+	for (; len >= 8; len -= 8, a += 8, b += 8) {
+		memcpy(&wa, a, 8);
+		memcpy(&wb, b, 8);
+		if (wa != wb &&
+		    ldns_casefold_word(wa) != ldns_casefold_word(wb)) {
+			return ldns_casefold_compare_bytes(a, b, 8);
+		}
+	}
+	return ldns_casefold_compare_bytes(a, b, len);
+}
+
+#ifdef LDNS_CASEFOLD_SSE2
+static inline __m128i
+ldns_casefold_sse2(__m128i v)
+{
+	/* bytes from 0x80 are negative, so they are never letters */
+	__m128i upper = _mm_and_si128(
+		_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+		_mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+
+	return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static void
+ldns_casefold_lower_sse2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	for (; len >= 16; len -= 16, src += 16, dst += 16) {
+		_mm_storeu_si128((__m128i *) dst, ldns_casefold_sse2(
+			_mm_loadu_si128((const __m128i *) src)));
+	}
+	ldns_casefold_lower_word(dst, src, len);
+}
+
+static int
+ldns_casefold_compare_sse2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	__m128i va, vb;
+	int eq;
+
+	for (; len >= 16; len -= 16, a += 16, b += 16) {
+		va = ldns_casefold_sse2(_mm_loadu_si128((const __m128i *) a));
+		vb = ldns_casefold_sse2(_mm_loadu_si128((const __m128i *) b));
+		eq = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+		if (eq != 0xffff) {
+			return ldns_casefold_compare_bytes(
+				a + __builtin_ctz(~eq), b + __builtin_ctz(~eq), 1);
+		}
+	}
+	return ldns_casefold_compare_word(a, b, len);
+}
+#endif /* LDNS_CASEFOLD_SSE2 */
+
+#ifdef LDNS_CASEFOLD_AVX2
+__attribute__((target("avx2")))
+static inline __m256i
+ldns_casefold_avx2(__m256i v)
+{
+	__m256i upper = _mm256_and_si256(
+		_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+
+	return _mm256_or_si256(v,
+		_mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static void
+ldns_casefold_lower_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	for (; len >= 32; len -= 32, src += 32, dst += 32) {
+		_mm256_storeu_si256((__m256i *) dst, ldns_casefold_avx2(
+			_mm256_loadu_si256((const __m256i *) src)));
+	}
+	/* no penalty for mixing AVX and SSE in the rest */
+	_mm256_zeroupper();
+	ldns_casefold_lower_sse2(dst, src, len);
+}
+
+__attribute__((target("avx2")))
+static int
+ldns_casefold_compare_avx2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	__m256i va, vb;
+	uint32_t eq;
+
+	for (; len >= 32; len -= 32, a += 32, b += 32) {
+		va = ldns_casefold_avx2(
+			_mm256_loadu_si256((const __m256i *) a));
+		vb = ldns_casefold_avx2(
+			_mm256_loadu_si256((const __m256i *) b));
+		eq = (uint32_t) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(va, vb));
+		if (eq != 0xffffffff) {
+			return ldns_casefold_compare_bytes(
+				a + __builtin_ctz(~eq), b + __builtin_ctz(~eq), 1);
+		}
+	}
+	_mm256_zeroupper();
+	return ldns_casefold_compare_sse2(a, b, len);
+}
+
+static bool
+ldns_casefold_avx2_available(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+}
+#endif /* LDNS_CASEFOLD_AVX2 */
+
+#ifdef LDNS_CASEFOLD_NEON
+static inline uint8x16_t
+ldns_casefold_neon(uint8x16_t v)
+{
+	uint8x16_t upper = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')),
+			vdupq_n_u8(26));
+
+	return vorrq_u8(v, vandq_u8(upper, vdupq_n_u8(0x20)));
+}
+
+static void
+ldns_casefold_lower_neon(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	for (; len >= 16; len -= 16, src += 16, dst += 16) {
+		vst1q_u8(dst, ldns_casefold_neon(vld1q_u8(src)));
+	}
+	ldns_casefold_lower_word(dst, src, len);
+}
+
+static int
+ldns_casefold_compare_neon(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	uint8x16_t va, vb;
+
+	for (; len >= 16; len -= 16, a += 16, b += 16) {
+		va = ldns_casefold_neon(vld1q_u8(a));
+		vb = ldns_casefold_neon(vld1q_u8(b));
+		if (vminvq_u8(vceqq_u8(va, vb)) != 0xff) {
+			return ldns_casefold_compare_bytes(a, b, 16);
+		}
+	}
+	return ldns_casefold_compare_word(a, b, len);
+}
+#endif /* LDNS_CASEFOLD_NEON */
+
+static bool
+ldns_casefold_always_available(void)
+{
+	return true;
+}
+
+typedef struct ldns_casefold_impl_struct {
+	const char *name;
+	bool (*available)(void);
+	void (*lower)(uint8_t *dst, const uint8_t *src, size_t len);
+	int (*compare)(const uint8_t *a, const uint8_t *b, size_t len);
+} ldns_casefold_impl_type;
+
+/* the best first */
+static const ldns_casefold_impl_type ldns_casefold_impls[] = {
+#ifdef LDNS_CASEFOLD_AVX2
+	{ "avx2", ldns_casefold_avx2_available,
+		ldns_casefold_lower_avx2, ldns_casefold_compare_avx2 },
+#endif
+#ifdef LDNS_CASEFOLD_SSE2
+	{ "sse2", ldns_casefold_always_available,
+		ldns_casefold_lower_sse2, ldns_casefold_compare_sse2 },
+#endif
+#ifdef LDNS_CASEFOLD_NEON
+	{ "neon", ldns_casefold_always_available,
+		ldns_casefold_lower_neon, ldns_casefold_compare_neon },
+#endif
+	{ "word", ldns_casefold_always_available,
+		ldns_casefold_lower_word, ldns_casefold_compare_word },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/* Chosen on first use. Threads that race for it all store the same
+ * pointer. */
+static const ldns_casefold_impl_type *ldns_casefold_current = NULL;
+
+static const ldns_casefold_impl_type *
+ldns_casefold_get(void)
+{
+	const ldns_casefold_impl_type *impl = ldns_casefold_current;
+
+	if (!impl) {
+		for (impl = ldns_casefold_impls; !impl->available(); impl++)
+			;
+		ldns_casefold_current = impl;
+	}
+	return impl;
+}
+
+bool
+ldns_casefold_use(const char *name)
+{
+	const ldns_casefold_impl_type *impl;
+
+	if (!name) {
+		ldns_casefold_current = NULL;
+		(void) ldns_casefold_get();
+		return true;
+	}
+	for (impl = ldns_casefold_impls; impl->name; impl++) {
+		if (strcmp(impl->name, name) == 0 && impl->available()) {
+			ldns_casefold_current = impl;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *
+ldns_casefold_impl(void)
+{
+	return ldns_casefold_get()->name;
+}
+
+void
+ldns_casefold_lower(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	/* most labels and names are short */
+	if (len < 16) {
+		ldns_casefold_lower_word(dst, src, len);
+	} else {
+		ldns_casefold_get()->lower(dst, src, len);
+	}
+}
+
+int
+ldns_casefold_compare(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	if (len < 16) {
+		return ldns_casefold_compare_word(a, b, len);
+	}
+	return ldns_casefold_get()->compare(a, b, len);
+}
+
+/* little endian, so the hash is the same on every platform */
+static inline uint64_t
+ldns_casefold_load64(const uint8_t *p, size_t len)
+{
+	uint64_t w = 0;
+
+	if (len == 8) {
+		memcpy(&w, p, 8);
+#ifdef WORDS_BIGENDIAN
+		w = ((w & 0x00000000ffffffffULL) << 32) |
+		    ((w & 0xffffffff00000000ULL) >> 32);
+		w = ((w & 0x0000ffff0000ffffULL) << 16) |
+		    ((w & 0xffff0000ffff0000ULL) >> 16);
+		w = ((w & 0x00ff00ff00ff00ffULL) << 8) |
+		    ((w & 0xff00ff00ff00ff00ULL) >> 8);
+#endif
+		return w;
+	}
+	while (len > 0) {
+		len--;
+		w = (w << 8) | p[len];
+	}
+	return w;
+}
+
+#define LDNS_CASEFOLD_K1 0x9e3779b97f4a7c15ULL
+#define LDNS_CASEFOLD_K2 0xff51afd7ed558ccdULL
+#define LDNS_CASEFOLD_K3 0xc4ceb9fe1a85ec53ULL
+
+uint64_t
+ldns_casefold_hash(const uint8_t *data, size_t len, uint64_t seed)
+{
+	uint64_t h = seed ^ ((uint64_t) len * LDNS_CASEFOLD_K1);
+	size_t n = len;
+
+	for (; n >= 8; n -= 8, data += 8) {
+		h ^= ldns_casefold_word(ldns_casefold_load64(data, 8));
+		h *= LDNS_CASEFOLD_K1;
+		h = (h << 31) | (h >> 33);
+	}
+	if (n > 0) {
+		h ^= ldns_casefold_word(ldns_casefold_load64(data, n));
+		h *= LDNS_CASEFOLD_K1;
+	}
+	/* the finalizer of MurmurHash3 */
+	h ^= h >> 33;
+	h *= LDNS_CASEFOLD_K2;
+	h ^= h >> 33;
+	h *= LDNS_CASEFOLD_K3;
+	h ^= h >> 33;
+	return h;
+}
@@ -48,6 +48,187 @@ ldns_dname_last_label_is_root_label(const ldns_rdf* dname)
 	return src_pos > 0 && len == 0;
 }
 
+ldns_status
+ldns_dname_view_init_frm_data(ldns_dname_view *view,
+		const uint8_t *data, size_t size)
+{
+	size_t pos = 0;
+	uint8_t labels = 0;
+
+	if (!view || !data || size == 0) {
+		return LDNS_STATUS_NULL;
+	}
+	if (size > LDNS_MAX_DOMAINLEN) {
+		return LDNS_STATUS_DOMAINNAME_OVERFLOW;
+	}
+	/* every non-root label takes at least two octets, so a name that
+	 * fits in LDNS_MAX_DOMAINLEN can not overflow _offsets
+	 */
+	while (pos < size && data[pos] != 0) {
+		if (data[pos] > LDNS_MAX_LABELLEN) {
+			return LDNS_STATUS_LABEL_OVERFLOW;
+		}
+		if (pos + data[pos] + 1 > size) {
+			return LDNS_STATUS_DOMAINNAME_OVERFLOW;
+		}
+		view->_offsets[labels++] = (uint8_t) pos;
+		pos += data[pos] + 1;
+	}
+	view->_offsets[labels] = (uint8_t) pos;
+	view->_data = data;
+	view->_size = (uint16_t) size;
+	view->_offset = 0;
+	view->_label_count = labels;
+	view->_first = 0;
+	return LDNS_STATUS_OK;
+}
+
+ldns_status
+ldns_dname_view_init(ldns_dname_view *view, const ldns_rdf *dname)
+{
+	if (!dname) {
+		return LDNS_STATUS_NULL;
+	}
+	if (ldns_rdf_get_type(dname) != LDNS_RDF_TYPE_DNAME) {
+		return LDNS_STATUS_ERR;
+	}
+	return ldns_dname_view_init_frm_data(view,
+			ldns_rdf_data(dname), ldns_rdf_size(dname));
+}
+
+uint8_t
+ldns_dname_view_label_count(const ldns_dname_view *view)
+{
+	return view->_label_count;
+}
+
+const uint8_t *
+ldns_dname_view_data(const ldns_dname_view *view)
+{
+	return view->_data + view->_offset;
+}
+
+size_t
+ldns_dname_view_size(const ldns_dname_view *view)
+{
+	return (size_t) view->_size - view->_offset;
+}
+
+const uint8_t *
+ldns_dname_view_label(const ldns_dname_view *view, uint8_t labelpos)
+{
+	if (labelpos >= view->_label_count) {
+		return NULL;
+	}
+	return view->_data + view->_offsets[view->_first + labelpos];
+}
+
+bool
+ldns_dname_view_suffix(ldns_dname_view *suffix,
+		const ldns_dname_view *view, uint8_t n)
+{
+	if (n > view->_label_count) {
+		return false;
+	}
+	if (suffix != view) {
+		*suffix = *view;
+	}
+	suffix->_first += n;
+	suffix->_label_count -= n;
+	suffix->_offset = suffix->_offsets[suffix->_first];
+	return true;
+}
+
+bool
+ldns_dname_view_left_chop(ldns_dname_view *view)
+{
+	return view->_label_count > 0 && ldns_dname_view_suffix(view, view, 1);
+}
+
+int
+ldns_dname_view_compare(const ldns_dname_view *view1,
+		const ldns_dname_view *view2)
+{
+	uint8_t lc1 = view1->_label_count;
+	uint8_t lc2 = view2->_label_count;
+	const uint8_t *lp1, *lp2;
+	int c;
+
+	/* see RFC4034 for this algorithm, we start at the last label */
+	while (lc1 > 0 && lc2 > 0) {
+		lc1--;
+		lc2--;
+		lp1 = view1->_data + view1->_offsets[view1->_first + lc1];
+		lp2 = view2->_data + view2->_offsets[view2->_first + lc2];
+
+		/* now check the common length of the labels */
+		c = ldns_casefold_compare(lp1 + 1, lp2 + 1,
+				*lp1 < *lp2 ? *lp1 : *lp2);
+		if (c != 0) {
+			return c;
+		}
+		/* the shorter label is a prefix of the longer one */
+		if (*lp1 != *lp2) {
+			return *lp1 < *lp2 ? -1 : 1;
+		}
+	}
+	/* all compared labels are equal, the name with less labels first */
+	if (lc1 == lc2) {
+		return 0;
+	}
+	return lc1 < lc2 ? -1 : 1;
+}
+
+/* Returns whether the last labels of name equal all labels of suffix,
+ * ignoring case.
+ */
+static bool
+ldns_dname_view_ends_with(const ldns_dname_view *name,
+		const ldns_dname_view *suffix)
+{
+	uint16_t start;
+
+	if (name->_label_count < suffix->_label_count) {
+		return false;
+	}
+	/* Both views run to the end of their data, so the labels are
+	 * compared in one go. The length bytes are never letters, so they
+	 * must be equal too.
+	 */
+	start = name->_offsets[name->_first + name->_label_count -
+		suffix->_label_count];
+	if ((size_t) (name->_size - start) != ldns_dname_view_size(suffix)) {
+		return false;
+	}
+	return ldns_casefold_compare(name->_data + start,
+			ldns_dname_view_data(suffix),
+			ldns_dname_view_size(suffix)) == 0;
+}
+
+bool
+ldns_dname_view_is_subdomain(const ldns_dname_view *sub,
+		const ldns_dname_view *parent)
+{
+	return sub->_label_count > parent->_label_count &&
+		ldns_dname_view_ends_with(sub, parent);
+}
+
+const ldns_rdf *
+ldns_dname_view2rdf(ldns_rdf *rdf, const ldns_dname_view *view)
+{
+	ldns_rdf_set_type(rdf, LDNS_RDF_TYPE_DNAME);
+	ldns_rdf_set_size(rdf, ldns_dname_view_size(view));
+	ldns_rdf_set_data(rdf, (void *) ldns_dname_view_data(view));
+	return rdf;
+}
+
+ldns_rdf *
+ldns_dname_view_clone(const ldns_dname_view *view)
+{
+	return ldns_dname_new_frm_data((uint16_t) ldns_dname_view_size(view),
+			ldns_dname_view_data(view));
+}
+
 ldns_rdf *
 ldns_dname_cat_clone(const ldns_rdf *rd1, const ldns_rdf *rd2)
 {
@@ -280,91 +461,41 @@ void
 ldns_dname2canonical(const ldns_rdf *rd)
 {
 	uint8_t *rdd;
-	uint16_t i;
 
 	if (ldns_rdf_get_type(rd) != LDNS_RDF_TYPE_DNAME) {
 		return;
 	}
 
 	rdd = (uint8_t*)ldns_rdf_data(rd);
-	for (i = 0; i < ldns_rdf_size(rd); i++, rdd++) {
-		*rdd = (uint8_t)LDNS_DNAME_NORMALIZE((int)*rdd);
-	}
+	ldns_casefold_lower(rdd, rdd, ldns_rdf_size(rd));
 }
 
 bool
 ldns_dname_is_subdomain(const ldns_rdf *sub, const ldns_rdf *parent)
 {
-	uint8_t sub_lab;
-	uint8_t par_lab;
-	int8_t i, j;
-	ldns_rdf *tmp_sub = NULL;
-	ldns_rdf *tmp_par = NULL;
-    ldns_rdf *sub_clone;
-    ldns_rdf *parent_clone;
-    bool result = true;
+	ldns_dname_view sub_view;
+	ldns_dname_view par_view;
 
 	if (ldns_rdf_get_type(sub) != LDNS_RDF_TYPE_DNAME ||
 			ldns_rdf_get_type(parent) != LDNS_RDF_TYPE_DNAME ||
 			ldns_rdf_compare(sub, parent) == 0) {
 		return false;
 	}
-
-    /* would be nicer if we do not have to clone... */
-    sub_clone = ldns_dname_clone_from(sub, 0);
-    parent_clone = ldns_dname_clone_from(parent, 0);
-    ldns_dname2canonical(sub_clone);
-    ldns_dname2canonical(parent_clone);
-
-	sub_lab = ldns_dname_label_count(sub_clone);
-	par_lab = ldns_dname_label_count(parent_clone);
-
-	/* if sub sits above parent, it cannot be a child/sub domain */
-	if (sub_lab < par_lab) {
-		result = false;
-	} else {
-		/* check all labels the from the parent labels, from right to left.
-		 * When they /all/ match we have found a subdomain
-		 */
-		j = sub_lab - 1; /* we count from zero, thank you */
-		for (i = par_lab -1; i >= 0; i--) {
-			tmp_sub = ldns_dname_label(sub_clone, j);
-			tmp_par = ldns_dname_label(parent_clone, i);
-			if (!tmp_sub || !tmp_par) {
-				/* deep free does null check */
-				ldns_rdf_deep_free(tmp_sub);
-				ldns_rdf_deep_free(tmp_par);
-				result = false;
-				break;
-			}
-
-			if (ldns_rdf_compare(tmp_sub, tmp_par) != 0) {
-				/* they are not equal */
-				ldns_rdf_deep_free(tmp_sub);
-				ldns_rdf_deep_free(tmp_par);
-				result = false;
-				break;
-			}
-			ldns_rdf_deep_free(tmp_sub);
-			ldns_rdf_deep_free(tmp_par);
-			j--;
-		}
+	if (ldns_dname_view_init(&sub_view, sub) != LDNS_STATUS_OK ||
+	    ldns_dname_view_init(&par_view, parent) != LDNS_STATUS_OK) {
+		return false;
 	}
-	ldns_rdf_deep_free(sub_clone);
-	ldns_rdf_deep_free(parent_clone);
-	return result;
+	/* check all labels the from the parent labels, from right to left.
+	 * When they /all/ match we have found a subdomain
+	 */
+	return ldns_dname_view_ends_with(&sub_view, &par_view);
 }
 
 int
 ldns_dname_compare(const ldns_rdf *dname1, const ldns_rdf *dname2)
 {
-	size_t lc1, lc2, lc1f, lc2f;
-	size_t i;
-	int result = 0;
-	uint8_t *lp1, *lp2;
-
-	/* see RFC4034 for this algorithm */
-	/* this algorithm assumes the names are normalized to case */
+	ldns_dname_view view1;
+	ldns_dname_view view2;
 
         /* only when both are not NULL we can say anything about them */
         if (!dname1 && !dname2) {
@@ -380,76 +511,12 @@ ldns_dname_compare(const ldns_rdf *dname1, const ldns_rdf *dname2)
 	assert(ldns_rdf_get_type(dname1) == LDNS_RDF_TYPE_DNAME);
 	assert(ldns_rdf_get_type(dname2) == LDNS_RDF_TYPE_DNAME);
 
-	lc1 = ldns_dname_label_count(dname1);
-	lc2 = ldns_dname_label_count(dname2);
-
-	if (lc1 == 0 && lc2 == 0) {
-		return 0;
-	}
-	if (lc1 == 0) {
-		return -1;
-	}
-	if (lc2 == 0) {
-		return 1;
-	}
-	lc1--;
-	lc2--;
-	/* we start at the last label */
-	while (true) {
-		/* find the label first */
-		lc1f = lc1;
-		lp1 = ldns_rdf_data(dname1);
-		while (lc1f > 0) {
-			lp1 += *lp1 + 1;
-			lc1f--;
-		}
-
-		/* and find the other one */
-		lc2f = lc2;
-		lp2 = ldns_rdf_data(dname2);
-		while (lc2f > 0) {
-			lp2 += *lp2 + 1;
-			lc2f--;
-		}
-
-		/* now check the label character for character. */
-		for (i = 1; i < (size_t)(*lp1 + 1); i++) {
-			if (i > *lp2) {
-				/* apparently label 1 is larger */
-				result = 1;
-				goto done;
-			}
-			if (LDNS_DNAME_NORMALIZE((int) *(lp1 + i)) <
-			    LDNS_DNAME_NORMALIZE((int) *(lp2 + i))) {
-			    result = -1;
-			    goto done;
-			} else if (LDNS_DNAME_NORMALIZE((int) *(lp1 + i)) >
-			    LDNS_DNAME_NORMALIZE((int) *(lp2 + i))) {
-			    result = 1;
-			    goto done;
-			}
-		}
-		if (*lp1 < *lp2) {
-			/* apparently label 2 is larger */
-			result = -1;
-			goto done;
-		}
-		if (lc1 == 0 && lc2 > 0) {
-			result = -1;
-			goto done;
-		} else if (lc1 > 0 && lc2 == 0) {
-			result = 1;
-			goto done;
-		} else if (lc1 == 0 && lc2 == 0) {
-			result = 0;
-			goto done;
-		}
-		lc1--;
-		lc2--;
+	if (ldns_dname_view_init(&view1, dname1) != LDNS_STATUS_OK ||
+	    ldns_dname_view_init(&view2, dname2) != LDNS_STATUS_OK) {
+		/* malformed names have no canonical order */
+		return ldns_rdf_compare(dname1, dname2);
 	}
-
-	done:
-	return result;
+	return ldns_dname_view_compare(&view1, &view2);
 }
 
 int
@@ -463,20 +530,22 @@ ldns_dname_is_wildcard(const ldns_rdf* dname)
 int
 ldns_dname_match_wildcard(const ldns_rdf *dname, const ldns_rdf *wildcard)
 {
-	ldns_rdf *wc_chopped;
-	int result;
+	ldns_dname_view dname_view;
+	ldns_dname_view wc_view;
+
 	/* check whether it really is a wildcard */
 	if (ldns_dname_is_wildcard(wildcard)) {
 		/* ok, so the dname needs to be a subdomain of the wildcard
 		 * without the *
 		 */
-		wc_chopped = ldns_dname_left_chop(wildcard);
-		result = (int) ldns_dname_is_subdomain(dname, wc_chopped);
-		ldns_rdf_deep_free(wc_chopped);
-	} else {
-		result = (ldns_dname_compare(dname, wildcard) == 0);
+		if (ldns_dname_view_init(&dname_view, dname) != LDNS_STATUS_OK ||
+		    ldns_dname_view_init(&wc_view, wildcard) != LDNS_STATUS_OK) {
+			return 0;
+		}
+		(void) ldns_dname_view_left_chop(&wc_view);
+		return (int) ldns_dname_view_is_subdomain(&dname_view, &wc_view);
 	}
-	return result;
+	return (ldns_dname_compare(dname, wildcard) == 0);
 }
 
 /* nsec test: does prev <= middle < next
@@ -13,6 +13,7 @@
 
 #include <ldns/ldns.h>
 #include <ldns/dnssec.h>
+#include <ldns/internal.h>
 
 #include <strings.h>
 #include <time.h>
@@ -28,6 +29,13 @@
 #ifdef USE_DSA
 #include <openssl/dsa.h>
 #endif
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+#include <openssl/core_names.h>
+/* fetch the algorithms once, and keep contexts per thread */
+#define LDNS_EVP_CACHE 1
+#endif
 #endif
 
 ldns_rr *
@@ -109,7 +117,9 @@ ldns_dnssec_nsec3_closest_encloser(const ldns_rdf *qname,
 	uint8_t salt_length;
 	uint8_t *salt;
 
-	ldns_rdf *sname, *hashed_sname, *tmp;
+	ldns_dname_view sname;
+	ldns_rdf sname_rdf;
+	ldns_rdf *hashed_sname;
 	bool flag;
 
 	bool exact_match_found;
@@ -132,18 +142,25 @@ ldns_dnssec_nsec3_closest_encloser(const ldns_rdf *qname,
 	salt = ldns_nsec3_salt_data(nsec);
 	iterations = ldns_nsec3_iterations(nsec);
 
-	sname = ldns_rdf_clone(qname);
+	/* the candidate names are all suffixes of qname, look at them
+	 * through a view instead of chopping off copies
+	 */
+	if (ldns_dname_view_init(&sname, qname) != LDNS_STATUS_OK) {
+		LDNS_FREE(salt);
+		return NULL;
+	}
 
 	flag = false;
 
 	zone_name = ldns_dname_left_chop(ldns_rr_owner(nsec));
 
 	/* algorithm from nsec3-07 8.3 */
-	while (ldns_dname_label_count(sname) > 0) {
+	while (ldns_dname_view_label_count(&sname) > 0) {
 		exact_match_found = false;
 		in_range_found = false;
 
-		hashed_sname = ldns_nsec3_hash_name(sname,
+		hashed_sname = ldns_nsec3_hash_name(
+		                             ldns_dname_view2rdf(&sname_rdf, &sname),
 									 algorithm,
 									 iterations,
 									 salt_length,
@@ -153,7 +170,6 @@ ldns_dnssec_nsec3_closest_encloser(const ldns_rdf *qname,
                 if(status != LDNS_STATUS_OK) {
 	                LDNS_FREE(salt);
 	                ldns_rdf_deep_free(zone_name);
-	                ldns_rdf_deep_free(sname);
 			ldns_rdf_deep_free(hashed_sname);
                         return NULL;
                 }
@@ -174,7 +190,7 @@ ldns_dnssec_nsec3_closest_encloser(const ldns_rdf *qname,
 		if (!exact_match_found && in_range_found) {
 			flag = true;
 		} else if (exact_match_found && flag) {
-			result = ldns_rdf_clone(sname);
+			result = ldns_dname_view_clone(&sname);
 			/* RFC 5155: 8.3. 2.** "The proof is complete" */
 			ldns_rdf_deep_free(hashed_sname);
 			goto done;
@@ -187,15 +203,12 @@ ldns_dnssec_nsec3_closest_encloser(const ldns_rdf *qname,
 		}
 
 		ldns_rdf_deep_free(hashed_sname);
-		tmp = sname;
-		sname = ldns_dname_left_chop(sname);
-		ldns_rdf_deep_free(tmp);
+		(void) ldns_dname_view_left_chop(&sname);
 	}
 
 	done:
 	LDNS_FREE(salt);
 	ldns_rdf_deep_free(zone_name);
-	ldns_rdf_deep_free(sname);
 
 	return result;
 }
@@ -486,21 +499,220 @@ ldns_key_buf2rsa_raw(const unsigned char* key, size_t len)
 	return rsa;
 }
 
+#ifdef LDNS_EVP_CACHE
+/* the digests that are fetched up front, the rest is looked up by name */
+static struct {
+	const char *name;
+	EVP_MD *md;
+} ldns_evp_mds[] = {
+	{ "SHA1", NULL },
+	{ "SHA256", NULL },
+	{ "SHA384", NULL },
+	{ "SHA512", NULL },
+	{ "MD5", NULL }
+};
+static EVP_MAC *ldns_evp_mac = NULL;
+static CRYPTO_ONCE ldns_evp_once = CRYPTO_ONCE_STATIC_INIT;
+static CRYPTO_THREAD_LOCAL ldns_evp_key;
+static int ldns_evp_key_ok = 0;
+
+/* what a thread keeps between operations */
+struct ldns_evp_local {
+	EVP_MD_CTX *md_ctx;
+	int md_ctx_busy;
+	EVP_MAC_CTX *mac_ctx;
+	const EVP_MD *mac_md;
+};
+
+static void
+ldns_evp_local_free(void *arg)
+{
+	struct ldns_evp_local *local = arg;
+
+	if (local) {
+		EVP_MD_CTX_free(local->md_ctx);
+		EVP_MAC_CTX_free(local->mac_ctx);
+		LDNS_FREE(local);
+	}
+}
+
+static void
+ldns_evp_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(ldns_evp_mds) / sizeof(*ldns_evp_mds); i++) {
+		ldns_evp_mds[i].md = EVP_MD_fetch(NULL, ldns_evp_mds[i].name,
+				NULL);
+	}
+	ldns_evp_mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+	ldns_evp_key_ok = CRYPTO_THREAD_init_local(&ldns_evp_key,
+			ldns_evp_local_free);
+	/* the digests were fetched, so errors are of no interest */
+	ERR_clear_error();
+}
+
+static struct ldns_evp_local *
+ldns_evp_local(void)
+{
+	struct ldns_evp_local *local;
+
+	if (!CRYPTO_THREAD_run_once(&ldns_evp_once, ldns_evp_init) ||
+			!ldns_evp_key_ok) {
+		return NULL;
+	}
+	local = CRYPTO_THREAD_get_local(&ldns_evp_key);
+	if (!local) {
+		local = LDNS_CALLOC(struct ldns_evp_local, 1);
+		if (!local) {
+			return NULL;
+		}
+		if (!CRYPTO_THREAD_set_local(&ldns_evp_key, local)) {
+			LDNS_FREE(local);
+			return NULL;
+		}
+	}
+	return local;
+}
+#endif /* LDNS_EVP_CACHE */
+
+const EVP_MD *
+ldns_evp_md(const char *name)
+{
+#ifdef LDNS_EVP_CACHE
+	size_t i;
+
+	if (CRYPTO_THREAD_run_once(&ldns_evp_once, ldns_evp_init)) {
+		for (i = 0; i < sizeof(ldns_evp_mds) / sizeof(*ldns_evp_mds);
+				i++) {
+			if (strcasecmp(name, ldns_evp_mds[i].name) == 0 &&
+					ldns_evp_mds[i].md) {
+				return ldns_evp_mds[i].md;
+			}
+		}
+	}
+#else
+	/* the lookup by name fails when the digests were not loaded */
+	if (strcasecmp(name, "SHA1") == 0) {
+		return EVP_sha1();
+	}
+#ifdef HAVE_EVP_SHA256
+	if (strcasecmp(name, "SHA256") == 0) {
+		return EVP_sha256();
+	}
+#endif
+#ifdef HAVE_EVP_SHA384
+	if (strcasecmp(name, "SHA384") == 0) {
+		return EVP_sha384();
+	}
+#endif
+#ifdef HAVE_EVP_SHA512
+	if (strcasecmp(name, "SHA512") == 0) {
+		return EVP_sha512();
+	}
+#endif
+	if (strcasecmp(name, "MD5") == 0) {
+		return EVP_md5();
+	}
+#endif /* LDNS_EVP_CACHE */
+	return EVP_get_digestbyname(name);
+}
+
+EVP_MD_CTX *
+ldns_evp_md_ctx_get(void)
+{
+#ifdef LDNS_EVP_CACHE
+	struct ldns_evp_local *local = ldns_evp_local();
+
+	if (local && !local->md_ctx_busy) {
+		if (!local->md_ctx) {
+			local->md_ctx = EVP_MD_CTX_new();
+		}
+		if (local->md_ctx) {
+			local->md_ctx_busy = 1;
+			return local->md_ctx;
+		}
+	}
+#endif
+	/* nested use, or no cache */
+	return EVP_MD_CTX_create();
+}
+
+void
+ldns_evp_md_ctx_release(EVP_MD_CTX *ctx)
+{
+#ifdef LDNS_EVP_CACHE
+	struct ldns_evp_local *local;
+
+	if (ctx && ldns_evp_key_ok &&
+			(local = CRYPTO_THREAD_get_local(&ldns_evp_key)) &&
+			local->md_ctx == ctx) {
+		/* do not hold on to keys */
+		EVP_MD_CTX_reset(ctx);
+		local->md_ctx_busy = 0;
+		return;
+	}
+#endif
+	if (ctx) {
+		EVP_MD_CTX_destroy(ctx);
+	}
+}
+
+int
+ldns_evp_hmac(const EVP_MD *md, const unsigned char *key, size_t key_len,
+	const unsigned char *data, size_t len, unsigned char *dest,
+	unsigned int *dest_len)
+{
+#ifdef LDNS_EVP_CACHE
+	struct ldns_evp_local *local = ldns_evp_local();
+	OSSL_PARAM params[2];
+	size_t mac_len = 0;
+
+	if (local && ldns_evp_mac) {
+		if (!local->mac_ctx) {
+			local->mac_ctx = EVP_MAC_CTX_new(ldns_evp_mac);
+			local->mac_md = NULL;
+		}
+		if (!local->mac_ctx) {
+			return false;
+		}
+		/* setting the digest fetches it again, only do that when
+		 * it changes */
+		params[0] = OSSL_PARAM_construct_utf8_string(
+				OSSL_MAC_PARAM_DIGEST,
+				(char *)EVP_MD_get0_name(md), 0);
+		params[1] = OSSL_PARAM_construct_end();
+		if (!EVP_MAC_init(local->mac_ctx, key, key_len,
+					local->mac_md == md ? NULL : params) ||
+				!EVP_MAC_update(local->mac_ctx, data, len) ||
+				!EVP_MAC_final(local->mac_ctx, dest, &mac_len,
+					EVP_MAX_MD_SIZE)) {
+			local->mac_md = NULL;
+			return false;
+		}
+		local->mac_md = md;
+		*dest_len = (unsigned int)mac_len;
+		return true;
+	}
+#endif
+	return HMAC(md, key, (int)key_len, data, len, dest, dest_len) != NULL;
+}
+
 int
 ldns_digest_evp(const unsigned char* data, unsigned int len, unsigned char* dest,
 	const EVP_MD* md)
 {
 	EVP_MD_CTX* ctx;
-	ctx = EVP_MD_CTX_create();
+	ctx = ldns_evp_md_ctx_get();
 	if(!ctx)
 		return false;
 	if(!EVP_DigestInit_ex(ctx, md, NULL) ||
 		!EVP_DigestUpdate(ctx, data, len) ||
 		!EVP_DigestFinal_ex(ctx, dest, NULL)) {
-		EVP_MD_CTX_destroy(ctx);
+		ldns_evp_md_ctx_release(ctx);
 		return false;
 	}
-	EVP_MD_CTX_destroy(ctx);
+	ldns_evp_md_ctx_release(ctx);
 	return true;
 }
 #endif /* HAVE_SSL */
@@ -813,16 +1025,107 @@ ldns_dnssec_rrsets_contains_type(const ldns_dnssec_rrsets *rrsets,
 	return 0;
 }
 
+/*
+ * Builds the NSEC(3) type bitmap of name straight from its rrsets. They
+ * are kept sorted by type, so the windows are completed one after the
+ * other in a single pass, and the rdf is allocated once at its final size.
+ * Only the authoritative NS and DS rrsets are taken on a delegation point.
+ * RRSIG, and for NSEC also NSEC, are added as the respective RFCs demand.
+ */
+static ldns_rdf *
+ldns_dnssec_name_nsec_bitmap(const ldns_dnssec_name *name,
+		ldns_rr_type nsec_type)
+{
+	uint8_t data[256 * 34];		/* all windows at maximum length */
+	uint8_t bits[32];		/* the window being filled */
+	int window = -1;		/* most significant octet of type */
+	int max_octet = -1;		/* last non-zero octet in bits */
+	size_t sz = 0;
+	const ldns_dnssec_rrsets *cur_rrsets;
+	ldns_rr_type type;
+	int on_delegation_point;
+	bool add_rrsig, extras_done = false;
+
+	on_delegation_point = ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_NS)
+		&& !ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_SOA);
+	if (nsec_type == LDNS_RR_TYPE_NSEC) {
+		add_rrsig = true;
+	} else if (on_delegation_point) {
+		/* not on an unsigned delegation */
+		add_rrsig = ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_DS);
+	} else {
+		add_rrsig = name->rrsets
+			&& (name->rrsets->type != LDNS_RR_TYPE_RRSIG
+			    || name->rrsets->next);
+	}
+
+	cur_rrsets = name->rrsets;
+	for (;;) {
+		if (!extras_done && (!cur_rrsets
+		    || cur_rrsets->type > LDNS_RR_TYPE_NSEC)) {
+			/* RRSIG and NSEC go in window 0, before these */
+			extras_done = true;
+			if (add_rrsig) {
+				type = LDNS_RR_TYPE_RRSIG;
+			} else if (cur_rrsets) {
+				continue;
+			} else {
+				break;
+			}
+		} else if (cur_rrsets) {
+			type = cur_rrsets->type;
+			cur_rrsets = cur_rrsets->next;
+			if ((on_delegation_point
+			     && type != LDNS_RR_TYPE_NS
+			     && type != LDNS_RR_TYPE_DS)
+			    || (!on_delegation_point
+			     && (type == LDNS_RR_TYPE_RRSIG
+			      || type == nsec_type))) {
+				continue;
+			}
+		} else {
+			break;
+		}
+
+		if ((int)(type >> 8) != window) {
+			if (max_octet >= 0) {
+				data[sz++] = (uint8_t)window;
+				data[sz++] = (uint8_t)(max_octet + 1);
+				memcpy(data + sz, bits, max_octet + 1);
+				sz += max_octet + 1;
+			}
+			window = type >> 8;
+			max_octet = -1;
+			memset(bits, 0, sizeof(bits));
+		}
+		bits[(type & 0xff) / 8] |= 0x80 >> (type % 8);
+		if ((int)((type & 0xff) / 8) > max_octet) {
+			max_octet = (type & 0xff) / 8;
+		}
+		if (type == LDNS_RR_TYPE_RRSIG
+		    && nsec_type == LDNS_RR_TYPE_NSEC) {
+			bits[LDNS_RR_TYPE_NSEC / 8] |=
+				0x80 >> (LDNS_RR_TYPE_NSEC % 8);
+		}
+	}
+	if (max_octet >= 0) {
+		data[sz++] = (uint8_t)window;
+		data[sz++] = (uint8_t)(max_octet + 1);
+		memcpy(data + sz, bits, max_octet + 1);
+		sz += max_octet + 1;
+	}
+	if (sz == 0) {
+		return ldns_rdf_new(LDNS_RDF_TYPE_BITMAP, 0, NULL);
+	}
+	return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_BITMAP, sz, data);
+}
+
 ldns_rr *
 ldns_dnssec_create_nsec(const ldns_dnssec_name *from,
                         const ldns_dnssec_name *to,
                         ldns_rr_type nsec_type)
 {
 	ldns_rr *nsec_rr;
-	ldns_rr_type types[65536];
-	size_t type_count = 0;
-	ldns_dnssec_rrsets *cur_rrsets;
-	int on_delegation_point;
 
 	if (!from || !to || (nsec_type != LDNS_RR_TYPE_NSEC)) {
 		return NULL;
@@ -833,56 +1136,24 @@ ldns_dnssec_create_nsec(const ldns_dnssec_name *from,
 	ldns_rr_set_owner(nsec_rr, ldns_rdf_clone(ldns_dnssec_name_name(from)));
 	ldns_rr_push_rdf(nsec_rr, ldns_rdf_clone(ldns_dnssec_name_name(to)));
 
-	on_delegation_point = ldns_dnssec_rrsets_contains_type(
-			from->rrsets, LDNS_RR_TYPE_NS)
-		&& !ldns_dnssec_rrsets_contains_type(
-			from->rrsets, LDNS_RR_TYPE_SOA);
-
-	cur_rrsets = from->rrsets;
-	while (cur_rrsets) {
-		/* Do not include non-authoritative rrsets on the delegation point
-		 * in the type bitmap */
-		if ((on_delegation_point && (
-				cur_rrsets->type == LDNS_RR_TYPE_NS 
-			     || cur_rrsets->type == LDNS_RR_TYPE_DS))
-			|| (!on_delegation_point &&
-				cur_rrsets->type != LDNS_RR_TYPE_RRSIG
-			     && cur_rrsets->type != LDNS_RR_TYPE_NSEC)) {
-
-			types[type_count] = cur_rrsets->type;
-			type_count++;
-		}
-		cur_rrsets = cur_rrsets->next;
-
-	}
-	types[type_count] = LDNS_RR_TYPE_RRSIG;
-	type_count++;
-	types[type_count] = LDNS_RR_TYPE_NSEC;
-	type_count++;
-
-	ldns_rr_push_rdf(nsec_rr, ldns_dnssec_create_nsec_bitmap(types,
-	                               type_count,
-	                               nsec_type));
+	ldns_rr_push_rdf(nsec_rr, ldns_dnssec_name_nsec_bitmap(from, nsec_type));
 
 	return nsec_rr;
 }
 
 ldns_rr *
-ldns_dnssec_create_nsec3(const ldns_dnssec_name *from,
+ldns_dnssec_create_nsec3_cached(const ldns_dnssec_name *from,
 					const ldns_dnssec_name *to,
 					const ldns_rdf *zone_name,
 					uint8_t algorithm,
 					uint8_t flags,
 					uint16_t iterations,
 					uint8_t salt_length,
-					const uint8_t *salt)
+					const uint8_t *salt,
+					ldns_nsec3_hash_cache *cache)
 {
 	ldns_rr *nsec_rr;
-	ldns_rr_type types[65536];
-	size_t type_count = 0;
-	ldns_dnssec_rrsets *cur_rrsets;
 	ldns_status status;
-	int on_delegation_point;
 
 	if (!from) {
 		return NULL;
@@ -890,7 +1161,8 @@ ldns_dnssec_create_nsec3(const ldns_dnssec_name *from,
 
 	nsec_rr = ldns_rr_new_frm_type(LDNS_RR_TYPE_NSEC3);
 	ldns_rr_set_owner(nsec_rr,
-	                  ldns_nsec3_hash_name(ldns_dnssec_name_name(from),
+	                  ldns_nsec3_hash_name_cached(cache,
+	                  ldns_dnssec_name_name(from),
 	                  algorithm,
 	                  iterations,
 	                  salt_length,
@@ -907,38 +1179,6 @@ ldns_dnssec_create_nsec3(const ldns_dnssec_name *from,
 	                          salt_length,
 	                          salt);
 
-	on_delegation_point = ldns_dnssec_rrsets_contains_type(
-			from->rrsets, LDNS_RR_TYPE_NS)
-		&& !ldns_dnssec_rrsets_contains_type(
-			from->rrsets, LDNS_RR_TYPE_SOA);
-	cur_rrsets = from->rrsets;
-	while (cur_rrsets) {
-		/* Do not include non-authoritative rrsets on the delegation point
-		 * in the type bitmap. Potentially not skipping insecure
-		 * delegation should have been done earlier, in function
-		 * ldns_dnssec_zone_create_nsec3s, or even earlier in:
-		 * ldns_dnssec_zone_sign_nsec3_flg .
-		 */
-		if ((on_delegation_point && (
-				cur_rrsets->type == LDNS_RR_TYPE_NS
-			     || cur_rrsets->type == LDNS_RR_TYPE_DS))
-			|| (!on_delegation_point &&
-				cur_rrsets->type != LDNS_RR_TYPE_RRSIG)) {
-
-			types[type_count] = cur_rrsets->type;
-			type_count++;
-		}
-		cur_rrsets = cur_rrsets->next;
-	}
-	/* always add rrsig type if this is not an unsigned
-	 * delegation
-	 */
-	if (type_count > 0 &&
-	    !(type_count == 1 && types[0] == LDNS_RR_TYPE_NS)) {
-		types[type_count] = LDNS_RR_TYPE_RRSIG;
-		type_count++;
-	}
-
 	/* leave next rdata empty if they weren't precomputed yet */
 	if (to && to->hashed_name) {
 		(void) ldns_rr_set_rdf(nsec_rr,
@@ -948,14 +1188,32 @@ ldns_dnssec_create_nsec3(const ldns_dnssec_name *from,
 		(void) ldns_rr_set_rdf(nsec_rr, NULL, 4);
 	}
 
+	/* Do not include non-authoritative rrsets on the delegation point
+	 * in the type bitmap. Potentially not skipping insecure
+	 * delegation should have been done earlier, in function
+	 * ldns_dnssec_zone_create_nsec3s, or even earlier in:
+	 * ldns_dnssec_zone_sign_nsec3_flg .
+	 */
 	ldns_rr_push_rdf(nsec_rr,
-	                 ldns_dnssec_create_nsec_bitmap(types,
-	                 type_count,
-	                 LDNS_RR_TYPE_NSEC3));
+	                 ldns_dnssec_name_nsec_bitmap(from, LDNS_RR_TYPE_NSEC3));
 
 	return nsec_rr;
 }
 
+ldns_rr *
+ldns_dnssec_create_nsec3(const ldns_dnssec_name *from,
+					const ldns_dnssec_name *to,
+					const ldns_rdf *zone_name,
+					uint8_t algorithm,
+					uint8_t flags,
+					uint16_t iterations,
+					uint8_t salt_length,
+					const uint8_t *salt)
+{
+	return ldns_dnssec_create_nsec3_cached(from, to, zone_name, algorithm,
+			flags, iterations, salt_length, salt, NULL);
+}
+
 ldns_rr *
 ldns_create_nsec(ldns_rdf *cur_owner, ldns_rdf *next_owner, ldns_rr_list *rrs)
 {
@@ -1105,6 +1363,270 @@ ldns_nsec3_hash_name(const ldns_rdf *name,
 	return hashed_owner;
 }
 
+/* An owner name in an ldns_nsec3_hash_cache with its hashed name */
+typedef struct ldns_nsec3_hash_cache_entry
+{
+	ldns_rbnode_t node;
+	ldns_rdf *name;
+	ldns_rdf *hashed_name;
+	bool used;
+} ldns_nsec3_hash_cache_entry;
+
+#define LDNS_NSEC3_HASH_CACHE_MAGIC "LDNSN3C1"
+
+ldns_nsec3_hash_cache *
+ldns_nsec3_hash_cache_new(uint8_t algorithm, uint16_t iterations,
+		uint8_t salt_length, const uint8_t *salt)
+{
+	ldns_nsec3_hash_cache *cache = LDNS_CALLOC(ldns_nsec3_hash_cache, 1);
+
+	if (!cache) {
+		return NULL;
+	}
+	cache->algorithm = algorithm;
+	cache->iterations = iterations;
+	cache->salt_length = salt_length;
+	if (salt_length > 0) {
+		cache->salt = LDNS_XMALLOC(uint8_t, salt_length);
+		if (!cache->salt) {
+			LDNS_FREE(cache);
+			return NULL;
+		}
+		memcpy(cache->salt, salt, salt_length);
+	}
+	cache->names = ldns_rbtree_create(ldns_dname_compare_v);
+	if (!cache->names) {
+		LDNS_FREE(cache->salt);
+		LDNS_FREE(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+static void
+ldns_nsec3_hash_cache_entry_free(ldns_rbnode_t *node, void *arg)
+{
+	ldns_nsec3_hash_cache_entry *entry = (ldns_nsec3_hash_cache_entry *)node;
+
+	(void)arg;
+	ldns_rdf_deep_free(entry->name);
+	ldns_rdf_deep_free(entry->hashed_name);
+	LDNS_FREE(entry);
+}
+
+void
+ldns_nsec3_hash_cache_free(ldns_nsec3_hash_cache *cache)
+{
+	if (!cache) {
+		return;
+	}
+	if (cache->names) {
+		ldns_traverse_postorder(cache->names,
+				ldns_nsec3_hash_cache_entry_free, NULL);
+		LDNS_FREE(cache->names);
+	}
+	LDNS_FREE(cache->salt);
+	LDNS_FREE(cache);
+}
+
+static bool
+ldns_nsec3_hash_cache_matches(const ldns_nsec3_hash_cache *cache,
+		uint8_t algorithm, uint16_t iterations,
+		uint8_t salt_length, const uint8_t *salt)
+{
+	return cache->algorithm == algorithm
+	    && cache->iterations == iterations
+	    && cache->salt_length == salt_length
+	    && (salt_length == 0
+	     || memcmp(cache->salt, salt, salt_length) == 0);
+}
+
+/* Takes ownership of name and hashed_name, also on failure */
+static ldns_nsec3_hash_cache_entry *
+ldns_nsec3_hash_cache_insert(ldns_nsec3_hash_cache *cache,
+		ldns_rdf *name, ldns_rdf *hashed_name)
+{
+	ldns_nsec3_hash_cache_entry *entry;
+
+	entry = LDNS_MALLOC(ldns_nsec3_hash_cache_entry);
+	if (!entry) {
+		ldns_rdf_deep_free(name);
+		ldns_rdf_deep_free(hashed_name);
+		return NULL;
+	}
+	entry->name = name;
+	entry->hashed_name = hashed_name;
+	entry->used = false;
+	entry->node.key = entry->name;
+	entry->node.data = entry;
+	if (!ldns_rbtree_insert(cache->names, &entry->node)) {
+		/* already present */
+		ldns_nsec3_hash_cache_entry_free(&entry->node, NULL);
+		return NULL;
+	}
+	return entry;
+}
+
+ldns_rdf *
+ldns_nsec3_hash_name_cached(ldns_nsec3_hash_cache *cache,
+		const ldns_rdf *name, uint8_t algorithm, uint16_t iterations,
+		uint8_t salt_length, const uint8_t *salt)
+{
+	ldns_nsec3_hash_cache_entry *entry;
+	ldns_rdf *hashed_name, *name_clone, *hashed_clone;
+
+	if (!cache || !name || !ldns_nsec3_hash_cache_matches(
+			cache, algorithm, iterations, salt_length, salt)) {
+		return ldns_nsec3_hash_name(name,
+				algorithm, iterations, salt_length, salt);
+	}
+	entry = (ldns_nsec3_hash_cache_entry *)
+		ldns_rbtree_search(cache->names, name);
+	if (entry) {
+		cache->hits++;
+		entry->used = true;
+		return ldns_rdf_clone(entry->hashed_name);
+	}
+	cache->misses++;
+	hashed_name = ldns_nsec3_hash_name(name,
+			algorithm, iterations, salt_length, salt);
+	if (hashed_name && (name_clone = ldns_rdf_clone(name))) {
+		if (!(hashed_clone = ldns_rdf_clone(hashed_name))) {
+			ldns_rdf_deep_free(name_clone);
+		} else if ((entry = ldns_nsec3_hash_cache_insert(
+				cache, name_clone, hashed_clone))) {
+			entry->used = true;
+		}
+	}
+	return hashed_name;
+}
+
+/*
+ * The file starts with LDNS_NSEC3_HASH_CACHE_MAGIC, the algorithm (1
+ * octet), the iterations (2 octets), the salt length (1 octet) and the
+ * salt. Then every entry is an owner name in wire format, followed by the
+ * length of the hash (1 octet) and the raw hash.
+ */
+ldns_status
+ldns_nsec3_hash_cache_write(const ldns_nsec3_hash_cache *cache, FILE *fp)
+{
+	ldns_rbnode_t *node;
+	ldns_nsec3_hash_cache_entry *entry;
+	const uint8_t *label;
+	uint8_t header[4], hash[256];
+	int hash_len;
+
+	if (!cache || !fp) {
+		return LDNS_STATUS_NULL;
+	}
+	header[0] = cache->algorithm;
+	ldns_write_uint16(header + 1, cache->iterations);
+	header[3] = cache->salt_length;
+	if (fwrite(LDNS_NSEC3_HASH_CACHE_MAGIC, 1,
+			sizeof(LDNS_NSEC3_HASH_CACHE_MAGIC) - 1, fp)
+			!= sizeof(LDNS_NSEC3_HASH_CACHE_MAGIC) - 1
+	    || fwrite(header, 1, sizeof(header), fp) != sizeof(header)
+	    || fwrite(cache->salt, 1, cache->salt_length, fp)
+			!= cache->salt_length) {
+		return LDNS_STATUS_FILE_ERR;
+	}
+	LDNS_RBTREE_FOR(node, ldns_rbnode_t *, cache->names) {
+		entry = (ldns_nsec3_hash_cache_entry *)node;
+		if (!entry->used) {
+			continue;
+		}
+		label = ldns_rdf_data(entry->hashed_name);
+		hash_len = ldns_b32_pton_extended_hex((const char *)label + 1,
+				label[0], hash + 1, sizeof(hash) - 1);
+		if (hash_len < 0 || hash_len > 255) {
+			return LDNS_STATUS_INVALID_B32_EXT;
+		}
+		hash[0] = (uint8_t)hash_len;
+		if (fwrite(ldns_rdf_data(entry->name), 1,
+				ldns_rdf_size(entry->name), fp)
+				!= ldns_rdf_size(entry->name)
+		    || fwrite(hash, 1, (size_t)hash_len + 1, fp)
+				!= (size_t)hash_len + 1) {
+			return LDNS_STATUS_FILE_ERR;
+		}
+	}
+	return fflush(fp) == 0 ? LDNS_STATUS_OK : LDNS_STATUS_FILE_ERR;
+}
+
+ldns_status
+ldns_nsec3_hash_cache_read(ldns_nsec3_hash_cache *cache, FILE *fp)
+{
+	uint8_t magic[sizeof(LDNS_NSEC3_HASH_CACHE_MAGIC) - 1];
+	uint8_t header[4], salt[255];
+	uint8_t name[LDNS_MAX_DOMAINLEN + 1], hash[255];
+	char b32[LDNS_MAX_LABELLEN + 2];
+	size_t name_len, b32_len;
+	int c, hash_len;
+	ldns_rdf *name_rdf, *hashed_rdf;
+
+	if (!cache || !fp) {
+		return LDNS_STATUS_NULL;
+	}
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+	    || memcmp(magic, LDNS_NSEC3_HASH_CACHE_MAGIC, sizeof(magic)) != 0
+	    || fread(header, 1, sizeof(header), fp) != sizeof(header)
+	    || fread(salt, 1, header[3], fp) != header[3]) {
+		return LDNS_STATUS_FILE_ERR;
+	}
+	if (!ldns_nsec3_hash_cache_matches(cache, header[0],
+			ldns_read_uint16(header + 1), header[3], salt)) {
+		/* made with other parameters, start afresh */
+		return LDNS_STATUS_OK;
+	}
+	while ((c = fgetc(fp)) != EOF) {
+		/* owner name, label by label */
+		name_len = 0;
+		while (c != 0) {
+			if (c == EOF || c > LDNS_MAX_LABELLEN
+			    || name_len + c + 2 > LDNS_MAX_DOMAINLEN) {
+				return LDNS_STATUS_FILE_ERR;
+			}
+			name[name_len++] = (uint8_t)c;
+			if (fread(name + name_len, 1, (size_t)c, fp)
+					!= (size_t)c) {
+				return LDNS_STATUS_FILE_ERR;
+			}
+			name_len += (size_t)c;
+			c = fgetc(fp);
+		}
+		name[name_len++] = 0;
+
+		if ((hash_len = fgetc(fp)) == EOF
+		    || fread(hash, 1, (size_t)hash_len, fp) != (size_t)hash_len
+		    || ldns_b32_ntop_calculate_size((size_t)hash_len)
+				> LDNS_MAX_LABELLEN) {
+			return LDNS_STATUS_FILE_ERR;
+		}
+		/* the hashed name is the base32hex hash as a single label */
+		c = ldns_b32_ntop_extended_hex(hash, (size_t)hash_len,
+				b32 + 1, sizeof(b32) - 1);
+		if (c < 1 || c > LDNS_MAX_LABELLEN) {
+			return LDNS_STATUS_FILE_ERR;
+		}
+		b32_len = (size_t)c;
+		b32[0] = (char)b32_len;
+		b32[b32_len + 1] = 0;
+
+		name_rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME,
+				name_len, name);
+		hashed_rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME,
+				b32_len + 2, b32);
+		if (!name_rdf || !hashed_rdf) {
+			ldns_rdf_deep_free(name_rdf);
+			ldns_rdf_deep_free(hashed_rdf);
+			return LDNS_STATUS_MEM_ERR;
+		}
+		/* a duplicate is dropped by insert */
+		(void) ldns_nsec3_hash_cache_insert(cache, name_rdf, hashed_rdf);
+	}
+	return ferror(fp) ? LDNS_STATUS_FILE_ERR : LDNS_STATUS_OK;
+}
+
 void
 ldns_nsec3_add_param_rdfs(ldns_rr *rr,
 					 uint8_t algorithm,
@@ -1514,7 +2036,8 @@ ldns_nsec_covers_name(const ldns_rr *nsec, const ldns_rdf *name)
 	char *next_hash_str;
 	ldns_rdf *nsec_next = NULL;
 	ldns_status status;
-	ldns_rdf *chopped_dname;
+	ldns_dname_view chopped_dname;
+	ldns_rdf chopped_rdf;
 	bool result;
 
 	if (ldns_rr_get_type(nsec) == LDNS_RR_TYPE_NSEC) {
@@ -1528,9 +2051,12 @@ ldns_nsec_covers_name(const ldns_rr *nsec, const ldns_rdf *name)
 		next_hash_str = ldns_rdf2str(hash_next);
 		nsec_next = ldns_dname_new_frm_str(next_hash_str);
 		LDNS_FREE(next_hash_str);
-		chopped_dname = ldns_dname_left_chop(nsec_owner);
-		status = ldns_dname_cat(nsec_next, chopped_dname);
-		ldns_rdf_deep_free(chopped_dname);
+		status = ldns_dname_view_init(&chopped_dname, nsec_owner);
+		if (status == LDNS_STATUS_OK) {
+			(void) ldns_dname_view_left_chop(&chopped_dname);
+			status = ldns_dname_cat(nsec_next, ldns_dname_view2rdf(
+						&chopped_rdf, &chopped_dname));
+		}
 		if (status != LDNS_STATUS_OK) {
 			printf("error catting: %s\n", ldns_get_errorstr_by_id(status));
 		}
@@ -1632,55 +2158,51 @@ ldns_pkt_verify(const ldns_pkt *p, ldns_rr_type t, const ldns_rdf *o,
 }
 #endif /* HAVE_SSL */
 
+/*
+ * Returns the next hashed owner field pointing at owner: its first label,
+ * decoded from base32hex, without going through a presentation string.
+ */
+static ldns_rdf *
+ldns_nsec3_next_owner_frm_owner(const ldns_rdf *owner)
+{
+	uint8_t buffer[256];
+	const uint8_t *label;
+	int i;
+
+	if (!owner || ldns_rdf_size(owner) < 1) {
+		return NULL;
+	}
+	label = ldns_rdf_data(owner);
+	if ((size_t)label[0] + 1 > ldns_rdf_size(owner)) {
+		return NULL;
+	}
+	i = ldns_b32_pton_extended_hex((const char *)label + 1, label[0],
+			buffer + 1, sizeof(buffer) - 1);
+	if (i < 0 || i > 255) {
+		return NULL;
+	}
+	buffer[0] = (uint8_t)i;
+	return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B32_EXT,
+			(uint16_t)i + 1, buffer);
+}
+
 ldns_status
 ldns_dnssec_chain_nsec3_list(ldns_rr_list *nsec3_rrs)
 {
-	size_t i;
-	char *next_nsec_owner_str;
-	ldns_rdf *next_nsec_owner_label;
+	size_t i, count = ldns_rr_list_rr_count(nsec3_rrs);
 	ldns_rdf *next_nsec_rdf;
 	ldns_status status = LDNS_STATUS_OK;
 
-	for (i = 0; i < ldns_rr_list_rr_count(nsec3_rrs); i++) {
-		if (i == ldns_rr_list_rr_count(nsec3_rrs) - 1) {
-			next_nsec_owner_label =
-				ldns_dname_label(ldns_rr_owner(ldns_rr_list_rr(nsec3_rrs,
-													  0)), 0);
-			next_nsec_owner_str = ldns_rdf2str(next_nsec_owner_label);
-			if (next_nsec_owner_str[strlen(next_nsec_owner_str) - 1]
-			    == '.') {
-				next_nsec_owner_str[strlen(next_nsec_owner_str) - 1]
-					= '\0';
-			}
-			status = ldns_str2rdf_b32_ext(&next_nsec_rdf,
-									next_nsec_owner_str);
-			if (!ldns_rr_set_rdf(ldns_rr_list_rr(nsec3_rrs, i),
-							 next_nsec_rdf, 4)) {
-				/* todo: error */
-			}
-
-			ldns_rdf_deep_free(next_nsec_owner_label);
-			LDNS_FREE(next_nsec_owner_str);
-		} else {
-			next_nsec_owner_label =
-				ldns_dname_label(ldns_rr_owner(ldns_rr_list_rr(nsec3_rrs,
-													  i + 1)),
-							  0);
-			next_nsec_owner_str = ldns_rdf2str(next_nsec_owner_label);
-			if (next_nsec_owner_str[strlen(next_nsec_owner_str) - 1]
-			    == '.') {
-				next_nsec_owner_str[strlen(next_nsec_owner_str) - 1]
-					= '\0';
-			}
-			status = ldns_str2rdf_b32_ext(&next_nsec_rdf,
-									next_nsec_owner_str);
-			ldns_rdf_deep_free(next_nsec_owner_label);
-			LDNS_FREE(next_nsec_owner_str);
-			if (!ldns_rr_set_rdf(ldns_rr_list_rr(nsec3_rrs, i),
-							 next_nsec_rdf, 4)) {
-				/* todo: error */
-			}
+	for (i = 0; i < count; i++) {
+		next_nsec_rdf = ldns_nsec3_next_owner_frm_owner(ldns_rr_owner(
+				ldns_rr_list_rr(nsec3_rrs, (i + 1) % count)));
+		if (!next_nsec_rdf) {
+			status = LDNS_STATUS_INVALID_B32_EXT;
+			continue;
 		}
+		/* free a next owner that was set before */
+		ldns_rdf_deep_free(ldns_rr_set_rdf(
+				ldns_rr_list_rr(nsec3_rrs, i), next_nsec_rdf, 4));
 	}
 	return status;
 }
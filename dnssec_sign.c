@@ -5,6 +5,7 @@
 
 #include <ldns/dnssec.h>
 #include <ldns/dnssec_sign.h>
+#include <ldns/internal.h>
 
 #include <oqs/sig.h>
 #include <strings.h>
@@ -29,11 +30,33 @@
 #define LDNS_SIGN_WITH_ZONEMD (LDNS_SIGN_WITH_ZONEMD_SIMPLE_SHA384 \
                                | LDNS_SIGN_WITH_ZONEMD_SIMPLE_SHA512)
 
+/*
+ * How far to move the expiration date of a signature forward, given
+ * the jitter and the validity period. A random offset, so that the
+ * signatures of a zone, and the signatures made again later, expire
+ * evenly spread. It never takes the expiration date down to the
+ * inception date.
+ */
+static uint32_t
+ldns_rrsig_expiration_offset(uint32_t jitter, uint32_t validity)
+{
+  uint32_t r;
+
+  if (validity <= 1 || validity > 0x7fffffff)
+    return 0;
+  if (jitter >= validity)
+    jitter = validity - 1;
+
+  r = ((uint32_t)ldns_get_random() << 16) | ldns_get_random();
+  return (uint32_t)(r % ((uint64_t)jitter + 1));
+}
+
 ldns_rr*
 ldns_create_empty_rrsig(const ldns_rr_list* rrset,
                         const ldns_key* current_key)
 {
   uint32_t orig_ttl;
+  uint32_t expiration;
   ldns_rr_class orig_class;
   time_t now;
   ldns_rr* current_sig;
@@ -93,19 +116,19 @@ ldns_create_empty_rrsig(const ldns_rr_list* rrset,
       ldns_native2rdf_int32(LDNS_RDF_TYPE_TIME, now));
   }
   if (ldns_key_expiration(current_key) != 0) {
-    (void)ldns_rr_rrsig_set_expiration(
-      current_sig,
-      ldns_native2rdf_int32(
-        LDNS_RDF_TYPE_TIME,
-        ldns_key_expiration(current_key)));
+    expiration = ldns_key_expiration(current_key);
   }
   else {
-    (void)ldns_rr_rrsig_set_expiration(
-      current_sig,
-      ldns_native2rdf_int32(
-        LDNS_RDF_TYPE_TIME,
-        now + LDNS_DEFAULT_EXP_TIME));
+    expiration = (uint32_t)now + LDNS_DEFAULT_EXP_TIME;
   }
+  if (ldns_key_expiration_jitter(current_key) != 0) {
+    expiration -= ldns_rrsig_expiration_offset(
+      ldns_key_expiration_jitter(current_key),
+      expiration - ldns_rdf2native_int32(ldns_rr_rrsig_inception(current_sig)));
+  }
+  (void)ldns_rr_rrsig_set_expiration(
+    current_sig,
+    ldns_native2rdf_int32(LDNS_RDF_TYPE_TIME, expiration));
 
   (void)ldns_rr_rrsig_set_keytag(
     current_sig,
@@ -143,7 +166,7 @@ ldns_sign_public_buffer(ldns_buffer* sign_buf, ldns_key* current_key)
 #ifdef HAVE_EVP_DSS1
       EVP_dss1()
 #else
-      EVP_sha1()
+      ldns_evp_md("SHA1")
 #endif
     );
     break;
@@ -153,20 +176,20 @@ ldns_sign_public_buffer(ldns_buffer* sign_buf, ldns_key* current_key)
     b64rdf = ldns_sign_public_evp(
       sign_buf,
       ldns_key_evp_key(current_key),
-      EVP_sha1());
+      ldns_evp_md("SHA1"));
     break;
 #ifdef USE_SHA2
   case LDNS_SIGN_RSASHA256:
     b64rdf = ldns_sign_public_evp(
       sign_buf,
       ldns_key_evp_key(current_key),
-      EVP_sha256());
+      ldns_evp_md("SHA256"));
     break;
   case LDNS_SIGN_RSASHA512:
     b64rdf = ldns_sign_public_evp(
       sign_buf,
       ldns_key_evp_key(current_key),
-      EVP_sha512());
+      ldns_evp_md("SHA512"));
     break;
 #endif /* USE_SHA2 */
 #ifdef USE_GOST
@@ -182,13 +205,13 @@ ldns_sign_public_buffer(ldns_buffer* sign_buf, ldns_key* current_key)
     b64rdf = ldns_sign_public_evp(
       sign_buf,
       ldns_key_evp_key(current_key),
-      EVP_sha256());
+      ldns_evp_md("SHA256"));
     break;
   case LDNS_SIGN_ECDSAP384SHA384:
     b64rdf = ldns_sign_public_evp(
       sign_buf,
       ldns_key_evp_key(current_key),
-      EVP_sha384());
+      ldns_evp_md("SHA384"));
     break;
 #endif
 #ifdef USE_ED25519
@@ -235,90 +258,77 @@ ldns_rr_list*
 ldns_sign_public(ldns_rr_list* rrset, ldns_key_list* keys)
 {
   ldns_rr_list* signatures;
-  ldns_rr_list* rrset_clone;
   ldns_rr* current_sig;
   ldns_rdf* b64rdf;
   ldns_key* current_key;
   size_t key_count;
-  uint16_t i;
   ldns_buffer* sign_buf;
-  ldns_rdf* new_owner;
+  ldns_buffer* rrset_buf;
 
-  if (!rrset || ldns_rr_list_rr_count(rrset) < 1 || !keys) {
+  if (!rrset || ldns_rr_list_rr_count(rrset) < 1
+      || !ldns_rr_list_rr(rrset, 0) || !keys) {
     return NULL;
   }
 
-  new_owner = NULL;
-
-  /* prepare a signature and add all the know data
-   * prepare the rrset. Sign this together.  */
-  rrset_clone = ldns_rr_list_clone(rrset);
-  if (!rrset_clone) {
+  /* the rrset part of the data to sign is the same for every key, only
+   * the rrsig rdata in front of it differs. Serialize it once, in
+   * canonical form and order, with the ttl of the first rr. */
+  rrset_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+  sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+  signatures = ldns_rr_list_new();
+  if (!rrset_buf || !sign_buf || !signatures
+      || ldns_rrset2buffer_wire_canonical(rrset_buf, rrset, NULL,
+           ldns_rr_ttl(ldns_rr_list_rr(rrset, 0)))
+      != LDNS_STATUS_OK) {
+    ldns_buffer_free(rrset_buf);
+    ldns_buffer_free(sign_buf);
+    ldns_rr_list_free(signatures);
     return NULL;
   }
 
-  /* make it canonical */
-  for (i = 0; i < ldns_rr_list_rr_count(rrset_clone); i++) {
-    ldns_rr_set_ttl(ldns_rr_list_rr(rrset_clone, i),
-                    ldns_rr_ttl(ldns_rr_list_rr(rrset, 0)));
-    ldns_rr2canonical(ldns_rr_list_rr(rrset_clone, i));
-  }
-  /* sort */
-  ldns_rr_list_sort(rrset_clone);
-
-  signatures = ldns_rr_list_new();
-
   for (key_count = 0;
        key_count < ldns_key_list_key_count(keys);
        key_count++) {
     if (!ldns_key_use(ldns_key_list_key(keys, key_count))) {
       continue;
     }
-    sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
-    if (!sign_buf) {
-      ldns_rr_list_free(rrset_clone);
-      ldns_rr_list_free(signatures);
-      ldns_rdf_free(new_owner);
-      return NULL;
-    }
     b64rdf = NULL;
 
     current_key = ldns_key_list_key(keys, key_count);
     /* sign all RRs with keys that have ZSKbit, !SEPbit.
        sign DNSKEY RRs with keys that have ZSKbit&SEPbit */
     if (ldns_key_flags(current_key) & LDNS_KEY_ZONE_KEY) {
-      current_sig = ldns_create_empty_rrsig(rrset_clone,
-                                            current_key);
+      current_sig = ldns_create_empty_rrsig(rrset, current_key);
+      /* the owner as it is signed */
+      ldns_dname2canonical(ldns_rr_owner(current_sig));
 
       /* right now, we have: a key, a semi-sig and an rrset. For
        * which we can create the sig and base64 encode that and
        * add that to the signature */
 
+      ldns_buffer_clear(sign_buf); /* restart for this key */
       if (ldns_rrsig2buffer_wire(sign_buf, current_sig)
-          != LDNS_STATUS_OK) {
+          != LDNS_STATUS_OK
+          || !ldns_buffer_reserve(sign_buf,
+                                  ldns_buffer_position(rrset_buf))) {
+        ldns_buffer_free(rrset_buf);
         ldns_buffer_free(sign_buf);
         /* ERROR */
-        ldns_rr_list_deep_free(rrset_clone);
         ldns_rr_free(current_sig);
         ldns_rr_list_deep_free(signatures);
         return NULL;
       }
 
       /* add the rrset in sign_buf */
-      if (ldns_rr_list2buffer_wire(sign_buf, rrset_clone)
-          != LDNS_STATUS_OK) {
-        ldns_buffer_free(sign_buf);
-        ldns_rr_list_deep_free(rrset_clone);
-        ldns_rr_free(current_sig);
-        ldns_rr_list_deep_free(signatures);
-        return NULL;
-      }
+      ldns_buffer_write(sign_buf, ldns_buffer_begin(rrset_buf),
+                        ldns_buffer_position(rrset_buf));
 
       b64rdf = ldns_sign_public_buffer(sign_buf, current_key);
 
       if (!b64rdf) {
         /* signing went wrong */
-        ldns_rr_list_deep_free(rrset_clone);
+        ldns_buffer_free(rrset_buf);
+        ldns_buffer_free(sign_buf);
         ldns_rr_free(current_sig);
         ldns_rr_list_deep_free(signatures);
         return NULL;
@@ -329,13 +339,28 @@ ldns_sign_public(ldns_rr_list* rrset, ldns_key_list* keys)
       /* push the signature to the signatures list */
       ldns_rr_list_push_rr(signatures, current_sig);
     }
-    ldns_buffer_free(sign_buf); /* restart for the next key */
   }
-  ldns_rr_list_deep_free(rrset_clone);
+  ldns_buffer_free(rrset_buf);
+  ldns_buffer_free(sign_buf);
 
   return signatures;
 }
 
+ldns_status
+ldns_dnssec_sign_jobs(ldns_dnssec_sign_job* jobs, size_t count,
+                      void* ATTR_UNUSED(arg))
+{
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    jobs[i].signature = ldns_sign_public_buffer(jobs[i].data, jobs[i].key);
+    if (!jobs[i].signature) {
+      return LDNS_STATUS_ERR;
+    }
+  }
+  return LDNS_STATUS_OK;
+}
+
 ldns_rdf*
 ldns_sign_public_dsa(ldns_buffer* to_sign, DSA* key)
 {
@@ -488,13 +513,7 @@ ldns_sign_public_evp(ldns_buffer* to_sign,
     return NULL;
   }
 
-#ifdef HAVE_EVP_MD_CTX_NEW
-  ctx = EVP_MD_CTX_new();
-#else
-  ctx = (EVP_MD_CTX*)malloc(sizeof(*ctx));
-  if (ctx)
-    EVP_MD_CTX_init(ctx);
-#endif
+  ctx = ldns_evp_md_ctx_get();
   if (!ctx) {
     ldns_buffer_free(b64sig);
     return NULL;
@@ -530,7 +549,7 @@ ldns_sign_public_evp(ldns_buffer* to_sign,
   }
   if (r != 1) {
     ldns_buffer_free(b64sig);
-    EVP_MD_CTX_destroy(ctx);
+    ldns_evp_md_ctx_release(ctx);
     return NULL;
   }
 
@@ -576,7 +595,7 @@ ldns_sign_public_evp(ldns_buffer* to_sign,
                                         ldns_buffer_begin(b64sig));
   }
   ldns_buffer_free(b64sig);
-  EVP_MD_CTX_destroy(ctx);
+  ldns_evp_md_ctx_release(ctx);
   return sigdata_rdf;
 }
 
@@ -743,7 +762,7 @@ ldns_dnssec_zone_mark_and_get_glue(ldns_dnssec_zone* zone,
        * the SOA) up into occluded space again, will not be
        * detected with the construct below!
        */
-      if (ldns_dname_is_subdomain(owner, cut) && !ldns_dnssec_rrsets_contains_type(name->rrsets, LDNS_RR_TYPE_SOA)) {
+      if (ldns_dname_is_subdomain(owner, cut) && !ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_SOA)) {
 
         if (below_delegation && glue_list) {
           s = ldns_dnssec_addresses_on_glue_list(
@@ -764,10 +783,10 @@ ldns_dnssec_zone_mark_and_get_glue(ldns_dnssec_zone* zone,
      * Everything below a SOA is authoritative of course; Except
      * when the name also contains a DNAME :).
      */
-    if (ldns_dnssec_rrsets_contains_type(
-          name->rrsets, LDNS_RR_TYPE_NS)
-        && !ldns_dnssec_rrsets_contains_type(
-          name->rrsets, LDNS_RR_TYPE_SOA)) {
+    if (ldns_dnssec_name_has_type(
+          name, LDNS_RR_TYPE_NS)
+        && !ldns_dnssec_name_has_type(
+          name, LDNS_RR_TYPE_SOA)) {
       cut = owner;
       below_delegation = 1;
       if (glue_list) { /* record glue on the zone cut */
@@ -778,8 +797,8 @@ ldns_dnssec_zone_mark_and_get_glue(ldns_dnssec_zone* zone,
         }
       }
     }
-    else if (ldns_dnssec_rrsets_contains_type(
-               name->rrsets, LDNS_RR_TYPE_DNAME)) {
+    else if (ldns_dnssec_name_has_type(
+               name, LDNS_RR_TYPE_DNAME)) {
       cut = owner;
       below_delegation = 0;
     }
@@ -984,14 +1003,15 @@ ldns_dnssec_zone_create_nsec3s_mkmap(ldns_dnssec_zone* zone,
   while (current_name_node && current_name_node != LDNS_RBTREE_NULL && result == LDNS_STATUS_OK) {
 
     current_name = (ldns_dnssec_name*)current_name_node->data;
-    nsec_rr = ldns_dnssec_create_nsec3(current_name,
-                                       NULL,
-                                       zone->soa->name,
-                                       algorithm,
-                                       flags,
-                                       iterations,
-                                       salt_length,
-                                       salt);
+    nsec_rr = ldns_dnssec_create_nsec3_cached(current_name,
+                                              NULL,
+                                              zone->soa->name,
+                                              algorithm,
+                                              flags,
+                                              iterations,
+                                              salt_length,
+                                              salt,
+                                         zone->_nsec3_hash_cache);
     /* by default, our nsec based generator adds rrsigs
      * remove the bitmap for empty nonterminals */
     if (!current_name->rrsets) {
@@ -1248,6 +1268,179 @@ ldns_key_list_filter_for_non_dnskey(ldns_key_list* key_list, int flags)
   }
 }
 
+/*
+ * The signatures queued for the signer of a zone. They are completed
+ * and added to the zone in the order they were queued, which is the
+ * order in which they are made without a signer.
+ */
+typedef struct ldns_dnssec_sign_batch
+{
+  ldns_dnssec_sign_job* jobs;
+  /* the rrsig of each job, without the signature data */
+  ldns_rr** sigs;
+  /* the signatures each rrsig goes to */
+  ldns_dnssec_rrs*** to;
+  size_t count;
+  size_t size;
+  /* the wiredata of the rrset being queued */
+  ldns_buffer* rrset_buf;
+} ldns_dnssec_sign_batch;
+
+static ldns_status
+ldns_dnssec_sign_batch_init(ldns_dnssec_sign_batch* batch, size_t size)
+{
+  size_t i;
+
+  batch->count = 0;
+  batch->size = size;
+  batch->jobs = LDNS_XMALLOC(ldns_dnssec_sign_job, size);
+  batch->sigs = LDNS_XMALLOC(ldns_rr*, size);
+  batch->to = LDNS_XMALLOC(ldns_dnssec_rrs**, size);
+  batch->rrset_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+  if (batch->jobs) {
+    for (i = 0; i < size; i++) {
+      batch->jobs[i].data = NULL;
+    }
+  }
+  return batch->jobs && batch->sigs && batch->to && batch->rrset_buf
+    ? LDNS_STATUS_OK : LDNS_STATUS_MEM_ERR;
+}
+
+static void
+ldns_dnssec_sign_batch_free(ldns_dnssec_sign_batch* batch)
+{
+  size_t i;
+
+  for (i = 0; i < batch->count; i++) {
+    ldns_rr_free(batch->sigs[i]);
+  }
+  if (batch->jobs) {
+    for (i = 0; i < batch->size; i++) {
+      ldns_buffer_free(batch->jobs[i].data);
+    }
+  }
+  LDNS_FREE(batch->jobs);
+  LDNS_FREE(batch->sigs);
+  LDNS_FREE(batch->to);
+  ldns_buffer_free(batch->rrset_buf);
+}
+
+/* hands the queued signatures to the signer and adds them to the zone */
+static ldns_status
+ldns_dnssec_sign_batch_flush(ldns_dnssec_zone* zone,
+                             ldns_dnssec_sign_batch* batch,
+                             ldns_rr_list* new_rrs)
+{
+  ldns_dnssec_sign_job* job;
+  ldns_dnssec_rrs** to;
+  ldns_status result;
+  size_t i;
+
+  if (batch->count == 0) {
+    return LDNS_STATUS_OK;
+  }
+  for (i = 0; i < batch->count; i++) {
+    batch->jobs[i].signature = NULL;
+  }
+  result = zone->_signer(batch->jobs, batch->count, zone->_signer_arg);
+
+  for (i = 0; i < batch->count; i++) {
+    job = &batch->jobs[i];
+    if (result != LDNS_STATUS_OK || !job->signature) {
+      ldns_rdf_deep_free(job->signature);
+      ldns_rr_free(batch->sigs[i]);
+      if (result == LDNS_STATUS_OK) {
+        result = LDNS_STATUS_ERR;
+      }
+      continue;
+    }
+    ldns_rr_rrsig_set_sig(batch->sigs[i], job->signature);
+
+    to = batch->to[i];
+    if (*to) {
+      (void)ldns_dnssec_rrs_add_rr(*to, batch->sigs[i]);
+    }
+    else {
+      *to = ldns_dnssec_rrs_new();
+      (*to)->rr = batch->sigs[i];
+    }
+    if (new_rrs) {
+      ldns_rr_list_push_rr(new_rrs, batch->sigs[i]);
+    }
+  }
+  batch->count = 0;
+  return result;
+}
+
+/*
+ * Queues the signatures of rrset with the keys in use, as
+ * ldns_sign_public() would make them, to go to the signatures in to.
+ */
+static ldns_status
+ldns_dnssec_sign_batch_add(ldns_dnssec_zone* zone,
+                           ldns_dnssec_sign_batch* batch,
+                           ldns_rr_list* rrset,
+                           ldns_key_list* keys,
+                           ldns_dnssec_rrs** to,
+                           ldns_rr_list* new_rrs)
+{
+  ldns_dnssec_sign_job* job;
+  ldns_key* current_key;
+  ldns_rr* current_sig;
+  ldns_status result;
+  size_t key_count;
+
+  if (ldns_rr_list_rr_count(rrset) < 1 || !ldns_rr_list_rr(rrset, 0)) {
+    return LDNS_STATUS_OK;
+  }
+  ldns_buffer_clear(batch->rrset_buf);
+  if (ldns_rrset2buffer_wire_canonical(batch->rrset_buf, rrset, NULL,
+        ldns_rr_ttl(ldns_rr_list_rr(rrset, 0)))
+      != LDNS_STATUS_OK) {
+    return LDNS_STATUS_ERR;
+  }
+  for (key_count = 0;
+       key_count < ldns_key_list_key_count(keys);
+       key_count++) {
+    current_key = ldns_key_list_key(keys, key_count);
+    if (!ldns_key_use(current_key)
+        || !(ldns_key_flags(current_key) & LDNS_KEY_ZONE_KEY)) {
+      continue;
+    }
+    if (batch->count == batch->size) {
+      result = ldns_dnssec_sign_batch_flush(zone, batch, new_rrs);
+      if (result != LDNS_STATUS_OK) {
+        return result;
+      }
+    }
+    job = &batch->jobs[batch->count];
+    if (!job->data
+        && !(job->data = ldns_buffer_new(LDNS_MIN_BUFLEN))) {
+      return LDNS_STATUS_MEM_ERR;
+    }
+    ldns_buffer_clear(job->data);
+
+    current_sig = ldns_create_empty_rrsig(rrset, current_key);
+    if (!current_sig) {
+      return LDNS_STATUS_MEM_ERR;
+    }
+    ldns_dname2canonical(ldns_rr_owner(current_sig));
+    if (ldns_rrsig2buffer_wire(job->data, current_sig) != LDNS_STATUS_OK
+        || !ldns_buffer_reserve(job->data,
+                                ldns_buffer_position(batch->rrset_buf))) {
+      ldns_rr_free(current_sig);
+      return LDNS_STATUS_MEM_ERR;
+    }
+    ldns_buffer_write(job->data, ldns_buffer_begin(batch->rrset_buf),
+                      ldns_buffer_position(batch->rrset_buf));
+    job->key = current_key;
+    batch->sigs[batch->count] = current_sig;
+    batch->to[batch->count] = to;
+    batch->count++;
+  }
+  return LDNS_STATUS_OK;
+}
+
 ldns_status
 ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs, ldns_key_list* key_list, int (*func)(ldns_rr*, void*), void* arg, int flags)
 {
@@ -1266,10 +1459,27 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
 
   int on_delegation_point = 0; /* handle partially occluded names */
 
+  ldns_dnssec_sign_batch batch;
+
   ldns_rr_list* pubkey_list = ldns_rr_list_new();
   for (i = 0; i < ldns_key_list_key_count(key_list); i++) {
     ldns_rr_list_push_rr(pubkey_list, ldns_key2rr(ldns_key_list_key(key_list, i)));
   }
+  memset(&batch, 0, sizeof(batch));
+  /* the signatures are compared and replaced as ldns_rr below */
+  if (zone->_rrsig_templates) {
+    result = ldns_dnssec_zone_expand_rrsigs(zone);
+    if (result != LDNS_STATUS_OK) {
+      ldns_rr_list_deep_free(pubkey_list);
+      return result;
+    }
+  }
+  if (zone->_signer) {
+    result = ldns_dnssec_sign_batch_init(&batch, zone->_signer_batch);
+    if (result != LDNS_STATUS_OK) {
+      goto done;
+    }
+  }
   /* TODO: callback to see is list should be signed */
   /* TODO: remove 'old' signatures from signature list */
   cur_node = ldns_rbtree_first(zone->names);
@@ -1277,10 +1487,10 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
     cur_name = (ldns_dnssec_name*)cur_node->data;
 
     if (!cur_name->is_glue) {
-      on_delegation_point = ldns_dnssec_rrsets_contains_type(
-                              cur_name->rrsets, LDNS_RR_TYPE_NS)
-        && !ldns_dnssec_rrsets_contains_type(
-                              cur_name->rrsets, LDNS_RR_TYPE_SOA);
+      on_delegation_point = ldns_dnssec_name_has_type(
+                              cur_name, LDNS_RR_TYPE_NS)
+        && !ldns_dnssec_name_has_type(
+                              cur_name, LDNS_RR_TYPE_SOA);
       cur_rrset = cur_name->rrsets;
       while (cur_rrset) {
         /* reset keys to use */
@@ -1314,7 +1524,16 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
         /* (glue should have been marked earlier,
          *  except on the delegation points itself) */
         if (!on_delegation_point || ldns_rr_list_type(rr_list) == LDNS_RR_TYPE_DS || ldns_rr_list_type(rr_list) == LDNS_RR_TYPE_NSEC || ldns_rr_list_type(rr_list) == LDNS_RR_TYPE_NSEC3) {
-          siglist = ldns_sign_public(rr_list, key_list);
+          if (zone->_signer) {
+            siglist = NULL;
+            result = ldns_dnssec_sign_batch_add(zone, &batch, rr_list,
+                                                key_list,
+                                                &cur_rrset->signatures,
+                                                new_rrs);
+          }
+          else {
+            siglist = ldns_sign_public(rr_list, key_list);
+          }
           for (i = 0; i < ldns_rr_list_rr_count(siglist); i++) {
             if (cur_rrset->signatures) {
               result = ldns_dnssec_rrs_add_rr(cur_rrset->signatures,
@@ -1335,6 +1554,9 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
         }
 
         ldns_rr_list_free(rr_list);
+        if (zone->_signer && result != LDNS_STATUS_OK) {
+          goto done;
+        }
 
         cur_rrset = cur_rrset->next;
       }
@@ -1349,7 +1571,16 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
 
       rr_list = ldns_rr_list_new();
       ldns_rr_list_push_rr(rr_list, cur_name->nsec);
-      siglist = ldns_sign_public(rr_list, key_list);
+      if (zone->_signer) {
+        siglist = NULL;
+        result = ldns_dnssec_sign_batch_add(zone, &batch, rr_list,
+                                            key_list,
+                                            &cur_name->nsec_signatures,
+                                            new_rrs);
+      }
+      else {
+        siglist = ldns_sign_public(rr_list, key_list);
+      }
 
       for (i = 0; i < ldns_rr_list_rr_count(siglist); i++) {
         if (cur_name->nsec_signatures) {
@@ -1368,10 +1599,20 @@ ldns_dnssec_zone_create_rrsigs_flg(ldns_dnssec_zone* zone, ldns_rr_list* new_rrs
 
       ldns_rr_list_free(siglist);
       ldns_rr_list_free(rr_list);
+      if (zone->_signer && result != LDNS_STATUS_OK) {
+        goto done;
+      }
     }
     cur_node = ldns_rbtree_next(cur_node);
   }
+  if (zone->_signer) {
+    result = ldns_dnssec_sign_batch_flush(zone, &batch, new_rrs);
+  }
 
+done:
+  if (zone->_signer) {
+    ldns_dnssec_sign_batch_free(&batch);
+  }
   ldns_rr_list_deep_free(pubkey_list);
   return result;
 }
@@ -1404,20 +1645,10 @@ ldns_dnssec_zone_sign_flg(ldns_dnssec_zone* zone,
     return LDNS_STATUS_ERR;
   }
   if (flags & LDNS_SIGN_WITH_ZONEMD) {
-    ldns_dnssec_rrsets** rrsets_ref = &zone->soa->rrsets;
-
-    while (*rrsets_ref
-           && (*rrsets_ref)->type < LDNS_RR_TYPE_ZONEMD)
-      rrsets_ref = &(*rrsets_ref)->next;
-    if (!*rrsets_ref
-        || (*rrsets_ref)->type > LDNS_RR_TYPE_ZONEMD) {
-      zonemd_rrset.rrs = NULL;
-      zonemd_rrset.type = LDNS_RR_TYPE_ZONEMD;
-      zonemd_rrset.signatures = NULL;
-      zonemd_rrset.next = *rrsets_ref;
-      *rrsets_ref = &zonemd_rrset;
-      zonemd_added = true;
-    }
+    memset(&zonemd_rrset, 0, sizeof(zonemd_rrset));
+    zonemd_rrset.type = LDNS_RR_TYPE_ZONEMD;
+    zonemd_added = ldns_dnssec_name_insert_rrset(zone->soa, &zonemd_rrset)
+                   == LDNS_STATUS_OK;
   }
   /* zone is already sorted */
   result = ldns_dnssec_zone_mark_glue(zone);
@@ -1445,13 +1676,7 @@ ldns_dnssec_zone_sign_flg(ldns_dnssec_zone* zone,
                                               flags);
 
   if (zonemd_added) {
-    ldns_dnssec_rrsets** rrsets_ref
-      = &zone->soa->rrsets;
-
-    while (*rrsets_ref
-           && (*rrsets_ref)->type < LDNS_RR_TYPE_ZONEMD)
-      rrsets_ref = &(*rrsets_ref)->next;
-    *rrsets_ref = zonemd_rrset.next;
+    (void)ldns_dnssec_name_remove_rrset(zone->soa, LDNS_RR_TYPE_ZONEMD);
   }
   return flags & LDNS_SIGN_WITH_ZONEMD
     ? dnssec_zone_equip_zonemd(zone, new_rrs, key_list, flags)
@@ -1545,21 +1770,11 @@ ldns_dnssec_zone_sign_nsec3_flg_mkmap(ldns_dnssec_zone* zone,
         ldns_rr_list_push_rr(new_rrs, nsec3param);
       }
       if (signflags & LDNS_SIGN_WITH_ZONEMD) {
-        ldns_dnssec_rrsets** rrsets_ref
-          = &zone->soa->rrsets;
-
-        while (*rrsets_ref
-               && (*rrsets_ref)->type < LDNS_RR_TYPE_ZONEMD)
-          rrsets_ref = &(*rrsets_ref)->next;
-        if (!*rrsets_ref
-            || (*rrsets_ref)->type > LDNS_RR_TYPE_ZONEMD) {
-          zonemd_rrset.rrs = NULL;
-          zonemd_rrset.type = LDNS_RR_TYPE_ZONEMD;
-          zonemd_rrset.signatures = NULL;
-          zonemd_rrset.next = *rrsets_ref;
-          *rrsets_ref = &zonemd_rrset;
-          zonemd_added = true;
-        }
+        memset(&zonemd_rrset, 0, sizeof(zonemd_rrset));
+        zonemd_rrset.type = LDNS_RR_TYPE_ZONEMD;
+        zonemd_added
+          = ldns_dnssec_name_insert_rrset(zone->soa, &zonemd_rrset)
+            == LDNS_STATUS_OK;
       }
       result = ldns_dnssec_zone_create_nsec3s_mkmap(zone,
                                                     new_rrs,
@@ -1570,13 +1785,7 @@ ldns_dnssec_zone_sign_nsec3_flg_mkmap(ldns_dnssec_zone* zone,
                                                     salt,
                                                     map);
       if (zonemd_added) {
-        ldns_dnssec_rrsets** rrsets_ref
-          = &zone->soa->rrsets;
-
-        while (*rrsets_ref
-               && (*rrsets_ref)->type < LDNS_RR_TYPE_ZONEMD)
-          rrsets_ref = &(*rrsets_ref)->next;
-        *rrsets_ref = zonemd_rrset.next;
+        (void)ldns_dnssec_name_remove_rrset(zone->soa, LDNS_RR_TYPE_ZONEMD);
       }
       if (result != LDNS_STATUS_OK) {
         return result;
@@ -1094,6 +1094,43 @@ ldns_dnssec_trust_tree_contains_keys(ldns_dnssec_trust_tree *tree,
 	return result;
 }
 
+/**
+ * An rrset made ready for verification against any number of signatures.
+ * The clone is canonicalized and sorted once (the canonical order does
+ * not depend on the ttl, and a wildcard owner replaces every owner name
+ * alike), and the wire format of every rr following its owner name is
+ * kept.  Per signature only the rrsig prefix, the owner name and the
+ * original ttl have to be written.  The keytags and algorithms of the
+ * keys are computed once as well.
+ */
+struct ldns_verify_rrset_struct
+{
+	/** canonical clone of the rrset */
+	ldns_rr_list *sorted;
+	/** wire format of the rrs, in canonical order */
+	ldns_buffer *wire;
+	/** start of every rr in wire, plus the end of the last */
+	size_t *offsets;
+	/** size of the (common) owner name in wire */
+	size_t owner_size;
+	/** false if the owner names differ, verify the slow way then */
+	bool same_owner;
+	/** keys to try */
+	const ldns_rr_list *keys;
+	/** keytag of every key */
+	uint16_t *keytags;
+	/** algorithm of every key, -1 if it has none */
+	int *algorithms;
+	/** raw signature buffer for verify */
+	ldns_buffer *rawsig_buf;
+	/** raw data buffer for verify */
+	ldns_buffer *verify_buf;
+};
+
+static ldns_status ldns_verify_rrset_init(ldns_verify_rrset *v,
+	const ldns_rr_list *rrset, const ldns_rr_list *keys);
+static void ldns_verify_rrset_clear(ldns_verify_rrset *v);
+
 ldns_status
 ldns_verify_time(
 		const ldns_rr_list *rrset,
@@ -1104,6 +1141,8 @@ ldns_verify_time(
 		)
 {
 	uint16_t i;
+	ldns_verify_rrset v;
+	ldns_status result;
 	ldns_status verify_result = LDNS_STATUS_ERR;
 
 	if (!rrset || !rrsig || !keys) {
@@ -1121,10 +1160,15 @@ ldns_verify_time(
 	if (ldns_rr_list_rr_count(keys) < 1) {
 		verify_result = LDNS_STATUS_CRYPTO_NO_TRUSTED_DNSKEY;
 	} else {
+		/* the canonical rrset is the same for every signature */
+		result = ldns_verify_rrset_init(&v, rrset, keys);
+		if (result != LDNS_STATUS_OK) {
+			return result;
+		}
 		for (i = 0; i < ldns_rr_list_rr_count(rrsig); i++) {
-			ldns_status s = ldns_verify_rrsig_keylist_time(
-					rrset, ldns_rr_list_rr(rrsig, i), 
-					keys, check_time, good_keys);
+			ldns_status s = ldns_verify_rrset_rrsig_time(&v,
+					ldns_rr_list_rr(rrsig, i), 
+					check_time, good_keys);
 			/* try a little to get more descriptive error */
 			if(s == LDNS_STATUS_OK) {
 				verify_result = LDNS_STATUS_OK;
@@ -1134,6 +1178,7 @@ ldns_verify_time(
 				LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY)
 				verify_result = s;
 		}
+		ldns_verify_rrset_clear(&v);
 	}
 	return verify_result;
 }
@@ -1150,6 +1195,8 @@ ldns_verify_notime(ldns_rr_list *rrset, ldns_rr_list *rrsig,
 	const ldns_rr_list *keys, ldns_rr_list *good_keys)
 {
 	uint16_t i;
+	ldns_verify_rrset v;
+	ldns_status result;
 	ldns_status verify_result = LDNS_STATUS_ERR;
 
 	if (!rrset || !rrsig || !keys) {
@@ -1167,9 +1214,14 @@ ldns_verify_notime(ldns_rr_list *rrset, ldns_rr_list *rrsig,
 	if (ldns_rr_list_rr_count(keys) < 1) {
 		verify_result = LDNS_STATUS_CRYPTO_NO_TRUSTED_DNSKEY;
 	} else {
+		/* the canonical rrset is the same for every signature */
+		result = ldns_verify_rrset_init(&v, rrset, keys);
+		if (result != LDNS_STATUS_OK) {
+			return result;
+		}
 		for (i = 0; i < ldns_rr_list_rr_count(rrsig); i++) {
-			ldns_status s = ldns_verify_rrsig_keylist_notime(rrset,
-				ldns_rr_list_rr(rrsig, i), keys, good_keys);
+			ldns_status s = ldns_verify_rrset_rrsig_notime(&v,
+				ldns_rr_list_rr(rrsig, i), good_keys);
 
 			/* try a little to get more descriptive error */
 			if (s == LDNS_STATUS_OK) {
@@ -1181,6 +1233,7 @@ ldns_verify_notime(ldns_rr_list *rrset, ldns_rr_list *rrsig,
 				verify_result = s;
 			}
 		}
+		ldns_verify_rrset_clear(&v);
 	}
 	return verify_result;
 }
@@ -1504,7 +1557,8 @@ ldns_dnssec_verify_denial(ldns_rr *rr,
 {
 	ldns_rdf *rr_name;
 	ldns_rdf *wildcard_name = NULL;
-	ldns_rdf *chopped_dname;
+	ldns_dname_view chopped_dname;
+	ldns_rdf chopped_rdf;
 	ldns_rr *cur_nsec;
 	size_t i;
 	ldns_status result;
@@ -1520,10 +1574,14 @@ ldns_dnssec_verify_denial(ldns_rr *rr,
 	rr_name_is_root =     ldns_rdf_size(rr_name) == 1
 	                  && *ldns_rdf_data(rr_name) == 0;
 	if (!rr_name_is_root) {
+		result = ldns_dname_view_init(&chopped_dname, rr_name);
+		if (result != LDNS_STATUS_OK) {
+			return result;
+		}
+		(void) ldns_dname_view_left_chop(&chopped_dname);
 		wildcard_name = ldns_dname_new_frm_str("*");
-		chopped_dname = ldns_dname_left_chop(rr_name);
-		result = ldns_dname_cat(wildcard_name, chopped_dname);
-		ldns_rdf_deep_free(chopped_dname);
+		result = ldns_dname_cat(wildcard_name, ldns_dname_view2rdf(
+					&chopped_rdf, &chopped_dname));
 		if (result != LDNS_STATUS_OK) {
 			return result;
 		}
@@ -1766,23 +1824,29 @@ ldns_dnssec_verify_denial_nsec3_match( ldns_rr *rr
 			/* Query name *is* the "next closer". */
 			hashed_next_closer = hashed_name;
 		} else {
-			ldns_rdf *next_closer;
+			ldns_dname_view next_closer;
+			ldns_rdf next_closer_rdf;
 			
 			ldns_rdf_deep_free(hashed_name);
 			/* "next closer" has less labels than the query name.
-			 * Create the name and hash it.
+			 * Look at it through a view and hash it.
 			 */
-			next_closer = ldns_dname_clone_from(
-					ldns_rr_owner(rr),
-					ldns_dname_label_count(ldns_rr_owner(rr))
+			if (ldns_dname_view_init(&next_closer, ldns_rr_owner(rr))
+					!= LDNS_STATUS_OK) {
+				ldns_rdf_deep_free(closest_encloser);
+				result = LDNS_STATUS_NSEC3_ERR;
+				goto done;
+			}
+			(void) ldns_dname_view_suffix(&next_closer, &next_closer,
+					ldns_dname_view_label_count(&next_closer)
 					- (ldns_dname_label_count(closest_encloser) + 1)
 					);
 			hashed_next_closer = ldns_nsec3_hash_name_frm_nsec3(
 					ldns_rr_list_rr(nsecs, 0),
-					next_closer
+					ldns_dname_view2rdf(&next_closer_rdf,
+						&next_closer)
 					);
 			(void) ldns_dname_cat(hashed_next_closer, zone_name);
-			ldns_rdf_deep_free(next_closer);
 		}
 		/* Find the NSEC3 that covers the "next closer" */
 		for (i = 0; i < ldns_rr_list_rr_count(nsecs); i++) {
@@ -1997,8 +2061,8 @@ ldns_verify_rrsig_ecdsa_raw(unsigned char* sig, size_t siglen,
 		return LDNS_STATUS_CRYPTO_BOGUS;
         }
         if(algo == LDNS_ECDSAP256SHA256)
-                d = EVP_sha256();
-        else    d = EVP_sha384(); /* LDNS_ECDSAP384SHA384 */
+                d = ldns_evp_md("SHA256");
+        else    d = ldns_evp_md("SHA384"); /* LDNS_ECDSAP384SHA384 */
 	result = ldns_verify_rrsig_evp_raw(sig, siglen, rrset, evp_key, d);
 	EVP_PKEY_free(evp_key);
 	return result;
@@ -2111,8 +2175,8 @@ ldns_rrset_use_signature_ttl(ldns_rr_list* rrset_clone, const ldns_rr* rrsig)
 	uint16_t i;
 	uint8_t label_count;
 	ldns_rdf *wildcard_name;
-	ldns_rdf *wildcard_chopped;
-	ldns_rdf *wildcard_chopped_tmp;
+	ldns_dname_view wildcard_chopped;
+	ldns_rdf wildcard_chopped_rdf;
 	
 	if ((rrsig == NULL) || ldns_rr_rd_count(rrsig) < 4) {
 		return;
@@ -2122,20 +2186,18 @@ ldns_rrset_use_signature_ttl(ldns_rr_list* rrset_clone, const ldns_rr* rrsig)
 	label_count = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 2));
 
 	for(i = 0; i < ldns_rr_list_rr_count(rrset_clone); i++) {
-		if (label_count < 
-		    ldns_dname_label_count(
-			   ldns_rr_owner(ldns_rr_list_rr(rrset_clone, i)))) {
+		if (ldns_dname_view_init(&wildcard_chopped,
+				ldns_rr_owner(ldns_rr_list_rr(rrset_clone, i)))
+				== LDNS_STATUS_OK &&
+		    label_count <
+		    ldns_dname_view_label_count(&wildcard_chopped)) {
+			(void) ldns_dname_view_suffix(&wildcard_chopped,
+				&wildcard_chopped,
+				ldns_dname_view_label_count(&wildcard_chopped)
+				- label_count);
 			(void) ldns_str2rdf_dname(&wildcard_name, "*");
-			wildcard_chopped = ldns_rdf_clone(ldns_rr_owner(
-				ldns_rr_list_rr(rrset_clone, i)));
-			while (label_count < ldns_dname_label_count(wildcard_chopped)) {
-				wildcard_chopped_tmp = ldns_dname_left_chop(
-					wildcard_chopped);
-				ldns_rdf_deep_free(wildcard_chopped);
-				wildcard_chopped = wildcard_chopped_tmp;
-			}
-			(void) ldns_dname_cat(wildcard_name, wildcard_chopped);
-			ldns_rdf_deep_free(wildcard_chopped);
+			(void) ldns_dname_cat(wildcard_name, ldns_dname_view2rdf(
+				&wildcard_chopped_rdf, &wildcard_chopped));
 			ldns_rdf_deep_free(ldns_rr_owner(ldns_rr_list_rr(
 				rrset_clone, i)));
 			ldns_rr_set_owner(ldns_rr_list_rr(rrset_clone, i), 
@@ -2285,6 +2347,11 @@ ldns_prepare_for_verify(ldns_buffer* rawsig_buf, ldns_buffer* verify_buf,
 	ldns_rr_list* rrset_clone, const ldns_rr* rrsig)
 {
 	ldns_status result;
+	uint32_t orig_ttl;
+	uint8_t label_count;
+	ldns_rdf *wildcard_name;
+	ldns_dname_view wildcard_chopped;
+	ldns_rdf wildcard_chopped_rdf;
 
 	/* canonicalize the sig */
 	ldns_dname2canonical(ldns_rr_owner(rrsig));
@@ -2299,6 +2366,36 @@ ldns_prepare_for_verify(ldns_buffer* rawsig_buf, ldns_buffer* verify_buf,
 	if(result != LDNS_STATUS_OK)
 		return result;
 
+	if (ldns_rr_rd_count(rrsig) >= 4 && ldns_is_rrset(rrset_clone)) {
+		/* put the signature rr (without the b64) to the verify_buf */
+		if (ldns_rrsig2buffer_wire(verify_buf, rrsig) != LDNS_STATUS_OK)
+			return LDNS_STATUS_MEM_ERR;
+
+		/* add the rrset in verify_buf, in canonical form and order,
+		 * with the TTL from the signature and the wildcard name for
+		 * wildcards */
+		orig_ttl = ldns_rdf2native_int32(ldns_rr_rdf(rrsig, 3));
+		label_count = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 2));
+		wildcard_name = NULL;
+		if (ldns_dname_view_init(&wildcard_chopped, ldns_rr_owner(
+				ldns_rr_list_rr(rrset_clone, 0)))
+				== LDNS_STATUS_OK &&
+		    label_count <
+		    ldns_dname_view_label_count(&wildcard_chopped)) {
+			(void) ldns_dname_view_suffix(&wildcard_chopped,
+				&wildcard_chopped,
+				ldns_dname_view_label_count(&wildcard_chopped)
+				- label_count);
+			(void) ldns_str2rdf_dname(&wildcard_name, "*");
+			(void) ldns_dname_cat(wildcard_name, ldns_dname_view2rdf(
+				&wildcard_chopped_rdf, &wildcard_chopped));
+		}
+		result = ldns_rrset2buffer_wire_canonical(verify_buf,
+			rrset_clone, wildcard_name, orig_ttl);
+		ldns_rdf_deep_free(wildcard_name);
+		return result == LDNS_STATUS_OK ? result : LDNS_STATUS_MEM_ERR;
+	}
+
 	/* use TTL from signature. Use wildcard names for wildcards */
 	/* also canonicalizes rrset_clone */
 	ldns_rrset_use_signature_ttl(rrset_clone, rrsig);
@@ -2318,6 +2415,56 @@ ldns_prepare_for_verify(ldns_buffer* rawsig_buf, ldns_buffer* verify_buf,
 	return LDNS_STATUS_OK;
 }
 
+/**
+ * Check if a key, whose keytag is known to match, verifies a signature.
+ * Checks sigalgo and signature.
+ * @param rawsig_buf: raw signature buffer for verify
+ * @param verify_buf: raw data buffer for verify
+ * @param sig_algo: the algorithm of the rrsig
+ * @param key: key to attempt.
+ * @return LDNS_STATUS_OK if OK, else some specific error.
+ */
+static ldns_status
+ldns_verify_test_sig_algo_key(ldns_buffer* rawsig_buf,
+	ldns_buffer* verify_buf, uint8_t sig_algo, ldns_rr* key)
+{
+	ldns_buffer* key_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	ldns_status result = LDNS_STATUS_ERR;
+
+	if (!key_buf) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	/* put the key-data in a buffer, that's the third rdf, with
+	 * the base64 encoded key data */
+	if (ldns_rr_rdf(key, 3) == NULL) {
+		ldns_buffer_free(key_buf);
+		return LDNS_STATUS_MISSING_RDATA_FIELDS_KEY;
+	}
+	if (ldns_rdf2buffer_wire(key_buf, ldns_rr_rdf(key, 3))
+		       	!= LDNS_STATUS_OK) {
+		ldns_buffer_free(key_buf); 
+		/* returning is bad might screw up
+		   good keys later in the list
+		   what to do? */
+		return LDNS_STATUS_ERR;
+	}
+
+	if (ldns_rr_rdf(key, 2) == NULL) {
+		result = LDNS_STATUS_MISSING_RDATA_FIELDS_KEY;
+	}
+	else if (sig_algo == ldns_rdf2native_int8(
+				ldns_rr_rdf(key, 2))) {
+		result = ldns_verify_rrsig_buffers(rawsig_buf, 
+			verify_buf, key_buf, sig_algo);
+	} else {
+		/* No keys with the corresponding algorithm are found */
+		result = LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+	}
+
+	ldns_buffer_free(key_buf); 
+	return result;
+}
+
 /**
  * Check if a key matches a signature.
  * Checks keytag, sigalgo and signature.
@@ -2346,43 +2493,310 @@ ldns_verify_test_sig_key(ldns_buffer* rawsig_buf, ldns_buffer* verify_buf,
 	    ==
 	    ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rrsig))
 	    ) {
-		ldns_buffer* key_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
-		ldns_status result = LDNS_STATUS_ERR;
+		return ldns_verify_test_sig_algo_key(rawsig_buf, verify_buf,
+			sig_algo, key);
+	}
+	else {
+		/* No keys with the corresponding keytag are found */
+		return LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+	}
+}
 
-		/* put the key-data in a buffer, that's the third rdf, with
-		 * the base64 encoded key data */
-		if (ldns_rr_rdf(key, 3) == NULL) {
-			ldns_buffer_free(key_buf);
-			return LDNS_STATUS_MISSING_RDATA_FIELDS_KEY;
+static void
+ldns_verify_rrset_clear(ldns_verify_rrset *v)
+{
+	ldns_rr_list_deep_free(v->sorted);
+	ldns_buffer_free(v->wire);
+	LDNS_FREE(v->offsets);
+	LDNS_FREE(v->keytags);
+	LDNS_FREE(v->algorithms);
+	ldns_buffer_free(v->rawsig_buf);
+	ldns_buffer_free(v->verify_buf);
+}
+
+static ldns_status
+ldns_verify_rrset_init(ldns_verify_rrset *v,
+	const ldns_rr_list *rrset, const ldns_rr_list *keys)
+{
+	size_t i, rr_count, key_count;
+	ldns_rr *rr;
+
+	memset(v, 0, sizeof(*v));
+	rr_count = ldns_rr_list_rr_count(rrset);
+	key_count = ldns_rr_list_rr_count(keys);
+	if (rr_count == 0) {
+		return LDNS_STATUS_ERR;
+	}
+	v->keys = keys;
+	v->sorted = ldns_rr_list_clone(rrset);
+	v->wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	v->offsets = LDNS_XMALLOC(size_t, rr_count + 1);
+	v->keytags = LDNS_XMALLOC(uint16_t, key_count + 1);
+	v->algorithms = LDNS_XMALLOC(int, key_count + 1);
+	v->rawsig_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	v->verify_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	if (!v->sorted || !v->wire || !v->offsets || !v->keytags ||
+	    !v->algorithms || !v->rawsig_buf || !v->verify_buf) {
+		ldns_verify_rrset_clear(v);
+		return LDNS_STATUS_MEM_ERR;
+	}
+
+	for (i = 0; i < key_count; i++) {
+		rr = ldns_rr_list_rr(keys, i);
+		v->keytags[i] = ldns_calc_keytag(rr);
+		v->algorithms[i] = ldns_rr_rdf(rr, 2) ? 
+			(int)ldns_rdf2native_int8(ldns_rr_rdf(rr, 2)) : -1;
+	}
+
+	v->same_owner = true;
+	for (i = 0; i < rr_count; i++) {
+		rr = ldns_rr_list_rr(v->sorted, i);
+		ldns_rr2canonical(rr);
+		if (ldns_rr_owner(rr) == NULL || ldns_dname_compare(
+				ldns_rr_owner(rr), ldns_rr_owner(
+				ldns_rr_list_rr(v->sorted, 0))) != 0) {
+			v->same_owner = false;
 		}
-		if (ldns_rdf2buffer_wire(key_buf, ldns_rr_rdf(key, 3))
-			       	!= LDNS_STATUS_OK) {
-			ldns_buffer_free(key_buf); 
-			/* returning is bad might screw up
-			   good keys later in the list
-			   what to do? */
-			return LDNS_STATUS_ERR;
+	}
+	if (!v->same_owner) {
+		return LDNS_STATUS_OK;
+	}
+	v->owner_size = ldns_rdf_size(ldns_rr_owner(
+		ldns_rr_list_rr(v->sorted, 0)));
+	if (ldns_rrset2buffer_wire_canonical(v->wire, v->sorted, NULL,
+			ldns_rr_ttl(ldns_rr_list_rr(v->sorted, 0)))
+			!= LDNS_STATUS_OK) {
+		ldns_verify_rrset_clear(v);
+		return LDNS_STATUS_MEM_ERR;
+	}
+	/* owner, type, class, ttl and rdata length precede the rdata */
+	v->offsets[0] = 0;
+	for (i = 0; i < rr_count; i++) {
+		v->offsets[i + 1] = v->offsets[i] + v->owner_size + 10 +
+			ldns_read_uint16(ldns_buffer_at(v->wire,
+			v->offsets[i] + v->owner_size + 8));
+	}
+	return LDNS_STATUS_OK;
+}
+
+ldns_status
+ldns_verify_rrset_new(ldns_verify_rrset **v,
+	const ldns_rr_list *rrset, const ldns_rr_list *keys)
+{
+	ldns_status result;
+
+	if (!v || !rrset || !keys) {
+		return LDNS_STATUS_ERR;
+	}
+	if (!(*v = LDNS_MALLOC(ldns_verify_rrset))) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	result = ldns_verify_rrset_init(*v, rrset, keys);
+	if (result != LDNS_STATUS_OK) {
+		LDNS_FREE(*v);
+		*v = NULL;
+	}
+	return result;
+}
+
+void
+ldns_verify_rrset_free(ldns_verify_rrset *v)
+{
+	if (v) {
+		ldns_verify_rrset_clear(v);
+		LDNS_FREE(v);
+	}
+}
+
+/**
+ * Prepare for verification of a signature over a prepared rrset.
+ * Like ldns_prepare_for_verify, but reuses the sorted canonical wire
+ * format, patching in the wildcard owner and the original ttl.
+ * @param v: the prepared rrset, its buffers are made ready.
+ * @param rrsig: signature to prepare for.
+ * @return LDNS_STATUS_OK is all went well. Otherwise specific error.
+ */
+static ldns_status
+ldns_verify_rrset_prepare(ldns_verify_rrset *v, const ldns_rr *rrsig)
+{
+	ldns_status result;
+	ldns_rr_list *rrset_clone;
+	ldns_dname_view owner;
+	bool wildcard;
+	uint32_t orig_ttl;
+	uint8_t label_count;
+	size_t i, start, end;
+
+	ldns_buffer_clear(v->rawsig_buf);
+	ldns_buffer_clear(v->verify_buf);
+
+	if (!v->same_owner) {
+		/* clone the rrset so that we can fiddle with it */
+		if (!(rrset_clone = ldns_rr_list_clone(v->sorted))) {
+			return LDNS_STATUS_MEM_ERR;
 		}
+		result = ldns_prepare_for_verify(v->rawsig_buf, v->verify_buf,
+			rrset_clone, rrsig);
+		ldns_rr_list_deep_free(rrset_clone);
+		return result;
+	}
 
-		if (ldns_rr_rdf(key, 2) == NULL) {
-			result = LDNS_STATUS_MISSING_RDATA_FIELDS_KEY;
+	/* canonicalize the sig */
+	ldns_dname2canonical(ldns_rr_owner(rrsig));
+	
+	/* check if the typecovered is equal to the type checked */
+	if (ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(rrsig)) !=
+	    ldns_rr_get_type(ldns_rr_list_rr(v->sorted, 0)))
+		return LDNS_STATUS_CRYPTO_TYPE_COVERED_ERR;
+	
+	/* create a buffer with b64 signature rdata */
+	result = ldns_rrsig2rawsig_buffer(v->rawsig_buf, rrsig);
+	if(result != LDNS_STATUS_OK)
+		return result;
+
+	/* put the signature rr (without the b64) to the verify_buf */
+	if (ldns_rrsig2buffer_wire(v->verify_buf, rrsig) != LDNS_STATUS_OK)
+		return LDNS_STATUS_MEM_ERR;
+
+	/* use TTL from signature. Use wildcard names for wildcards */
+	orig_ttl = ldns_rdf2native_int32(ldns_rr_rdf(rrsig, 3));
+	label_count = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 2));
+	wildcard = ldns_dname_view_init(&owner, ldns_rr_owner(
+			ldns_rr_list_rr(v->sorted, 0))) == LDNS_STATUS_OK &&
+		label_count < ldns_dname_view_label_count(&owner);
+	if (wildcard) {
+		(void) ldns_dname_view_suffix(&owner, &owner,
+			ldns_dname_view_label_count(&owner) - label_count);
+	}
+
+	/* add the rrset in verify_buf */
+	for (i = 0; i < ldns_rr_list_rr_count(v->sorted); i++) {
+		start = v->offsets[i] + v->owner_size;
+		end = v->offsets[i + 1];
+		if (!ldns_buffer_reserve(v->verify_buf, 2 + (wildcard ?
+				ldns_dname_view_size(&owner) : v->owner_size)
+				+ end - start)) {
+			return LDNS_STATUS_MEM_ERR;
 		}
-		else if (sig_algo == ldns_rdf2native_int8(
-					ldns_rr_rdf(key, 2))) {
-			result = ldns_verify_rrsig_buffers(rawsig_buf, 
-				verify_buf, key_buf, sig_algo);
+		if (wildcard) {
+			ldns_buffer_write_u8(v->verify_buf, 1);
+			ldns_buffer_write_u8(v->verify_buf, '*');
+			ldns_buffer_write(v->verify_buf,
+				ldns_dname_view_data(&owner),
+				ldns_dname_view_size(&owner));
 		} else {
-			/* No keys with the corresponding algorithm are found */
-			result = LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+			ldns_buffer_write(v->verify_buf,
+				ldns_buffer_at(v->wire, v->offsets[i]),
+				v->owner_size);
 		}
+		ldns_buffer_write(v->verify_buf,
+			ldns_buffer_at(v->wire, start), end - start);
+		/* type (2) and class (2) precede the ttl */
+		ldns_buffer_write_u32_at(v->verify_buf,
+			ldns_buffer_position(v->verify_buf) - (end - start) + 4,
+			orig_ttl);
+	}
+	return LDNS_STATUS_OK;
+}
 
-		ldns_buffer_free(key_buf); 
+ldns_status
+ldns_verify_rrset_rrsig_notime(ldns_verify_rrset *v, const ldns_rr *rrsig,
+	ldns_rr_list *good_keys)
+{
+	uint16_t keytag;
+	uint8_t sig_algo;
+	size_t i;
+	ldns_status result, status;
+	ldns_rr_list *validkeys;
+
+	if (!v) {
+		return LDNS_STATUS_ERR;
+	}
+	if (!rrsig) {
+		return LDNS_STATUS_CRYPTO_NO_RRSIG;
+	}
+	result = ldns_verify_rrset_prepare(v, rrsig);
+	if (result != LDNS_STATUS_OK) {
 		return result;
 	}
-	else {
-		/* No keys with the corresponding keytag are found */
-		return LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+	validkeys = ldns_rr_list_new();
+	if (!validkeys) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	sig_algo = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 1));
+	keytag = ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rrsig));
+
+	result = LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+	for (i = 0; i < ldns_rr_list_rr_count(v->keys); i++) {
+		/* the others would return NO_MATCHING_KEYTAG_DNSKEY */
+		if (v->keytags[i] != keytag || (v->algorithms[i] != -1 &&
+				v->algorithms[i] != (int)sig_algo)) {
+			continue;
+		}
+		status = ldns_verify_test_sig_algo_key(v->rawsig_buf,
+			v->verify_buf, sig_algo, ldns_rr_list_rr(v->keys, i));
+		if (status == LDNS_STATUS_OK) {
+			/* one of the keys has matched, don't break
+			 * here, instead put the 'winning' key in
+			 * the validkey list and return the list 
+			 * later */
+			if (!ldns_rr_list_push_rr(validkeys, 
+				ldns_rr_list_rr(v->keys, i))) {
+				/* couldn't push the key?? */
+				ldns_rr_list_free(validkeys);
+				return LDNS_STATUS_MEM_ERR;
+			}
+
+			result = status;
+		}
+
+		if (result == LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY) {
+			result = status;
+		}
+	}
+
+	if (ldns_rr_list_rr_count(validkeys) == 0) {
+		/* no keys were added, return last error */
+		ldns_rr_list_free(validkeys); 
+		return result;
+	}
+
+	/* do not check timestamps */
+
+	ldns_rr_list_cat(good_keys, validkeys);
+	ldns_rr_list_free(validkeys);
+	return LDNS_STATUS_OK;
+}
+
+ldns_status
+ldns_verify_rrset_rrsig_time(ldns_verify_rrset *v, const ldns_rr *rrsig,
+	time_t check_time, ldns_rr_list *good_keys)
+{
+	ldns_status result;
+	ldns_rr_list *valid;
+
+	if (!good_keys)
+		valid = NULL;
+
+	else if (!(valid = ldns_rr_list_new()))
+		return LDNS_STATUS_MEM_ERR;
+
+	result = ldns_verify_rrset_rrsig_notime(v, rrsig, valid);
+	if(result != LDNS_STATUS_OK) {
+		ldns_rr_list_free(valid); 
+		return result;
+	}
+
+	/* check timestamps last; its OK except time */
+	result = ldns_rrsig_check_timestamps(rrsig, check_time);
+	if(result != LDNS_STATUS_OK) {
+		ldns_rr_list_free(valid); 
+		return result;
 	}
+
+	ldns_rr_list_cat(good_keys, valid);
+	ldns_rr_list_free(valid);
+	return LDNS_STATUS_OK;
 }
 
 /* 
@@ -2456,17 +2870,54 @@ ldns_verify_rrsig_keylist_notime(const ldns_rr_list *rrset,
 {
 	ldns_buffer *rawsig_buf;
 	ldns_buffer *verify_buf;
-	uint16_t i;
+	uint16_t i, keytag;
+	uint8_t sig_algo;
 	ldns_status result, status;
 	ldns_rr_list *rrset_clone;
+	ldns_rr_list *candidates;
 	ldns_rr_list *validkeys;
+	ldns_rr *key;
 
 	if (!rrset) {
 		return LDNS_STATUS_ERR;
 	}
+	if (!rrsig) {
+		return LDNS_STATUS_CRYPTO_NO_RRSIG;
+	}
+	if (ldns_rr_rdf(rrsig, 1) == NULL || ldns_rr_rdf(rrsig, 6) == NULL) {
+		return LDNS_STATUS_MISSING_RDATA_FIELDS_RRSIG;
+	}
+	sig_algo = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 1));
+	keytag = ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rrsig));
+
+	/* only keys with the keytag and algorithm of the signature can
+	 * verify it; without any the rrset need not be prepared at all */
+	candidates = ldns_rr_list_new();
+	if (!candidates) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	for (i = 0; i < ldns_rr_list_rr_count(keys); i++) {
+		key = ldns_rr_list_rr(keys, i);
+		if (ldns_rr_rdf(key, 2) != NULL &&
+		    ldns_rdf2native_int8(ldns_rr_rdf(key, 2)) != sig_algo) {
+			continue;
+		}
+		if (ldns_calc_keytag(key) != keytag) {
+			continue;
+		}
+		if (!ldns_rr_list_push_rr(candidates, key)) {
+			ldns_rr_list_free(candidates);
+			return LDNS_STATUS_MEM_ERR;
+		}
+	}
+	if (ldns_rr_list_rr_count(candidates) == 0) {
+		ldns_rr_list_free(candidates);
+		return LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
+	}
 
 	validkeys = ldns_rr_list_new();
 	if (!validkeys) {
+		ldns_rr_list_free(candidates);
 		return LDNS_STATUS_MEM_ERR;
 	}
 	
@@ -2483,25 +2934,27 @@ ldns_verify_rrsig_keylist_notime(const ldns_rr_list *rrset,
 		ldns_buffer_free(verify_buf);
 		ldns_buffer_free(rawsig_buf);
 		ldns_rr_list_deep_free(rrset_clone);
+		ldns_rr_list_free(candidates);
 		ldns_rr_list_free(validkeys);
 		return result;
 	}
 
 	result = LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY;
-	for(i = 0; i < ldns_rr_list_rr_count(keys); i++) {
-		status = ldns_verify_test_sig_key(rawsig_buf, verify_buf, 
-			rrsig, ldns_rr_list_rr(keys, i));
+	for(i = 0; i < ldns_rr_list_rr_count(candidates); i++) {
+		key = ldns_rr_list_rr(candidates, i);
+		status = ldns_verify_test_sig_algo_key(rawsig_buf, verify_buf, 
+			sig_algo, key);
 		if (status == LDNS_STATUS_OK) {
 			/* one of the keys has matched, don't break
 			 * here, instead put the 'winning' key in
 			 * the validkey list and return the list 
 			 * later */
-			if (!ldns_rr_list_push_rr(validkeys, 
-				ldns_rr_list_rr(keys,i))) {
+			if (!ldns_rr_list_push_rr(validkeys, key)) {
 				/* couldn't push the key?? */
 				ldns_buffer_free(rawsig_buf);
 				ldns_buffer_free(verify_buf);
 				ldns_rr_list_deep_free(rrset_clone);
+				ldns_rr_list_free(candidates);
 				ldns_rr_list_free(validkeys);
 				return LDNS_STATUS_MEM_ERR;
 			}
@@ -2516,6 +2969,7 @@ ldns_verify_rrsig_keylist_notime(const ldns_rr_list *rrset,
 
 	/* no longer needed */
 	ldns_rr_list_deep_free(rrset_clone);
+	ldns_rr_list_free(candidates);
 	ldns_buffer_free(rawsig_buf);
 	ldns_buffer_free(verify_buf);
 
@@ -2603,12 +3057,7 @@ ldns_verify_rrsig_evp_raw(const unsigned char *sig, size_t siglen,
 	EVP_MD_CTX *ctx;
 	int res;
 
-#ifdef HAVE_EVP_MD_CTX_NEW
-	ctx = EVP_MD_CTX_new();
-#else
-	ctx = (EVP_MD_CTX*)malloc(sizeof(*ctx));
-	if(ctx) EVP_MD_CTX_init(ctx);
-#endif
+	ctx = ldns_evp_md_ctx_get();
 	if(!ctx)
 		return LDNS_STATUS_MEM_ERR;
 	
@@ -2632,7 +3081,7 @@ ldns_verify_rrsig_evp_raw(const unsigned char *sig, size_t siglen,
 		res = EVP_VerifyFinal(ctx, sig, (unsigned int) siglen, key);
 	}
 	
-	EVP_MD_CTX_destroy(ctx);
+	ldns_evp_md_ctx_release(ctx);
 	
 	if (res == 1) {
 		return LDNS_STATUS_OK;
@@ -2695,7 +3144,7 @@ ldns_verify_rrsig_dsa_raw(unsigned char* sig, size_t siglen,
 # ifdef HAVE_EVP_DSS1
 								EVP_dss1()
 # else
-								EVP_sha1()
+								ldns_evp_md("SHA1")
 # endif
 								);
 	} else {
@@ -2722,7 +3171,7 @@ ldns_verify_rrsig_rsasha1_raw(unsigned char* sig, size_t siglen,
 								siglen,
 								rrset,
 								evp_key,
-								EVP_sha1());
+								ldns_evp_md("SHA1"));
 	} else {
 		result = LDNS_STATUS_SSL_ERR;
 	}
@@ -2748,7 +3197,7 @@ ldns_verify_rrsig_rsasha256_raw(unsigned char* sig,
 								siglen,
 								rrset,
 								evp_key,
-								EVP_sha256());
+								ldns_evp_md("SHA256"));
 	} else {
 		result = LDNS_STATUS_SSL_ERR;
 	}
@@ -2783,7 +3232,7 @@ ldns_verify_rrsig_rsasha512_raw(unsigned char* sig,
 								siglen,
 								rrset,
 								evp_key,
-								EVP_sha512());
+								ldns_evp_md("SHA512"));
 	} else {
 		result = LDNS_STATUS_SSL_ERR;
 	}
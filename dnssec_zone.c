@@ -14,6 +14,7 @@ ldns_dnssec_rrs_new(void)
         if(!new_rrs) return NULL;
 	new_rrs->rr = NULL;
 	new_rrs->next = NULL;
+	new_rrs->_compact = NULL;
 	return new_rrs;
 }
 
@@ -26,6 +27,7 @@ ldns_dnssec_rrs_free_internal(ldns_dnssec_rrs *rrs, int deep)
 		if (deep) {
 			ldns_rr_free(rrs->rr);
 		}
+		LDNS_FREE(rrs->_compact);
 		LDNS_FREE(rrs);
 		rrs = next;
 	}
@@ -52,6 +54,9 @@ ldns_dnssec_rrs_add_rr(ldns_dnssec_rrs *rrs, ldns_rr *rr)
 		return LDNS_STATUS_ERR;
 	}
 
+	if (rrs->_compact && !ldns_dnssec_rrs_rr(rrs)) {
+		return LDNS_STATUS_MEM_ERR;
+	}
 	/* this could be done more efficiently; name and type should already
 	   be equal */
 	cmp = ldns_rr_compare(rrs->rr, rr);
@@ -81,12 +86,20 @@ void
 ldns_dnssec_rrs_print_fmt(FILE *out, const ldns_output_format *fmt,
 	       const ldns_dnssec_rrs *rrs)
 {
+	ldns_rr *rr;
+
 	if (!rrs) {
 		if ((fmt->flags & LDNS_COMMENT_LAYOUT))
 			fprintf(out, "; <void>");
 	} else {
 		if (rrs->rr) {
 			ldns_rr_print_fmt(out, fmt, rrs->rr);
+		} else if (rrs->_compact) {
+			/* print a copy, the zone stays compact */
+			if ((rr = ldns_dnssec_rrs_clone_rr(rrs))) {
+				ldns_rr_print_fmt(out, fmt, rr);
+				ldns_rr_free(rr);
+			}
 		}
 		if (rrs->next) {
 			ldns_dnssec_rrs_print_fmt(out, fmt, rrs->next);
@@ -100,6 +113,257 @@ ldns_dnssec_rrs_print(FILE *out, const ldns_dnssec_rrs *rrs)
 	ldns_dnssec_rrs_print_fmt(out, ldns_output_format_default, rrs);
 }
 
+/*
+ * The fields that compact RRSIGs share: the class, and the rdata fields
+ * before the signature (type covered, algorithm, labels, original ttl,
+ * expiration, inception, key tag and signer), each as a two byte length
+ * followed by the data. The templates of a zone are kept in a tree, of
+ * which they are the nodes.
+ */
+typedef struct ldns_rrsig_template_struct
+{
+	ldns_rbnode_t node;
+	ldns_rr_class klass;
+	size_t size;
+	uint8_t *data;
+} ldns_rrsig_template;
+
+/* the number of rdata fields in a template */
+#define LDNS_RRSIG_TEMPLATE_RDFS 8
+
+struct ldns_struct_compact_rrsig
+{
+	/** the owner name, of the name or NSEC(3) the RRSIG is kept with */
+	const ldns_rdf *owner;
+	/** the shared fields */
+	const ldns_rrsig_template *tmpl;
+	uint32_t ttl;
+	/** size of the signature, which follows the struct */
+	uint16_t size;
+};
+
+static int
+ldns_rrsig_template_compare(const void *a, const void *b)
+{
+	const ldns_rrsig_template *ta = (const ldns_rrsig_template *)a;
+	const ldns_rrsig_template *tb = (const ldns_rrsig_template *)b;
+
+	if (ta->klass != tb->klass) {
+		return ta->klass < tb->klass ? -1 : 1;
+	}
+	if (ta->size != tb->size) {
+		return ta->size < tb->size ? -1 : 1;
+	}
+	return memcmp(ta->data, tb->data, ta->size);
+}
+
+static void
+ldns_rrsig_template_node_free(ldns_rbnode_t *node, void *arg)
+{
+	(void) arg;
+	LDNS_FREE(node);
+}
+
+static void
+ldns_rrsig_templates_free(ldns_rbtree_t *templates)
+{
+	if (templates) {
+		ldns_traverse_postorder(templates,
+				ldns_rrsig_template_node_free, NULL);
+		LDNS_FREE(templates);
+	}
+}
+
+static ldns_rr *
+ldns_compact_rrsig2rr(const ldns_compact_rrsig *c)
+{
+	const ldns_rr_descriptor *desc =
+		ldns_rr_descript(LDNS_RR_TYPE_RRSIG);
+	const uint8_t *data = c->tmpl->data;
+	ldns_rdf *rdf;
+	ldns_rr *rr;
+	uint16_t len;
+	size_t i;
+
+	if (!(rr = ldns_rr_new_frm_type(LDNS_RR_TYPE_RRSIG))) {
+		return NULL;
+	}
+	if (!(rdf = ldns_rdf_clone(c->owner))) {
+		goto error;
+	}
+	ldns_rr_set_owner(rr, rdf);
+	ldns_rr_set_ttl(rr, c->ttl);
+	ldns_rr_set_class(rr, c->tmpl->klass);
+	for (i = 0; i < LDNS_RRSIG_TEMPLATE_RDFS; i++) {
+		len = ldns_read_uint16(data);
+		if (!(rdf = ldns_rdf_new_frm_data(
+				ldns_rr_descriptor_field_type(desc, i),
+				len, data + 2))) {
+			goto error;
+		}
+		ldns_rr_set_rdf(rr, rdf, i);
+		data += 2 + len;
+	}
+	if (!(rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64, c->size,
+			(const uint8_t *)(c + 1)))) {
+		goto error;
+	}
+	ldns_rr_set_rdf(rr, rdf, LDNS_RRSIG_TEMPLATE_RDFS);
+	return rr;
+error:
+	ldns_rr_free(rr);
+	return NULL;
+}
+
+/* whether rr can be kept compact with this owner name */
+static bool
+ldns_rrsig_is_compactable(const ldns_rr *rr, const ldns_rdf *owner)
+{
+	const ldns_rr_descriptor *desc =
+		ldns_rr_descript(LDNS_RR_TYPE_RRSIG);
+	size_t i;
+
+	if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_RRSIG ||
+	    ldns_rr_rd_count(rr) != LDNS_RRSIG_TEMPLATE_RDFS + 1 ||
+	    ldns_rdf_size(ldns_rr_owner(rr)) != ldns_rdf_size(owner) ||
+	    memcmp(ldns_rdf_data(ldns_rr_owner(rr)), ldns_rdf_data(owner),
+			ldns_rdf_size(owner)) != 0) {
+		return false;
+	}
+	for (i = 0; i <= LDNS_RRSIG_TEMPLATE_RDFS; i++) {
+		if (ldns_rdf_get_type(ldns_rr_rdf(rr, i)) !=
+				ldns_rr_descriptor_field_type(desc, i) ||
+		    ldns_rdf_size(ldns_rr_rdf(rr, i)) > UINT16_MAX) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* the template in templates with the shared fields of rr, added when
+ * there is none yet */
+static const ldns_rrsig_template *
+ldns_rrsig_template_get(ldns_rbtree_t *templates, const ldns_rr *rr)
+{
+	uint8_t data[LDNS_RRSIG_TEMPLATE_RDFS * 2 + LDNS_MAX_DOMAINLEN + 32];
+	ldns_rrsig_template key, *t;
+	ldns_rbnode_t *node;
+	ldns_rdf *rdf;
+	size_t i;
+
+	key.klass = ldns_rr_get_class(rr);
+	key.size = 0;
+	key.data = data;
+	for (i = 0; i < LDNS_RRSIG_TEMPLATE_RDFS; i++) {
+		rdf = ldns_rr_rdf(rr, i);
+		if (key.size + 2 + ldns_rdf_size(rdf) > sizeof(data)) {
+			return NULL;
+		}
+		ldns_write_uint16(data + key.size,
+				(uint16_t) ldns_rdf_size(rdf));
+		memcpy(data + key.size + 2, ldns_rdf_data(rdf),
+				ldns_rdf_size(rdf));
+		key.size += 2 + ldns_rdf_size(rdf);
+	}
+	if ((node = ldns_rbtree_search(templates, &key))) {
+		return (const ldns_rrsig_template *)node;
+	}
+	/* the data follows the template in the same allocation */
+	t = (ldns_rrsig_template *)LDNS_XMALLOC(uint8_t,
+			sizeof(ldns_rrsig_template) + key.size);
+	if (!t) {
+		return NULL;
+	}
+	t->klass = key.klass;
+	t->size = key.size;
+	t->data = (uint8_t *)(t + 1);
+	memcpy(t->data, data, key.size);
+	t->node.key = t;
+	t->node.data = NULL;
+	(void) ldns_rbtree_insert(templates, &t->node);
+	return t;
+}
+
+/* keeps the RRSIGs in rrs compact, with the given owner name */
+static ldns_status
+ldns_dnssec_rrs_compact(ldns_dnssec_rrs *rrs, const ldns_rdf *owner,
+		ldns_rbtree_t *templates)
+{
+	const ldns_rrsig_template *t;
+	ldns_compact_rrsig *c;
+	ldns_rdf *sig;
+
+	for (; rrs; rrs = rrs->next) {
+		if (!rrs->rr || !ldns_rrsig_is_compactable(rrs->rr, owner)) {
+			continue;
+		}
+		if (!(t = ldns_rrsig_template_get(templates, rrs->rr))) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+		sig = ldns_rr_rdf(rrs->rr, LDNS_RRSIG_TEMPLATE_RDFS);
+		c = (ldns_compact_rrsig *)LDNS_XMALLOC(uint8_t,
+				sizeof(ldns_compact_rrsig) + ldns_rdf_size(sig));
+		if (!c) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+		c->owner = owner;
+		c->tmpl = t;
+		c->ttl = ldns_rr_ttl(rrs->rr);
+		c->size = (uint16_t) ldns_rdf_size(sig);
+		memcpy(c + 1, ldns_rdf_data(sig), ldns_rdf_size(sig));
+		ldns_rr_free(rrs->rr);
+		rrs->rr = NULL;
+		rrs->_compact = c;
+	}
+	return LDNS_STATUS_OK;
+}
+
+/* whether owner is the owner name of one of the RRSIGs in rrs */
+static bool
+ldns_dnssec_rrs_owns(const ldns_dnssec_rrs *rrs, const ldns_rdf *owner)
+{
+	for (; rrs; rrs = rrs->next) {
+		if (rrs->rr && ldns_rr_owner(rrs->rr) == owner) {
+			return true;
+		}
+	}
+	return false;
+}
+
+ldns_rr *
+ldns_dnssec_rrs_rr(ldns_dnssec_rrs *rrs)
+{
+	ldns_rr *rr;
+
+	if (!rrs) {
+		return NULL;
+	}
+	if (!rrs->rr && rrs->_compact) {
+		if (!(rr = ldns_compact_rrsig2rr(rrs->_compact))) {
+			return NULL;
+		}
+		rrs->rr = rr;
+		LDNS_FREE(rrs->_compact);
+		rrs->_compact = NULL;
+	}
+	return rrs->rr;
+}
+
+ldns_rr *
+ldns_dnssec_rrs_clone_rr(const ldns_dnssec_rrs *rrs)
+{
+	if (!rrs) {
+		return NULL;
+	}
+	if (rrs->rr) {
+		return ldns_rr_clone(rrs->rr);
+	}
+	if (rrs->_compact) {
+		return ldns_compact_rrsig2rr(rrs->_compact);
+	}
+	return NULL;
+}
+
 
 ldns_dnssec_rrsets *
 ldns_dnssec_rrsets_new(void)
@@ -111,6 +375,7 @@ ldns_dnssec_rrsets_new(void)
 	new_rrsets->type = 0;
 	new_rrsets->signatures = NULL;
 	new_rrsets->next = NULL;
+	new_rrsets->changes = 0;
 	return new_rrsets;
 }
 
@@ -159,6 +424,7 @@ ldns_dnssec_rrsets_set_type(ldns_dnssec_rrsets *rrsets,
 {
 	if (rrsets) {
 		rrsets->type = type;
+		rrsets->changes++;
 		return LDNS_STATUS_OK;
 	}
 	return LDNS_STATUS_ERR;
@@ -172,6 +438,9 @@ ldns_dnssec_rrsets_new_frm_rr(ldns_rr *rr)
 	bool rrsig;
 
 	new_rrsets = ldns_dnssec_rrsets_new();
+	if (!new_rrsets) {
+		return NULL;
+	}
 	rr_type = ldns_rr_get_type(rr);
 	if (rr_type == LDNS_RR_TYPE_RRSIG) {
 		rrsig = true;
@@ -181,17 +450,29 @@ ldns_dnssec_rrsets_new_frm_rr(ldns_rr *rr)
 	}
 	if (!rrsig) {
 		new_rrsets->rrs = ldns_dnssec_rrs_new();
+		if (!new_rrsets->rrs) {
+			LDNS_FREE(new_rrsets);
+			return NULL;
+		}
 		new_rrsets->rrs->rr = rr;
 	} else {
 		new_rrsets->signatures = ldns_dnssec_rrs_new();
+		if (!new_rrsets->signatures) {
+			LDNS_FREE(new_rrsets);
+			return NULL;
+		}
 		new_rrsets->signatures->rr = rr;
 	}
 	new_rrsets->type = rr_type;
 	return new_rrsets;
 }
 
-ldns_status
-ldns_dnssec_rrsets_add_rr(ldns_dnssec_rrsets *rrsets, ldns_rr *rr)
+/* Sets *relinked when an rrsets was linked into the list or the type of
+ * one changed
+ */
+static ldns_status
+ldns_dnssec_rrsets_add_rr_internal(ldns_dnssec_rrsets *rrsets, ldns_rr *rr,
+		bool *relinked)
 {
 	ldns_dnssec_rrsets *new_rrsets;
 	ldns_rr_type rr_type;
@@ -219,15 +500,18 @@ ldns_dnssec_rrsets_add_rr(ldns_dnssec_rrsets *rrsets, ldns_rr *rr)
 			rrsets->signatures->rr = rr;
 			rrsets->type = rr_type;
 		}
+		*relinked = true;
 		return LDNS_STATUS_OK;
 	}
 
 	if (rr_type > ldns_dnssec_rrsets_type(rrsets)) {
 		if (rrsets->next) {
-			result = ldns_dnssec_rrsets_add_rr(rrsets->next, rr);
+			result = ldns_dnssec_rrsets_add_rr_internal(
+					rrsets->next, rr, relinked);
 		} else {
 			new_rrsets = ldns_dnssec_rrsets_new_frm_rr(rr);
 			rrsets->next = new_rrsets;
+			*relinked = true;
 		}
 	} else if (rr_type < ldns_dnssec_rrsets_type(rrsets)) {
 		/* move the current one into the new next, 
@@ -248,6 +532,7 @@ ldns_dnssec_rrsets_add_rr(ldns_dnssec_rrsets *rrsets, ldns_rr *rr)
 		}
 		rrsets->type = rr_type;
 		rrsets->next = new_rrsets;
+		*relinked = true;
 	} else {
 		/* equal, add to current rrsets */
 		if (rrsig) {
@@ -270,6 +555,19 @@ ldns_dnssec_rrsets_add_rr(ldns_dnssec_rrsets *rrsets, ldns_rr *rr)
 	return result;
 }
 
+ldns_status
+ldns_dnssec_rrsets_add_rr(ldns_dnssec_rrsets *rrsets, ldns_rr *rr)
+{
+	bool relinked = false;
+	ldns_status result;
+
+	result = ldns_dnssec_rrsets_add_rr_internal(rrsets, rr, &relinked);
+	if (relinked) {
+		rrsets->changes++;
+	}
+	return result;
+}
+
 static void
 ldns_dnssec_rrsets_print_soa_fmt(FILE *out, const ldns_output_format *fmt,
 		const ldns_dnssec_rrsets *rrsets,
@@ -376,6 +674,7 @@ ldns_dnssec_name_free_internal(ldns_dnssec_name *name,
 			 */
 			ldns_rdf_deep_free(name->hashed_name);
 		}
+		LDNS_FREE(name->rrset_index);
 		LDNS_FREE(name);
 	}
 }
@@ -446,6 +745,185 @@ ldns_dnssec_name_cmp(const void *a, const void *b)
 	}
 }
 
+/*
+ * The type index of a name is an array with the rrsets of the name in list
+ * order, so binary search finds a type, plus a bitmap of the types below
+ * 256 for quick presence tests. When the first entry is not the head of
+ * the list anymore, or the head counted changes since the index was made
+ * (ldns_dnssec_rrsets_add_rr() on the list), the list was changed behind
+ * our back and the index is not used until it is rebuilt.
+ */
+static bool
+ldns_dnssec_name_index_fresh(const ldns_dnssec_name *name)
+{
+	if (name->rrset_count == 0) {
+		return name->rrsets == NULL;
+	}
+	return name->rrset_index[0] == name->rrsets
+		&& name->rrsets->changes == name->rrset_changes;
+}
+
+/* Returns the position of type in the index, or where it would go */
+static size_t
+ldns_dnssec_name_index_search(const ldns_dnssec_name *name,
+		ldns_rr_type type, bool *found)
+{
+	size_t lo = 0, hi = name->rrset_count, mid;
+
+	*found = false;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (name->rrset_index[mid]->type < type) {
+			lo = mid + 1;
+		} else if (name->rrset_index[mid]->type > type) {
+			hi = mid;
+		} else {
+			*found = true;
+			return mid;
+		}
+	}
+	return lo;
+}
+
+static ldns_status
+ldns_dnssec_name_index_reserve(ldns_dnssec_name *name, size_t count)
+{
+	ldns_dnssec_rrsets **index;
+	size_t capacity;
+
+	if (count <= name->rrset_capacity) {
+		return LDNS_STATUS_OK;
+	}
+	capacity = name->rrset_capacity ? name->rrset_capacity : 4;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	index = LDNS_XREALLOC(name->rrset_index, ldns_dnssec_rrsets *,
+			capacity);
+	if (!index) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	name->rrset_index = index;
+	name->rrset_capacity = capacity;
+	return LDNS_STATUS_OK;
+}
+
+/* Links rrset into the list and the index at position pos */
+static void
+ldns_dnssec_name_index_link(ldns_dnssec_name *name,
+		ldns_dnssec_rrsets *rrset, size_t pos)
+{
+	rrset->next = pos < name->rrset_count ? name->rrset_index[pos] : NULL;
+	if (pos > 0) {
+		name->rrset_index[pos - 1]->next = rrset;
+	} else {
+		name->rrsets = rrset;
+		name->rrset_changes = rrset->changes;
+	}
+	memmove(&name->rrset_index[pos + 1], &name->rrset_index[pos],
+			(name->rrset_count - pos) * sizeof(ldns_dnssec_rrsets *));
+	name->rrset_index[pos] = rrset;
+	name->rrset_count++;
+	if (rrset->type < 256) {
+		name->rrset_types[rrset->type / 8] |= 1 << (rrset->type % 8);
+	}
+}
+
+ldns_status
+ldns_dnssec_name_reindex(ldns_dnssec_name *name)
+{
+	ldns_dnssec_rrsets *cur;
+	size_t count = 0;
+	ldns_status result;
+
+	if (!name) {
+		return LDNS_STATUS_NULL;
+	}
+	for (cur = name->rrsets; cur; cur = cur->next) {
+		count++;
+	}
+	result = ldns_dnssec_name_index_reserve(name, count);
+	if (result != LDNS_STATUS_OK) {
+		return result;
+	}
+	memset(name->rrset_types, 0, sizeof(name->rrset_types));
+	name->rrset_count = 0;
+	name->rrset_changes = name->rrsets ? name->rrsets->changes : 0;
+	for (cur = name->rrsets; cur; cur = cur->next) {
+		name->rrset_index[name->rrset_count++] = cur;
+		if (cur->type < 256) {
+			name->rrset_types[cur->type / 8] |= 1 << (cur->type % 8);
+		}
+	}
+	return LDNS_STATUS_OK;
+}
+
+ldns_status
+ldns_dnssec_name_insert_rrset(ldns_dnssec_name *name,
+		ldns_dnssec_rrsets *rrset)
+{
+	ldns_status result;
+	size_t pos;
+	bool found;
+
+	if (!name || !rrset) {
+		return LDNS_STATUS_NULL;
+	}
+	if (!ldns_dnssec_name_index_fresh(name)) {
+		result = ldns_dnssec_name_reindex(name);
+		if (result != LDNS_STATUS_OK) {
+			return result;
+		}
+	}
+	pos = ldns_dnssec_name_index_search(name, rrset->type, &found);
+	if (found) {
+		return LDNS_STATUS_ERR;
+	}
+	result = ldns_dnssec_name_index_reserve(name, name->rrset_count + 1);
+	if (result != LDNS_STATUS_OK) {
+		return result;
+	}
+	ldns_dnssec_name_index_link(name, rrset, pos);
+	return LDNS_STATUS_OK;
+}
+
+ldns_dnssec_rrsets *
+ldns_dnssec_name_remove_rrset(ldns_dnssec_name *name, ldns_rr_type type)
+{
+	ldns_dnssec_rrsets *rrset;
+	size_t pos;
+	bool found;
+
+	if (!name) {
+		return NULL;
+	}
+	if (!ldns_dnssec_name_index_fresh(name)
+	    && ldns_dnssec_name_reindex(name) != LDNS_STATUS_OK) {
+		return NULL;
+	}
+	pos = ldns_dnssec_name_index_search(name, type, &found);
+	if (!found) {
+		return NULL;
+	}
+	rrset = name->rrset_index[pos];
+	if (pos > 0) {
+		name->rrset_index[pos - 1]->next = rrset->next;
+	} else {
+		name->rrsets = rrset->next;
+		if (name->rrsets) {
+			name->rrset_changes = name->rrsets->changes;
+		}
+	}
+	name->rrset_count--;
+	memmove(&name->rrset_index[pos], &name->rrset_index[pos + 1],
+			(name->rrset_count - pos) * sizeof(ldns_dnssec_rrsets *));
+	if (type < 256) {
+		name->rrset_types[type / 8] &= ~(1 << (type % 8));
+	}
+	rrset->next = NULL;
+	return rrset;
+}
+
 ldns_status
 ldns_dnssec_name_add_rr(ldns_dnssec_name *name,
 				    ldns_rr *rr)
@@ -453,6 +931,9 @@ ldns_dnssec_name_add_rr(ldns_dnssec_name *name,
 	ldns_status result = LDNS_STATUS_OK;
 	ldns_rr_type rr_type;
 	ldns_rr_type typecovered = 0;
+	ldns_dnssec_rrsets *new_rrsets;
+	size_t pos;
+	bool found;
 
 	/* special handling for NSEC3 and NSECX covering RRSIGS */
 
@@ -480,12 +961,30 @@ ldns_dnssec_name_add_rr(ldns_dnssec_name *name,
 		}
 	} else {
 		/* it's a 'normal' RR, add it to the right rrset */
-		if (name->rrsets) {
-			result = ldns_dnssec_rrsets_add_rr(name->rrsets, rr);
-		} else {
-			name->rrsets = ldns_dnssec_rrsets_new();
-			result = ldns_dnssec_rrsets_add_rr(name->rrsets, rr);
+		if (!ldns_dnssec_name_index_fresh(name)) {
+			result = ldns_dnssec_name_reindex(name);
+			if (result != LDNS_STATUS_OK) {
+				return result;
+			}
+		}
+		if (rr_type == LDNS_RR_TYPE_RRSIG) {
+			rr_type = typecovered;
+		}
+		pos = ldns_dnssec_name_index_search(name, rr_type, &found);
+		if (found) {
+			return ldns_dnssec_rrsets_add_rr(
+					name->rrset_index[pos], rr);
+		}
+		result = ldns_dnssec_name_index_reserve(name,
+				name->rrset_count + 1);
+		if (result != LDNS_STATUS_OK) {
+			return result;
+		}
+		new_rrsets = ldns_dnssec_rrsets_new_frm_rr(rr);
+		if (!new_rrsets) {
+			return LDNS_STATUS_MEM_ERR;
 		}
+		ldns_dnssec_name_index_link(name, new_rrsets, pos);
 	}
 	return result;
 }
@@ -494,7 +993,13 @@ ldns_dnssec_rrsets *
 ldns_dnssec_name_find_rrset(const ldns_dnssec_name *name,
 					   ldns_rr_type type) {
 	ldns_dnssec_rrsets *result;
+	size_t pos;
+	bool found;
 
+	if (ldns_dnssec_name_index_fresh(name)) {
+		pos = ldns_dnssec_name_index_search(name, type, &found);
+		return found ? name->rrset_index[pos] : NULL;
+	}
 	result = name->rrsets;
 	while (result) {
 		if (result->type == type) {
@@ -506,6 +1011,18 @@ ldns_dnssec_name_find_rrset(const ldns_dnssec_name *name,
 	return NULL;
 }
 
+bool
+ldns_dnssec_name_has_type(const ldns_dnssec_name *name, ldns_rr_type type)
+{
+	if (!name) {
+		return false;
+	}
+	if (type < 256 && ldns_dnssec_name_index_fresh(name)) {
+		return (name->rrset_types[type / 8] >> (type % 8)) & 1;
+	}
+	return ldns_dnssec_name_find_rrset(name, type) != NULL;
+}
+
 ldns_dnssec_rrsets *
 ldns_dnssec_zone_find_rrset(const ldns_dnssec_zone *zone,
 					   const ldns_rdf *dname,
@@ -576,10 +1093,35 @@ ldns_dnssec_zone_new(void)
 	zone->names = NULL;
 	zone->hashed_names = NULL;
 	zone->_nsec3params = NULL;
+	zone->_nsec3_hash_cache = NULL;
+	zone->_signer = NULL;
+	zone->_signer_arg = NULL;
+	zone->_signer_batch = 0;
+	zone->_rrsig_templates = NULL;
 
 	return zone;
 }
 
+void
+ldns_dnssec_zone_set_nsec3_hash_cache(ldns_dnssec_zone *zone,
+		ldns_nsec3_hash_cache *cache)
+{
+	if (zone) {
+		zone->_nsec3_hash_cache = cache;
+	}
+}
+
+void
+ldns_dnssec_zone_set_signer(ldns_dnssec_zone *zone,
+		ldns_dnssec_signer signer, void *arg, size_t batch)
+{
+	if (zone) {
+		zone->_signer = signer;
+		zone->_signer_arg = arg;
+		zone->_signer_batch = batch > 0 ? batch : 1;
+	}
+}
+
 static bool
 rr_is_rrsig_covering(ldns_rr* rr, ldns_rr_type t)
 {
@@ -890,6 +1432,7 @@ ldns_dnssec_zone_free(ldns_dnssec_zone *zone)
 						    NULL);
 			LDNS_FREE(zone->names);
 		}
+		ldns_rrsig_templates_free(zone->_rrsig_templates);
 		LDNS_FREE(zone);
 	}
 }
@@ -910,10 +1453,102 @@ ldns_dnssec_zone_deep_free(ldns_dnssec_zone *zone)
 						    NULL);
 			LDNS_FREE(zone->names);
 		}
+		ldns_rrsig_templates_free(zone->_rrsig_templates);
 		LDNS_FREE(zone);
 	}
 }
 
+ldns_status
+ldns_dnssec_zone_compact_rrsigs(ldns_dnssec_zone *zone)
+{
+	ldns_rbnode_t *node;
+	ldns_dnssec_name *name;
+	ldns_dnssec_rrsets *rrsets;
+	ldns_rdf *owner;
+	bool owned;
+	ldns_status s = LDNS_STATUS_OK;
+
+	if (!zone || !zone->names) {
+		return LDNS_STATUS_NULL;
+	}
+	if (!zone->_rrsig_templates) {
+		zone->_rrsig_templates =
+			ldns_rbtree_create(ldns_rrsig_template_compare);
+		if (!zone->_rrsig_templates) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+	}
+	for (node = ldns_rbtree_first(zone->names);
+	     node != LDNS_RBTREE_NULL && s == LDNS_STATUS_OK;
+	     node = ldns_rbtree_next(node)) {
+		name = (ldns_dnssec_name *) node->data;
+
+		/* the name may be the owner of an RRSIG that is freed */
+		owned = ldns_dnssec_rrs_owns(name->nsec_signatures,
+				name->name);
+		for (rrsets = name->rrsets; rrsets && !owned;
+		     rrsets = rrsets->next) {
+			owned = ldns_dnssec_rrs_owns(rrsets->signatures,
+					name->name);
+		}
+		if (owned && !name->name_alloced) {
+			if (!(owner = ldns_rdf_clone(name->name))) {
+				return LDNS_STATUS_MEM_ERR;
+			}
+			if (node->key == name->name) {
+				node->key = owner;
+			}
+			name->name = owner;
+			name->name_alloced = true;
+		}
+		for (rrsets = name->rrsets; rrsets && s == LDNS_STATUS_OK;
+		     rrsets = rrsets->next) {
+			s = ldns_dnssec_rrs_compact(rrsets->signatures,
+					name->name, zone->_rrsig_templates);
+		}
+		if (s == LDNS_STATUS_OK && name->nsec) {
+			s = ldns_dnssec_rrs_compact(name->nsec_signatures,
+					ldns_rr_owner(name->nsec),
+					zone->_rrsig_templates);
+		}
+	}
+	return s;
+}
+
+ldns_status
+ldns_dnssec_zone_expand_rrsigs(ldns_dnssec_zone *zone)
+{
+	ldns_rbnode_t *node;
+	ldns_dnssec_name *name;
+	ldns_dnssec_rrsets *rrsets;
+	ldns_dnssec_rrs *rrs;
+
+	if (!zone || !zone->names) {
+		return LDNS_STATUS_NULL;
+	}
+	for (node = ldns_rbtree_first(zone->names);
+	     node != LDNS_RBTREE_NULL;
+	     node = ldns_rbtree_next(node)) {
+		name = (ldns_dnssec_name *) node->data;
+		for (rrsets = name->rrsets; rrsets; rrsets = rrsets->next) {
+			for (rrs = rrsets->signatures; rrs; rrs = rrs->next) {
+				if (rrs->_compact && !ldns_dnssec_rrs_rr(rrs)) {
+					return LDNS_STATUS_MEM_ERR;
+				}
+			}
+		}
+		for (rrs = name->nsec_signatures; rrs; rrs = rrs->next) {
+			if (rrs->_compact && !ldns_dnssec_rrs_rr(rrs)) {
+				return LDNS_STATUS_MEM_ERR;
+			}
+		}
+	}
+	/* nothing refers to the templates anymore */
+	ldns_rrsig_templates_free(zone->_rrsig_templates);
+	zone->_rrsig_templates = NULL;
+	return LDNS_STATUS_OK;
+}
+
 /* use for dname comparison in tree */
 int
 ldns_dname_compare_v(const void *a, const void *b) {
@@ -1136,7 +1771,7 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 	/* for the detection */
 	uint16_t i, cur_label_count, next_label_count;
 	uint16_t soa_label_count = 0;
-	ldns_rdf *l1, *l2;
+	ldns_dname_view cur_view, next_view, l1, l2;
 	int lpos;
 
 	if (!zone) {
@@ -1166,37 +1801,37 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 		}
 		cur_name = ((ldns_dnssec_name *)cur_node->data)->name;
 		next_name = ((ldns_dnssec_name *)next_node->data)->name;
-		cur_label_count = ldns_dname_label_count(cur_name);
-		next_label_count = ldns_dname_label_count(next_name);
+		if (ldns_dname_view_init(&cur_view, cur_name) != LDNS_STATUS_OK
+		 || ldns_dname_view_init(&next_view, next_name)
+							!= LDNS_STATUS_OK) {
+			return LDNS_STATUS_ERR;
+		}
+		cur_label_count = ldns_dname_view_label_count(&cur_view);
+		next_label_count = ldns_dname_view_label_count(&next_view);
 
 		/* Since the names are in canonical order, we can
 		 * recognize empty non-terminals by their labels;
 		 * every label after the first one on the next owner
 		 * name is a non-terminal if it either does not exist
 		 * in the current name or is different from the same
-		 * label in the current name (counting from the end)
+		 * label in the current name (counting from the end).
+		 * The labels are compared through views on the names,
+		 * so only the empty nonterminals themselves are cloned.
 		 */
 		for (i = 1; i < next_label_count - soa_label_count; i++) {
 			lpos = (int)cur_label_count - (int)next_label_count + (int)i;
-			if (lpos >= 0) {
-				l1 = ldns_dname_clone_from(cur_name, (uint8_t)lpos);
-			} else {
-				l1 = NULL;
-			}
-			l2 = ldns_dname_clone_from(next_name, i);
+			(void) ldns_dname_view_suffix(&l2, &next_view, (uint8_t)i);
 
-			if (!l1 || ldns_dname_compare(l1, l2) != 0) {
+			if (lpos < 0
+			 || !ldns_dname_view_suffix(&l1, &cur_view, (uint8_t)lpos)
+			 || ldns_dname_view_compare(&l1, &l2) != 0) {
 				/* We have an empty nonterminal, add it to the
 				 * tree
 				 */
 				ldns_rbnode_t *node = NULL;
 				ldns_rdf *ent_name;
 
-				if (!(ent_name = ldns_dname_clone_from(
-						next_name, i))) {
-					
-					ldns_rdf_deep_free(l1);
-					ldns_rdf_deep_free(l2);
+				if (!(ent_name = ldns_dname_view_clone(&l2))) {
 					return LDNS_STATUS_MEM_ERR;
 				}
 
@@ -1207,8 +1842,6 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 					    ldns_nsec3_hash_name_frm_nsec3(
 							zone->_nsec3params,
 							ent_name))) {
-						ldns_rdf_deep_free(l1);
-						ldns_rdf_deep_free(l2);
 						ldns_rdf_deep_free(ent_name);
 						return LDNS_STATUS_MEM_ERR;
 					}
@@ -1216,16 +1849,12 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 							ent_hashed_name);
 					ldns_rdf_deep_free(ent_hashed_name);
 					if (!node) {
-						ldns_rdf_deep_free(l1);
-						ldns_rdf_deep_free(l2);
 						ldns_rdf_deep_free(ent_name);
 						continue;
 					}
 				}
 				new_name = ldns_dnssec_name_new();
 				if (!new_name) {
-					ldns_rdf_deep_free(l1);
-					ldns_rdf_deep_free(l2);
 					ldns_rdf_deep_free(ent_name);
 					return LDNS_STATUS_MEM_ERR;
 				}
@@ -1233,8 +1862,6 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 				new_name->name_alloced = true;
 				new_node = LDNS_MALLOC(ldns_rbnode_t);
 				if (!new_node) {
-					ldns_rdf_deep_free(l1);
-					ldns_rdf_deep_free(l2);
 					ldns_dnssec_name_free(new_name);
 					return LDNS_STATUS_MEM_ERR;
 				}
@@ -1247,8 +1874,6 @@ ldns_dnssec_zone_add_empty_nonterminals_nsec3(
 					(void) ldns_dnssec_zone_add_rr(zone,
 							(ldns_rr *)node->data);
 			}
-			ldns_rdf_deep_free(l1);
-			ldns_rdf_deep_free(l2);
 		}
 		
 		/* we might have inserted a new node after
@@ -1315,6 +1940,8 @@ typedef struct dnssec_zone_rr_iter {
 	dnssec_zone_rr_iter_state state;
 	ldns_rdf                 *apex_name;
 	uint8_t                   apex_labs;
+	ldns_rr                  *compact_rr; /* the copy of a compact RRSIG */
+	ldns_status               status;
 } dnssec_zone_rr_iter;
 
 INLINE void
@@ -1409,9 +2036,19 @@ dnssec_zone_rr_iter_next(dnssec_zone_rr_iter *i)
 {
 	ldns_rr *nsec3;
 
+	ldns_rr_free(i->compact_rr);
+	i->compact_rr = NULL;
 	for (;;) {
 		if (i->rrs) {
 			ldns_rr *rr = i->rrs->rr;
+			if (!rr && i->rrs->_compact) {
+				rr = i->compact_rr =
+					ldns_dnssec_rrs_clone_rr(i->rrs);
+				if (!rr) {
+					i->status = LDNS_STATUS_MEM_ERR;
+					return NULL;
+				}
+			}
 			i->rrs = i->rrs->next;
 			return rr;
 		}
@@ -1772,7 +2409,8 @@ ldns_digest_zone(ldns_dnssec_zone *zone, zone_digester *zd)
 			continue;
 		st = zone_digester_update(zd, rr);
 	}
-	return st;
+	ldns_rr_free(rr_iter.compact_rr);
+	return st ? st : rr_iter.status;
 }
 
 ldns_status
@@ -1943,7 +2581,6 @@ dnssec_zone_equip_zonemd(ldns_dnssec_zone *zone,
 	ldns_rr_list *zonemd_rrsigs = NULL;
 	ldns_dnssec_rrsets *soa_rrset;
 	ldns_rr *soa_rr = NULL;
-	ldns_dnssec_rrsets **rrset_ref;
 	ldns_dnssec_rrsets *zonemd_rrset;
 
 	zone_digester_init(&zd);
@@ -1968,12 +2605,10 @@ dnssec_zone_equip_zonemd(ldns_dnssec_zone *zone,
 		return st;
 	
 	/* - replace or add ZONEMD rrset */
-	rrset_ref = &zone->soa->rrsets; /* scan rrsets at apex */
-	while (*rrset_ref && (*rrset_ref)->type < LDNS_RR_TYPE_ZONEMD)
-		rrset_ref = &(*rrset_ref)->next;
-	if (*rrset_ref && (*rrset_ref)->type == LDNS_RR_TYPE_ZONEMD) {
+	zonemd_rrset = ldns_dnssec_name_find_rrset(
+			zone->soa, LDNS_RR_TYPE_ZONEMD);
+	if (zonemd_rrset) {
 		/* reuse zonemd rrset */
-		zonemd_rrset = *rrset_ref;
 		ldns_dnssec_rrs_free(zonemd_rrset->rrs);
 		zonemd_rrset->rrs = NULL;
 		ldns_dnssec_rrs_free(zonemd_rrset->signatures);
@@ -1986,8 +2621,12 @@ dnssec_zone_equip_zonemd(ldns_dnssec_zone *zone,
 			return LDNS_STATUS_MEM_ERR;
 		}
 		zonemd_rrset->type = LDNS_RR_TYPE_ZONEMD;
-		zonemd_rrset->next = *rrset_ref;
-		*rrset_ref = zonemd_rrset;
+		if ((st = ldns_dnssec_name_insert_rrset(
+						zone->soa, zonemd_rrset))) {
+			LDNS_FREE(zonemd_rrset);
+			ldns_rr_list_deep_free(zonemd_rr_list);
+			return st;
+		}
 	}
 	if ((zonemd_rrsigs = ldns_sign_public(zonemd_rr_list, key_list)))
 		st = rr_list2dnssec_rrs(  zonemd_rrsigs
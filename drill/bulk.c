@@ -0,0 +1,566 @@
+/*
+ * bulk.c
+ * query a list of names, with a number of queries outstanding at once
+ *
+ * See the file LICENSE for the license
+ *
+ */
+
+#include "drill.h"
+#include <ldns/ldns.h>
+
+#include <sys/time.h>
+#include <errno.h>
+
+/* one outstanding (or finished, but not printed) query */
+struct bulk_query {
+	bool		used;
+	bool		done;
+	size_t		seq;
+	size_t		line;
+	ldns_rdf	*qname;
+	ldns_rr_type	type;
+	ldns_rr_class	clas;
+	ldns_buffer	*qbin;
+	uint16_t	id;
+	ldns_rdf	*tsig_mac;
+	int		sockfd;
+	size_t		ns;
+	int		tries;
+	struct timeval	first_sent;
+	struct timeval	retry_at;
+	ldns_pkt	*answer;
+	ldns_status	status;
+	long		usec;
+};
+
+struct bulk {
+	ldns_resolver	*res;
+	FILE		*in;
+	size_t		line;
+	bool		eof;
+	ldns_rr_type	type;
+	ldns_rr_class	clas;
+	uint16_t	qflags;
+	ldns_rr_list	*keys;
+	const ldns_output_format *fmt;
+	bool		ordered;
+
+	struct sockaddr_storage **ns;
+	socklen_t	*ns_len;
+	size_t		ns_count;
+
+	struct bulk_query *q;
+	size_t		max;
+	size_t		inflight;
+	size_t		next_seq;
+	size_t		next_print;
+
+	/* statistics */
+	size_t		answered;
+	size_t		failed;
+	size_t		retries;
+	long		*lat;
+	size_t		lat_count;
+	size_t		lat_alloc;
+};
+
+static long
+tv_usec_diff(const struct timeval *a, const struct timeval *b)
+{
+	return (long)(a->tv_sec - b->tv_sec) * 1000000L
+		+ (long)(a->tv_usec - b->tv_usec);
+}
+
+static void
+tv_add_sec(struct timeval *tv, const struct timeval *now, int sec)
+{
+	tv->tv_sec = now->tv_sec + sec;
+	tv->tv_usec = now->tv_usec;
+}
+
+static void
+bulk_query_clear(struct bulk_query *q)
+{
+	if (q->sockfd != -1) {
+		close_socket(q->sockfd);
+	}
+	ldns_rdf_deep_free(q->qname);
+	ldns_buffer_free(q->qbin);
+	ldns_rdf_deep_free(q->tsig_mac);
+	ldns_pkt_free(q->answer);
+	memset(q, 0, sizeof(*q));
+	q->sockfd = -1;
+}
+
+/* the addresses of the nameservers that may be used */
+static void
+bulk_nameservers(struct bulk *b)
+{
+	ldns_rdf **ns = ldns_resolver_nameservers(b->res);
+	size_t i, len;
+
+	b->ns = xmalloc(sizeof(*b->ns) * ldns_resolver_nameserver_count(b->res));
+	b->ns_len = xmalloc(sizeof(*b->ns_len) *
+			ldns_resolver_nameserver_count(b->res));
+	b->ns_count = 0;
+	for (i = 0; i < ldns_resolver_nameserver_count(b->res); i++) {
+		if ((ldns_rdf_get_type(ns[i]) == LDNS_RDF_TYPE_A &&
+		     ldns_resolver_ip6(b->res) == LDNS_RESOLV_INET6) ||
+		    (ldns_rdf_get_type(ns[i]) == LDNS_RDF_TYPE_AAAA &&
+		     ldns_resolver_ip6(b->res) == LDNS_RESOLV_INET)) {
+			continue;
+		}
+		b->ns[b->ns_count] = ldns_rdf2native_sockaddr_storage(ns[i],
+				ldns_resolver_port(b->res), &len);
+		if (b->ns[b->ns_count]) {
+			b->ns_len[b->ns_count++] = (socklen_t)len;
+		}
+	}
+}
+
+/* build the query for the next line of input; false at the end */
+static bool
+bulk_read(struct bulk *b, struct bulk_query *q)
+{
+	char line[LDNS_MAX_LINELEN];
+	char *name, *arg;
+	ldns_rr_type type;
+	ldns_rr_class clas;
+	ldns_pkt *qpkt;
+	ldns_status status;
+
+	while (fgets(line, (int)sizeof(line), b->in)) {
+		b->line++;
+		name = strtok(line, " \t\r\n");
+		if (!name || *name == ';' || *name == '#') {
+			continue;
+		}
+		type = b->type;
+		clas = b->clas;
+		while ((arg = strtok(NULL, " \t\r\n"))) {
+			if (ldns_get_rr_type_by_name(arg)) {
+				type = ldns_get_rr_type_by_name(arg);
+			} else if (ldns_get_rr_class_by_name(arg)) {
+				clas = ldns_get_rr_class_by_name(arg);
+			} else {
+				break;
+			}
+		}
+		if (arg) {
+			warning("line %u: unknown type or class %s",
+					(unsigned)b->line, arg);
+			continue;
+		}
+		if (type == LDNS_RR_TYPE_AXFR || type == LDNS_RR_TYPE_IXFR) {
+			warning("line %u: zone transfers are not done in bulk",
+					(unsigned)b->line);
+			continue;
+		}
+		q->qname = ldns_dname_new_frm_str(name);
+		if (!q->qname) {
+			warning("line %u: cannot parse name %s",
+					(unsigned)b->line, name);
+			continue;
+		}
+		status = ldns_resolver_prepare_query_pkt(&qpkt, b->res,
+				q->qname, type, clas, b->qflags);
+		if (status != LDNS_STATUS_OK) {
+			error("making query: %s",
+					ldns_get_errorstr_by_id(status));
+		}
+#ifdef HAVE_SSL
+		if (ldns_resolver_tsig_keyname(b->res) &&
+		    ldns_resolver_tsig_keydata(b->res)) {
+			status = ldns_pkt_tsig_sign(qpkt,
+					ldns_resolver_tsig_keyname(b->res),
+					ldns_resolver_tsig_keydata(b->res), 300,
+					ldns_resolver_tsig_algorithm(b->res),
+					NULL);
+			if (status != LDNS_STATUS_OK) {
+				error("signing query: %s",
+					ldns_get_errorstr_by_id(status));
+			}
+			q->tsig_mac = ldns_rdf_clone(
+					ldns_rr_rdf(ldns_pkt_tsig(qpkt), 3));
+		}
+#endif /* HAVE_SSL */
+		q->qbin = ldns_buffer_new(LDNS_MIN_BUFLEN);
+		if (!q->qbin ||
+		    ldns_pkt2buffer_wire(q->qbin, qpkt) != LDNS_STATUS_OK) {
+			error("%s", "converting query to wire format");
+		}
+		q->id = ldns_pkt_id(qpkt);
+		ldns_pkt_free(qpkt);
+
+		q->used = true;
+		q->seq = b->next_seq++;
+		q->line = b->line;
+		q->type = type;
+		q->clas = clas;
+		q->status = LDNS_STATUS_OK;
+		q->ns = ldns_resolver_random(b->res) && b->ns_count > 1 ?
+			(size_t)ldns_get_random() % b->ns_count : 0;
+		return true;
+	}
+	b->eof = true;
+	return false;
+}
+
+static void
+bulk_finish(struct bulk *b, struct bulk_query *q, ldns_status status,
+		const struct timeval *now)
+{
+	if (q->sockfd != -1) {
+		close_socket(q->sockfd);
+	}
+	q->status = status;
+	q->done = true;
+	b->inflight--;
+	if (status != LDNS_STATUS_OK) {
+		b->failed++;
+		return;
+	}
+	b->answered++;
+	q->usec = tv_usec_diff(now, &q->first_sent);
+	if (b->lat_count == b->lat_alloc) {
+		b->lat_alloc = b->lat_alloc ? b->lat_alloc * 2 : 1024;
+		b->lat = xrealloc(b->lat, sizeof(*b->lat) * b->lat_alloc);
+	}
+	b->lat[b->lat_count++] = q->usec;
+}
+
+/* send (again) to the next server; finishes the query when out of tries */
+static void
+bulk_send(struct bulk *b, struct bulk_query *q, const struct timeval *now)
+{
+	struct timeval timeout = ldns_resolver_timeout(b->res);
+
+	while (q->tries <= (int)ldns_resolver_retry(b->res)) {
+		if (q->tries > 0) {
+			q->ns = (q->ns + 1) % b->ns_count;
+			b->retries++;
+		} else {
+			q->first_sent = *now;
+		}
+		q->tries++;
+		if (ldns_resolver_usevc(b->res)) {
+			q->sockfd = ldns_tcp_bgsend2(q->qbin, b->ns[q->ns],
+					b->ns_len[q->ns], timeout);
+		} else {
+			q->sockfd = ldns_udp_bgsend2(q->qbin, b->ns[q->ns],
+					b->ns_len[q->ns], timeout);
+		}
+		if (q->sockfd != -1) {
+			tv_add_sec(&q->retry_at, now,
+					ldns_resolver_retrans(b->res));
+			return;
+		}
+	}
+	bulk_finish(b, q, LDNS_STATUS_NETWORK_ERR, now);
+}
+
+/* read the answer on the socket of q, if it is one */
+static void
+bulk_receive(struct bulk *b, struct bulk_query *q, const struct timeval *now)
+{
+	uint8_t *wire;
+	size_t size = 0;
+	ldns_pkt *pkt = NULL;
+	ldns_status status;
+	bool usevc;
+
+	if (ldns_resolver_usevc(b->res)) {
+		wire = ldns_tcp_read_wire_timeout(q->sockfd, &size,
+				ldns_resolver_timeout(b->res));
+		if (!wire) {
+			/* the connection broke, try the next server */
+			close_socket(q->sockfd);
+			bulk_send(b, q, now);
+			return;
+		}
+	} else {
+		wire = ldns_udp_read_wire(q->sockfd, &size, NULL, NULL);
+		if (!wire) {
+			return;
+		}
+	}
+	/* not for us; keep waiting */
+	if (size < LDNS_HEADER_SIZE || ldns_read_uint16(wire) != q->id) {
+		LDNS_FREE(wire);
+		return;
+	}
+	status = ldns_wire2pkt(&pkt, wire, size);
+#ifdef HAVE_SSL
+	if (status == LDNS_STATUS_OK && q->tsig_mac &&
+	    !ldns_pkt_tsig_verify(pkt, wire, size,
+			    ldns_resolver_tsig_keyname(b->res),
+			    ldns_resolver_tsig_keydata(b->res), q->tsig_mac)) {
+		status = LDNS_STATUS_CRYPTO_TSIG_BOGUS;
+	}
+#endif /* HAVE_SSL */
+	LDNS_FREE(wire);
+
+	/* a truncated answer is asked again over tcp, and waited for */
+	if (status == LDNS_STATUS_OK && ldns_pkt_tc(pkt) &&
+	    !ldns_resolver_usevc(b->res) && !ldns_resolver_igntc(b->res) &&
+	    ldns_resolver_fallback(b->res)) {
+		ldns_pkt_free(pkt);
+		pkt = NULL;
+		usevc = ldns_resolver_usevc(b->res);
+		ldns_resolver_set_usevc(b->res, true);
+		status = ldns_send_buffer(&pkt, b->res, q->qbin, q->tsig_mac);
+		ldns_resolver_set_usevc(b->res, usevc);
+	}
+	q->answer = pkt;
+	bulk_finish(b, q, status, now);
+}
+
+/* a short account of the validation of the answer, NULL when not done */
+static const char *
+bulk_validate(struct bulk *b, struct bulk_query *q)
+{
+#ifdef HAVE_SSL
+	ldns_rr_list *verified;
+	ldns_status status;
+
+	if (ldns_rr_list_rr_count(b->keys) == 0 ||
+	    q->type == LDNS_RR_TYPE_ANY) {
+		return NULL;
+	}
+	verified = ldns_rr_list_new();
+	status = ldns_pkt_verify(q->answer, q->type, q->qname, b->keys,
+			NULL, verified);
+	ldns_rr_list_free(verified);
+	if (status == LDNS_STATUS_ERR) {
+		if (ldns_verify_denial(q->answer, q->qname, q->type,
+					NULL, NULL) == LDNS_STATUS_OK) {
+			return "existence denied";
+		}
+		return "bogus";
+	} else if (status == LDNS_STATUS_OK) {
+		return "validated";
+	}
+	return ldns_get_errorstr_by_id(status);
+#else
+	(void)b;
+	(void)q;
+	return NULL;
+#endif /* HAVE_SSL */
+}
+
+static void
+bulk_print(struct bulk *b, struct bulk_query *q)
+{
+	char *name = ldns_rdf2str(q->qname);
+	char *type = ldns_rr_type2str(q->type);
+	char *clas = ldns_rr_class2str(q->clas);
+	char *rcode;
+	const char *valid;
+
+	if (q->status != LDNS_STATUS_OK) {
+		fprintf(verbosity == -1 ? stderr : stdout,
+				";; %s %s %s: %s\n", name, clas, type,
+				ldns_get_errorstr_by_id(q->status));
+	} else if (verbosity == -1) {
+		ldns_rr_list_print_fmt(stdout, b->fmt,
+				ldns_pkt_answer(q->answer));
+	} else if (verbosity >= 3) {
+		ldns_pkt_print_fmt(stdout, b->fmt, q->answer);
+	} else {
+		rcode = ldns_pkt_rcode2str(ldns_pkt_get_rcode(q->answer));
+		valid = bulk_validate(b, q);
+		printf(";; %s %s %s: %s, %u answers, %ld.%03ld ms%s%s\n",
+				name, clas, type, rcode,
+				(unsigned)ldns_pkt_ancount(q->answer),
+				q->usec / 1000, q->usec % 1000,
+				valid ? ", " : "", valid ? valid : "");
+		ldns_rr_list_print_fmt(stdout, b->fmt,
+				ldns_pkt_answer(q->answer));
+		LDNS_FREE(rcode);
+	}
+	LDNS_FREE(name);
+	LDNS_FREE(type);
+	LDNS_FREE(clas);
+	bulk_query_clear(q);
+}
+
+/* print what is finished, in input order when asked for */
+static void
+bulk_print_done(struct bulk *b)
+{
+	size_t i;
+	bool found = true;
+
+	while (found) {
+		found = false;
+		for (i = 0; i < b->max; i++) {
+			if (!b->q[i].used || !b->q[i].done) {
+				continue;
+			}
+			if (!b->ordered || b->q[i].seq == b->next_print) {
+				bulk_print(b, &b->q[i]);
+				b->next_print++;
+				found = b->ordered;
+			}
+		}
+	}
+	fflush(stdout);
+}
+
+static int
+cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+bulk_summary(struct bulk *b, const struct timeval *start,
+		const struct timeval *end)
+{
+	long total = tv_usec_diff(end, start), sum = 0;
+	size_t i;
+
+	fprintf(stderr, ";; %u queries in %ld.%03ld s, %.0f queries/s\n",
+			(unsigned)(b->answered + b->failed),
+			total / 1000000, (total % 1000000) / 1000,
+			total > 0 ? (b->answered + b->failed) * 1e6 / total : 0.0);
+	fprintf(stderr, ";; %u answered, %u failed, %u retries\n",
+			(unsigned)b->answered, (unsigned)b->failed,
+			(unsigned)b->retries);
+	if (b->lat_count == 0) {
+		return;
+	}
+	qsort(b->lat, b->lat_count, sizeof(*b->lat), cmp_long);
+	for (i = 0; i < b->lat_count; i++) {
+		sum += b->lat[i];
+	}
+	fprintf(stderr, ";; latency in ms: min %.3f avg %.3f median %.3f "
+			"p95 %.3f p99 %.3f max %.3f\n",
+			b->lat[0] / 1000.0,
+			(double)sum / b->lat_count / 1000.0,
+			b->lat[b->lat_count / 2] / 1000.0,
+			b->lat[b->lat_count * 95 / 100] / 1000.0,
+			b->lat[b->lat_count * 99 / 100] / 1000.0,
+			b->lat[b->lat_count - 1] / 1000.0);
+}
+
+int
+do_bulk(ldns_resolver *res, const char *filename, size_t inflight,
+		bool ordered, ldns_rr_type type, ldns_rr_class clas,
+		uint16_t qflags, ldns_rr_list *keys,
+		const ldns_output_format *fmt)
+{
+	struct bulk b;
+	struct bulk_query *q;
+	struct timeval start, now, wait;
+	fd_set fds;
+	int maxfd, ret;
+	long w;
+	size_t i;
+
+	memset(&b, 0, sizeof(b));
+	b.res = res;
+	b.type = type;
+	b.clas = clas;
+	b.qflags = qflags;
+	b.keys = keys;
+	b.fmt = fmt;
+	b.ordered = ordered;
+
+	if (strcmp(filename, "-") == 0) {
+		b.in = stdin;
+	} else if (!(b.in = fopen(filename, "r"))) {
+		warning("Unable to open %s: %s", filename, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	bulk_nameservers(&b);
+	if (b.ns_count == 0) {
+		warning("%s", "No usable nameserver");
+		return EXIT_FAILURE;
+	}
+	/* every query has its own socket */
+	b.max = inflight;
+	if (b.max < 1) {
+		b.max = 1;
+	} else if (b.max > FD_SETSIZE - 16) {
+		b.max = FD_SETSIZE - 16;
+	}
+	b.q = xmalloc(sizeof(*b.q) * b.max);
+	memset(b.q, 0, sizeof(*b.q) * b.max);
+	for (i = 0; i < b.max; i++) {
+		b.q[i].sockfd = -1;
+	}
+
+	gettimeofday(&start, NULL);
+	while (!b.eof || b.next_print < b.next_seq) {
+		gettimeofday(&now, NULL);
+		for (i = 0; i < b.max && !b.eof; i++) {
+			q = &b.q[i];
+			if (!q->used && bulk_read(&b, q)) {
+				b.inflight++;
+				bulk_send(&b, q, &now);
+			}
+		}
+		bulk_print_done(&b);
+		if (b.inflight == 0) {
+			continue;
+		}
+
+		/* wait for an answer, or the first retransmit */
+		FD_ZERO(&fds);
+		maxfd = -1;
+		w = ldns_resolver_retrans(res) * 1000000L;
+		for (i = 0; i < b.max; i++) {
+			q = &b.q[i];
+			if (!q->used || q->done) {
+				continue;
+			}
+			FD_SET(FD_SET_T q->sockfd, &fds);
+			if (q->sockfd > maxfd) {
+				maxfd = q->sockfd;
+			}
+			if (tv_usec_diff(&q->retry_at, &now) < w) {
+				w = tv_usec_diff(&q->retry_at, &now);
+			}
+		}
+		if (w < 0) {
+			w = 0;
+		}
+		wait.tv_sec = w / 1000000L;
+		wait.tv_usec = w % 1000000L;
+		ret = select(maxfd + 1, &fds, NULL, NULL, &wait);
+		if (ret == -1 && errno != EINTR) {
+			error("select: %s", strerror(errno));
+		}
+
+		gettimeofday(&now, NULL);
+		for (i = 0; i < b.max; i++) {
+			q = &b.q[i];
+			if (!q->used || q->done) {
+				continue;
+			}
+			if (ret > 0 && FD_ISSET(q->sockfd, &fds)) {
+				bulk_receive(&b, q, &now);
+			} else if (tv_usec_diff(&now, &q->retry_at) >= 0) {
+				close_socket(q->sockfd);
+				bulk_send(&b, q, &now);
+			}
+		}
+	}
+	gettimeofday(&now, NULL);
+	bulk_summary(&b, &start, &now);
+
+	for (i = 0; i < b.ns_count; i++) {
+		LDNS_FREE(b.ns[i]);
+	}
+	xfree(b.ns);
+	xfree(b.ns_len);
+	xfree(b.q);
+	xfree(b.lat);
+	if (b.in != stdin) {
+		fclose(b.in);
+	}
+	return b.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -48,6 +48,8 @@ usage(FILE *stream, const char *progname)
 	fprintf(stream, "\t-V <number>\tverbosity (0-5)\n");
 	fprintf(stream, "\t-Q\t\tquiet mode (overrules -V)\n");
 	fprintf(stream, "\n");
+	fprintf(stream, "\t-B file\t\tquery the \"name [type] [class]\" lines in file\n"
+			"\t\t\t(- for stdin), with several queries in flight\n");
 	fprintf(stream, "\t-f file\t\tread packet from file and send it\n");
 	fprintf(stream, "\t-i file\t\tread packet from file and print it\n");
 	fprintf(stream, "\t-w file\t\twrite answer packet to file\n");
@@ -59,6 +61,8 @@ usage(FILE *stream, const char *progname)
 	fprintf(stream, "\t-6\t\tstay on ip6\n");
 	fprintf(stream, "\t-a\t\tfallback to EDNS0 and TCP if the answer is truncated\n");
 	fprintf(stream, "\t-b <bufsize>\tuse <bufsize> as the buffer size (defaults to 512 b)\n");
+	fprintf(stream, "\t-j <number>\twith -B, the number of queries in flight (default 16)\n");
+	fprintf(stream, "\t-U\t\twith -B, print answers as they come in, not in input order\n");
 	fprintf(stream, "\t-c <file>\tuse file for recursive nameserver configuration"
 			"\n\t\t\t(/etc/resolv.conf)\n");
 	fprintf(stream, "\t-k <file>\tspecify a file that contains a trusted DNSSEC key [**]\n");
@@ -120,6 +124,9 @@ main(int argc, char *argv[])
 	char		*progname;
 	char 		*query_file = NULL;
 	char		*answer_file = NULL;
+	char		*bulk_file = NULL;
+	size_t		bulk_inflight = 16;
+	bool		bulk_ordered = true;
 	ldns_buffer	*query_buffer = NULL;
 	ldns_rdf 	*serv_rdf;
 	ldns_rdf 	*src_rdf = NULL;
@@ -211,7 +218,7 @@ main(int argc, char *argv[])
 	/* global first, query opt next, option with parm's last
 	 * and sorted */ /*  "46DITSVQf:i:w:q:achuvxzy:so:p:b:k:" */
 	                               
-	while ((c = getopt(argc, argv, "46ab:c:d:Df:hi:I:k:o:p:q:Qr:sStTuvV:w:xy:z")) != -1) {
+	while ((c = getopt(argc, argv, "46ab:B:c:d:Df:hi:I:j:k:o:p:q:Qr:sStTuUvV:w:xy:z")) != -1) {
 		switch(c) {
 			/* global options */
 			case '4':
@@ -256,6 +263,10 @@ main(int argc, char *argv[])
 			case 'f':
 				query_file = optarg;
 				break;
+			case 'B':
+				bulk_file = optarg;
+				PURPOSE = DRILL_BULK;
+				break;
 			case 'i':
 				answer_file = optarg;
 				PURPOSE = DRILL_AFROMFILE;
@@ -291,6 +302,12 @@ main(int argc, char *argv[])
 			case 'c':
 				resolv_conf_file = optarg;
 				break;
+			case 'j':
+				bulk_inflight = (size_t)atoi(optarg);
+				if (bulk_inflight == 0) {
+					error("%s", "<number> could not be converted");
+				}
+				break;
 			case 't':
 				qusevc = true;
 				break;
@@ -359,6 +376,9 @@ main(int argc, char *argv[])
 			case 'u':
 				qusevc = false;
 				break;
+			case 'U':
+				bulk_ordered = false;
+				break;
 			case 'v':
 				version(stdout, progname);
 				result = EXIT_SUCCESS;
@@ -512,7 +532,7 @@ main(int argc, char *argv[])
 		name = argv[i];
 	}
 	/* act like dig and use for . NS */
-	if (!name) {
+	if (!name && PURPOSE != DRILL_BULK) {
 		name = ".";
 		int_type = 0;
 		type = LDNS_RR_TYPE_NS;
@@ -529,6 +549,10 @@ main(int argc, char *argv[])
 			type = LDNS_RR_TYPE_PTR;
 		}
 	}
+	if (PURPOSE == DRILL_BULK && (src || drill_reverse)) {
+		fprintf(stderr, "-I and -x cannot be used with -B.\n");
+		exit(EXIT_FAILURE);
+	}
 	if (!drill_reverse)
 		; /* pass */
 	else if (strchr(name, ':')) { /* ipv4 or ipv6 addr? */
@@ -679,6 +703,7 @@ main(int argc, char *argv[])
 
 	if (!name && 
 	    PURPOSE != DRILL_AFROMFILE &&
+	    PURPOSE != DRILL_BULK &&
 	    !query_file
 	   ) {
 		usage(stdout, progname);
@@ -830,6 +855,11 @@ main(int argc, char *argv[])
 			break;
 		case DRILL_NSEC:
 			break;
+		case DRILL_BULK:
+			result = do_bulk(res, bulk_file, bulk_inflight,
+					bulk_ordered, type, clas, qflags,
+					key_list, fmt);
+			break;
 		case DRILL_QUERY:
 		default:
 			if (query_file) {
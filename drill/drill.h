@@ -22,6 +22,7 @@
 #define DRILL_QTOFILE 	4
 #define DRILL_NSEC	5
 #define DRILL_SECTRACE 	7
+#define DRILL_BULK	8
 
 #define DRILL_ON(VAR, BIT) \
 (VAR) = (VAR) | (BIT)
@@ -50,6 +51,16 @@ int do_secure_trace(ldns_resolver *res,
 				ldns_rr_list *trusted_keys,
 				ldns_rdf *start_name);
 
+int do_bulk(ldns_resolver *res,
+				const char *filename,
+				size_t inflight,
+				bool ordered,
+				ldns_rr_type type,
+				ldns_rr_class c,
+				uint16_t qflags,
+				ldns_rr_list *trusted_keys,
+				const ldns_output_format *fmt);
+
 ldns_rr_list *	get_rr(ldns_resolver *res,
 				  ldns_rdf *zname,
 				  ldns_rr_type t,
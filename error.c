@@ -191,6 +191,10 @@ ldns_lookup_table ldns_error_str[] = {
 		"at least 2 bytes of option data" },
 	{ LDNS_STATUS_EQUAL_RR,
 		"An identical RR already existed in the zone" },
+	{ LDNS_STATUS_ZONE_NOT_SORTED,
+		"The RRs of the zone are not in canonical order" },
+	{ LDNS_STATUS_ZONE_NO_SOA,
+		"The zone has no SOA RR" },
 	{ 0, NULL }
 };
 
@@ -0,0 +1,27 @@
+/*
+ * filter_key.h - the key of an RRSIG in a withdrawn-signature filter
+ *
+ * Shared by ldns-gen-filter-rr, which adds the keys to the filter, and
+ * ldns-filter-check, which looks them up, so both make the same key.
+ */
+
+#ifndef _FILTER_KEY_H
+#define _FILTER_KEY_H
+
+#include <ldns/ldns.h>
+
+/*
+ * The canonical wire format of the RRSIG, with the TTL set to its
+ * original TTL, so that a copy from a cache, with a lower TTL or in
+ * another case, has the key of the signature in the zone. The rrsig is
+ * changed to that form. The wire format is allocated in *wire.
+ */
+static inline ldns_status filter_key(ldns_rr* rrsig, uint8_t** wire,
+                                     size_t* size)
+{
+  ldns_rr2canonical(rrsig);
+  ldns_rr_set_ttl(rrsig, ldns_rdf2native_int32(ldns_rr_rrsig_origttl(rrsig)));
+  return ldns_rr2wire(wire, rrsig, LDNS_SECTION_ANSWER, size);
+}
+
+#endif /* _FILTER_KEY_H */
@@ -0,0 +1,1162 @@
+/*
+ * ldns-axfr-zone transfers a zone with AXFR and writes it to a file in
+ * canonical order, without holding the zone in memory.
+ *
+ * The main thread only reads the messages from the TCP connection and
+ * hands them in batches to a number of worker threads. The workers
+ * decode the rrs, encode them in canonical wire format and collect them
+ * in runs, which are sorted and spilled to temporary files when full.
+ * At the end the runs are merged into the zone file. While merging the
+ * ZONEMD digest of the zone is computed, and a sample of the signatures
+ * is verified against the DNSKEYs at the apex.
+ */
+
+#include "config.h"
+
+#include <ldns/ldns.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define AXFR_BATCH_SIZE (256 * 1024)
+#define AXFR_MAX_WORKERS 64
+#define AXFR_KEY_MAX 768
+
+#define ZONEMD_SCHEME_SIMPLE 1
+#define ZONEMD_HASH_SHA384 1
+#define ZONEMD_HASH_SHA512 2
+
+/* messages read from the connection, each preceded by its length */
+typedef struct axfr_batch
+{
+  uint8_t* data;
+  size_t len;
+} axfr_batch_t;
+
+typedef struct axfr_queue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  axfr_batch_t** batches;
+  size_t cap;
+  size_t head;
+  size_t count;
+  bool closed;
+  /* set by a worker that cannot decode a message */
+  bool failed;
+} axfr_queue_t;
+
+/*
+ * A record in a run: this header, the sort key and the rr in canonical
+ * wire format. The key is the owner name with the labels reversed, so
+ * that a memcmp of two keys gives the canonical order of the names.
+ */
+typedef struct rec_hdr
+{
+  uint32_t wire_len;
+  uint16_t key_len;
+  uint16_t owner_len;
+} rec_hdr_t;
+
+typedef struct axfr_runs
+{
+  pthread_mutex_t lock;
+  FILE** files;
+  size_t count;
+  size_t cap;
+} axfr_runs_t;
+
+typedef struct axfr
+{
+  axfr_queue_t queue;
+  axfr_runs_t runs;
+  size_t run_size;
+  const char* tmpdir;
+} axfr_t;
+
+typedef struct axfr_worker
+{
+  pthread_t thread;
+  axfr_t* x;
+  uint8_t* arena;
+  size_t len;
+  size_t cap;
+  size_t* recs;
+  size_t nrecs;
+  size_t recs_cap;
+  ldns_buffer* buf;
+  unsigned long long rrs;
+  ldns_status status;
+} axfr_worker_t;
+
+typedef struct run_reader
+{
+  FILE* fp;
+  uint8_t* rec;
+  size_t cap;
+} run_reader_t;
+
+/* the records of one owner name, while merging */
+typedef struct merge_group
+{
+  uint8_t* arena;
+  size_t len;
+  size_t cap;
+  size_t* recs;
+  size_t nrecs;
+  size_t recs_cap;
+} merge_group_t;
+
+typedef struct merge
+{
+  FILE* out;
+  merge_group_t group;
+  bool apex_done;
+  bool have_soa;
+  uint32_t soa_serial;
+  ldns_rr_list* zonemds;
+  ldns_rr_list* dnskeys;
+  bool digest_sha384;
+  bool digest_sha512;
+  ldns_sha384_CTX sha384;
+  ldns_sha512_CTX sha512;
+  unsigned long spot_every;
+  unsigned long sigs;
+  unsigned long spot_checked;
+  unsigned long spot_failed;
+  time_t now;
+  unsigned long long records;
+  unsigned long long duplicates;
+  ldns_status status;
+} merge_t;
+
+static void
+usage(FILE* fp, const char* prog)
+{
+  fprintf(fp, "%s [options] <server> <zone> <file>\n", prog);
+  fprintf(fp, "  transfer <zone> from <server> and write it sorted to <file>\n");
+  fprintf(fp, "  -p <port>\tport of the server (default 53)\n");
+  fprintf(fp, "  -w <num>\tnumber of worker threads (default 2)\n");
+  fprintf(fp, "  -m <MB>\tsize of a sorted run per worker (default 32)\n");
+  fprintf(fp, "  -T <dir>\tdirectory for the sorted runs (default tmpfile())\n");
+  fprintf(fp, "  -y <name:key[:algo]>\tTSIG key for the transfer\n");
+  fprintf(fp, "  -Z\t\trequire a valid ZONEMD at the apex\n");
+  fprintf(fp, "  -s <num>\tverify every <num>th signature (default 0, none)\n");
+  fprintf(fp, "  -v\t\tprint statistics and timings\n");
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static bool
+queue_init(axfr_queue_t* q, size_t cap)
+{
+  memset(q, 0, sizeof(*q));
+  q->batches = LDNS_XMALLOC(axfr_batch_t*, cap);
+  if (!q->batches) {
+    return false;
+  }
+  q->cap = cap;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  return true;
+}
+
+static void
+queue_free(axfr_queue_t* q)
+{
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+  LDNS_FREE(q->batches);
+}
+
+/* false when a worker failed, the batch is then freed */
+static bool
+queue_push(axfr_queue_t* q, axfr_batch_t* b)
+{
+  bool failed;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == q->cap && !q->failed) {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  failed = q->failed;
+  if (!failed) {
+    q->batches[(q->head + q->count) % q->cap] = b;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+  }
+  pthread_mutex_unlock(&q->lock);
+  if (failed) {
+    LDNS_FREE(b->data);
+    LDNS_FREE(b);
+  }
+  return !failed;
+}
+
+/* NULL when the queue is closed and empty */
+static axfr_batch_t*
+queue_pop(axfr_queue_t* q)
+{
+  axfr_batch_t* b = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  if (q->count > 0) {
+    b = q->batches[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return b;
+}
+
+static void
+queue_close(axfr_queue_t* q, bool failed)
+{
+  pthread_mutex_lock(&q->lock);
+  q->closed = true;
+  q->failed = q->failed || failed;
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_cond_broadcast(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * The sort key of a canonical owner name: the labels from the root
+ * down, each followed by a 0 byte. Bytes 0 and 1 in a label are escaped
+ * as 1 1 and 1 2, so that a shorter label sorts before a longer one.
+ */
+static size_t
+owner_key(const uint8_t* owner, size_t owner_len, uint8_t* key)
+{
+  size_t labels[128];
+  size_t nlabels = 0;
+  size_t pos = 0;
+  size_t len = 0;
+  size_t i;
+
+  while (pos < owner_len && owner[pos] != 0 && nlabels < 128) {
+    labels[nlabels++] = pos;
+    pos += 1 + (size_t)owner[pos];
+  }
+  while (nlabels > 0) {
+    const uint8_t* label = owner + labels[--nlabels];
+    for (i = 1; i <= label[0]; i++) {
+      if (label[i] <= 1) {
+        key[len++] = 1;
+        key[len++] = label[i] + 1;
+      } else {
+        key[len++] = label[i];
+      }
+    }
+    key[len++] = 0;
+  }
+  return len;
+}
+
+static int
+rec_compare(const uint8_t* a, const uint8_t* b)
+{
+  rec_hdr_t ha, hb;
+  const uint8_t *wa, *wb;
+  size_t la, lb;
+  uint16_t ta, tb;
+  int c;
+
+  memcpy(&ha, a, sizeof(ha));
+  memcpy(&hb, b, sizeof(hb));
+  a += sizeof(ha);
+  b += sizeof(hb);
+  c = memcmp(a, b, ha.key_len < hb.key_len ? ha.key_len : hb.key_len);
+  if (c != 0) {
+    return c;
+  }
+  if (ha.key_len != hb.key_len) {
+    return ha.key_len < hb.key_len ? -1 : 1;
+  }
+  wa = a + ha.key_len + ha.owner_len;
+  wb = b + hb.key_len + hb.owner_len;
+  ta = ldns_read_uint16(wa);
+  tb = ldns_read_uint16(wb);
+  if (ta != tb) {
+    return ta < tb ? -1 : 1;
+  }
+  la = ha.wire_len - ha.owner_len - 10;
+  lb = hb.wire_len - hb.owner_len - 10;
+  c = memcmp(wa + 10, wb + 10, la < lb ? la : lb);
+  if (c != 0) {
+    return c;
+  }
+  if (la != lb) {
+    return la < lb ? -1 : 1;
+  }
+  return 0;
+}
+
+static int
+rec_qsort_compare(const void* a, const void* b)
+{
+  return rec_compare(*(const uint8_t* const*)a, *(const uint8_t* const*)b);
+}
+
+static size_t
+rec_size(const uint8_t* rec)
+{
+  rec_hdr_t h;
+  memcpy(&h, rec, sizeof(h));
+  return sizeof(h) + h.key_len + h.wire_len;
+}
+
+static const uint8_t*
+rec_wire(const uint8_t* rec, size_t* wire_len, size_t* owner_len)
+{
+  rec_hdr_t h;
+  memcpy(&h, rec, sizeof(h));
+  *wire_len = h.wire_len;
+  *owner_len = h.owner_len;
+  return rec + sizeof(h) + h.key_len;
+}
+
+/* room for a record of size bytes in an arena, its offset goes in recs */
+static uint8_t*
+arena_alloc(uint8_t** arena, size_t* len, size_t* cap, size_t** recs,
+            size_t* nrecs, size_t* recs_cap, size_t size)
+{
+  uint8_t* rec;
+
+  if (*len + size > *cap) {
+    size_t ncap = *cap ? *cap * 2 : 65536;
+    while (ncap < *len + size) {
+      ncap *= 2;
+    }
+    *arena = LDNS_XREALLOC(*arena, uint8_t, ncap);
+    if (!*arena) {
+      return NULL;
+    }
+    *cap = ncap;
+  }
+  if (*nrecs == *recs_cap) {
+    size_t ncap = *recs_cap ? *recs_cap * 2 : 1024;
+    *recs = LDNS_XREALLOC(*recs, size_t, ncap);
+    if (!*recs) {
+      return NULL;
+    }
+    *recs_cap = ncap;
+  }
+  rec = *arena + *len;
+  (*recs)[(*nrecs)++] = *len;
+  *len += size;
+  return rec;
+}
+
+static FILE*
+run_file(const char* tmpdir)
+{
+  char path[4096];
+  FILE* fp;
+  int fd;
+
+  if (!tmpdir) {
+    return tmpfile();
+  }
+  snprintf(path, sizeof(path), "%s/ldns-axfr-zone.XXXXXX", tmpdir);
+  fd = mkstemp(path);
+  if (fd == -1) {
+    return NULL;
+  }
+  (void)unlink(path);
+  fp = fdopen(fd, "w+b");
+  if (!fp) {
+    close(fd);
+  }
+  return fp;
+}
+
+/* sort the records of the worker and write them to a new run */
+static ldns_status
+worker_spill(axfr_worker_t* w)
+{
+  axfr_runs_t* runs = &w->x->runs;
+  const uint8_t** sorted;
+  FILE* fp;
+  size_t i;
+  bool ok = true;
+
+  if (w->nrecs == 0) {
+    return LDNS_STATUS_OK;
+  }
+  sorted = LDNS_XMALLOC(const uint8_t*, w->nrecs);
+  if (!sorted) {
+    return LDNS_STATUS_MEM_ERR;
+  }
+  for (i = 0; i < w->nrecs; i++) {
+    sorted[i] = w->arena + w->recs[i];
+  }
+  qsort(sorted, w->nrecs, sizeof(*sorted), rec_qsort_compare);
+
+  fp = run_file(w->x->tmpdir);
+  if (!fp) {
+    LDNS_FREE(sorted);
+    return LDNS_STATUS_FILE_ERR;
+  }
+  for (i = 0; i < w->nrecs && ok; i++) {
+    size_t size = rec_size(sorted[i]);
+    ok = fwrite(sorted[i], 1, size, fp) == size;
+  }
+  LDNS_FREE(sorted);
+  if (!ok || fflush(fp) != 0 || fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    return LDNS_STATUS_FILE_ERR;
+  }
+  w->len = 0;
+  w->nrecs = 0;
+
+  pthread_mutex_lock(&runs->lock);
+  if (runs->count == runs->cap) {
+    size_t ncap = runs->cap ? runs->cap * 2 : 16;
+    FILE** nfiles = LDNS_XREALLOC(runs->files, FILE*, ncap);
+    if (!nfiles) {
+      pthread_mutex_unlock(&runs->lock);
+      fclose(fp);
+      return LDNS_STATUS_MEM_ERR;
+    }
+    runs->files = nfiles;
+    runs->cap = ncap;
+  }
+  runs->files[runs->count++] = fp;
+  pthread_mutex_unlock(&runs->lock);
+  return LDNS_STATUS_OK;
+}
+
+static ldns_status
+worker_add_rr(axfr_worker_t* w, const ldns_rr* rr)
+{
+  uint8_t key[AXFR_KEY_MAX];
+  uint8_t* rec;
+  rec_hdr_t h;
+  size_t owner_len = ldns_rdf_size(ldns_rr_owner(rr));
+  size_t key_len, wire_len;
+  ldns_status s;
+
+  ldns_buffer_clear(w->buf);
+  s = ldns_rr2buffer_wire_canonical(w->buf, rr, LDNS_SECTION_ANSWER);
+  if (s != LDNS_STATUS_OK) {
+    return s;
+  }
+  wire_len = ldns_buffer_position(w->buf);
+  if (wire_len < owner_len + 10) {
+    return LDNS_STATUS_PACKET_OVERFLOW;
+  }
+  key_len = owner_key(ldns_buffer_begin(w->buf), owner_len, key);
+  rec = arena_alloc(&w->arena, &w->len, &w->cap, &w->recs, &w->nrecs,
+                    &w->recs_cap, sizeof(h) + key_len + wire_len);
+  if (!rec) {
+    return LDNS_STATUS_MEM_ERR;
+  }
+  h.wire_len = (uint32_t)wire_len;
+  h.key_len = (uint16_t)key_len;
+  h.owner_len = (uint16_t)owner_len;
+  memcpy(rec, &h, sizeof(h));
+  memcpy(rec + sizeof(h), key, key_len);
+  memcpy(rec + sizeof(h) + key_len, ldns_buffer_begin(w->buf), wire_len);
+  w->rrs++;
+
+  if (w->len >= w->x->run_size) {
+    return worker_spill(w);
+  }
+  return LDNS_STATUS_OK;
+}
+
+static ldns_status
+worker_message(axfr_worker_t* w, const uint8_t* wire, size_t size)
+{
+  size_t pos = LDNS_HEADER_SIZE;
+  uint16_t i;
+  ldns_rr* rr;
+  ldns_status s;
+
+  for (i = 0; i < LDNS_QDCOUNT(wire); i++) {
+    s = ldns_wire2rr(&rr, wire, size, &pos, LDNS_SECTION_QUESTION);
+    if (s != LDNS_STATUS_OK) {
+      return s;
+    }
+    ldns_rr_free(rr);
+  }
+  for (i = 0; i < LDNS_ANCOUNT(wire); i++) {
+    s = ldns_wire2rr(&rr, wire, size, &pos, LDNS_SECTION_ANSWER);
+    if (s != LDNS_STATUS_OK) {
+      return s;
+    }
+    s = worker_add_rr(w, rr);
+    ldns_rr_free(rr);
+    if (s != LDNS_STATUS_OK) {
+      return s;
+    }
+  }
+  return LDNS_STATUS_OK;
+}
+
+static void*
+worker_run(void* arg)
+{
+  axfr_worker_t* w = (axfr_worker_t*)arg;
+  axfr_batch_t* b;
+  size_t pos, len;
+
+  while ((b = queue_pop(&w->x->queue)) != NULL) {
+    for (pos = 0; w->status == LDNS_STATUS_OK && pos + 2 <= b->len;
+         pos += 2 + len) {
+      len = ldns_read_uint16(b->data + pos);
+      w->status = worker_message(w, b->data + pos + 2, len);
+    }
+    LDNS_FREE(b->data);
+    LDNS_FREE(b);
+    if (w->status != LDNS_STATUS_OK) {
+      queue_close(&w->x->queue, true);
+    }
+  }
+  if (w->status == LDNS_STATUS_OK) {
+    w->status = worker_spill(w);
+  }
+  return NULL;
+}
+
+static axfr_batch_t*
+batch_new(void)
+{
+  axfr_batch_t* b = LDNS_MALLOC(axfr_batch_t);
+  if (!b) {
+    return NULL;
+  }
+  b->data = LDNS_XMALLOC(uint8_t, AXFR_BATCH_SIZE);
+  if (!b->data) {
+    LDNS_FREE(b);
+    return NULL;
+  }
+  b->len = 0;
+  return b;
+}
+
+/* read the transfer and hand the messages to the workers */
+static ldns_status
+read_transfer(ldns_resolver* res, axfr_queue_t* q,
+              unsigned long long* messages, unsigned long long* bytes)
+{
+  axfr_batch_t* b = NULL;
+  const uint8_t* wire;
+  size_t size;
+
+  while ((wire = ldns_axfr_next_wire(res, &size)) != NULL) {
+    if (b && b->len + 2 + size > AXFR_BATCH_SIZE) {
+      if (!queue_push(q, b)) {
+        return LDNS_STATUS_ERR;
+      }
+      b = NULL;
+    }
+    if (!b && !(b = batch_new())) {
+      return LDNS_STATUS_MEM_ERR;
+    }
+    ldns_write_uint16(b->data + b->len, (uint16_t)size);
+    memcpy(b->data + b->len + 2, wire, size);
+    b->len += 2 + size;
+    (*messages)++;
+    *bytes += size;
+  }
+  if (b && !queue_push(q, b)) {
+    return LDNS_STATUS_ERR;
+  }
+  return ldns_axfr_complete(res) ? LDNS_STATUS_OK : LDNS_STATUS_NETWORK_ERR;
+}
+
+/* read the next record of a run, false at the end */
+static bool
+run_next(run_reader_t* r, ldns_status* status)
+{
+  rec_hdr_t h;
+  size_t n = fread(&h, 1, sizeof(h), r->fp);
+  size_t size;
+
+  if (n != sizeof(h)) {
+    if (n != 0 || ferror(r->fp)) {
+      *status = LDNS_STATUS_FILE_ERR;
+    }
+    return false;
+  }
+  size = sizeof(h) + h.key_len + h.wire_len;
+  if (size > r->cap) {
+    uint8_t* rec = LDNS_XREALLOC(r->rec, uint8_t, size);
+    if (!rec) {
+      *status = LDNS_STATUS_MEM_ERR;
+      return false;
+    }
+    r->rec = rec;
+    r->cap = size;
+  }
+  memcpy(r->rec, &h, sizeof(h));
+  if (fread(r->rec + sizeof(h), 1, size - sizeof(h), r->fp)
+      != size - sizeof(h)) {
+    *status = LDNS_STATUS_FILE_ERR;
+    return false;
+  }
+  return true;
+}
+
+static void
+heap_down(run_reader_t** heap, size_t n, size_t i)
+{
+  for (;;) {
+    size_t l = 2 * i + 1, m = i;
+    run_reader_t* t;
+    if (l < n && rec_compare(heap[l]->rec, heap[m]->rec) < 0) {
+      m = l;
+    }
+    if (l + 1 < n && rec_compare(heap[l + 1]->rec, heap[m]->rec) < 0) {
+      m = l + 1;
+    }
+    if (m == i) {
+      return;
+    }
+    t = heap[i];
+    heap[i] = heap[m];
+    heap[m] = t;
+    i = m;
+  }
+}
+
+/* the position after an uncompressed dname, or 0 */
+static size_t
+skip_dname(const uint8_t* wire, size_t size, size_t pos)
+{
+  while (pos < size && wire[pos] != 0) {
+    pos += 1 + (size_t)wire[pos];
+  }
+  return pos < size ? pos + 1 : 0;
+}
+
+/* the apex is the first owner name, it must have the SOA */
+static void
+merge_apex(merge_t* m)
+{
+  merge_group_t* g = &m->group;
+  size_t i, wire_len, owner_len, rdata, pos;
+  const uint8_t* wire;
+
+  for (i = 0; i < g->nrecs; i++) {
+    wire = rec_wire(g->arena + g->recs[i], &wire_len, &owner_len);
+    rdata = owner_len + 10;
+    switch (ldns_read_uint16(wire + owner_len)) {
+    case LDNS_RR_TYPE_SOA:
+      pos = skip_dname(wire, wire_len, rdata);
+      pos = pos ? skip_dname(wire, wire_len, pos) : 0;
+      if (pos && pos + 4 <= wire_len) {
+        m->soa_serial = ldns_read_uint32(wire + pos);
+        m->have_soa = true;
+      }
+      break;
+    case LDNS_RR_TYPE_ZONEMD:
+      if (wire_len >= rdata + 6
+          && wire[rdata + 4] == ZONEMD_SCHEME_SIMPLE) {
+        if (wire[rdata + 5] == ZONEMD_HASH_SHA384) {
+          m->digest_sha384 = true;
+        } else if (wire[rdata + 5] == ZONEMD_HASH_SHA512) {
+          m->digest_sha512 = true;
+        }
+      }
+      break;
+    }
+  }
+  if (!m->have_soa) {
+    m->status = LDNS_STATUS_ZONEMD_INVALID_SOA;
+  }
+  if (m->digest_sha384) {
+    ldns_sha384_init(&m->sha384);
+  }
+  if (m->digest_sha512) {
+    ldns_sha512_init(&m->sha512);
+  }
+}
+
+/* verify a signature of the group against the apex DNSKEYs */
+static void
+merge_spot_verify(merge_t* m, ldns_rr_list* rrs, ldns_rr* sig)
+{
+  ldns_rr_type covered = ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(sig));
+  ldns_rr_list* rrset = ldns_rr_list_new();
+  char* type;
+  size_t i;
+
+  if (!rrset) {
+    m->status = LDNS_STATUS_MEM_ERR;
+    return;
+  }
+  for (i = 0; i < ldns_rr_list_rr_count(rrs); i++) {
+    if (ldns_rr_get_type(ldns_rr_list_rr(rrs, i)) == covered) {
+      ldns_rr_list_push_rr(rrset, ldns_rr_list_rr(rrs, i));
+    }
+  }
+  m->spot_checked++;
+  if (ldns_verify_rrsig_keylist_time(rrset, sig, m->dnskeys, m->now, NULL)
+      != LDNS_STATUS_OK) {
+    m->spot_failed++;
+    type = ldns_rr_type2str(covered);
+    fprintf(stderr, "Bad signature over ");
+    ldns_rdf_print(stderr, ldns_rr_owner(sig));
+    fprintf(stderr, " %s\n", type ? type : "");
+    LDNS_FREE(type);
+  }
+  ldns_rr_list_free(rrset);
+}
+
+/* digest and write the records of an owner name */
+static void
+merge_flush(merge_t* m)
+{
+  merge_group_t* g = &m->group;
+  ldns_rr_list* rrs;
+  ldns_rr* rr;
+  size_t i, wire_len, owner_len, pos;
+  const uint8_t* wire;
+  bool apex = !m->apex_done;
+  uint16_t type;
+
+  if (g->nrecs == 0) {
+    return;
+  }
+  if (apex) {
+    merge_apex(m);
+    m->apex_done = true;
+  }
+  rrs = ldns_rr_list_new();
+  if (!rrs) {
+    m->status = LDNS_STATUS_MEM_ERR;
+    return;
+  }
+  for (i = 0; i < g->nrecs && m->status == LDNS_STATUS_OK; i++) {
+    wire = rec_wire(g->arena + g->recs[i], &wire_len, &owner_len);
+    type = ldns_read_uint16(wire + owner_len);
+
+    /* the ZONEMD rrs at the apex and their signatures are excluded */
+    if (!(apex && (type == LDNS_RR_TYPE_ZONEMD
+                   || (type == LDNS_RR_TYPE_RRSIG
+                       && wire_len >= owner_len + 12
+                       && ldns_read_uint16(wire + owner_len + 10)
+                          == LDNS_RR_TYPE_ZONEMD)))) {
+      if (m->digest_sha384) {
+        ldns_sha384_update(&m->sha384, wire, wire_len);
+      }
+      if (m->digest_sha512) {
+        ldns_sha512_update(&m->sha512, wire, wire_len);
+      }
+    }
+    pos = 0;
+    m->status = ldns_wire2rr(&rr, wire, wire_len, &pos,
+                             LDNS_SECTION_ANSWER);
+    if (m->status != LDNS_STATUS_OK) {
+      break;
+    }
+    ldns_rr_print(m->out, rr);
+    ldns_rr_list_push_rr(rrs, rr);
+    m->records++;
+  }
+  if (apex) {
+    for (i = 0; i < ldns_rr_list_rr_count(rrs); i++) {
+      rr = ldns_rr_list_rr(rrs, i);
+      if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_ZONEMD) {
+        ldns_rr_list_push_rr(m->zonemds, ldns_rr_clone(rr));
+      } else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY) {
+        ldns_rr_list_push_rr(m->dnskeys, ldns_rr_clone(rr));
+      }
+    }
+  }
+  if (m->spot_every > 0 && m->status == LDNS_STATUS_OK) {
+    for (i = 0; i < ldns_rr_list_rr_count(rrs); i++) {
+      rr = ldns_rr_list_rr(rrs, i);
+      if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG
+          && ++m->sigs % m->spot_every == 0) {
+        merge_spot_verify(m, rrs, rr);
+      }
+    }
+  }
+  ldns_rr_list_deep_free(rrs);
+  g->len = 0;
+  g->nrecs = 0;
+}
+
+static ldns_status
+merge_runs(merge_t* m, axfr_runs_t* runs)
+{
+  run_reader_t* readers;
+  run_reader_t** heap;
+  uint8_t* prev = NULL;
+  size_t prev_cap = 0;
+  size_t n = 0, i, size;
+  merge_group_t* g = &m->group;
+  uint8_t* grec;
+  rec_hdr_t h, gh;
+
+  readers = LDNS_XMALLOC(run_reader_t, runs->count ? runs->count : 1);
+  heap = LDNS_XMALLOC(run_reader_t*, runs->count ? runs->count : 1);
+  if (!readers || !heap) {
+    LDNS_FREE(readers);
+    LDNS_FREE(heap);
+    return LDNS_STATUS_MEM_ERR;
+  }
+  for (i = 0; i < runs->count; i++) {
+    readers[i].fp = runs->files[i];
+    readers[i].rec = NULL;
+    readers[i].cap = 0;
+    if (run_next(&readers[i], &m->status)) {
+      heap[n++] = &readers[i];
+    }
+  }
+  for (i = n; i > 0; i--) {
+    heap_down(heap, n, i - 1);
+  }
+
+  while (n > 0 && m->status == LDNS_STATUS_OK) {
+    const uint8_t* rec = heap[0]->rec;
+    size = rec_size(rec);
+
+    /* the SOA is in the transfer twice, rrs may be repeated too */
+    if (prev && rec_compare(prev, rec) == 0) {
+      m->duplicates++;
+    } else {
+      memcpy(&h, rec, sizeof(h));
+      if (g->nrecs > 0) {
+        memcpy(&gh, g->arena, sizeof(gh));
+        if (gh.key_len != h.key_len
+            || memcmp(g->arena + sizeof(gh), rec + sizeof(h), h.key_len)
+               != 0) {
+          merge_flush(m);
+        }
+      }
+      grec = arena_alloc(&g->arena, &g->len, &g->cap, &g->recs,
+                         &g->nrecs, &g->recs_cap, size);
+      if (!grec) {
+        m->status = LDNS_STATUS_MEM_ERR;
+        break;
+      }
+      memcpy(grec, rec, size);
+      if (size > prev_cap) {
+        uint8_t* p = LDNS_XREALLOC(prev, uint8_t, size);
+        if (!p) {
+          m->status = LDNS_STATUS_MEM_ERR;
+          break;
+        }
+        prev = p;
+        prev_cap = size;
+      }
+      memcpy(prev, rec, size);
+    }
+    if (!run_next(heap[0], &m->status)) {
+      heap[0] = heap[--n];
+    }
+    heap_down(heap, n, 0);
+  }
+  if (m->status == LDNS_STATUS_OK) {
+    merge_flush(m);
+  }
+  for (i = 0; i < runs->count; i++) {
+    LDNS_FREE(readers[i].rec);
+  }
+  LDNS_FREE(prev);
+  LDNS_FREE(readers);
+  LDNS_FREE(heap);
+  return m->status;
+}
+
+/* check the ZONEMD rrs against the digests, true if one matches */
+static bool
+zonemd_check(merge_t* m, bool verbose)
+{
+  uint8_t sha384[LDNS_SHA384_DIGEST_LENGTH];
+  uint8_t sha512[LDNS_SHA512_DIGEST_LENGTH];
+  bool valid = false;
+  size_t i;
+
+  if (m->digest_sha384) {
+    ldns_sha384_final(sha384, &m->sha384);
+  }
+  if (m->digest_sha512) {
+    ldns_sha512_final(sha512, &m->sha512);
+  }
+  for (i = 0; i < ldns_rr_list_rr_count(m->zonemds); i++) {
+    ldns_rr* rr = ldns_rr_list_rr(m->zonemds, i);
+    ldns_rdf* digest;
+    uint32_t serial;
+    uint8_t scheme, hash;
+    const uint8_t* d = NULL;
+    size_t d_len = 0;
+
+    if (ldns_rr_rd_count(rr) != 4) {
+      continue;
+    }
+    serial = ldns_rdf2native_int32(ldns_rr_rdf(rr, 0));
+    scheme = ldns_rdf2native_int8(ldns_rr_rdf(rr, 1));
+    hash = ldns_rdf2native_int8(ldns_rr_rdf(rr, 2));
+    digest = ldns_rr_rdf(rr, 3);
+    if (scheme != ZONEMD_SCHEME_SIMPLE) {
+      continue;
+    } else if (hash == ZONEMD_HASH_SHA384) {
+      d = sha384;
+      d_len = sizeof(sha384);
+    } else if (hash == ZONEMD_HASH_SHA512) {
+      d = sha512;
+      d_len = sizeof(sha512);
+    } else {
+      continue;
+    }
+    if (serial != m->soa_serial) {
+      fprintf(stderr, "ZONEMD serial %u does not match the SOA serial %u\n",
+              (unsigned)serial, (unsigned)m->soa_serial);
+    } else if (ldns_rdf_size(digest) != d_len
+               || memcmp(ldns_rdf_data(digest), d, d_len) != 0) {
+      fprintf(stderr, "ZONEMD digest with hash %u does not match\n",
+              (unsigned)hash);
+    } else {
+      if (verbose) {
+        fprintf(stderr, "ZONEMD digest with hash %u is valid\n",
+                (unsigned)hash);
+      }
+      valid = true;
+    }
+  }
+  return valid;
+}
+
+static bool
+set_tsig(ldns_resolver* res, const char* arg)
+{
+  char* name = strdup(arg);
+  char* key;
+  char* alg;
+
+  if (!name || !(key = strchr(name, ':'))) {
+    free(name);
+    return false;
+  }
+  *key++ = '\0';
+  if ((alg = strchr(key, ':')) != NULL) {
+    *alg++ = '\0';
+  }
+  ldns_resolver_set_tsig_keyname(res, name);
+  ldns_resolver_set_tsig_keydata(res, key);
+  ldns_resolver_set_tsig_algorithm(res, alg ? alg : "hmac-md5.sig-alg.reg.int.");
+  free(name);
+  return true;
+}
+
+int
+main(int argc, char** argv)
+{
+  axfr_t x;
+  axfr_worker_t workers[AXFR_MAX_WORKERS];
+  merge_t m;
+  ldns_resolver* res = NULL;
+  ldns_rdf* ns = NULL;
+  ldns_rdf* zone = NULL;
+  ldns_status s;
+  const char* prog = argv[0];
+  const char* tsig = NULL;
+  unsigned long nworkers = 2;
+  unsigned long run_mb = 32;
+  unsigned long port = 53;
+  unsigned long long messages = 0, bytes = 0, rrs = 0;
+  bool require_zonemd = false;
+  bool verbose = false;
+  bool ok = true;
+  double t_start, t_transfer, t_end;
+  size_t i;
+  int c;
+
+  memset(&x, 0, sizeof(x));
+  memset(&m, 0, sizeof(m));
+  while ((c = getopt(argc, argv, "hm:p:s:T:vw:y:Z")) != -1) {
+    switch (c) {
+    case 'm':
+      run_mb = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      port = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      m.spot_every = strtoul(optarg, NULL, 10);
+      break;
+    case 'T':
+      x.tmpdir = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'w':
+      nworkers = strtoul(optarg, NULL, 10);
+      break;
+    case 'y':
+      tsig = optarg;
+      break;
+    case 'Z':
+      require_zonemd = true;
+      break;
+    case 'h':
+      usage(stdout, prog);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(stderr, prog);
+      exit(EXIT_FAILURE);
+    }
+  }
+  argc -= optind;
+  argv += optind;
+  if (argc != 3 || nworkers < 1 || nworkers > AXFR_MAX_WORKERS
+      || run_mb < 1 || port < 1 || port > 65535) {
+    usage(stderr, prog);
+    exit(EXIT_FAILURE);
+  }
+  x.run_size = run_mb * 1024 * 1024;
+
+  res = ldns_resolver_new();
+  if (!res) {
+    fprintf(stderr, "Could not create a resolver\n");
+    exit(EXIT_FAILURE);
+  }
+  ldns_resolver_set_port(res, (uint16_t)port);
+  if (ldns_str2rdf_a(&ns, argv[0]) != LDNS_STATUS_OK
+      && ldns_str2rdf_aaaa(&ns, argv[0]) != LDNS_STATUS_OK) {
+    fprintf(stderr, "Bad address of the server: %s\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  (void)ldns_resolver_push_nameserver(res, ns);
+  ldns_rdf_deep_free(ns);
+  if (tsig && !set_tsig(res, tsig)) {
+    fprintf(stderr, "Bad TSIG key: %s\n", tsig);
+    exit(EXIT_FAILURE);
+  }
+  if (ldns_str2rdf_dname(&zone, argv[1]) != LDNS_STATUS_OK) {
+    fprintf(stderr, "Bad zone name: %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  m.out = fopen(argv[2], "w");
+  if (!m.out) {
+    fprintf(stderr, "Could not open %s: %s\n", argv[2], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  m.zonemds = ldns_rr_list_new();
+  m.dnskeys = ldns_rr_list_new();
+  if (!m.zonemds || !m.dnskeys || !queue_init(&x.queue, 2 * nworkers)) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&x.runs.lock, NULL);
+
+  t_start = now();
+  s = ldns_axfr_start(res, zone, LDNS_RR_CLASS_IN);
+  if (s != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error starting the transfer: %s\n",
+            ldns_get_errorstr_by_id(s));
+    exit(EXIT_FAILURE);
+  }
+  memset(workers, 0, sizeof(workers));
+  for (i = 0; i < nworkers; i++) {
+    workers[i].x = &x;
+    workers[i].status = LDNS_STATUS_OK;
+    workers[i].buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    if (!workers[i].buf
+        || pthread_create(&workers[i].thread, NULL, worker_run, &workers[i])
+           != 0) {
+      fprintf(stderr, "Could not start a worker\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  s = read_transfer(res, &x.queue, &messages, &bytes);
+  if (s != LDNS_STATUS_OK) {
+    ldns_axfr_abort(res);
+  }
+  queue_close(&x.queue, s != LDNS_STATUS_OK);
+  for (i = 0; i < nworkers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    if (workers[i].status != LDNS_STATUS_OK) {
+      fprintf(stderr, "Error in the transfer: %s\n",
+              ldns_get_errorstr_by_id(workers[i].status));
+      ok = false;
+    } else if (s != LDNS_STATUS_OK && ok) {
+      fprintf(stderr, "Error in the transfer: %s\n",
+              ldns_get_errorstr_by_id(s));
+      ok = false;
+    }
+    rrs += workers[i].rrs;
+    LDNS_FREE(workers[i].arena);
+    LDNS_FREE(workers[i].recs);
+    ldns_buffer_free(workers[i].buf);
+  }
+  t_transfer = now();
+
+  if (ok) {
+    m.now = time(NULL);
+    s = merge_runs(&m, &x.runs);
+    if (s != LDNS_STATUS_OK) {
+      fprintf(stderr, "Error writing the zone: %s\n",
+              ldns_get_errorstr_by_id(s));
+      ok = false;
+    }
+  }
+  if (fclose(m.out) != 0) {
+    fprintf(stderr, "Error writing %s: %s\n", argv[2], strerror(errno));
+    ok = false;
+  }
+  t_end = now();
+
+  if (ok && ldns_rr_list_rr_count(m.zonemds) > 0) {
+    if (!zonemd_check(&m, verbose)) {
+      fprintf(stderr, "No valid ZONEMD digest\n");
+      ok = false;
+    }
+  } else if (ok && require_zonemd) {
+    fprintf(stderr, "No ZONEMD at the apex\n");
+    ok = false;
+  }
+  if (m.spot_failed > 0) {
+    ok = false;
+  }
+  if (verbose) {
+    fprintf(stderr, "Transfer: %llu messages, %llu bytes, %llu rrs, "
+            "%lu sorted runs, %.3f s\n", messages, bytes, rrs,
+            (unsigned long)x.runs.count, t_transfer - t_start);
+    fprintf(stderr, "Merge: %llu rrs written, %llu duplicates, %.3f s\n",
+            m.records, m.duplicates, t_end - t_transfer);
+    if (m.spot_every > 0) {
+      fprintf(stderr, "Signatures: %lu verified of %lu, %lu failed\n",
+              m.spot_checked, m.sigs, m.spot_failed);
+    }
+  }
+
+  for (i = 0; i < x.runs.count; i++) {
+    fclose(x.runs.files[i]);
+  }
+  LDNS_FREE(x.runs.files);
+  pthread_mutex_destroy(&x.runs.lock);
+  queue_free(&x.queue);
+  LDNS_FREE(m.group.arena);
+  LDNS_FREE(m.group.recs);
+  ldns_rr_list_deep_free(m.zonemds);
+  ldns_rr_list_deep_free(m.dnskeys);
+  ldns_rdf_deep_free(zone);
+  ldns_resolver_deep_free(res);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,255 @@
+/*
+ * ldns-casefold-bench measures the case insensitive primitives of ldns:
+ * lowercasing, comparing and hashing, for every implementation that this
+ * CPU can run and for a plain tolower() loop, at a number of lengths.
+ *
+ * The data are domain names in wire format with mixed case letters. For
+ * compare, both names are equal but for the case, so every byte is
+ * looked at. The throughput is printed in MB per second.
+ */
+
+#include "config.h"
+
+#include <ldns/ldns.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define BENCH_NAMES 4096
+#define BENCH_MAX_LEN 255
+
+static const char* bench_impls[] = { "avx2", "sse2", "neon", "word" };
+
+static const size_t bench_lens[] = { 8, 16, 32, 64, 128, 255 };
+
+typedef enum bench_op
+{
+  BENCH_LOWER,
+  BENCH_COMPARE,
+  BENCH_HASH,
+  BENCH_OPS
+} bench_op_t;
+
+static const char* bench_op_names[BENCH_OPS] =
+  { "lower", "compare", "hash" };
+
+/* keeps the compiler from dropping the work */
+static volatile uint64_t bench_sink;
+
+static void
+usage(FILE* out, const char* prog)
+{
+  fprintf(out, "Usage: %s [-l <len>] [-t <seconds>]\n", prog);
+  fprintf(out, "  Measure lowercasing, comparing and hashing of names.\n");
+  fprintf(out, "  -l <len>      only measure names of <len> bytes (1-255)\n");
+  fprintf(out, "  -t <seconds>  time per measurement (default 0.5)\n");
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* a name of len bytes with labels of up to 63 random mixed case letters
+ * and digits */
+static void
+make_name(uint8_t* name, size_t len)
+{
+  static const char chars[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-";
+  size_t pos = 0;
+  size_t label;
+
+  while (pos + 1 < len) {
+    label = 1 + (size_t)random() % 63;
+    if (label > len - pos - 2) {
+      label = len - pos - 2;
+    }
+    if (label == 0) {
+      break;
+    }
+    name[pos++] = (uint8_t)label;
+    while (label-- > 0) {
+      name[pos++] = (uint8_t)chars[random() % (sizeof(chars) - 1)];
+    }
+  }
+  while (pos < len) {
+    name[pos++] = 0;
+  }
+}
+
+static void
+lower_tolower(uint8_t* dst, const uint8_t* src, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    dst[i] = (uint8_t)tolower(src[i]);
+  }
+}
+
+static int
+compare_tolower(const uint8_t* a, const uint8_t* b, size_t len)
+{
+  size_t i;
+  int ca, cb;
+
+  for (i = 0; i < len; i++) {
+    ca = tolower(a[i]);
+    cb = tolower(b[i]);
+    if (ca != cb) {
+      return ca < cb ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/* FNV-1a over the lowercased bytes */
+static uint64_t
+hash_tolower(const uint8_t* data, size_t len, uint64_t seed)
+{
+  uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ (uint64_t)tolower(data[i])) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/* runs op over all names until the time is up, returns MB per second */
+static double
+bench_run(bench_op_t op, bool baseline, uint8_t* names, uint8_t* other,
+          size_t len, double seconds)
+{
+  uint8_t out[BENCH_MAX_LEN];
+  uint64_t acc = 0;
+  size_t rounds = 0;
+  double start = now();
+  double elapsed;
+  size_t i;
+
+  do {
+    for (i = 0; i < BENCH_NAMES; i++) {
+      const uint8_t* a = names + i * len;
+      const uint8_t* b = other + i * len;
+
+      switch (op) {
+      case BENCH_LOWER:
+        if (baseline) {
+          lower_tolower(out, a, len);
+        } else {
+          ldns_casefold_lower(out, a, len);
+        }
+        acc += out[len - 1];
+        break;
+      case BENCH_COMPARE:
+        acc += (uint64_t)(baseline ? compare_tolower(a, b, len)
+                                   : ldns_casefold_compare(a, b, len));
+        break;
+      case BENCH_HASH:
+        acc += baseline ? hash_tolower(a, len, 0)
+                        : ldns_casefold_hash(a, len, 0);
+        break;
+      default:
+        break;
+      }
+    }
+    rounds++;
+    elapsed = now() - start;
+  } while (elapsed < seconds);
+
+  bench_sink += acc;
+  return (double)rounds * BENCH_NAMES * len / elapsed / 1e6;
+}
+
+static void
+bench_len(size_t len, double seconds)
+{
+  uint8_t* names = malloc(BENCH_NAMES * len);
+  uint8_t* other = malloc(BENCH_NAMES * len);
+  size_t i, j;
+  int op;
+
+  if (!names || !other) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < BENCH_NAMES; i++) {
+    make_name(names + i * len, len);
+  }
+  /* the same names, in other case */
+  for (i = 0; i < BENCH_NAMES * len; i++) {
+    other[i] = isalpha(names[i]) ? names[i] ^ 0x20 : names[i];
+  }
+
+  for (op = 0; op < BENCH_OPS; op++) {
+    printf("%-8s %4zu  %-8s %10.1f\n", bench_op_names[op], len, "tolower",
+           bench_run((bench_op_t)op, true, names, other, len, seconds));
+    for (j = 0; j < sizeof(bench_impls) / sizeof(bench_impls[0]); j++) {
+      /* the hash is the same for all implementations */
+      if (op == BENCH_HASH && j > 0) {
+        break;
+      }
+      if (op != BENCH_HASH && !ldns_casefold_use(bench_impls[j])) {
+        continue;
+      }
+      printf("%-8s %4zu  %-8s %10.1f\n", bench_op_names[op], len,
+             op == BENCH_HASH ? "ldns" : bench_impls[j],
+             bench_run((bench_op_t)op, false, names, other, len, seconds));
+    }
+    ldns_casefold_use(NULL);
+  }
+  free(names);
+  free(other);
+}
+
+int
+main(int argc, char** argv)
+{
+  double seconds = 0.5;
+  size_t only_len = 0;
+  size_t i;
+  int c;
+
+  while ((c = getopt(argc, argv, "hl:t:")) != -1) {
+    switch (c) {
+    case 'l':
+      only_len = (size_t)atoi(optarg);
+      if (only_len < 1 || only_len > BENCH_MAX_LEN) {
+        usage(stderr, argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(stderr, argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  srandom(1);
+  printf("best implementation: %s\n", ldns_casefold_impl());
+  printf("%-8s %4s  %-8s %10s\n", "op", "len", "impl", "MB/s");
+  if (only_len) {
+    bench_len(only_len, seconds);
+  } else {
+    for (i = 0; i < sizeof(bench_lens) / sizeof(bench_lens[0]); i++) {
+      bench_len(bench_lens[i], seconds);
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -1911,6 +1911,805 @@ parse_match_expression(char *string)
 	return result;
 	
 }
+
+/* The index (-wi and -ri)
+ *
+ * An index keeps the values of the matches of every correct dns packet
+ * in a capture, one column per match, so that later runs can evaluate
+ * filters, counters and uniques on the columns instead of reading and
+ * decoding the capture again. Numeric matches are stored as numbers;
+ * the addresses, qname and qtype as codes into a dictionary of their
+ * distinct values, so a match on those is evaluated once per distinct
+ * value instead of once per packet. The rr matches (query, answer,
+ * authority, additional) are not in the index.
+ *
+ * The file starts with INDEX_MAGIC, the number of columns, the number of
+ * packets and the packet counters shown by -p. Every column then has its
+ * match id, the number of strings in its dictionary (0 for numbers), the
+ * strings (a 16 bit length and the characters), the width of its values
+ * (1, 2 or 4 bytes) and a value per packet. Numbers are in network order.
+ */
+#define INDEX_MAGIC "LDNSDPA1"
+#define INDEX_MAGIC_LEN 8
+#define INDEX_COUNTERS 7
+#define INDEX_MAX_COLUMNS MATCH_LAST
+
+static const match_id index_match_ids[] = {
+	MATCH_ID, MATCH_OPCODE, MATCH_RCODE, MATCH_PACKETSIZE,
+	MATCH_QR, MATCH_TC, MATCH_AD, MATCH_CD, MATCH_RD,
+	MATCH_EDNS, MATCH_EDNS_PACKETSIZE, MATCH_DO, MATCH_CO,
+	MATCH_QUESTION_SIZE, MATCH_ANSWER_SIZE, MATCH_AUTHORITY_SIZE,
+	MATCH_ADDITIONAL_SIZE, MATCH_SRC_ADDRESS, MATCH_DST_ADDRESS,
+	MATCH_TIMESTAMP, MATCH_QTYPE, MATCH_QNAME
+};
+
+struct struct_index_string {
+	ldns_rbnode_t node;
+	uint32_t code;
+};
+typedef struct struct_index_string index_string;
+
+struct struct_index_column {
+	match_id id;
+	/* the value, or the code of the string, of every packet */
+	uint32_t *values;
+	/* the distinct strings, NULL for numbers */
+	char **strings;
+	uint32_t string_count;
+	uint32_t string_capacity;
+	/* string to code, while the index is built */
+	ldns_rbtree_t *lookup;
+};
+typedef struct struct_index_column index_column;
+
+struct struct_dpa_index {
+	size_t packet_count;
+	size_t capacity;
+	size_t column_count;
+	index_column columns[INDEX_MAX_COLUMNS];
+};
+typedef struct struct_dpa_index dpa_index;
+
+/* the index that is built from the capture, for -wi */
+dpa_index *index_out = NULL;
+
+static bool
+index_has_dictionary(match_id id)
+{
+	match_table *mt = get_match_by_id(id);
+
+	return mt && (mt->type == TYPE_STRING || mt->type == TYPE_ADDRESS ||
+	              mt->type == TYPE_RR_TYPE);
+}
+
+static int
+index_string_compare(const void *a, const void *b)
+{
+	return strcmp((const char *) a, (const char *) b);
+}
+
+static index_column *
+index_get_column(dpa_index *idx, match_id id)
+{
+	size_t i;
+
+	for (i = 0; i < idx->column_count; i++) {
+		if (idx->columns[i].id == id) {
+			return &idx->columns[i];
+		}
+	}
+	return NULL;
+}
+
+static void
+index_free_string(ldns_rbnode_t *node, void *arg)
+{
+	(void) arg;
+	free(node);
+}
+
+static void
+index_free(dpa_index *idx)
+{
+	size_t i;
+	uint32_t j;
+	index_column *c;
+
+	if (!idx) {
+		return;
+	}
+	for (i = 0; i < idx->column_count; i++) {
+		c = &idx->columns[i];
+		free(c->values);
+		for (j = 0; j < c->string_count; j++) {
+			free(c->strings[j]);
+		}
+		free(c->strings);
+		if (c->lookup) {
+			ldns_traverse_postorder(c->lookup, index_free_string, NULL);
+			ldns_rbtree_free(c->lookup);
+		}
+	}
+	free(idx);
+}
+
+static dpa_index *
+index_new(void)
+{
+	dpa_index *idx;
+	size_t i;
+
+	idx = calloc(1, sizeof(dpa_index));
+	if (!idx) {
+		return NULL;
+	}
+	idx->column_count = sizeof(index_match_ids) / sizeof(match_id);
+	for (i = 0; i < idx->column_count; i++) {
+		idx->columns[i].id = index_match_ids[i];
+		if (index_has_dictionary(index_match_ids[i])) {
+			idx->columns[i].lookup = ldns_rbtree_create(index_string_compare);
+			if (!idx->columns[i].lookup) {
+				index_free(idx);
+				return NULL;
+			}
+		}
+	}
+	return idx;
+}
+
+/* returns the code of str in the dictionary of c, and takes str */
+static uint32_t
+index_string_code(index_column *c, char *str)
+{
+	ldns_rbnode_t *node;
+	index_string *s;
+
+	node = ldns_rbtree_search(c->lookup, str);
+	if (node) {
+		free(str);
+		return ((index_string *) node)->code;
+	}
+	if (c->string_count == c->string_capacity) {
+		c->string_capacity = c->string_capacity ? c->string_capacity * 2 : 64;
+		c->strings = realloc(c->strings, c->string_capacity * sizeof(char *));
+		if (!c->strings) {
+			printf("Malloc failed, out of mem?\n");
+			exit(4);
+		}
+	}
+	s = malloc(sizeof(index_string));
+	if (!s) {
+		printf("Malloc failed, out of mem?\n");
+		exit(4);
+	}
+	s->node.key = str;
+	s->node.data = s;
+	s->code = c->string_count;
+	c->strings[c->string_count++] = str;
+	(void) ldns_rbtree_insert(c->lookup, &s->node);
+	return s->code;
+}
+
+/* adds the values of a dns packet to the index */
+static void
+index_add_packet(dpa_index *idx, ldns_pkt *pkt, ldns_rdf *src_addr, ldns_rdf *dst_addr)
+{
+	size_t i;
+	index_column *c;
+	char *val;
+
+	if (idx->packet_count == idx->capacity) {
+		idx->capacity = idx->capacity ? idx->capacity * 2 : 1024;
+		for (i = 0; i < idx->column_count; i++) {
+			c = &idx->columns[i];
+			c->values = realloc(c->values, idx->capacity * sizeof(uint32_t));
+			if (!c->values) {
+				printf("Malloc failed, out of mem?\n");
+				exit(4);
+			}
+		}
+	}
+	for (i = 0; i < idx->column_count; i++) {
+		c = &idx->columns[i];
+		val = get_string_value(c->id, pkt, src_addr, dst_addr);
+		if (!val) {
+			val = strdup("");
+		}
+		if (c->lookup) {
+			c->values[idx->packet_count] = index_string_code(c, val);
+		} else {
+			c->values[idx->packet_count] = (uint32_t) strtoul(val, NULL, 10);
+			free(val);
+		}
+	}
+	idx->packet_count++;
+}
+
+static bool
+index_write_uint32(FILE *fp, uint32_t value)
+{
+	uint8_t buf[4];
+
+	ldns_write_uint32(buf, value);
+	return fwrite(buf, 4, 1, fp) == 1;
+}
+
+static bool
+index_read_uint32(FILE *fp, uint32_t *value)
+{
+	uint8_t buf[4];
+
+	if (fread(buf, 4, 1, fp) != 1) {
+		return false;
+	}
+	*value = ldns_read_uint32(buf);
+	return true;
+}
+
+static bool
+index_write_column(FILE *fp, dpa_index *idx, index_column *c)
+{
+	uint8_t *buf;
+	uint8_t width = 1;
+	uint32_t max = 0;
+	uint32_t j;
+	size_t i, len;
+	bool result;
+
+	if (!index_write_uint32(fp, (uint32_t) c->id) ||
+	    !index_write_uint32(fp, c->string_count)) {
+		return false;
+	}
+	for (j = 0; j < c->string_count; j++) {
+		len = strlen(c->strings[j]);
+		if (len > 65535) {
+			len = 65535;
+		}
+		buf = (uint8_t *) c->strings[j];
+		if (fputc((int) (len >> 8), fp) == EOF ||
+		    fputc((int) (len & 0xff), fp) == EOF ||
+		    fwrite(buf, 1, len, fp) != len) {
+			return false;
+		}
+	}
+
+	/* the smallest width that holds all values */
+	for (i = 0; i < idx->packet_count; i++) {
+		max |= c->values[i];
+	}
+	if (max > 0xffff) {
+		width = 4;
+	} else if (max > 0xff) {
+		width = 2;
+	}
+	if (fputc(width, fp) == EOF) {
+		return false;
+	}
+	buf = malloc(idx->packet_count * width + 1);
+	if (!buf) {
+		return false;
+	}
+	for (i = 0; i < idx->packet_count; i++) {
+		switch (width) {
+			case 1:
+				buf[i] = (uint8_t) c->values[i];
+				break;
+			case 2:
+				ldns_write_uint16(&buf[i * 2], (uint16_t) c->values[i]);
+				break;
+			default:
+				ldns_write_uint32(&buf[i * 4], c->values[i]);
+				break;
+		}
+	}
+	result = fwrite(buf, width, idx->packet_count, fp) == idx->packet_count;
+	free(buf);
+	return result;
+}
+
+static bool
+index_write(dpa_index *idx, const char *filename)
+{
+	FILE *fp;
+	size_t i;
+	bool result;
+	size_t counters[INDEX_COUNTERS];
+
+	counters[0] = not_ip_packets;
+	counters[1] = bad_dns_packets;
+	counters[2] = arp_packets;
+	counters[3] = udp_packets;
+	counters[4] = tcp_packets;
+	counters[5] = fragmented_packets;
+	counters[6] = lost_packet_fragments;
+
+	if (idx->packet_count > 0xffffffff) {
+		fprintf(stderr, "Too many packets for an index\n");
+		return false;
+	}
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error opening index file %s: %s\n", filename, strerror(errno));
+		return false;
+	}
+	result = fwrite(INDEX_MAGIC, INDEX_MAGIC_LEN, 1, fp) == 1 &&
+	         index_write_uint32(fp, (uint32_t) idx->column_count) &&
+	         index_write_uint32(fp, (uint32_t) idx->packet_count);
+	for (i = 0; result && i < INDEX_COUNTERS; i++) {
+		result = index_write_uint32(fp, (uint32_t) counters[i]);
+	}
+	for (i = 0; result && i < idx->column_count; i++) {
+		result = index_write_column(fp, idx, &idx->columns[i]);
+	}
+	if (fclose(fp) != 0) {
+		result = false;
+	}
+	if (!result) {
+		fprintf(stderr, "Error writing index file %s: %s\n", filename, strerror(errno));
+	}
+	return result;
+}
+
+static bool
+index_read_column(FILE *fp, dpa_index *idx, index_column *c)
+{
+	uint8_t *buf;
+	uint8_t lenbuf[2];
+	uint32_t id, j;
+	size_t i, len;
+	int width;
+
+	if (!index_read_uint32(fp, &id) || id >= MATCH_LAST ||
+	    !index_read_uint32(fp, &c->string_count)) {
+		return false;
+	}
+	c->id = (match_id) id;
+	if (c->string_count > 0) {
+		c->strings = calloc(c->string_count, sizeof(char *));
+		if (!c->strings) {
+			c->string_count = 0;
+			return false;
+		}
+	}
+	for (j = 0; j < c->string_count; j++) {
+		if (fread(lenbuf, 2, 1, fp) != 1) {
+			return false;
+		}
+		len = ldns_read_uint16(lenbuf);
+		c->strings[j] = malloc(len + 1);
+		if (!c->strings[j] || fread(c->strings[j], 1, len, fp) != len) {
+			return false;
+		}
+		c->strings[j][len] = '\0';
+	}
+
+	width = fgetc(fp);
+	if (width != 1 && width != 2 && width != 4) {
+		return false;
+	}
+	buf = malloc(idx->packet_count * width + 1);
+	c->values = malloc(idx->packet_count * sizeof(uint32_t) + 1);
+	if (!buf || !c->values ||
+	    fread(buf, width, idx->packet_count, fp) != idx->packet_count) {
+		free(buf);
+		return false;
+	}
+	for (i = 0; i < idx->packet_count; i++) {
+		switch (width) {
+			case 1:
+				c->values[i] = buf[i];
+				break;
+			case 2:
+				c->values[i] = ldns_read_uint16(&buf[i * 2]);
+				break;
+			default:
+				c->values[i] = ldns_read_uint32(&buf[i * 4]);
+				break;
+		}
+		if (c->strings && c->values[i] >= c->string_count) {
+			free(buf);
+			return false;
+		}
+	}
+	free(buf);
+	return true;
+}
+
+/* reads an index, and sets the packet counters from it */
+static dpa_index *
+index_read(const char *filename)
+{
+	FILE *fp;
+	dpa_index *idx;
+	char magic[INDEX_MAGIC_LEN];
+	uint32_t column_count, packet_count;
+	uint32_t counters[INDEX_COUNTERS];
+	size_t i;
+	bool result;
+
+	if (strncmp(filename, "-", 2) == 0) {
+		fp = stdin;
+	} else {
+		fp = fopen(filename, "rb");
+	}
+	if (!fp) {
+		fprintf(stderr, "Error opening index file %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+	idx = calloc(1, sizeof(dpa_index));
+	result = idx &&
+	         fread(magic, INDEX_MAGIC_LEN, 1, fp) == 1 &&
+	         memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_LEN) == 0 &&
+	         index_read_uint32(fp, &column_count) &&
+	         column_count <= INDEX_MAX_COLUMNS &&
+	         index_read_uint32(fp, &packet_count);
+	for (i = 0; result && i < INDEX_COUNTERS; i++) {
+		result = index_read_uint32(fp, &counters[i]);
+	}
+	if (result) {
+		idx->packet_count = packet_count;
+		idx->capacity = packet_count;
+	}
+	for (i = 0; result && i < column_count; i++) {
+		idx->column_count++;
+		result = index_read_column(fp, idx, &idx->columns[i]);
+	}
+	if (fp != stdin) {
+		fclose(fp);
+	}
+	if (!result) {
+		fprintf(stderr, "Error reading index file %s: not an index, or truncated\n", filename);
+		index_free(idx);
+		return NULL;
+	}
+
+	not_ip_packets = counters[0];
+	bad_dns_packets = counters[1];
+	arp_packets = counters[2];
+	udp_packets = counters[3];
+	tcp_packets = counters[4];
+	fragmented_packets = counters[5];
+	lost_packet_fragments = counters[6];
+	total_nr_of_dns_packets = idx->packet_count;
+	return idx;
+}
+
+/* checks that all matches in expr are in the index */
+static bool
+index_has_matches(dpa_index *idx, match_expression *expr)
+{
+	if (!expr) {
+		return true;
+	}
+	if (expr->op == MATCH_EXPR_LEAF) {
+		if (!index_get_column(idx, expr->match->id)) {
+			fprintf(stderr, "Match %s is not in the index\n", get_match_name_str(expr->match->id));
+			return false;
+		}
+		return true;
+	}
+	return index_has_matches(idx, expr->left) &&
+	       index_has_matches(idx, expr->right);
+}
+
+static bool
+index_has_counter_matches(dpa_index *idx, match_counters *counters)
+{
+	if (!counters) {
+		return true;
+	}
+	return index_has_matches(idx, counters->match) &&
+	       index_has_counter_matches(idx, counters->left) &&
+	       index_has_counter_matches(idx, counters->right);
+}
+
+/* sets result[i] for the packets with active[i] that match the
+ * operation; the int matches are compared as match_int() does, in a loop
+ * per operator that the compiler can vectorize, the others are evaluated
+ * once per distinct value */
+static void
+index_match_operation(dpa_index *idx, match_operation *mo, const uint8_t *active, uint8_t *result)
+{
+	index_column *c = index_get_column(idx, mo->id);
+	const uint32_t *v = c->values;
+	size_t i, n = idx->packet_count;
+	uint8_t *truth;
+	int8_t cache[256];
+	char val[16];
+	int b;
+
+	if (c->strings) {
+		truth = malloc(c->string_count + 1);
+		if (!truth) {
+			printf("Malloc failed, out of mem?\n");
+			exit(4);
+		}
+		for (i = 0; i < c->string_count; i++) {
+			truth[i] = value_matches(mo->id, mo->operator, c->strings[i], mo->value);
+		}
+		for (i = 0; i < n; i++) {
+			result[i] = active[i] & truth[v[i]];
+		}
+		free(truth);
+		return;
+	}
+
+	if (mo->id != MATCH_OPCODE && mo->id != MATCH_RCODE) {
+		b = atoi(mo->value);
+		switch (mo->operator) {
+			case OP_EQUAL:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] == b);
+				}
+				return;
+			case OP_NOTEQUAL:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] != b);
+				}
+				return;
+			case OP_GREATER:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] > b);
+				}
+				return;
+			case OP_LESSER:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] < b);
+				}
+				return;
+			case OP_GREATEREQUAL:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] >= b);
+				}
+				return;
+			case OP_LESSEREQUAL:
+				for (i = 0; i < n; i++) {
+					result[i] = active[i] & ((int) v[i] <= b);
+				}
+				return;
+			default:
+				break;
+		}
+	}
+
+	/* opcodes and rcodes are looked up by name; only for the values
+	 * that occur, as match_opcode() and match_rcode() stop on unknown
+	 * ones */
+	memset(cache, -1, sizeof(cache));
+	for (i = 0; i < n; i++) {
+		result[i] = 0;
+		if (!active[i]) {
+			continue;
+		}
+		if (v[i] < 256 && cache[v[i]] >= 0) {
+			result[i] = (uint8_t) cache[v[i]];
+			continue;
+		}
+		snprintf(val, sizeof(val), "%u", (unsigned int) v[i]);
+		result[i] = value_matches(mo->id, mo->operator, val, mo->value);
+		if (v[i] < 256) {
+			cache[v[i]] = (int8_t) result[i];
+		}
+	}
+}
+
+/* sets result[i] for the packets with active[i] that match expr, and
+ * counts them in expr->count, as match_dns_packet_to_expr() does for
+ * every packet, including the short circuit of & and | */
+static void
+index_match_expr(dpa_index *idx, match_expression *expr, const uint8_t *active, uint8_t *result)
+{
+	size_t i, n = idx->packet_count;
+	uint8_t *tmp, *right;
+
+	switch (expr->op) {
+		case MATCH_EXPR_OR:
+		case MATCH_EXPR_AND:
+			tmp = malloc(n + 1);
+			right = malloc(n + 1);
+			if (!tmp || !right) {
+				printf("Malloc failed, out of mem?\n");
+				exit(4);
+			}
+			if (expr->op == MATCH_EXPR_OR) {
+				/* the right side only for the packets that
+				 * did not match the left side */
+				index_match_expr(idx, expr->left, active, result);
+				for (i = 0; i < n; i++) {
+					tmp[i] = active[i] & !result[i];
+				}
+				index_match_expr(idx, expr->right, tmp, right);
+				for (i = 0; i < n; i++) {
+					result[i] |= right[i];
+				}
+			} else {
+				index_match_expr(idx, expr->left, active, tmp);
+				index_match_expr(idx, expr->right, tmp, result);
+			}
+			free(tmp);
+			free(right);
+			break;
+		case MATCH_EXPR_LEAF:
+			index_match_operation(idx, expr->match, active, result);
+			break;
+		default:
+			fprintf(stderr, "Error, unknown expression operator %u\n", expr->op);
+			exit(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		expr->count += result[i];
+	}
+}
+
+static void
+index_match_counters(dpa_index *idx, match_counters *counts, const uint8_t *active, uint8_t *result)
+{
+	if (counts->left) {
+		index_match_counters(idx, counts->left, active, result);
+	}
+	if (counts->match) {
+		index_match_expr(idx, counts->match, active, result);
+	}
+	if (counts->right) {
+		index_match_counters(idx, counts->right, active, result);
+	}
+}
+
+static int
+index_uint64_compare(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t *) a;
+	uint64_t ub = *(const uint64_t *) b;
+
+	return ua < ub ? -1 : ua > ub;
+}
+
+/* sets first[i] to the number of active packets with the value of
+ * packet i in column c, if i is the first of them, and to 0 otherwise */
+static void
+index_count_values(dpa_index *idx, index_column *c, const uint8_t *active, uint32_t *first)
+{
+	size_t i, j, k, m = 0, n = idx->packet_count;
+	uint32_t *counts;
+	uint64_t *sorted;
+
+	memset(first, 0, n * sizeof(uint32_t));
+	if (c->strings) {
+		counts = calloc(c->string_count + 1, sizeof(uint32_t));
+		if (!counts) {
+			printf("Malloc failed, out of mem?\n");
+			exit(4);
+		}
+		for (i = 0; i < n; i++) {
+			counts[c->values[i]] += active[i];
+		}
+		for (i = 0; i < n; i++) {
+			if (active[i] && counts[c->values[i]] > 0) {
+				first[i] = counts[c->values[i]];
+				counts[c->values[i]] = 0;
+			}
+		}
+		free(counts);
+		return;
+	}
+
+	/* sort on value and then on packet number, the first of each run
+	 * of equal values is the first packet with that value */
+	sorted = malloc(n * sizeof(uint64_t) + 1);
+	if (!sorted) {
+		printf("Malloc failed, out of mem?\n");
+		exit(4);
+	}
+	for (i = 0; i < n; i++) {
+		if (active[i]) {
+			sorted[m++] = ((uint64_t) c->values[i] << 32) | i;
+		}
+	}
+	qsort(sorted, m, sizeof(uint64_t), index_uint64_compare);
+	for (j = 0; j < m; j = k) {
+		for (k = j + 1; k < m && (sorted[k] >> 32) == (sorted[j] >> 32); k++) {
+			/* same value */;
+		}
+		first[sorted[j] & 0xffffffff] = (uint32_t) (k - j);
+	}
+	free(sorted);
+}
+
+/* adds the unique values of the active packets to uniques, in the order
+ * in which match_pkt_uniques() would have found them */
+static void
+index_match_uniques(dpa_index *idx, const uint8_t *active, match_counters *uniques, match_id unique_ids[], size_t unique_id_count)
+{
+	uint32_t *first[MAX_MATCHES];
+	index_column *columns[MAX_MATCHES];
+	size_t i, u;
+	match_operation *mo;
+	match_expression *me;
+
+	for (u = 0; u < unique_id_count; u++) {
+		columns[u] = index_get_column(idx, unique_ids[u]);
+		first[u] = malloc(idx->packet_count * sizeof(uint32_t) + 1);
+		if (!first[u]) {
+			printf("Malloc failed, out of mem?\n");
+			exit(4);
+		}
+		index_count_values(idx, columns[u], active, first[u]);
+	}
+	for (i = 0; i < idx->packet_count; i++) {
+		for (u = 0; u < unique_id_count; u++) {
+			if (!first[u][i]) {
+				continue;
+			}
+			mo = malloc(sizeof(match_operation));
+			mo->id = unique_ids[u];
+			mo->operator = OP_EQUAL;
+			if (columns[u]->strings) {
+				mo->value = strdup(columns[u]->strings[columns[u]->values[i]]);
+			} else {
+				mo->value = malloc(16);
+				snprintf(mo->value, 16, "%u", (unsigned int) columns[u]->values[i]);
+			}
+
+			me = malloc(sizeof(match_expression));
+			me->op = MATCH_EXPR_LEAF;
+			me->left = NULL;
+			me->right = NULL;
+			me->match = mo;
+			me->count = first[u][i];
+
+			if (add_match_counter(uniques, me, false) == 1) {
+				free_match_expression(me);
+			}
+		}
+	}
+	for (u = 0; u < unique_id_count; u++) {
+		free(first[u]);
+	}
+}
+
+/* evaluates the filter, counters and uniques on the index, instead of
+ * on the packets of a capture */
+static bool
+index_match(dpa_index *idx, match_expression *expr, match_counters *count, match_counters *uniques, match_id unique_ids[], size_t unique_id_count)
+{
+	uint8_t *active, *result;
+	size_t i;
+
+	if (!index_has_matches(idx, expr) ||
+	    !index_has_counter_matches(idx, count)) {
+		return false;
+	}
+	for (i = 0; i < unique_id_count; i++) {
+		if (!index_get_column(idx, unique_ids[i])) {
+			fprintf(stderr, "Match %s is not in the index\n", get_match_name_str(unique_ids[i]));
+			return false;
+		}
+	}
+
+	active = malloc(idx->packet_count + 1);
+	result = malloc(idx->packet_count + 1);
+	if (!active || !result) {
+		printf("Malloc failed, out of mem?\n");
+		exit(4);
+	}
+	memset(active, 1, idx->packet_count);
+	if (expr) {
+		index_match_expr(idx, expr, active, result);
+		memcpy(active, result, idx->packet_count);
+	}
+	for (i = 0; i < idx->packet_count; i++) {
+		total_nr_of_filtered_packets += active[i];
+	}
+
+	index_match_counters(idx, count, active, result);
+	index_match_uniques(idx, active, uniques, unique_ids, unique_id_count);
+
+	free(active);
+	free(result);
+	return true;
+}
+
 /* end of matches and counts */
 void 
 usage(FILE *output)
@@ -1933,6 +2732,8 @@ usage(FILE *output)
 	fprintf(output, "\t-v <level>:\tbe more verbose\n");
 	fprintf(output, "\t-notip <file>:\tDump pcap packets that were not recognized as\n\t\t\tIP packets to file\n");
 	fprintf(output, "\t-baddns <file>:\tDump mangled dns packets to file\n");
+	fprintf(output, "\t-wi <file>:\tWrite an index of all dns packets to file\n");
+	fprintf(output, "\t-ri <file>:\tRead the packets from an index written by -wi,\n\t\t\tinstead of from a pcap file\n");
 	fprintf(output, "\t-version:\tShow the version and exit\n");
 	fprintf(output, "\n");
 	fprintf(output, "The filename '-' stands for stdin or stdout, so you can use \"-of -\" if you want to pipe the output to another process\n");
@@ -2245,6 +3046,10 @@ printf("timeval: %u ; %u\n", cur_hdr.ts.tv_sec, cur_hdr.ts.tv_usec);
 
 					total_nr_of_dns_packets++;
 
+					if (index_out) {
+						index_add_packet(index_out, pkt, src_addr, dst_addr);
+					}
+
 					if (match_expr) {
 						if (match_dns_packet_to_expr(pkt, src_addr, dst_addr, match_expr)) {
 							/* if outputfile write */
@@ -2381,6 +3186,10 @@ printf("timeval: %u ; %u\n", cur_hdr.ts.tv_sec, cur_hdr.ts.tv_usec);
 
 				total_nr_of_dns_packets++;
 
+				if (index_out) {
+					index_add_packet(index_out, pkt, src_addr, dst_addr);
+				}
+
 				if (match_expr) {
 					if (match_dns_packet_to_expr(pkt, src_addr, dst_addr, match_expr)) {
 						/* if outputfile write */
@@ -2590,6 +3399,9 @@ int main(int argc, char *argv[]) {
 	char *hexdumpfilename = NULL;
 	char *not_ip_dumpfile = NULL;
 	char *bad_dns_dumpfile = NULL;
+	char *index_out_file = NULL;
+	char *index_in_file = NULL;
+	dpa_index *index_in = NULL;
 
 	bool show_percentages = false;
 	bool show_averages = false;
@@ -2713,6 +3525,24 @@ int main(int argc, char *argv[]) {
 				status = EXIT_FAILURE;
 				goto exit;
 			}
+		} else if (strcmp("-wi", argv[i]) == 0) {
+			if (i + 1 < argc) {
+				index_out_file = argv[i + 1];
+				i++;
+			} else {
+				usage(stderr);
+				status = EXIT_FAILURE;
+				goto exit;
+			}
+		} else if (strcmp("-ri", argv[i]) == 0) {
+			if (i + 1 < argc) {
+				index_in_file = argv[i + 1];
+				i++;
+			} else {
+				usage(stderr);
+				status = EXIT_FAILURE;
+				goto exit;
+			}
 		} else if (strcmp("-v", argv[i]) == 0) {
 			i++;
 			if (i < argc) {
@@ -2730,16 +3560,40 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (!inputfile) {
-		inputfile = "-";
-	}
-
 	if (verbosity >= 5) {
 		printf("Filter:\n");
 		print_match_expression(stdout, expr);
 		printf("\n\n");
 	}
 
+	if (index_in_file) {
+		if (inputfile || index_out_file || dumpfile || hexdumpfilename ||
+		    not_ip_dumpfile || bad_dns_dumpfile || show_filter_matches) {
+			fprintf(stderr, "-ri cannot be used with a pcap file, or with -wi, -of, -ofh, -notip, -baddns or -sf\n");
+			status = EXIT_FAILURE;
+			goto exit;
+		}
+		index_in = index_read(index_in_file);
+		if (!index_in ||
+		    !index_match(index_in, expr, count, uniques, unique_ids, unique_id_count)) {
+			status = EXIT_FAILURE;
+			goto exit;
+		}
+		goto showresult;
+	}
+
+	if (index_out_file) {
+		index_out = index_new();
+		if (!index_out) {
+			printf("Malloc failed, out of mem?\n");
+			exit(4);
+		}
+	}
+
+	if (!inputfile) {
+		inputfile = "-";
+	}
+
 	pc = pcap_open_offline(inputfile, errbuf);
 	
 	if (!pc) {
@@ -2814,6 +3668,9 @@ int main(int argc, char *argv[]) {
 	pcap_close(pc);
 	
 	showresult:
+	if (index_out && !index_write(index_out, index_out_file)) {
+		status = EXIT_FAILURE;
+	}
 	if (show_percentages) {
 		fprintf(stdout, "Packets that are not IP: %u\n", (unsigned int) not_ip_packets);
 		fprintf(stdout, "bad dns packets: %u\n", (unsigned int) bad_dns_packets);
@@ -2843,6 +3700,8 @@ int main(int argc, char *argv[]) {
 	free_match_expression(expr);
 	free_counters(count);
 	free_counters(uniques);
+	index_free(index_in);
+	index_free(index_out);
 
 	return status;
 }
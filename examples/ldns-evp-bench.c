@@ -0,0 +1,435 @@
+/*
+ * ldns-evp-bench measures the throughput of the crypto operations of
+ * ldns over a number of threads: signing, verifying, digesting and the
+ * HMAC of TSIG.
+ *
+ * For every thread count the operations run for a while in all threads
+ * at once, and the total number of operations per second is printed.
+ * With -u the same operations are done the way ldns did them before the
+ * algorithms were cached: a digest by its legacy accessor and a new
+ * context for every operation, which makes OpenSSL 3 fetch the
+ * implementation again every time.
+ */
+
+#include "config.h"
+
+#include <ldns/ldns.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#define BENCH_MAX_THREADS 256
+#define BENCH_HMAC_KEY "0123456789abcdef0123456789abcdef"
+
+typedef enum bench_op
+{
+  BENCH_SIGN,
+  BENCH_VERIFY,
+  BENCH_DIGEST,
+  BENCH_HMAC,
+  BENCH_OPS
+} bench_op_t;
+
+static const char* bench_op_names[BENCH_OPS] =
+  { "sign", "verify", "digest", "hmac" };
+
+typedef struct bench
+{
+  bench_op_t op;
+  bool uncached;
+  EVP_PKEY* pkey;
+  /* NULL for the algorithms that hash themselves */
+  const char* md_name;
+  /* the data that is signed, digested and authenticated */
+  ldns_buffer* data;
+  unsigned char* sig;
+  size_t sig_len;
+  double seconds;
+} bench_t;
+
+typedef struct bench_thread
+{
+  pthread_t thread;
+  const bench_t* bench;
+  unsigned long ops;
+  bool failed;
+} bench_thread_t;
+
+static void
+usage(FILE* fp, const char* prog)
+{
+  fprintf(fp, "%s [options]\n", prog);
+  fprintf(fp, "  measure sign, verify, digest and hmac throughput over threads\n");
+  fprintf(fp, "  -a <alg>\talgorithm of the key (default ECDSAP256SHA256)\n");
+  fprintf(fp, "  -b <bits>\tkey size for RSA (default 2048)\n");
+  fprintf(fp, "  -o <op>\tonly this operation: sign, verify, digest or hmac\n");
+  fprintf(fp, "  -s <sec>\tseconds per measurement (default 2)\n");
+  fprintf(fp, "  -t <list>\tthread counts, comma separated (default 1,2,4,8)\n");
+  fprintf(fp, "  -u\t\tuncached: legacy digests and a new context per operation\n");
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* the digest the way it was used before, by its legacy accessor */
+static const EVP_MD*
+legacy_md(const char* name)
+{
+  if (!name) {
+    return NULL;
+  } else if (strcmp(name, "SHA1") == 0) {
+    return EVP_sha1();
+  } else if (strcmp(name, "SHA384") == 0) {
+    return EVP_sha384();
+  } else if (strcmp(name, "SHA512") == 0) {
+    return EVP_sha512();
+  }
+  return EVP_sha256();
+}
+
+static const EVP_MD*
+bench_md(const bench_t* b, const char* name)
+{
+  if (!name) {
+    return NULL;
+  }
+  return b->uncached ? legacy_md(name) : ldns_evp_md(name);
+}
+
+static EVP_MD_CTX*
+bench_ctx_get(const bench_t* b)
+{
+  return b->uncached ? EVP_MD_CTX_new() : ldns_evp_md_ctx_get();
+}
+
+static void
+bench_ctx_release(const bench_t* b, EVP_MD_CTX* ctx)
+{
+  if (b->uncached) {
+    EVP_MD_CTX_free(ctx);
+  } else {
+    ldns_evp_md_ctx_release(ctx);
+  }
+}
+
+/* sign like ldns_sign_public_evp(), raw output in sig */
+static bool
+bench_sign(const bench_t* b, unsigned char* sig, size_t* sig_len)
+{
+  EVP_MD_CTX* ctx = bench_ctx_get(b);
+  const EVP_MD* md = bench_md(b, b->md_name);
+  unsigned int len = (unsigned int)*sig_len;
+  int r = 0;
+
+  if (!ctx) {
+    return false;
+  }
+  if (!md) {
+    r = EVP_DigestSignInit(ctx, NULL, NULL, NULL, b->pkey) == 1
+        && EVP_DigestSign(ctx, sig, sig_len, ldns_buffer_begin(b->data),
+                          ldns_buffer_position(b->data)) == 1;
+  } else {
+    r = EVP_SignInit(ctx, md) == 1
+        && EVP_SignUpdate(ctx, ldns_buffer_begin(b->data),
+                          ldns_buffer_position(b->data)) == 1
+        && EVP_SignFinal(ctx, sig, &len, b->pkey) == 1;
+    *sig_len = len;
+  }
+  bench_ctx_release(b, ctx);
+  return r;
+}
+
+static bool
+bench_once(const bench_t* b)
+{
+  unsigned char dest[EVP_MAX_MD_SIZE];
+  unsigned char sig[LDNS_MAX_PACKETLEN];
+  unsigned int dest_len = 0;
+  size_t sig_len = sizeof(sig);
+  EVP_MD_CTX* ctx;
+  bool ok = false;
+
+  switch (b->op) {
+  case BENCH_SIGN:
+    ok = bench_sign(b, sig, &sig_len);
+    break;
+  case BENCH_VERIFY:
+    if (!b->uncached) {
+      ok = ldns_verify_rrsig_evp_raw(b->sig, b->sig_len, b->data, b->pkey,
+                                     bench_md(b, b->md_name))
+           == LDNS_STATUS_OK;
+      break;
+    }
+    ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+      break;
+    }
+    if (!b->md_name) {
+      ok = EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, b->pkey) == 1
+           && EVP_DigestVerify(ctx, b->sig, b->sig_len,
+                               ldns_buffer_begin(b->data),
+                               ldns_buffer_position(b->data)) == 1;
+    } else {
+      ok = EVP_VerifyInit(ctx, legacy_md(b->md_name)) == 1
+           && EVP_VerifyUpdate(ctx, ldns_buffer_begin(b->data),
+                               ldns_buffer_position(b->data)) == 1
+           && EVP_VerifyFinal(ctx, b->sig, (unsigned int)b->sig_len,
+                              b->pkey) == 1;
+    }
+    EVP_MD_CTX_free(ctx);
+    break;
+  case BENCH_DIGEST:
+    if (!b->uncached) {
+      ok = ldns_digest_evp(ldns_buffer_begin(b->data),
+                           (unsigned int)ldns_buffer_position(b->data),
+                           dest, ldns_evp_md("SHA256"));
+      break;
+    }
+    ctx = EVP_MD_CTX_new();
+    ok = ctx && EVP_DigestInit_ex(ctx, EVP_sha256(), NULL)
+         && EVP_DigestUpdate(ctx, ldns_buffer_begin(b->data),
+                             ldns_buffer_position(b->data))
+         && EVP_DigestFinal_ex(ctx, dest, NULL);
+    EVP_MD_CTX_free(ctx);
+    break;
+  case BENCH_HMAC:
+    if (!b->uncached) {
+      ok = ldns_evp_hmac(ldns_evp_md("SHA256"),
+                         (const unsigned char*)BENCH_HMAC_KEY,
+                         strlen(BENCH_HMAC_KEY), ldns_buffer_begin(b->data),
+                         ldns_buffer_position(b->data), dest, &dest_len);
+      break;
+    }
+    ok = HMAC(EVP_sha256(), BENCH_HMAC_KEY, (int)strlen(BENCH_HMAC_KEY),
+              ldns_buffer_begin(b->data), ldns_buffer_position(b->data),
+              dest, &dest_len) != NULL;
+    break;
+  default:
+    break;
+  }
+  return ok;
+}
+
+static void*
+bench_thread_run(void* arg)
+{
+  bench_thread_t* t = arg;
+  double end = now() + t->bench->seconds;
+  unsigned long i;
+
+  while (now() < end) {
+    /* look at the clock every so many operations only */
+    for (i = 0; i < 16; i++) {
+      if (!bench_once(t->bench)) {
+        t->failed = true;
+        return NULL;
+      }
+      t->ops++;
+    }
+  }
+  return NULL;
+}
+
+/* operations per second with nthreads threads, -1 on failure */
+static double
+bench_run(const bench_t* b, size_t nthreads)
+{
+  bench_thread_t threads[BENCH_MAX_THREADS];
+  unsigned long ops = 0;
+  double start, elapsed;
+  size_t i, started;
+  bool failed = false;
+
+  memset(threads, 0, sizeof(threads));
+  start = now();
+  for (started = 0; started < nthreads; started++) {
+    threads[started].bench = b;
+    if (pthread_create(&threads[started].thread, NULL, bench_thread_run,
+                       &threads[started]) != 0) {
+      failed = true;
+      break;
+    }
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i].thread, NULL);
+    ops += threads[i].ops;
+    failed = failed || threads[i].failed;
+  }
+  elapsed = now() - start;
+  return failed || elapsed <= 0 ? -1 : (double)ops / elapsed;
+}
+
+static const char*
+md_name_for(ldns_signing_algorithm alg)
+{
+  switch (alg) {
+  case LDNS_SIGN_RSASHA1:
+  case LDNS_SIGN_RSASHA1_NSEC3:
+    return "SHA1";
+  case LDNS_SIGN_RSASHA512:
+    return "SHA512";
+  case LDNS_SIGN_ECDSAP384SHA384:
+    return "SHA384";
+  case LDNS_SIGN_ED25519:
+  case LDNS_SIGN_ED448:
+    return NULL;
+  default:
+    return "SHA256";
+  }
+}
+
+/* some data the size of a typical rrset in canonical form, written up
+ * to the position as ldns_verify_rrsig_evp_raw() expects */
+static ldns_buffer*
+bench_data(void)
+{
+  ldns_buffer* data = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+  size_t i;
+
+  if (!data) {
+    return NULL;
+  }
+  for (i = 0; i < 512; i++) {
+    ldns_buffer_write_u8(data, (uint8_t)(i * 31 + 7));
+  }
+  return data;
+}
+
+int
+main(int argc, char** argv)
+{
+  bench_t b;
+  ldns_key* key = NULL;
+  ldns_signing_algorithm alg = LDNS_SIGN_ECDSAP256SHA256;
+  ldns_lookup_table* lt;
+  size_t threads[BENCH_MAX_THREADS];
+  size_t nthreads = 0;
+  char* list = NULL;
+  char* tok;
+  unsigned char sig[LDNS_MAX_PACKETLEN];
+  size_t sig_len = sizeof(sig);
+  uint16_t bits = 2048;
+  int only = -1;
+  int c, op;
+  size_t i;
+  double rate;
+
+  memset(&b, 0, sizeof(b));
+  b.seconds = 2;
+
+  while ((c = getopt(argc, argv, "a:b:ho:s:t:u")) != -1) {
+    switch (c) {
+    case 'a':
+      lt = ldns_lookup_by_name(ldns_signing_algorithms, optarg);
+      if (!lt) {
+        fprintf(stderr, "unknown algorithm %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      alg = (ldns_signing_algorithm)lt->id;
+      break;
+    case 'b':
+      bits = (uint16_t)atoi(optarg);
+      break;
+    case 'o':
+      for (op = 0; op < BENCH_OPS; op++) {
+        if (strcmp(optarg, bench_op_names[op]) == 0) {
+          only = op;
+        }
+      }
+      if (only == -1) {
+        fprintf(stderr, "unknown operation %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 's':
+      b.seconds = atof(optarg);
+      break;
+    case 't':
+      list = optarg;
+      break;
+    case 'u':
+      b.uncached = true;
+      break;
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(stderr, argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (list) {
+    for (tok = strtok(list, ","); tok && nthreads < BENCH_MAX_THREADS;
+         tok = strtok(NULL, ",")) {
+      if (atoi(tok) > 0 && atoi(tok) <= BENCH_MAX_THREADS) {
+        threads[nthreads++] = (size_t)atoi(tok);
+      }
+    }
+  } else {
+    for (i = 1; i <= 8; i *= 2) {
+      threads[nthreads++] = i;
+    }
+  }
+  if (nthreads == 0) {
+    fprintf(stderr, "no thread counts given\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (!(key = ldns_key_new_frm_algorithm(alg, bits)) ||
+      !(b.pkey = ldns_key_evp_key(key))) {
+    fprintf(stderr, "could not create a key\n");
+    exit(EXIT_FAILURE);
+  }
+  b.md_name = md_name_for(alg);
+  b.data = bench_data();
+  if (!b.data || !bench_sign(&b, sig, &sig_len)) {
+    fprintf(stderr, "could not sign\n");
+    exit(EXIT_FAILURE);
+  }
+  b.sig = sig;
+  b.sig_len = sig_len;
+
+  printf("%-8s", "threads");
+  for (i = 0; i < nthreads; i++) {
+    printf(" %12zu", threads[i]);
+  }
+  printf("\n");
+  for (op = 0; op < BENCH_OPS; op++) {
+    if (only != -1 && op != only) {
+      continue;
+    }
+    b.op = (bench_op_t)op;
+    printf("%-8s", bench_op_names[op]);
+    fflush(stdout);
+    for (i = 0; i < nthreads; i++) {
+      rate = bench_run(&b, threads[i]);
+      if (rate < 0) {
+        printf(" %12s", "failed");
+      } else {
+        printf(" %12.0f", rate);
+      }
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+  printf("operations per second, %s, %s\n",
+         ldns_lookup_by_id(ldns_signing_algorithms, (int)alg)->name,
+         b.uncached ? "uncached" : "cached");
+
+  ldns_buffer_free(b.data);
+  ldns_key_deep_free(key);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,492 @@
+/*
+ * ldns-filter-check checks RRSIGs against the filters published by
+ * ldns-gen-filter-rr as YYYYMMDD._filter.<zone> TXT records.
+ *
+ * It reads RRSIG records from stdin, one per line, and tells for every
+ * one of them whether the filter of its signer lists it as withdrawn.
+ *
+ * Filters are kept per zone, today's and tomorrow's. A check only
+ * consults the cache; the network is used for the first check of a zone
+ * only. While waiting for input the filters of zones in use are fetched
+ * again ahead of their expiry (the TTL of the TXT record, capped by the
+ * r= refresh hint in its header), and tomorrow's filter is fetched
+ * before the day rolls over. A fetched filter replaces the old one only
+ * once it is completely parsed, so a check never sees a partial filter
+ * and never waits for a refresh.
+ */
+
+#include "config.h"
+
+#include <ldns/ldns.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bloom_filter/bloom.h"
+#include "bloom_filter/filter_key.h"
+
+/* filters of zones not checked for this long are dropped */
+#define FILTER_IDLE_SECONDS 86400
+/* retry interval for zones without a (parsable) filter */
+#define FILTER_NEGATIVE_SECONDS 300
+/* the longest time to wait for input before looking at the cache */
+#define FILTER_MAX_WAIT_SECONDS 60
+
+typedef struct filter
+{
+  struct bloom bloom;
+  /* the r= hint from the header */
+  uint32_t refresh;
+  uint32_t ttl;
+} filter_t;
+
+typedef struct filter_day
+{
+  /* YYYYMMDD, 0 if the slot is unused */
+  uint32_t day;
+  /* NULL if there is no filter (yet) */
+  filter_t* filter;
+  /* the lookup has been done, filter NULL means none is published */
+  bool fetched;
+  time_t refresh_at;
+} filter_day_t;
+
+typedef struct filter_zone
+{
+  ldns_rdf* zone;
+  /* today and tomorrow */
+  filter_day_t days[2];
+  time_t last_used;
+  struct filter_zone* next;
+} filter_zone_t;
+
+typedef struct filter_cache
+{
+  ldns_resolver* res;
+  filter_zone_t* zones;
+  size_t fetches;
+  size_t prefetches;
+} filter_cache_t;
+
+static int verbosity = 1;
+
+static void usage(FILE* fp, const char* prog)
+{
+  fprintf(fp, "%s [-@ <server>] [-p <port>] [-v <level>]\n", prog);
+  fprintf(fp, "  reads RRSIG records from stdin, one per line, and prints for each\n");
+  fprintf(fp, "  whether the filter of its signer (YYYYMMDD._filter.<signer>) lists\n");
+  fprintf(fp, "  it as withdrawn\n");
+  fprintf(fp, "  -@ <server> - ask this nameserver (default: from resolv.conf)\n");
+  fprintf(fp, "  -p <port> - use this port for the server (default: 53)\n");
+  fprintf(fp, "  -v <level> - verbosity, 2 shows the filter fetches\n");
+}
+
+static uint32_t day_of(time_t t)
+{
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return (uint32_t)((tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100
+                    + tm.tm_mday);
+}
+
+static void filter_free(filter_t* f)
+{
+  if (f) {
+    bloom_free(&f->bloom);
+    free(f);
+  }
+}
+
+/*
+ * The TXT rdata is "r=<seconds>;a=<n>;d=" followed by a struct bloom and
+ * the bits of the filter, split in character strings.
+ */
+static filter_t* filter_new_frm_rr(const ldns_rr* txt)
+{
+  ldns_buffer* data = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+  filter_t* f = NULL;
+  const char* text;
+  const uint8_t* d;
+  size_t i, size;
+
+  if (!data) {
+    return NULL;
+  }
+  for (i = 0; i < ldns_rr_rd_count(txt); i++) {
+    const ldns_rdf* rdf = ldns_rr_rdf(txt, i);
+    if (ldns_rdf_size(rdf) > 1
+        && ldns_buffer_reserve(data, ldns_rdf_size(rdf) - 1)) {
+      ldns_buffer_write(data, ldns_rdf_data(rdf) + 1, ldns_rdf_size(rdf) - 1);
+    }
+  }
+  size = ldns_buffer_position(data);
+  text = (const char*)ldns_buffer_begin(data);
+  if (size < 2 || strncmp(text, "r=", 2) != 0) {
+    goto done;
+  }
+  for (i = 2; i + 2 < size && i < 64; i++) {
+    if (text[i] == 'd' && text[i + 1] == '=' && text[i - 1] == ';') {
+      break;
+    }
+  }
+  if (i + 2 >= size || i >= 64) {
+    goto done;
+  }
+  d = ldns_buffer_begin(data) + i + 2;
+  size -= i + 2;
+
+  f = calloc(1, sizeof(*f));
+  if (!f || size < sizeof(struct bloom)) {
+    free(f);
+    f = NULL;
+    goto done;
+  }
+  f->refresh = (uint32_t)strtoul(text + 2, NULL, 10);
+  f->ttl = ldns_rr_ttl(txt);
+  memcpy(&f->bloom, d, sizeof(struct bloom));
+  f->bloom.bf = NULL;
+  if (!f->bloom.ready || f->bloom.hashes == 0 || f->bloom.bits == 0
+      || f->bloom.bytes != size - sizeof(struct bloom)
+      || f->bloom.bits > f->bloom.bytes * 8
+      || !(f->bloom.bf = malloc(f->bloom.bytes))) {
+    free(f);
+    f = NULL;
+    goto done;
+  }
+  memcpy(f->bloom.bf, d + sizeof(struct bloom), f->bloom.bytes);
+done:
+  ldns_buffer_free(data);
+  return f;
+}
+
+/* look up the filter for one day of a zone, and swap it in */
+static void filter_fetch(filter_cache_t* cache, filter_zone_t* z,
+                         filter_day_t* slot, time_t now)
+{
+  char* zone_str = ldns_rdf2str(z->zone);
+  char name_str[LDNS_MAX_DOMAINLEN + 32];
+  ldns_rdf* name = NULL;
+  ldns_pkt* pkt = NULL;
+  ldns_rr_list* txts = NULL;
+  filter_t* f = NULL;
+  uint32_t interval = FILTER_NEGATIVE_SECONDS;
+  size_t i;
+
+  cache->fetches++;
+  if (zone_str) {
+    snprintf(name_str, sizeof(name_str), "%u._filter.%s",
+             (unsigned)slot->day, zone_str);
+    name = ldns_dname_new_frm_str(name_str);
+    free(zone_str);
+  }
+  if (name) {
+    pkt = ldns_resolver_query(cache->res, name, LDNS_RR_TYPE_TXT,
+                              LDNS_RR_CLASS_IN, LDNS_RD);
+  }
+  if (pkt) {
+    txts = ldns_pkt_rr_list_by_name_and_type(pkt, name, LDNS_RR_TYPE_TXT,
+                                             LDNS_SECTION_ANSWER);
+  }
+  for (i = 0; !f && i < ldns_rr_list_rr_count(txts); i++) {
+    f = filter_new_frm_rr(ldns_rr_list_rr(txts, i));
+  }
+  if (f) {
+    /* refresh ahead of the expiry */
+    interval = f->ttl;
+    if (f->refresh && f->refresh < interval) {
+      interval = f->refresh;
+    }
+    interval -= interval / 10;
+    if (interval < 1) {
+      interval = 1;
+    }
+  }
+  if (verbosity >= 2) {
+    fprintf(stderr, "fetched %s: %s, next in %u s\n",
+            name ? name_str : "?", f ? "filter" : "no filter",
+            (unsigned)interval);
+  }
+  /* a failed refresh keeps the filter we have */
+  if (f || !slot->fetched || (pkt && ldns_pkt_get_rcode(pkt)
+                              == LDNS_RCODE_NXDOMAIN)) {
+    filter_free(slot->filter);
+    slot->filter = f;
+  }
+  slot->fetched = true;
+  slot->refresh_at = now + interval;
+
+  ldns_rr_list_deep_free(txts);
+  ldns_pkt_free(pkt);
+  ldns_rdf_deep_free(name);
+}
+
+/* move the slots along when the day changes */
+static void filter_zone_roll(filter_zone_t* z, time_t now)
+{
+  uint32_t today = day_of(now);
+  uint32_t tomorrow = day_of(now + 86400);
+
+  if (z->days[0].day == today) {
+    return;
+  }
+  filter_free(z->days[0].filter);
+  if (z->days[1].day == today) {
+    z->days[0] = z->days[1];
+  }
+  else {
+    filter_free(z->days[1].filter);
+    memset(&z->days[0], 0, sizeof(z->days[0]));
+    z->days[0].day = today;
+  }
+  memset(&z->days[1], 0, sizeof(z->days[1]));
+  z->days[1].day = tomorrow;
+}
+
+static filter_zone_t* filter_zone_get(filter_cache_t* cache,
+                                      const ldns_rdf* zone, time_t now)
+{
+  filter_zone_t* z;
+
+  for (z = cache->zones; z; z = z->next) {
+    if (ldns_dname_compare(z->zone, zone) == 0) {
+      break;
+    }
+  }
+  if (!z) {
+    z = calloc(1, sizeof(*z));
+    if (!z || !(z->zone = ldns_rdf_clone(zone))) {
+      free(z);
+      return NULL;
+    }
+    ldns_dname2canonical(z->zone);
+    z->next = cache->zones;
+    cache->zones = z;
+  }
+  z->last_used = now;
+  filter_zone_roll(z, now);
+  /* only the first check of a zone waits for the network */
+  if (!z->days[0].fetched) {
+    filter_fetch(cache, z, &z->days[0], now);
+  }
+  return z;
+}
+
+/*
+ * Refresh what is due, for the zones in use, and return the number of
+ * seconds until the next refresh.
+ */
+static time_t filter_cache_prefetch(filter_cache_t* cache, time_t now)
+{
+  filter_zone_t **zp, *z;
+  time_t next = FILTER_MAX_WAIT_SECONDS;
+  size_t i;
+
+  for (zp = &cache->zones; (z = *zp);) {
+    if (now - z->last_used > FILTER_IDLE_SECONDS) {
+      *zp = z->next;
+      filter_free(z->days[0].filter);
+      filter_free(z->days[1].filter);
+      ldns_rdf_deep_free(z->zone);
+      free(z);
+      continue;
+    }
+    filter_zone_roll(z, now);
+    for (i = 0; i < 2; i++) {
+      if (!z->days[i].fetched || z->days[i].refresh_at <= now) {
+        cache->prefetches++;
+        filter_fetch(cache, z, &z->days[i], now);
+      }
+      if (z->days[i].refresh_at - now < next) {
+        next = z->days[i].refresh_at - now;
+      }
+    }
+    zp = &z->next;
+  }
+  return next > 0 ? next : 0;
+}
+
+static void filter_cache_free(filter_cache_t* cache)
+{
+  filter_zone_t* z;
+
+  while ((z = cache->zones)) {
+    cache->zones = z->next;
+    filter_free(z->days[0].filter);
+    filter_free(z->days[1].filter);
+    ldns_rdf_deep_free(z->zone);
+    free(z);
+  }
+}
+
+static const char* filter_check(filter_cache_t* cache, ldns_rr* rrsig,
+                                time_t now)
+{
+  filter_zone_t* z;
+  uint8_t* wire = NULL;
+  size_t size = 0;
+  int listed;
+
+  if (ldns_rr_get_type(rrsig) != LDNS_RR_TYPE_RRSIG
+      || !ldns_rr_rrsig_signame(rrsig) || !ldns_rr_rrsig_origttl(rrsig)) {
+    return "not an RRSIG";
+  }
+  z = filter_zone_get(cache, ldns_rr_rrsig_signame(rrsig), now);
+  if (!z) {
+    return "out of memory";
+  }
+  if (!z->days[0].filter) {
+    return "no filter";
+  }
+  if (filter_key(rrsig, &wire, &size) != LDNS_STATUS_OK) {
+    return "out of memory";
+  }
+  listed = bloom_check(&z->days[0].filter->bloom, wire, (int)size);
+  LDNS_FREE(wire);
+  return listed == 1 ? "withdrawn" : "ok";
+}
+
+static void check_line(filter_cache_t* cache, const char* line)
+{
+  ldns_rr* rr = NULL;
+  ldns_status s;
+  char* str;
+  char* type;
+
+  if (!*line || *line == ';') {
+    return;
+  }
+  s = ldns_rr_new_frm_str(&rr, line, 0, NULL, NULL);
+  if (s != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error parsing %s: %s\n", line,
+            ldns_get_errorstr_by_id(s));
+    return;
+  }
+  if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_RRSIG) {
+    ldns_rr_free(rr);
+    return;
+  }
+  str = ldns_rdf2str(ldns_rr_owner(rr));
+  type = ldns_rdf2str(ldns_rr_rrsig_typecovered(rr));
+  printf("%s %s %u: %s\n", str ? str : "?", type ? type : "?",
+         ldns_rr_rrsig_keytag(rr) ?
+         (unsigned)ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rr)) : 0,
+         filter_check(cache, rr, time(NULL)));
+  fflush(stdout);
+  free(type);
+  free(str);
+  ldns_rr_free(rr);
+}
+
+int main(int argc, char* argv[])
+{
+  filter_cache_t cache;
+  ldns_rdf* server = NULL;
+  ldns_status s;
+  char line[LDNS_MAX_LINELEN + 1];
+  size_t len = 0;
+  time_t wait;
+  uint16_t port = 0;
+  int c;
+
+  memset(&cache, 0, sizeof(cache));
+  while ((c = getopt(argc, argv, "@:p:v:h")) != -1) {
+    switch (c) {
+    case '@':
+      server = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_AAAA, optarg);
+      if (!server) {
+        server = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, optarg);
+      }
+      if (!server) {
+        fprintf(stderr, "Bad server address: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'p':
+      port = (uint16_t)atoi(optarg);
+      break;
+    case 'v':
+      verbosity = atoi(optarg);
+      break;
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(stderr, argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (server) {
+    cache.res = ldns_resolver_new();
+    if (!cache.res
+        || ldns_resolver_push_nameserver(cache.res, server)
+        != LDNS_STATUS_OK) {
+      fprintf(stderr, "Could not create a resolver\n");
+      exit(EXIT_FAILURE);
+    }
+    ldns_rdf_deep_free(server);
+  }
+  else if ((s = ldns_resolver_new_frm_file(&cache.res, NULL))
+           != LDNS_STATUS_OK) {
+    fprintf(stderr, "Could not create a resolver: %s\n",
+            ldns_get_errorstr_by_id(s));
+    exit(EXIT_FAILURE);
+  }
+  if (port) {
+    ldns_resolver_set_port(cache.res, port);
+  }
+
+  for (;;) {
+    struct pollfd pfd;
+    ssize_t n;
+    char* nl;
+
+    /* the refreshes happen here, never in a check */
+    wait = filter_cache_prefetch(&cache, time(NULL));
+    pfd.fd = 0;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, (int)wait * 1000) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (!(pfd.revents & (POLLIN | POLLHUP))) {
+      continue;
+    }
+    n = read(0, line + len, sizeof(line) - 1 - len);
+    if (n <= 0) {
+      break;
+    }
+    len += (size_t)n;
+    line[len] = 0;
+    while ((nl = strchr(line, '\n'))) {
+      *nl = 0;
+      check_line(&cache, line);
+      len -= (size_t)(nl + 1 - line);
+      memmove(line, nl + 1, len + 1);
+    }
+    if (len == sizeof(line) - 1) {
+      fprintf(stderr, "Line too long\n");
+      len = 0;
+    }
+  }
+  if (len > 0) {
+    line[len] = 0;
+    check_line(&cache, line);
+  }
+  if (verbosity >= 2) {
+    fprintf(stderr, "%u filter lookups, %u of them ahead of time\n",
+            (unsigned)cache.fetches, (unsigned)cache.prefetches);
+  }
+  filter_cache_free(&cache);
+  ldns_resolver_deep_free(cache.res);
+  exit(EXIT_SUCCESS);
+}
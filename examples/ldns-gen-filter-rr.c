@@ -10,7 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "bloom_filter/bloom.h"
-#include "examples/bloom_filter/murmurhash2.h"
+#include "bloom_filter/filter_key.h"
 #include "ldns/error.h"
 #include "ldns/host2str.h"
 #include "ldns/host2wire.h"
@@ -31,21 +31,23 @@
 
 #include "khashl.h"
 
-static inline int rr_hash_func(ldns_rr* rr)
+/* hashes the owner, type, class and rdata like ldns_rr_compare() sees
+ * them, without converting the rr to wire format */
+static inline khint_t rr_hash_func(const ldns_rr* rr)
 {
-  ldns_rr2canonical(rr);
-  uint8_t* wire = NULL;
-  size_t size = 0;
-  uint32_t hash = 0;
-  if (ldns_rr2wire(&wire, rr, LDNS_SECTION_ANSWER, &size) == LDNS_STATUS_OK) {
-    hash = murmurhash2(wire, (int)size, 0x9747b28c);
-    LDNS_FREE(wire);
+  uint8_t tc[4];
+  uint64_t hash;
+
+  ldns_write_uint16(tc, ldns_rr_get_type(rr));
+  ldns_write_uint16(tc + 2, ldns_rr_get_class(rr));
+  hash = ldns_casefold_hash(ldns_rdf_data(ldns_rr_owner(rr)),
+                            ldns_rdf_size(ldns_rr_owner(rr)), 0x9747b28c);
+  hash = ldns_casefold_hash(tc, sizeof(tc), hash);
+  for (size_t i = 0; i < ldns_rr_rd_count(rr); i++) {
+    hash = ldns_casefold_hash(ldns_rdf_data(ldns_rr_rdf(rr, i)),
+                              ldns_rdf_size(ldns_rr_rdf(rr, i)), hash);
   }
-  else {
-    exit(EXIT_FAILURE);
-  }
-
-  return hash;
+  return (khint_t)(hash ^ (hash >> 32));
 }
 
 static inline int rr_eq_func(const ldns_rr* a, const ldns_rr* b)
@@ -113,17 +115,29 @@ ldns_status load_rrsigs(const char* filename, ldns_rr_list** rrsig_list, bool rr
     *rrsig_list = ldns_zone_rrs(zone);
   }
   else {
-    while ((status = ldns_rr_new_frm_fp_l(&rr, fp, NULL, NULL, NULL, &line_nr)) == LDNS_STATUS_OK) {
-      if (!rr)
-        continue;
-
-      if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG) {
-        ldns_rr_list_push_rr(*rrsig_list, rr);
+    /* only the RRSIGs are parsed, the rdata of other rrs is skipped */
+    ldns_rr_type wanted[] = { LDNS_RR_TYPE_RRSIG };
+    ldns_rdf* types = ldns_dnssec_create_nsec_bitmap(wanted, 1, LDNS_RR_TYPE_NSEC);
+    ldns_rdf* origin = NULL;
+    ldns_rdf* prev = NULL;
+    uint32_t default_ttl = 3600;
+
+    if (!types) {
+      status = LDNS_STATUS_MEM_ERR;
+    }
+    while (status == LDNS_STATUS_OK || status == LDNS_STATUS_SYNTAX_EMPTY ||
+           status == LDNS_STATUS_SYNTAX_TTL || status == LDNS_STATUS_SYNTAX_ORIGIN) {
+      if (feof(fp)) {
+        break;
       }
-      else {
-        ldns_rr_free(rr);
+      status = ldns_rr_new_frm_fp_types_l(&rr, fp, &default_ttl, &origin, &prev, &line_nr, types);
+      if (status == LDNS_STATUS_OK) {
+        ldns_rr_list_push_rr(*rrsig_list, rr);
       }
     }
+    ldns_rdf_deep_free(types);
+    ldns_rdf_deep_free(origin);
+    ldns_rdf_deep_free(prev);
   }
 
   if (status != LDNS_STATUS_SYNTAX_EMPTY && status != LDNS_STATUS_OK) {
@@ -250,6 +264,7 @@ int main(int argc, char* argv[])
 
   for (size_t i = 0; i < ldns_rr_list_rr_count(sigs2); i++) {
     ldns_rr* rr = ldns_rr_list_rr(sigs2, i);
+    ldns_rr2canonical(rr);
     rr_set_put(set_z2, rr, &absent_set);
   }
 
@@ -259,6 +274,7 @@ int main(int argc, char* argv[])
 
   for (size_t i = 0; i < ldns_rr_list_rr_count(sigs1); i++) {
     ldns_rr* rrsig1 = ldns_rr_list_rr(sigs1, i);
+    ldns_rr2canonical(rrsig1);
     khint_t k_pos = rr_set_get(set_z2, rrsig1);
 
     if (k_pos != kh_end(set_z2)) {
@@ -299,7 +315,7 @@ int main(int argc, char* argv[])
     ldns_rr* rr = ldns_rr_list_rr(affected_rrsigs, i);
     uint8_t* wire = NULL;
     size_t size = 0;
-    if (ldns_rr2wire(&wire, rr, LDNS_SECTION_ANSWER, &size) == LDNS_STATUS_OK) {
+    if (filter_key(rr, &wire, &size) == LDNS_STATUS_OK) {
       bloom_add(&bloom, wire, (int)size);
       LDNS_FREE(wire);
     }
@@ -396,8 +412,6 @@ int main(int argc, char* argv[])
 
   fclose(fp);
 
-  ldns_rr_list_free(affected_rrsigs);
-
   ldns_rr_list_deep_free(affected_rrsigs);
   exit(EXIT_SUCCESS);
 }
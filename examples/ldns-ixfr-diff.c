@@ -0,0 +1,263 @@
+/*
+ * ldns-ixfr-diff writes the difference between two versions of a zone
+ * as an IXFR, in the text format of the IXFR files of masterdont.
+ *
+ * Both zone files must be sorted in canonical order (ldns-read-zone -z),
+ * they are compared in one pass without loading them.
+ *
+ * See the file LICENSE for the license
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <ldns/ldns.h>
+
+static void
+usage(FILE *f, char *progname)
+{
+	fprintf(f, "Usage: %s [OPTIONS] <old zonefile> <new zonefile>\n", progname);
+	fprintf(f, "  Write the difference between two sorted versions of a zone as an IXFR.\n");
+	fprintf(f, "  The zone files must be in canonical order, see ldns-read-zone -z.\n");
+	fprintf(f, "  The IXFR is printed to stdout, unless -d or -f is given.\n");
+	fprintf(f, "OPTIONS:\n");
+	fprintf(f, "-d DIR\t\tWrite zone.<name>.ixfr.<old serial> in DIR, for masterdont,\n");
+	fprintf(f, "\t\tand zone.<name>.index if it does not exist yet\n");
+	fprintf(f, "-f FILE\t\tWrite the IXFR to FILE\n");
+	fprintf(f, "-o ORIGIN\tUse this as initial origin, for zones starting with @\n");
+	fprintf(f, "-v\t\tShow the version number and exit\n");
+}
+
+/* the name of the zone as masterdont uses it, without the final dot */
+static char *
+zone_name(const ldns_rr *soa)
+{
+	char *name = ldns_rdf2str(ldns_rr_owner(soa));
+	size_t len;
+
+	if (name && (len = strlen(name)) > 1 && name[len - 1] == '.') {
+		name[len - 1] = '\0';
+	}
+	return name;
+}
+
+/* read the SOA of a zone file and rewind it, so the serials can be
+ * compared before anything is written */
+static ldns_status
+read_soa(FILE *fp, const ldns_rdf *origin, ldns_rr **soa, int *line_nr)
+{
+	ldns_rdf *my_origin = NULL;
+	ldns_rdf *my_prev = NULL;
+	uint32_t ttl = 0;
+	ldns_rr *rr;
+	ldns_status s = LDNS_STATUS_OK;
+
+	*soa = NULL;
+	if (origin) {
+		my_origin = ldns_rdf_clone(origin);
+		my_prev = ldns_rdf_clone(origin);
+		if (!my_origin || !my_prev) {
+			s = LDNS_STATUS_MEM_ERR;
+		}
+	}
+	while (s == LDNS_STATUS_OK && !*soa && !feof(fp)) {
+		s = ldns_rr_new_frm_fp_l(&rr, fp, &ttl, &my_origin, &my_prev,
+				line_nr);
+		switch (s) {
+		case LDNS_STATUS_OK:
+			if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+				*soa = rr;
+			} else {
+				ldns_rr_free(rr);
+			}
+			break;
+		case LDNS_STATUS_SYNTAX_EMPTY:
+		case LDNS_STATUS_SYNTAX_TTL:
+		case LDNS_STATUS_SYNTAX_ORIGIN:
+			s = LDNS_STATUS_OK;
+			break;
+		case LDNS_STATUS_SYNTAX_INCLUDE:
+			s = LDNS_STATUS_SYNTAX_INCLUDE_ERR_NOTIMPL;
+			break;
+		default:
+			break;
+		}
+	}
+	if (s == LDNS_STATUS_OK && !*soa) {
+		s = LDNS_STATUS_ZONE_NO_SOA;
+	}
+	ldns_rdf_deep_free(my_origin);
+	ldns_rdf_deep_free(my_prev);
+	rewind(fp);
+	return s;
+}
+
+/* create the index with the oldest serial, when there is none */
+static void
+write_index(const char *dir, const char *name, uint32_t serial)
+{
+	char path[1024];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/zone.%s.index", dir, name);
+	if (access(path, F_OK) == 0) {
+		return;
+	}
+	if (!(fp = fopen(path, "w"))) {
+		fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+		return;
+	}
+	fprintf(fp, "%u\n", (unsigned int) serial);
+	fclose(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *progname;
+	FILE *old_fp, *new_fp, *out;
+	int c;
+	ldns_rdf *origin = NULL;
+	ldns_rr *old_soa = NULL;
+	ldns_rr *new_soa = NULL;
+	ldns_status s;
+	uint32_t old_serial, new_serial;
+	const char *dir = NULL;
+	const char *outfile = NULL;
+	char tmpname[1024];
+	char path[1024];
+	char *name;
+	int line_nr;
+
+	progname = strdup(argv[0]);
+
+	while ((c = getopt(argc, argv, "d:f:o:v")) != -1) {
+		switch(c) {
+			case 'd':
+				dir = optarg;
+				break;
+			case 'f':
+				outfile = optarg;
+				break;
+			case 'o':
+				origin = ldns_dname_new_frm_str(optarg);
+				if (!origin) {
+					fprintf(stderr, "Cannot convert the origin %s to a domainname\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'v':
+				printf("zone file differ version %s (ldns version %s)\n", LDNS_VERSION, ldns_version());
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				fprintf(stderr, "Unrecognized option\n");
+				usage(stdout, progname);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2 || (dir && outfile)) {
+		usage(stdout, progname);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!(old_fp = fopen(argv[0], "r"))) {
+		fprintf(stderr, "Error opening %s: %s\n", argv[0], strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	if (!(new_fp = fopen(argv[1], "r"))) {
+		fprintf(stderr, "Error opening %s: %s\n", argv[1], strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/* the new serial must be greater, in serial number arithmetic;
+	 * check that before anything is written */
+	line_nr = 0;
+	if ((s = read_soa(old_fp, origin, &old_soa, &line_nr))
+			!= LDNS_STATUS_OK) {
+		fprintf(stderr, "Error reading %s at line %d: %s\n", argv[0],
+				line_nr, ldns_get_errorstr_by_id(s));
+		exit(EXIT_FAILURE);
+	}
+	line_nr = 0;
+	if ((s = read_soa(new_fp, origin, &new_soa, &line_nr))
+			!= LDNS_STATUS_OK) {
+		fprintf(stderr, "Error reading %s at line %d: %s\n", argv[1],
+				line_nr, ldns_get_errorstr_by_id(s));
+		exit(EXIT_FAILURE);
+	}
+	old_serial = ldns_rdf2native_int32(ldns_rr_rdf(old_soa, 2));
+	new_serial = ldns_rdf2native_int32(ldns_rr_rdf(new_soa, 2));
+	if ((int32_t) (new_serial - old_serial) <= 0) {
+		fprintf(stderr, "The new serial %u is not greater than the old "
+				"serial %u\n", (unsigned int) new_serial,
+				(unsigned int) old_serial);
+		exit(EXIT_FAILURE);
+	}
+
+	/* write under a temporary name and rename it when it is complete,
+	 * with -d because the name depends on the old serial, and with -f
+	 * to leave an existing file alone when the zones cannot be compared */
+	if (dir) {
+		snprintf(tmpname, sizeof(tmpname), "%s/.ldns-ixfr-diff.%d",
+				dir, (int) getpid());
+	} else if (outfile) {
+		snprintf(tmpname, sizeof(tmpname), "%s.ldns-ixfr-diff.%d",
+				outfile, (int) getpid());
+	}
+	if (!dir && !outfile) {
+		out = stdout;
+	} else if (!(out = fopen(tmpname, "w"))) {
+		fprintf(stderr, "Error opening %s: %s\n", tmpname,
+				strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	s = ldns_zone_diff_ixfr_fp(out, old_fp, new_fp, origin, 0, NULL, NULL);
+	fclose(old_fp);
+	fclose(new_fp);
+	if (out != stdout && fclose(out) != 0 && s == LDNS_STATUS_OK) {
+		s = LDNS_STATUS_FILE_ERR;
+	}
+	if (s != LDNS_STATUS_OK) {
+		fprintf(stderr, "Error comparing the zones: %s\n",
+				ldns_get_errorstr_by_id(s));
+		if (out != stdout) {
+			unlink(tmpname);
+		}
+		exit(EXIT_FAILURE);
+	}
+
+	if (outfile && rename(tmpname, outfile) != 0) {
+		fprintf(stderr, "Error renaming to %s: %s\n", outfile,
+				strerror(errno));
+		unlink(tmpname);
+		exit(EXIT_FAILURE);
+	}
+	if (dir) {
+		if (!(name = zone_name(new_soa))) {
+			fprintf(stderr, "Out of memory\n");
+			unlink(tmpname);
+			exit(EXIT_FAILURE);
+		}
+		snprintf(path, sizeof(path), "%s/zone.%s.ixfr.%u", dir, name,
+				(unsigned int) old_serial);
+		if (rename(tmpname, path) != 0) {
+			fprintf(stderr, "Error renaming to %s: %s\n", path,
+					strerror(errno));
+			unlink(tmpname);
+			exit(EXIT_FAILURE);
+		}
+		write_index(dir, name, old_serial);
+		LDNS_FREE(name);
+	}
+
+	ldns_rr_free(old_soa);
+	ldns_rr_free(new_soa);
+	ldns_rdf_deep_free(origin);
+	free(progname);
+	exit(EXIT_SUCCESS);
+}
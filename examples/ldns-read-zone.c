@@ -254,7 +254,9 @@ main(int argc, char **argv)
 		}
 	}
 	
-	s = ldns_zone_new_frm_fp_l(&z, fp, NULL, 0, LDNS_RR_CLASS_IN, &line_nr);
+	/* with show_types, the rdata of the other rrs is not parsed */
+	s = ldns_zone_new_frm_fp_types_l(&z, fp, NULL, 0, LDNS_RR_CLASS_IN,
+			&line_nr, show_types);
 
 	fclose(fp);
 	if (s != LDNS_STATUS_OK) {
@@ -0,0 +1,181 @@
+/*
+ * ldns-rrsig-bench measures what keeping the RRSIGs of a signed zone in
+ * compact form saves: it reads the zone, shows the heap in use, makes
+ * the RRSIGs compact and shows the heap in use again. It also times
+ * compacting, printing the compact zone and expanding it again.
+ *
+ * The heap in use is taken from mallinfo2(), where there is one.
+ */
+
+#include "config.h"
+
+#include <ldns/ldns.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+static void
+usage(FILE* out, const char* prog)
+{
+  fprintf(out, "Usage: %s [-o <origin>] <signed zonefile>\n", prog);
+  fprintf(out, "  Measure the memory that compact RRSIGs save.\n");
+  fprintf(out, "  -o <origin>   use this as initial origin\n");
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the heap in use, or 0 when it cannot be told */
+static size_t
+heap_in_use(void)
+{
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 mi = mallinfo2();
+
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static void
+print_heap(const char* what, size_t heap, size_t base)
+{
+  if (heap) {
+    printf("%-24s %12.1f kB\n", what, (heap - base) / 1024.0);
+  } else {
+    printf("%-24s %15s\n", what, "n/a");
+  }
+}
+
+static size_t
+count_rrsigs(ldns_dnssec_zone* zone)
+{
+  ldns_rbnode_t* node;
+  ldns_dnssec_name* name;
+  ldns_dnssec_rrsets* rrsets;
+  ldns_dnssec_rrs* rrs;
+  size_t count = 0;
+
+  for (node = ldns_rbtree_first(zone->names); node != LDNS_RBTREE_NULL;
+       node = ldns_rbtree_next(node)) {
+    name = (ldns_dnssec_name*)node->data;
+    for (rrsets = name->rrsets; rrsets; rrsets = rrsets->next) {
+      for (rrs = rrsets->signatures; rrs; rrs = rrs->next) {
+        count++;
+      }
+    }
+    for (rrs = name->nsec_signatures; rrs; rrs = rrs->next) {
+      count++;
+    }
+  }
+  return count;
+}
+
+int
+main(int argc, char** argv)
+{
+  ldns_rdf* origin = NULL;
+  ldns_dnssec_zone* zone = NULL;
+  FILE* fp;
+  FILE* null;
+  ldns_status s;
+  size_t base, loaded, compact, rrsigs;
+  double start;
+  int line_nr = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "ho:")) != -1) {
+    switch (c) {
+    case 'o':
+      origin = ldns_dname_new_frm_str(optarg);
+      if (!origin) {
+        fprintf(stderr, "Cannot convert the origin %s to a domainname\n",
+                optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'h':
+      usage(stdout, argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(stderr, argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (argc - optind != 1) {
+    usage(stderr, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (!(fp = fopen(argv[optind], "r"))) {
+    fprintf(stderr, "Error opening %s: %s\n", argv[optind], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (!(null = fopen("/dev/null", "w"))) {
+    fprintf(stderr, "Error opening /dev/null: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  base = heap_in_use();
+  s = ldns_dnssec_zone_new_frm_fp_l(&zone, fp, origin, 0,
+                                    LDNS_RR_CLASS_IN, &line_nr);
+  fclose(fp);
+  if (s != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error reading %s at line %d: %s\n", argv[optind],
+            line_nr, ldns_get_errorstr_by_id(s));
+    exit(EXIT_FAILURE);
+  }
+  loaded = heap_in_use();
+  rrsigs = count_rrsigs(zone);
+
+  start = now();
+  if ((s = ldns_dnssec_zone_compact_rrsigs(zone)) != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error making the RRSIGs compact: %s\n",
+            ldns_get_errorstr_by_id(s));
+    exit(EXIT_FAILURE);
+  }
+  printf("%-24s %12.3f s\n", "compact", now() - start);
+  compact = heap_in_use();
+
+  start = now();
+  ldns_dnssec_zone_print(null, zone);
+  printf("%-24s %12.3f s\n", "print compact", now() - start);
+
+  printf("%-24s %12zu\n", "RRSIGs", rrsigs);
+  print_heap("zone", loaded, base);
+  print_heap("zone, compact RRSIGs", compact, base);
+  if (loaded && compact && rrsigs) {
+    printf("%-24s %12.1f bytes\n", "saved per RRSIG",
+           ((double)loaded - (double)compact) / rrsigs);
+  }
+
+  start = now();
+  if ((s = ldns_dnssec_zone_expand_rrsigs(zone)) != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error expanding the RRSIGs: %s\n",
+            ldns_get_errorstr_by_id(s));
+    exit(EXIT_FAILURE);
+  }
+  printf("%-24s %12.3f s\n", "expand", now() - start);
+
+  start = now();
+  ldns_dnssec_zone_print(null, zone);
+  printf("%-24s %12.3f s\n", "print", now() - start);
+
+  fclose(null);
+  ldns_dnssec_zone_deep_free(zone);
+  ldns_rdf_deep_free(origin);
+  return EXIT_SUCCESS;
+}
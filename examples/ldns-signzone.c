@@ -16,6 +16,9 @@
 
 #include <errno.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <time.h>
 
 #include <ldns/ldns.h>
@@ -33,6 +36,9 @@
 
 #define MAX_FILENAME_LEN 250
 
+/* signatures handed to the signing threads at once, per thread */
+#define SIGN_BATCH_PER_THREAD 64
+
 char* prog;
 int verbosity = 2;
 
@@ -46,7 +52,13 @@ usage(FILE* fp, const char* prog)
   fprintf(fp, "  -e <date>\texpiration date\n");
   fprintf(fp, "  -f <file>\toutput zone to file (default <name>.signed)\n");
   fprintf(fp, "  -i <date>\tinception date\n");
+  fprintf(fp, "  -j <time>\tspread the expiration dates over this time before\n");
+  fprintf(fp, "           \tthe expiration date\n");
   fprintf(fp, "  -o <domain>\torigin for the zone\n");
+  fprintf(fp, "  -r <time>\tkeep the signatures of the previously signed zone that\n");
+  fprintf(fp, "           \tare valid for longer than this time, sign only the rest\n");
+  fprintf(fp, "  -R <file>\tthe previously signed zone (default the output file)\n");
+  fprintf(fp, "  -D <file>\twrite the number of signatures due per hour to file\n");
   fprintf(fp, "  -u\t\tset SOA serial to the number of seconds since 1-1-1970\n");
   fprintf(fp, "  -v\t\tprint version and exit\n");
   fprintf(fp, "  -z <[scheme:]hash>\tAdd ZONEMD resource record\n");
@@ -56,6 +68,8 @@ usage(FILE* fp, const char* prog)
   fprintf(fp, "  -Z\t\tAllow ZONEMDs to be added without signing\n");
   fprintf(fp, "  -A\t\tsign DNSKEY with all keys instead of minimal\n");
   fprintf(fp, "  -U\t\tSign with every unique algorithm in the provided keys\n");
+  fprintf(fp, "  -P <number>\tkeep this many signing operations in flight, each\n");
+  fprintf(fp, "           \tthread with its own engine session (default 1)\n");
 #ifndef OPENSSL_NO_ENGINE
   fprintf(fp, "  -E <name>\tuse <name> as the crypto engine for signing\n");
   fprintf(fp, "           \tThis can have a lot of extra options, see the manual page for more info\n");
@@ -68,6 +82,8 @@ usage(FILE* fp, const char* prog)
   fprintf(fp, "\t\t-t [number] number of hash iterations\n");
   fprintf(fp, "\t\t-s [string] salt\n");
   fprintf(fp, "\t\t-p set the opt-out flag on all nsec3 rrs\n");
+  fprintf(fp, "\t\t-H [file] reuse the hashed names in file, and save them\n");
+  fprintf(fp, "\t\t   there for the next run (created when absent)\n");
   fprintf(fp, "\n");
   fprintf(fp, "  keys must be specified by their base name (usually K<name>+<alg>+<id>),\n");
   fprintf(fp, "  i.e. WITHOUT the .private extension.\n");
@@ -75,6 +91,7 @@ usage(FILE* fp, const char* prog)
   fprintf(fp, "  will be read from the file called <base name>.key. If that does not exist,\n");
   fprintf(fp, "  a default DNSKEY will be generated from the private key and added to the zone.\n");
   fprintf(fp, "  A date can be a timestamp (seconds since the epoch), or of\n  the form <YYYYMMdd[hhmmss]>\n");
+  fprintf(fp, "  A time is a number of seconds, or a number followed by m, h, d or w.\n");
 #ifndef OPENSSL_NO_ENGINE
   fprintf(fp, "  For -k or -K, the algorithm can be specified as an integer or a symbolic name:");
 
@@ -479,7 +496,8 @@ post_process_engine_key(ldns_key_list* const keys,
                         const bool add_keys,
                         const uint32_t ttl,
                         const uint32_t inception,
-                        const uint32_t expiration)
+                        const uint32_t expiration,
+                        const uint32_t jitter)
 {
   if (key == NULL)
     return;
@@ -487,6 +505,8 @@ post_process_engine_key(ldns_key_list* const keys,
   if (expiration)
     ldns_key_set_expiration(key, expiration);
 
+  ldns_key_set_expiration_jitter(key, jitter);
+
   if (inception)
     ldns_key_set_inception(key, inception);
 
@@ -572,6 +592,553 @@ shutdown_openssl(ENGINE* const e)
 }
 #endif
 
+#ifdef HAVE_PTHREAD
+/*
+ * Signing in threads (-P). The zone is walked as usual, but the
+ * signatures to make are queued and handed to the threads a batch at a
+ * time. Each thread takes the next signature of the batch and puts its
+ * result in place, so they are collected in the order they were queued.
+ * Keys from the engine are opened again for every thread, so that each
+ * has its own session with the HSM. Other keys are shared.
+ */
+typedef struct sign_pool sign_pool_t;
+
+typedef struct sign_thread
+{
+  pthread_t thread;
+  sign_pool_t* pool;
+  /* the handle of this thread for every key in the key list */
+  ldns_key** keys;
+} sign_thread_t;
+
+struct sign_pool
+{
+  pthread_mutex_t lock;
+  /* signalled when there are jobs to take, or the threads must stop */
+  pthread_cond_t work;
+  /* signalled when the last job of the batch is done */
+  pthread_cond_t done;
+  ldns_key_list* keys;
+  ldns_dnssec_sign_job* jobs;
+  size_t count;
+  /* the next job to take */
+  size_t next;
+  size_t finished;
+  bool failed;
+  bool stop;
+  size_t nthreads;
+  size_t started;
+  sign_thread_t* threads;
+#ifndef OPENSSL_NO_ENGINE
+  ENGINE* engine;
+  /* the keys loaded with -k and -K, and their specifications */
+  ldns_key* engine_keys[2];
+  const char* engine_specs[2];
+#endif
+};
+
+static void*
+sign_thread_run(void* arg)
+{
+  sign_thread_t* t = (sign_thread_t*)arg;
+  sign_pool_t* pool = t->pool;
+  ldns_dnssec_sign_job* job;
+  ldns_key* key;
+  ldns_rdf* signature;
+  size_t k;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stop && pool->next >= pool->count)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    if (pool->stop)
+      break;
+    job = &pool->jobs[pool->next++];
+    pthread_mutex_unlock(&pool->lock);
+
+    key = job->key;
+    for (k = 0; k < ldns_key_list_key_count(pool->keys); k++) {
+      if (ldns_key_list_key(pool->keys, k) == job->key) {
+        key = t->keys[k];
+        break;
+      }
+    }
+    signature = ldns_sign_public_buffer(job->data, key);
+
+    pthread_mutex_lock(&pool->lock);
+    job->signature = signature;
+    if (!signature)
+      pool->failed = true;
+    if (++pool->finished == pool->count)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* the signer for ldns_dnssec_zone_set_signer() */
+static ldns_status
+sign_pool_sign(ldns_dnssec_sign_job* jobs, size_t count, void* arg)
+{
+  sign_pool_t* pool = (sign_pool_t*)arg;
+  bool failed;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->jobs = jobs;
+  pool->count = count;
+  pool->next = 0;
+  pool->finished = 0;
+  pool->failed = false;
+  pthread_cond_broadcast(&pool->work);
+  while (pool->finished < count)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  failed = pool->failed;
+  pool->jobs = NULL;
+  pool->count = 0;
+  pthread_mutex_unlock(&pool->lock);
+
+  return failed ? LDNS_STATUS_ERR : LDNS_STATUS_OK;
+}
+
+/* the handle of thread t for key, a new engine session for engine keys */
+static ldns_key*
+sign_pool_key(sign_pool_t* pool, size_t t, ldns_key* key)
+{
+#ifndef OPENSSL_NO_ENGINE
+  enum ldns_enum_signing_algorithm alg = 0;
+  const char* id = NULL;
+  ldns_key* handle = NULL;
+  ldns_status s;
+  size_t i;
+
+  for (i = 0; t > 0 && i < 2; i++) {
+    if (key != pool->engine_keys[i])
+      continue;
+
+    (void)parse_keyspec(pool->engine_specs[i], &alg, &id);
+    s = ldns_key_new_frm_engine(&handle, pool->engine, (char*)id,
+                                (ldns_algorithm)alg);
+    if (s != LDNS_STATUS_OK) {
+      fprintf(stderr, "Error opening engine key %s for thread %zu: %s\n",
+              id, t, ldns_get_errorstr_by_id(s));
+      ERR_print_errors_fp(stderr);
+      return NULL;
+    }
+    return handle;
+  }
+#else
+  (void)pool;
+  (void)t;
+#endif
+  return key;
+}
+
+static void
+sign_pool_free(sign_pool_t* pool)
+{
+  size_t t, k;
+
+  if (!pool)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (t = 0; t < pool->started; t++)
+    pthread_join(pool->threads[t].thread, NULL);
+
+  for (t = 0; t < pool->nthreads; t++) {
+    if (!pool->threads[t].keys)
+      continue;
+    for (k = 0; k < ldns_key_list_key_count(pool->keys); k++) {
+      if (pool->threads[t].keys[k]
+          && pool->threads[t].keys[k] != ldns_key_list_key(pool->keys, k))
+        ldns_key_deep_free(pool->threads[t].keys[k]);
+    }
+    LDNS_FREE(pool->threads[t].keys);
+  }
+  LDNS_FREE(pool->threads);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+  pthread_mutex_destroy(&pool->lock);
+  LDNS_FREE(pool);
+}
+
+/* opens the key handles of the threads, and starts them */
+static sign_pool_t*
+sign_pool_start(sign_pool_t* pool)
+{
+  size_t key_count = ldns_key_list_key_count(pool->keys);
+  sign_thread_t* t;
+  size_t k;
+  int r;
+
+  pool->threads = LDNS_CALLOC(sign_thread_t, pool->nthreads);
+  if (!pool->threads) {
+    fprintf(stderr, "Memory error\n");
+    sign_pool_free(pool);
+    return NULL;
+  }
+  for (pool->started = 0; pool->started < pool->nthreads; pool->started++) {
+    t = &pool->threads[pool->started];
+    t->pool = pool;
+    t->keys = LDNS_CALLOC(ldns_key*, key_count + 1);
+    if (!t->keys) {
+      fprintf(stderr, "Memory error\n");
+      sign_pool_free(pool);
+      return NULL;
+    }
+    for (k = 0; k < key_count; k++) {
+      t->keys[k] = sign_pool_key(pool, pool->started,
+                                 ldns_key_list_key(pool->keys, k));
+      if (!t->keys[k]) {
+        sign_pool_free(pool);
+        return NULL;
+      }
+    }
+    if ((r = pthread_create(&t->thread, NULL, sign_thread_run, t)) != 0) {
+      fprintf(stderr, "Error starting signing thread: %s\n",
+              strerror(r));
+      sign_pool_free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+static sign_pool_t*
+sign_pool_new(ldns_key_list* keys, size_t nthreads)
+{
+  sign_pool_t* pool = LDNS_CALLOC(sign_pool_t, 1);
+
+  if (!pool) {
+    fprintf(stderr, "Memory error\n");
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->keys = keys;
+  pool->nthreads = nthreads;
+  return pool;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Replace the NSEC3 hash cache file, so an interrupted run keeps the old */
+static void
+write_nsec3_hash_cache(const ldns_nsec3_hash_cache* cache, const char* name)
+{
+  char tmp_name[MAX_FILENAME_LEN];
+  FILE* fp;
+  ldns_status s;
+
+  snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name);
+  if (!(fp = fopen(tmp_name, "wb"))) {
+    fprintf(stderr, "Unable to open %s for writing: %s\n",
+            tmp_name, strerror(errno));
+    return;
+  }
+  s = ldns_nsec3_hash_cache_write(cache, fp);
+  if (fclose(fp) != 0 && s == LDNS_STATUS_OK)
+    s = LDNS_STATUS_FILE_ERR;
+  if (s != LDNS_STATUS_OK) {
+    fprintf(stderr, "Error writing NSEC3 hash cache %s: %s\n",
+            tmp_name, ldns_get_errorstr_by_id(s));
+    (void)remove(tmp_name);
+  }
+  else if (rename(tmp_name, name) != 0) {
+    fprintf(stderr, "Unable to rename %s to %s: %s\n",
+            tmp_name, name, strerror(errno));
+  }
+}
+
+/* Parse a time like 3600, 90m, 12h, 10d or 2w into seconds */
+static uint32_t
+parse_time(const char* arg)
+{
+  char* end;
+  unsigned long t = strtoul(arg, &end, 10);
+
+  switch (*end) {
+  case 'w': t *= 7; /* fallthrough */
+  case 'd': t *= 24; /* fallthrough */
+  case 'h': t *= 60; /* fallthrough */
+  case 'm': t *= 60; end++; break;
+  case 's': end++; break;
+  default: break;
+  }
+  if (end == arg || *end || t > 0x7fffffffUL) {
+    fprintf(stderr, "Bad time: %s\n", arg);
+    exit(EXIT_FAILURE);
+  }
+  return (uint32_t)t;
+}
+
+/*
+ * State for keep_valid_signatures(), which decides per signature taken
+ * over from the previously signed zone whether it can stay.
+ */
+struct resign_state {
+  ldns_dnssec_zone* zone;
+  ldns_dnssec_zone* prev;
+  time_t now;
+  uint32_t refresh;
+  /* keytags and algorithms of the keys signed with */
+  size_t key_count;
+  uint16_t* keytags;
+  uint8_t* algorithms;
+  /* ldns_dnssec_remove_signatures() asks twice for the first one */
+  ldns_rr* last_sig;
+  int last_result;
+};
+
+/* The rrset that sig covers in zone, or NULL */
+static ldns_rr_list*
+covered_rrset(const ldns_dnssec_zone* zone, const ldns_rr* sig)
+{
+  ldns_rr_type type = ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(sig));
+  ldns_rbnode_t* node = NULL;
+  ldns_dnssec_name* name;
+  ldns_dnssec_rrsets* rrset;
+  ldns_dnssec_rrs* rrs;
+  ldns_rr_list* rr_list;
+  ldns_rdf* label;
+
+  /* nsec3s are found by their hash, but are kept with the original */
+  if (type == LDNS_RR_TYPE_NSEC3) {
+    if (zone->hashed_names
+        && (label = ldns_dname_label(ldns_rr_owner(sig), 0))) {
+      node = ldns_rbtree_search(zone->hashed_names, label);
+      ldns_rdf_deep_free(label);
+    }
+  }
+  else if (zone->names) {
+    node = ldns_rbtree_search(zone->names, ldns_rr_owner(sig));
+  }
+  if (!node || node == LDNS_RBTREE_NULL || !(rr_list = ldns_rr_list_new()))
+    return NULL;
+  name = (ldns_dnssec_name*)node->data;
+
+  if (type == LDNS_RR_TYPE_NSEC || type == LDNS_RR_TYPE_NSEC3) {
+    if (name->nsec && ldns_rr_get_type(name->nsec) == type)
+      ldns_rr_list_push_rr(rr_list, name->nsec);
+  }
+  else if ((rrset = ldns_dnssec_name_find_rrset(name, type))) {
+    for (rrs = rrset->rrs; rrs; rrs = rrs->next)
+      ldns_rr_list_push_rr(rr_list, rrs->rr);
+  }
+  if (ldns_rr_list_rr_count(rr_list) == 0) {
+    ldns_rr_list_free(rr_list);
+    return NULL;
+  }
+  return rr_list;
+}
+
+/*
+ * Keep a signature when it is valid for longer than the refresh time,
+ * made with one of the keys, and the rrset it covers is the same as it
+ * was in the previously signed zone. Remove it and sign again
+ * otherwise. The previous signatures themselves are not verified.
+ */
+static int
+keep_valid_signatures(ldns_rr* sig, void* arg)
+{
+  struct resign_state* st = (struct resign_state*)arg;
+  ldns_rr_list *now_rrset = NULL, *prev_rrset = NULL;
+  uint32_t inception, expiration;
+  uint16_t keytag;
+  uint8_t algorithm;
+  size_t i;
+
+  if (!sig)
+    return LDNS_SIGNATURE_REMOVE_ADD_NEW;
+  if (sig == st->last_sig)
+    return st->last_result;
+  st->last_sig = sig;
+  st->last_result = LDNS_SIGNATURE_REMOVE_ADD_NEW;
+
+  if (ldns_rr_rd_count(sig) < 9)
+    return st->last_result;
+  inception = ldns_rdf2native_int32(ldns_rr_rrsig_inception(sig));
+  expiration = ldns_rdf2native_int32(ldns_rr_rrsig_expiration(sig));
+  if ((int32_t)(inception - (uint32_t)st->now) > 0
+      || (int32_t)(expiration - (uint32_t)st->now) <= (int32_t)st->refresh)
+    return st->last_result;
+
+  keytag = ldns_rdf2native_int16(ldns_rr_rrsig_keytag(sig));
+  algorithm = ldns_rdf2native_int8(ldns_rr_rrsig_algorithm(sig));
+  for (i = 0; i < st->key_count; i++) {
+    if (st->keytags[i] == keytag && st->algorithms[i] == algorithm)
+      break;
+  }
+  if (i == st->key_count)
+    return st->last_result;
+
+  /* the rrset must be the same, its ttl included */
+  now_rrset = covered_rrset(st->zone, sig);
+  prev_rrset = covered_rrset(st->prev, sig);
+  if (now_rrset && prev_rrset
+      && ldns_rr_list_compare(now_rrset, prev_rrset) == 0
+      && ldns_rdf2native_int32(ldns_rr_rrsig_origttl(sig))
+      == ldns_rr_ttl(ldns_rr_list_rr(now_rrset, 0))) {
+    for (i = 0; i < ldns_rr_list_rr_count(now_rrset); i++) {
+      if (ldns_rr_ttl(ldns_rr_list_rr(now_rrset, i))
+          != ldns_rr_ttl(ldns_rr_list_rr(prev_rrset, i)))
+        break;
+    }
+    if (i == ldns_rr_list_rr_count(now_rrset))
+      st->last_result = LDNS_SIGNATURE_LEAVE_NO_ADD;
+  }
+  ldns_rr_list_free(now_rrset);
+  ldns_rr_list_free(prev_rrset);
+  return st->last_result;
+}
+
+/* Put copies of the list nodes of sigs in front of *to */
+static void
+take_signatures(ldns_dnssec_rrs** to, const ldns_dnssec_rrs* sigs)
+{
+  ldns_dnssec_rrs* rrs;
+
+  for (; sigs; sigs = sigs->next) {
+    if (!(rrs = ldns_dnssec_rrs_new()))
+      return;
+    rrs->rr = sigs->rr;
+    rrs->next = *to;
+    *to = rrs;
+  }
+}
+
+/*
+ * Give the names in the zone to sign the signatures they had in the
+ * previously signed zone, for keep_valid_signatures() to look at. The
+ * rrs stay owned by the previous zone.
+ */
+static void
+take_previous_signatures(ldns_dnssec_zone* zone, ldns_dnssec_zone* prev)
+{
+  ldns_rbnode_t *node, *prev_node;
+  ldns_dnssec_name *name, *prev_name;
+  ldns_dnssec_rrsets *rrset, *prev_rrset;
+
+  if (!zone->names || !prev->names)
+    return;
+  for (node = ldns_rbtree_first(zone->names); node != LDNS_RBTREE_NULL;
+       node = ldns_rbtree_next(node)) {
+    name = (ldns_dnssec_name*)node->data;
+    prev_node = ldns_rbtree_search(prev->names, name->name);
+    if (!prev_node)
+      continue;
+    prev_name = (ldns_dnssec_name*)prev_node->data;
+    for (rrset = name->rrsets; rrset; rrset = rrset->next) {
+      if ((prev_rrset = ldns_dnssec_name_find_rrset(prev_name, rrset->type)))
+        take_signatures(&rrset->signatures, prev_rrset->signatures);
+    }
+    take_signatures(&name->nsec_signatures, prev_name->nsec_signatures);
+  }
+}
+
+static void
+count_due(size_t** due, size_t* due_hours, const ldns_dnssec_rrs* sigs,
+          time_t now, uint32_t refresh)
+{
+  uint32_t expiration;
+  int32_t left;
+  size_t hour, *grown;
+
+  for (; sigs; sigs = sigs->next) {
+    if (ldns_rr_rd_count(sigs->rr) < 9)
+      continue;
+    expiration = ldns_rdf2native_int32(ldns_rr_rrsig_expiration(sigs->rr));
+    left = (int32_t)(expiration - refresh - (uint32_t)now);
+    if (left < 0)
+      left = 0;
+    /* by clock hour, the current one being 0 */
+    hour = (size_t)((now + left) / 3600 - now / 3600);
+    if (hour >= *due_hours) {
+      grown = LDNS_XREALLOC(*due, size_t, hour + 1);
+      if (!grown)
+        continue;
+      memset(grown + *due_hours, 0,
+             (hour + 1 - *due_hours) * sizeof(size_t));
+      *due = grown;
+      *due_hours = hour + 1;
+    }
+    (*due)[hour]++;
+  }
+}
+
+/*
+ * Count the signatures in the zone by the hour in which they are due to
+ * be made again, which is the refresh time before they expire. Write
+ * the count for every hour to due_name when given, and a summary to
+ * stderr.
+ */
+static void
+report_due(const ldns_dnssec_zone* zone, const ldns_rr_list* added_rrs,
+           time_t now, uint32_t refresh, const char* due_name)
+{
+  ldns_rbnode_t* node;
+  ldns_dnssec_name* name;
+  ldns_dnssec_rrsets* rrset;
+  size_t* due = NULL;
+  size_t due_hours = 0, total = 0, added = 0, busiest = 0, hours = 0;
+  size_t first = 0, i;
+  FILE* fp = NULL;
+  struct tm tm;
+  char buf[32];
+
+  for (node = ldns_rbtree_first(zone->names); node != LDNS_RBTREE_NULL;
+       node = ldns_rbtree_next(node)) {
+    name = (ldns_dnssec_name*)node->data;
+    for (rrset = name->rrsets; rrset; rrset = rrset->next)
+      count_due(&due, &due_hours, rrset->signatures, now, refresh);
+    count_due(&due, &due_hours, name->nsec_signatures, now, refresh);
+  }
+  for (i = 0; i < ldns_rr_list_rr_count(added_rrs); i++) {
+    if (ldns_rr_get_type(ldns_rr_list_rr(added_rrs, i))
+        == LDNS_RR_TYPE_RRSIG)
+      added++;
+  }
+  for (i = 0; i < due_hours; i++) {
+    if (due[i] && !total)
+      first = i;
+    total += due[i];
+    if (due[i] > busiest)
+      busiest = due[i];
+  }
+  if (total)
+    hours = due_hours - first;
+
+  if (due_name && !(fp = fopen(due_name, "w"))) {
+    fprintf(stderr, "Unable to open %s for writing: %s\n",
+            due_name, strerror(errno));
+  }
+  if (fp) {
+    fprintf(fp, "; signatures due per hour (UTC), %u seconds before "
+                "they expire\n", (unsigned)refresh);
+    for (i = first; i < due_hours; i++) {
+      if (!ldns_serial_arithmetics_gmtime_r(
+            (int32_t)((now / 3600 + (time_t)i) * 3600), now, &tm)
+          || !strftime(buf, sizeof(buf), "%Y-%m-%d %H:00", &tm))
+        snprintf(buf, sizeof(buf), "+%u h", (unsigned)i);
+      fprintf(fp, "%s\t%u\n", buf, (unsigned)due[i]);
+    }
+    fclose(fp);
+  }
+  if (verbosity >= 2) {
+    fprintf(stderr, "Signatures: %u, %u reused, %u new\n",
+            (unsigned)total, (unsigned)(total > added ? total - added : 0),
+            (unsigned)added);
+    if (hours)
+      fprintf(stderr, "Due per hour: at most %u, %.1f on average "
+                      "over %u hours\n", (unsigned)busiest,
+              (double)total / hours, (unsigned)hours);
+  }
+  LDNS_FREE(due);
+}
+
 int str2zonemd_signflag(const char* str, const char** reason)
 {
   char* colon;
@@ -629,6 +1196,8 @@ int main(int argc, char* argv[])
 #ifndef OPENSSL_NO_ENGINE
   ldns_key* eng_ksk = NULL; /* KSK specified with -K */
   ldns_key* eng_zsk = NULL; /* ZSK specified with -k */
+  const char* eng_ksk_spec = NULL;
+  const char* eng_zsk_spec = NULL;
 #endif
   ldns_key_list* keys;
   ldns_status s;
@@ -641,6 +1210,10 @@ int main(int argc, char* argv[])
   bool use_nsec3 = false;
   int signflags = 0;
   bool unixtime_serial = false;
+  long sign_threads = 1;
+#ifdef HAVE_PTHREAD
+  sign_pool_t* sign_pool = NULL;
+#endif
 
   /* Add the given keys to the zone if they are not yet present */
   bool add_keys = true;
@@ -650,6 +1223,9 @@ int main(int argc, char* argv[])
   uint16_t nsec3_iterations = 1;
   uint8_t nsec3_salt_length = 0;
   uint8_t* nsec3_salt = NULL;
+  const char* nsec3_cache_name = NULL;
+  ldns_nsec3_hash_cache* nsec3_cache = NULL;
+  FILE* nsec3_cache_file;
 
   /* we need to know the origin before reading ksk's,
    * so keep an array of filenames until we know it
@@ -657,6 +1233,13 @@ int main(int argc, char* argv[])
   struct tm tm;
   uint32_t inception;
   uint32_t expiration;
+  uint32_t jitter = 0;
+  uint32_t refresh = 0;
+  bool resign = false;
+  const char* prev_name = NULL;
+  const char* due_name = NULL;
+  FILE* prev_file;
+  struct resign_state resign_st;
   ldns_rdf* origin = NULL;
   uint32_t ttl = LDNS_DEFAULT_TTL;
   ldns_rr_class class = LDNS_RR_CLASS_IN;
@@ -676,7 +1259,7 @@ int main(int argc, char* argv[])
 
   keys = ldns_key_list_new();
 
-  while ((c = getopt(argc, argv, "a:bde:f:i:k:no:ps:t:uvz:ZAUE:K:")) != -1) {
+  while ((c = getopt(argc, argv, "a:bde:f:i:j:k:no:pr:s:t:uvz:ZAUD:E:H:K:P:R:")) != -1) {
     switch (c) {
     case 'a':
       nsec3_algorithm = (uint8_t)atoi(optarg);
@@ -737,6 +1320,9 @@ int main(int argc, char* argv[])
         inception = (uint32_t)atol(optarg);
       }
       break;
+    case 'j':
+      jitter = parse_time(optarg);
+      break;
     case 'n':
       use_nsec3 = true;
       break;
@@ -747,6 +1333,19 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
       }
       break;
+    case 'H':
+      nsec3_cache_name = optarg;
+      break;
+    case 'r':
+      refresh = parse_time(optarg);
+      resign = true;
+      break;
+    case 'R':
+      prev_name = optarg;
+      break;
+    case 'D':
+      due_name = optarg;
+      break;
     case 'p':
       nsec3_flags = nsec3_flags | LDNS_NSEC3_VARS_OPTOUT_MASK;
       break;
@@ -784,6 +1383,7 @@ int main(int argc, char* argv[])
     case 'k':
 #ifndef OPENSSL_NO_ENGINE
       eng_zsk = load_key(optarg, engine);
+      eng_zsk_spec = optarg;
       break;
 #else
       /* fallthrough */
@@ -791,6 +1391,7 @@ int main(int argc, char* argv[])
     case 'K':
 #ifndef OPENSSL_NO_ENGINE
       eng_ksk = load_key(optarg, engine);
+      eng_ksk_spec = optarg;
       /* I apologize for that, there is no API. */
       eng_ksk->_extra.dnssec.flags |= LDNS_KEY_SEP_KEY;
 #else
@@ -801,6 +1402,20 @@ int main(int argc, char* argv[])
     case 'U':
       signflags |= LDNS_SIGN_WITH_ALL_ALGORITHMS;
       break;
+    case 'P':
+      sign_threads = atol(optarg);
+      if (sign_threads < 1) {
+        fprintf(stderr, "Bad number of signing operations: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+#ifndef HAVE_PTHREAD
+      if (sign_threads > 1) {
+        fprintf(stderr, "Warning: built without threads, -P %s signs "
+                        "one at a time\n", optarg);
+        sign_threads = 1;
+      }
+#endif
+      break;
     case 's':
       if (strlen(optarg) % 2 != 0) {
         fprintf(stderr, "Salt value is not valid hex data, not a multiple of 2 characters\n");
@@ -946,6 +1561,7 @@ int main(int argc, char* argv[])
         if (inception != 0) {
           ldns_key_set_inception(key, inception);
         }
+        ldns_key_set_expiration_jitter(key, jitter);
 
         LDNS_FREE(keyfile_name);
 
@@ -980,7 +1596,8 @@ int main(int argc, char* argv[])
                           add_keys,
                           ttl,
                           inception,
-                          expiration);
+                          expiration,
+                          jitter);
 
   /* The engine's ZSK. */
   post_process_engine_key(keys,
@@ -989,7 +1606,8 @@ int main(int argc, char* argv[])
                           add_keys,
                           ttl,
                           inception,
-                          expiration);
+                          expiration,
+                          jitter);
 #endif
   if (ldns_key_list_key_count(keys) < 1
       && !(signflags & LDNS_SIGN_NO_KEYS_NO_NSECS)) {
@@ -1026,6 +1644,83 @@ int main(int argc, char* argv[])
   /* list to store newly created rrs, so we can free them later */
   added_rrs = ldns_rr_list_new();
 
+  memset(&resign_st, 0, sizeof(resign_st));
+  resign_st.now = time(NULL);
+  if (!outputfile_name) {
+    outputfile_name = LDNS_XMALLOC(char, MAX_FILENAME_LEN);
+    snprintf(outputfile_name, MAX_FILENAME_LEN, "%s.signed", zonefile_name);
+  }
+  if (resign && !prev_name && strncmp(outputfile_name, "-", 2) != 0) {
+    prev_name = outputfile_name;
+  }
+  if (resign && prev_name) {
+    if (!(prev_file = fopen(prev_name, "r"))) {
+      if (verbosity > 0)
+        fprintf(stderr, "Warning: no signatures to reuse, unable to "
+                        "read %s: %s\n", prev_name, strerror(errno));
+    }
+    else {
+      s = ldns_dnssec_zone_new_frm_fp(&resign_st.prev, prev_file,
+                                      ldns_rr_owner(orig_soa), ttl, class);
+      fclose(prev_file);
+      if (s != LDNS_STATUS_OK) {
+        fprintf(stderr, "Error reading previously signed zone %s: %s\n",
+                prev_name, ldns_get_errorstr_by_id(s));
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  if (resign_st.prev) {
+    resign_st.zone = signed_zone;
+    resign_st.refresh = refresh;
+    resign_st.key_count = ldns_key_list_key_count(keys);
+    resign_st.keytags = LDNS_XMALLOC(uint16_t, resign_st.key_count + 1);
+    resign_st.algorithms = LDNS_XMALLOC(uint8_t, resign_st.key_count + 1);
+    if (!resign_st.keytags || !resign_st.algorithms) {
+      fprintf(stderr, "Memory error\n");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < resign_st.key_count; i++) {
+      ldns_rr* pubkey = ldns_key2rr(ldns_key_list_key(keys, i));
+
+      resign_st.keytags[i] = pubkey ? ldns_calc_keytag(pubkey) : 0;
+      resign_st.algorithms[i] =
+        (uint8_t)ldns_key_algorithm(ldns_key_list_key(keys, i));
+      ldns_rr_free(pubkey);
+    }
+    take_previous_signatures(signed_zone, resign_st.prev);
+
+    /* a signature made now should not be due before the next run */
+    if (jitter && verbosity > 0
+        && (uint64_t)jitter + refresh
+           > (expiration ? (uint32_t)(expiration - resign_st.now)
+                          : LDNS_DEFAULT_EXP_TIME))
+      fprintf(stderr, "Warning: with this jitter new signatures may "
+                      "already be due for re-signing\n");
+  }
+
+#ifdef HAVE_PTHREAD
+  if (sign_threads > 1 && ldns_key_list_key_count(keys) > 0) {
+    if (!(sign_pool = sign_pool_new(keys, (size_t)sign_threads)))
+      exit(EXIT_FAILURE);
+#ifndef OPENSSL_NO_ENGINE
+    sign_pool->engine = engine;
+    sign_pool->engine_keys[0] = eng_ksk;
+    sign_pool->engine_specs[0] = eng_ksk_spec;
+    sign_pool->engine_keys[1] = eng_zsk;
+    sign_pool->engine_specs[1] = eng_zsk_spec;
+#endif
+    if (!(sign_pool = sign_pool_start(sign_pool)))
+      exit(EXIT_FAILURE);
+    ldns_dnssec_zone_set_signer(signed_zone, sign_pool_sign, sign_pool,
+                                (size_t)sign_threads * SIGN_BATCH_PER_THREAD);
+  }
+#elif !defined(OPENSSL_NO_ENGINE)
+  /* only the threads open the engine keys again */
+  (void)eng_ksk_spec;
+  (void)eng_zsk_spec;
+#endif
+
   if (use_nsec3) {
     if (verbosity < 1)
       ; /* pass */
@@ -1044,11 +1739,33 @@ int main(int argc, char* argv[])
                       "See: https://datatracker.ietf.org/doc/html/"
                       "draft-hardaker-dnsop-nsec3-guidance-03#section-4\n");
 
+    if (nsec3_cache_name) {
+      nsec3_cache = ldns_nsec3_hash_cache_new(nsec3_algorithm,
+                                              nsec3_iterations,
+                                              nsec3_salt_length,
+                                              nsec3_salt);
+      if (!nsec3_cache) {
+        fprintf(stderr, "Memory error creating NSEC3 hash cache\n");
+        exit(EXIT_FAILURE);
+      }
+      if ((nsec3_cache_file = fopen(nsec3_cache_name, "rb"))) {
+        result = ldns_nsec3_hash_cache_read(nsec3_cache, nsec3_cache_file);
+        if (result != LDNS_STATUS_OK && verbosity > 0) {
+          fprintf(stderr, "Warning: ignoring rest of NSEC3 hash cache "
+                          "%s: %s\n", nsec3_cache_name,
+                  ldns_get_errorstr_by_id(result));
+        }
+        fclose(nsec3_cache_file);
+      }
+      ldns_dnssec_zone_set_nsec3_hash_cache(signed_zone, nsec3_cache);
+    }
     result = ldns_dnssec_zone_sign_nsec3_flg_mkmap(signed_zone,
                                                    added_rrs,
                                                    keys,
-                                                   ldns_dnssec_default_replace_signatures,
-                                                   NULL,
+                                                   resign_st.prev
+                                                   ? keep_valid_signatures
+                                                   : ldns_dnssec_default_replace_signatures,
+                                                   resign_st.prev ? &resign_st : NULL,
                                                    nsec3_algorithm,
                                                    nsec3_flags,
                                                    nsec3_iterations,
@@ -1056,24 +1773,35 @@ int main(int argc, char* argv[])
                                                    nsec3_salt,
                                                    signflags,
                                                    &fmt_st.hashmap);
+    if (nsec3_cache) {
+      ldns_dnssec_zone_set_nsec3_hash_cache(signed_zone, NULL);
+      if (result == LDNS_STATUS_OK)
+        write_nsec3_hash_cache(nsec3_cache, nsec3_cache_name);
+      ldns_nsec3_hash_cache_free(nsec3_cache);
+    }
   }
   else {
     result = ldns_dnssec_zone_sign_flg(signed_zone,
                                        added_rrs,
                                        keys,
-                                       ldns_dnssec_default_replace_signatures,
-                                       NULL,
+                                       resign_st.prev
+                                       ? keep_valid_signatures
+                                       : ldns_dnssec_default_replace_signatures,
+                                       resign_st.prev ? &resign_st : NULL,
                                        signflags);
   }
+#ifdef HAVE_PTHREAD
+  sign_pool_free(sign_pool);
+#endif
   if (result != LDNS_STATUS_OK) {
     fprintf(stderr, "Error signing zone: %s\n",
             ldns_get_errorstr_by_id(result));
   }
-
-  if (!outputfile_name) {
-    outputfile_name = LDNS_XMALLOC(char, MAX_FILENAME_LEN);
-    snprintf(outputfile_name, MAX_FILENAME_LEN, "%s.signed", zonefile_name);
+  else if (resign || jitter || due_name) {
+    report_due(signed_zone, added_rrs, resign_st.now, refresh, due_name);
   }
+  LDNS_FREE(resign_st.keytags);
+  LDNS_FREE(resign_st.algorithms);
 
   if (signed_zone) {
     if (strncmp(outputfile_name, "-", 2) == 0) {
@@ -1122,6 +1850,8 @@ int main(int argc, char* argv[])
   ldns_dnssec_zone_free(signed_zone);
   ldns_zone_deep_free(orig_zone);
   ldns_rr_list_deep_free(added_rrs);
+  if (resign_st.prev)
+    ldns_dnssec_zone_deep_free(resign_st.prev);
   ldns_rdf_deep_free(origin);
   LDNS_FREE(outputfile_name);
 
@@ -129,6 +129,9 @@ ENTRY_END
 struct sockaddr_storage;
 #include "config.h"
 #include <ldns/ldns.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "ldns-testpkts.h"
 
 #ifdef HAVE_SYS_SOCKET_H
@@ -179,6 +182,7 @@ static void usage(void)
 	printf("  -r	listens on random port. Port number is printed.\n");
 	printf("  -p	listens on the specified port, default %d.\n", DEFAULT_PORT);
 	printf("  -f	forks given number extra instances, default none.\n");
+	printf("  -t	starts given number extra threads, default none.\n");
 	printf("  -v	more verbose, prints queries, answers and matching.\n");
 	printf("  -6	listen on IP6 any address, instead of IP4 any address.\n");
 	printf("The program answers queries with canned replies from the datafile.\n");
@@ -264,7 +268,8 @@ send_udp(uint8_t* buf, size_t len, void* data)
 }
 
 static void
-handle_udp(int udp_sock, struct entry* entries, int *count)
+handle_udp(int udp_sock, const struct entry* entries,
+	struct handle_state* state)
 {
 	ssize_t nb;
 	uint8_t inbuf[INBUF_SIZE];
@@ -286,7 +291,7 @@ handle_udp(int udp_sock, struct entry* entries, int *count)
 #endif
 		return;
 	}
-	handle_query(inbuf, nb, entries, count, transport_udp, send_udp, 
+	handle_query(inbuf, nb, entries, state, transport_udp, send_udp, 
 		&userdata, do_verbose?logfile:0);
 }
 
@@ -337,7 +342,8 @@ send_tcp(uint8_t* buf, size_t len, void* data)
 }
 
 static void
-handle_tcp(int tcp_sock, struct entry* entries, int *count)
+handle_tcp(int tcp_sock, const struct entry* entries,
+	struct handle_state* state)
 {
 	int s;
 	struct sockaddr_storage addr_him;
@@ -384,7 +390,7 @@ handle_tcp(int tcp_sock, struct entry* entries, int *count)
 			return;
 		}
 
-		handle_query(inbuf, (ssize_t) tcplen, entries, count, transport_tcp, 
+		handle_query(inbuf, (ssize_t) tcplen, entries, state, transport_tcp, 
 			send_tcp, &userdata, do_verbose?logfile:0);
 
 		/* another query straight away? */
@@ -414,23 +420,27 @@ handle_tcp(int tcp_sock, struct entry* entries, int *count)
 
 }
 
-/** shared by the service and main routine (forked and threaded) */
+/** shared by the service and main routine (forked and threaded),
+ * the entries are not changed after they are read */
 static int udp_sock, tcp_sock;
-static struct entry* entries;
+static const struct entry* entries;
+/** the state of every service, the first for the main routine */
+static struct handle_state* states;
+static int num_states;
 
 /** 
  * Test DNS server service, uses global udpsock, tcpsock, reply entries 
  * The signature is kept void so the function can be used as a thread function.
+ * @param arg: the handle_state of this service.
  */
 static void
-service(void)
+service(void* arg)
 {
+	struct handle_state* state = (struct handle_state*)arg;
 	fd_set rset, wset, eset;
-	int count;
 	int maxfd;
 
 	/* service */
-	count = 0;
 	while (1) {
 #ifndef S_SPLINT_S
 		FD_ZERO(&rset);
@@ -446,14 +456,57 @@ service(void)
 			error("select(): %s\n", strerror(errno));
 		}
 		if(FD_ISSET(udp_sock, &rset)) {
-			handle_udp(udp_sock, entries, &count);
+			handle_udp(udp_sock, entries, state);
 		}
 		if(FD_ISSET(tcp_sock, &rset)) {
-			handle_tcp(tcp_sock, entries, &count);
+			handle_tcp(tcp_sock, entries, state);
 		}
 	}
 }
 
+/** log the counters of all services of this process, added up */
+static void
+log_stats(void)
+{
+	struct handle_stats total;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	for(i=0; i<num_states; i++)
+		handle_stats_add(&total, &states[i]);
+	log_msg("%d queries, %d malformed, %d unmatched, %d replies "
+		"(%d prepared)\n", (int)total.queries, (int)total.malformed,
+		(int)total.unmatched, (int)total.replies,
+		(int)total.prepared);
+}
+
+#ifdef HAVE_PTHREAD
+static void*
+service_thread(void* arg)
+{
+	service(arg);
+	return NULL;
+}
+
+/** start extra service threads, that share the entries. They serve
+ * until the process exits, so they are detached. */
+static void
+threadit(int number)
+{
+	pthread_t tid;
+	int i;
+	for(i=0; i<number; i++) {
+		if(pthread_create(&tid, NULL, service_thread,
+			&states[i+1]) != 0) {
+			log_msg("error pthread_create\n");
+			return;
+		}
+		(void)pthread_detach(tid);
+		log_msg("thread started\n");
+	}
+}
+#endif /* HAVE_PTHREAD */
+
 static void
 forkit(int number)
 {
@@ -467,7 +520,7 @@ forkit(int number)
 #else /* USE_WINSOCK */
 		DWORD tid;
 		HANDLE id = CreateThread(NULL, 0, 
-			(LPTHREAD_START_ROUTINE)service, NULL,
+			(LPTHREAD_START_ROUTINE)service, &states[i+1],
 			0, &tid);
 		if(id == NULL) {
 			log_msg("error CreateThread: %d\n", GetLastError());
@@ -496,6 +549,8 @@ main(int argc, char **argv)
 	int port = DEFAULT_PORT;
 	const char* datafile;
 	int forknum = 0;
+	int threadnum = 0;
+	int i;
 
 	/* network */
 	int fam = AF_INET;
@@ -510,7 +565,7 @@ main(int argc, char **argv)
 	logfile = stdout;
 	prog_name = argv[0];
 	log_msg("%s: start\n", prog_name);
-	while((c = getopt(argc, argv, "6f:p:rv")) != -1) {
+	while((c = getopt(argc, argv, "6f:p:rt:v")) != -1) {
 		switch(c) {
 		case '6':
 #ifdef AF_INET6
@@ -528,6 +583,11 @@ main(int argc, char **argv)
 			if(forknum < 1)
 				error("invalid forkno %s, give number", optarg);
                 	break;
+		case 't':
+			threadnum = atoi(optarg);
+			if(threadnum < 1)
+				error("invalid threadno %s, give number", optarg);
+			break;
 		case 'p':
 			port = atoi(optarg);
 			if (port < 1) {
@@ -628,11 +688,32 @@ main(int argc, char **argv)
 	}
 	log_msg("Listening on port %d\n", port);
 
+	/* every thread has its own scratch buffer and counters */
+	num_states = 1 + threadnum;
+#if !defined(HAVE_FORK) || !defined(HAVE_FORK_AVAILABLE)
+	/* forkit() starts threads */
+	num_states += forknum;
+#endif
+	states = (struct handle_state*)calloc((size_t)num_states,
+		sizeof(*states));
+	if(!states)
+		error("out of memory");
+	for(i=0; i<num_states; i++)
+		handle_state_init(&states[i]);
+	atexit(log_stats);
+
 	/* forky! */
 	if(forknum > 0)
 		forkit(forknum);
+#ifdef HAVE_PTHREAD
+	if(threadnum > 0)
+		threadit(threadnum);
+#else
+	if(threadnum > 0)
+		log_msg("-t not available, use -f.\n");
+#endif
 
-	service();
+	service(&states[0]);
 
         return 0;
 }
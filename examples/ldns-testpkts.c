@@ -24,6 +24,9 @@
 struct sockaddr_storage;
 #include <ldns/ldns.h>
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "ldns-testpkts.h"
 
 /** max line length */
@@ -86,6 +89,9 @@ entry_add_reply(struct entry* entry)
 	pkt->reply = ldns_pkt_new();
 	pkt->reply_from_hex = NULL;
 	pkt->raw_ednsdata = NULL;
+	pkt->reply_wire = NULL;
+	pkt->reply_wire_len = 0;
+	pkt->reply_wire_raw = false;
 	/* link at end */
 	while(*p)
 		p = &((*p)->next);
@@ -437,6 +443,41 @@ get_origin(const char* name, int lineno, ldns_rdf** origin, char* parse)
 		ldns_get_errorstr_by_id(status), parse);
 }
 
+/** prepare the wire format of the replies of an entry, when they do not
+ * depend on the query other than its ID */
+static void
+entry_prepare(struct entry* e)
+{
+	struct reply_packet* p;
+	ldns_pkt* pkt;
+
+	for(p = e->reply_list; p; p = p->next) {
+		if(p->reply_from_hex) {
+			if(ldns_buffer2pkt_wire(&pkt, p->reply_from_hex)
+				!= LDNS_STATUS_OK) {
+				/* sent literally */
+				p->reply_wire_len = ldns_buffer_capacity(
+					p->reply_from_hex);
+				p->reply_wire = LDNS_XMALLOC(uint8_t,
+					p->reply_wire_len);
+				if(!p->reply_wire)
+					error("out of memory");
+				memcpy(p->reply_wire, ldns_buffer_begin(
+					p->reply_from_hex), p->reply_wire_len);
+				p->reply_wire_raw = true;
+				continue;
+			}
+			if(!e->copy_query && ldns_pkt2wire(&p->reply_wire,
+				pkt, &p->reply_wire_len) != LDNS_STATUS_OK)
+				p->reply_wire = NULL;
+			ldns_pkt_free(pkt);
+		} else if(!e->copy_query && ldns_pkt2wire(&p->reply_wire,
+			p->reply, &p->reply_wire_len) != LDNS_STATUS_OK) {
+			p->reply_wire = NULL;
+		}
+	}
+}
+
 /* Reads one entry from file. Returns entry or NULL on error. */
 struct entry*
 read_entry(FILE* in, const char* name, int *lineno, uint32_t* default_ttl, 
@@ -546,6 +587,7 @@ read_entry(FILE* in, const char* name, int *lineno, uint32_t* default_ttl,
 		} else if(str_keyword(&parse, "ENTRY_END")) {
 			if (hex_data_buffer)
 				ldns_buffer_free(hex_data_buffer);
+			entry_prepare(current);
 			return current;
 		} else {
 			/* it must be a RR, parse and add to packet. */
@@ -731,7 +773,7 @@ verbose_hex(int lvl, uint8_t *data, size_t datalen, const char *header)
 
 /** Match q edns data to p raw edns data */
 static int
-match_ednsdata(ldns_pkt* q, struct reply_packet* p)
+match_ednsdata(ldns_pkt* q, const struct reply_packet* p)
 {
 	size_t qdlen, pdlen;
 	uint8_t *qd, *pd;
@@ -751,11 +793,11 @@ match_ednsdata(ldns_pkt* q, struct reply_packet* p)
 }
 
 /* finds entry in list, or returns NULL */
-struct entry* 
-find_match(struct entry* entries, ldns_pkt* query_pkt,
+const struct entry* 
+find_match(const struct entry* entries, ldns_pkt* query_pkt,
 	enum transport_type transport)
 {
-	struct entry* p = entries;
+	const struct entry* p = entries;
 	ldns_pkt* reply = NULL;
 	for(p=entries; p; p=p->next) {
 		verbose(3, "comparepkt: ");
@@ -833,8 +875,23 @@ find_match(struct entry* entries, ldns_pkt* query_pkt,
 	return NULL;
 }
 
+/** sleep before the reply, if the entry says so */
+static void
+entry_sleep(const struct entry* match)
+{
+	if(match->sleeptime > 0) {
+		verbose(3, "sleeping for %d seconds\n", match->sleeptime);
+#ifdef HAVE_SLEEP
+		sleep(match->sleeptime);
+#else
+		Sleep(match->sleeptime * 1000);
+#endif
+	}
+}
+
 void
-adjust_packet(struct entry* match, ldns_pkt* answer_pkt, ldns_pkt* query_pkt)
+adjust_packet(const struct entry* match, ldns_pkt* answer_pkt,
+	ldns_pkt* query_pkt)
 {
 	/* copy & adjust packet */
 	if(match->copy_id)
@@ -845,14 +902,50 @@ adjust_packet(struct entry* match, ldns_pkt* answer_pkt, ldns_pkt* query_pkt)
 		ldns_rr_list_deep_free(ldns_pkt_question(answer_pkt));
 		ldns_pkt_set_question(answer_pkt, list);
 	}
-	if(match->sleeptime > 0) {
-		verbose(3, "sleeping for %d seconds\n", match->sleeptime);
-#ifdef HAVE_SLEEP
-		sleep(match->sleeptime);
+	entry_sleep(match);
+}
+
+#ifdef HAVE_PTHREAD
+#define STATS_LOCK(state) pthread_mutex_lock(&(state)->lock)
+#define STATS_UNLOCK(state) pthread_mutex_unlock(&(state)->lock)
 #else
-		Sleep(match->sleeptime * 1000);
+#define STATS_LOCK(state) /* no threads */
+#define STATS_UNLOCK(state) /* no threads */
+#endif
+
+void
+handle_state_init(struct handle_state* state)
+{
+	memset(state, 0, sizeof(*state));
+	state->scratch = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	if(!state->scratch)
+		error("out of memory");
+#ifdef HAVE_PTHREAD
+	if(pthread_mutex_init(&state->lock, NULL) != 0)
+		error("could not create lock");
+#endif
+}
+
+void
+handle_state_free(struct handle_state* state)
+{
+	ldns_buffer_free(state->scratch);
+	state->scratch = NULL;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&state->lock);
 #endif
-	}
+}
+
+void
+handle_stats_add(struct handle_stats* total, struct handle_state* state)
+{
+	STATS_LOCK(state);
+	total->queries += state->stats.queries;
+	total->malformed += state->stats.malformed;
+	total->unmatched += state->stats.unmatched;
+	total->replies += state->stats.replies;
+	total->prepared += state->stats.prepared;
+	STATS_UNLOCK(state);
 }
 
 /*
@@ -860,36 +953,47 @@ adjust_packet(struct entry* match, ldns_pkt* answer_pkt, ldns_pkt* query_pkt)
  * and calls the given function for every packet to send.
  */
 void
-handle_query(uint8_t* inbuf, ssize_t inlen, struct entry* entries, int* count,
-	enum transport_type transport, void (*sendfunc)(uint8_t*, size_t, void*),
-	void* userdata, FILE* verbose_out)
+handle_query(uint8_t* inbuf, ssize_t inlen, const struct entry* entries,
+	struct handle_state* state, enum transport_type transport,
+	void (*sendfunc)(uint8_t*, size_t, void*), void* userdata,
+	FILE* verbose_out)
 {
+	/* server.stop. in wire format */
+	static const uint8_t stop_command[] = "\006server\004stop";
 	ldns_status status;
 	ldns_pkt *query_pkt = NULL;
 	ldns_pkt *answer_pkt = NULL;
 	struct reply_packet *p;
 	ldns_rr *query_rr = NULL;
-	uint8_t *outbuf = NULL;
-	size_t answer_size = 0;
-	struct entry* entry = NULL;
-	ldns_rdf *stop_command = ldns_dname_new_frm_str("server.stop.");
+	ldns_buffer *scratch = state->scratch;
+	const struct entry* entry = NULL;
+	size_t queries;
 
 	status = ldns_wire2pkt(&query_pkt, inbuf, (size_t)inlen);
 	if (status != LDNS_STATUS_OK) {
 		verbose(1, "Got bad packet: %s\n", ldns_get_errorstr_by_id(status));
-		ldns_rdf_deep_free(stop_command);
+		STATS_LOCK(state);
+		state->stats.malformed++;
+		STATS_UNLOCK(state);
 		return;
 	}
 	
+	STATS_LOCK(state);
+	queries = ++state->stats.queries;
+	STATS_UNLOCK(state);
 	query_rr = ldns_rr_list_rr(ldns_pkt_question(query_pkt), 0);
-	verbose(1, "query %d: id %d: %s %d bytes: ", ++(*count), (int)ldns_pkt_id(query_pkt), 
+	verbose(1, "query %d: id %d: %s %d bytes: ",
+		(int)queries, (int)ldns_pkt_id(query_pkt),
 		(transport==transport_tcp)?"TCP":"UDP", (int)inlen);
 	if(verbose_out) ldns_rr_print(verbose_out, query_rr);
 	if(verbose_out) ldns_pkt_print(verbose_out, query_pkt);
 
-	if (ldns_rr_get_type(query_rr) == LDNS_RR_TYPE_TXT &&
+	if (query_rr &&
+	    ldns_rr_get_type(query_rr) == LDNS_RR_TYPE_TXT &&
 	    ldns_rr_get_class(query_rr) == LDNS_RR_CLASS_CH &&
-	    ldns_dname_compare(ldns_rr_owner(query_rr), stop_command) == 0) {
+	    ldns_rdf_size(ldns_rr_owner(query_rr)) == sizeof(stop_command) &&
+	    ldns_casefold_compare(ldns_rdf_data(ldns_rr_owner(query_rr)),
+		    stop_command, sizeof(stop_command)) == 0) {
 		exit(0);
         }
 	
@@ -897,56 +1001,63 @@ handle_query(uint8_t* inbuf, ssize_t inlen, struct entry* entries, int* count,
 	entry = find_match(entries, query_pkt, transport);
 	if(!entry || !entry->reply_list) {
 		verbose(1, "no answer packet for this query, no reply.\n");
+		STATS_LOCK(state);
+		state->stats.unmatched++;
+		STATS_UNLOCK(state);
 		ldns_pkt_free(query_pkt);
-		ldns_rdf_deep_free(stop_command);
 		return;
 	}
 	for(p = entry->reply_list; p; p = p->next)
 	{
 		verbose(3, "Answer pkt:\n");
-		if (p->reply_from_hex) {
-			/* try to parse the hex packet, if it can be
-			 * parsed, we can use adjust rules. if not,
-			 * send packet literally */
-			status = ldns_buffer2pkt_wire(&answer_pkt, p->reply_from_hex);
+		ldns_buffer_clear(scratch);
+		if (p->reply_wire && (!verbose_out || p->reply_wire_raw)) {
+			/* prepared, only the ID may change */
+			if (!p->reply_wire_raw)
+				entry_sleep(entry);
+			if (p->reply_wire_raw)
+				verbose(3, "Could not parse hex data, sending hex data directly.\n");
+			if (ldns_buffer_reserve(scratch, p->reply_wire_len))
+				ldns_buffer_write(scratch, p->reply_wire,
+					p->reply_wire_len);
+			if (entry->copy_id &&
+				ldns_buffer_position(scratch) >= 2)
+				ldns_write_uint16(ldns_buffer_begin(scratch),
+					ldns_pkt_id(query_pkt));
+			STATS_LOCK(state);
+			state->stats.prepared++;
+			STATS_UNLOCK(state);
+		} else {
+			if (p->reply_from_hex) {
+				/* the hex packet could be parsed when the
+				 * entry was read, so ADJUST rules apply */
+				status = ldns_buffer2pkt_wire(&answer_pkt,
+					p->reply_from_hex);
+			} else {
+				answer_pkt = ldns_pkt_clone(p->reply);
+				status = answer_pkt ? LDNS_STATUS_OK
+					: LDNS_STATUS_MEM_ERR;
+			}
 			if (status == LDNS_STATUS_OK) {
 				adjust_packet(entry, answer_pkt, query_pkt);
 				if(verbose_out) ldns_pkt_print(verbose_out, answer_pkt);
-				status = ldns_pkt2wire(&outbuf, answer_pkt, &answer_size);
-				verbose(2, "Answer packet size: %u bytes.\n", (unsigned int)answer_size);
-				if (status != LDNS_STATUS_OK) {
-					verbose(1, "Error creating answer: %s\n", ldns_get_errorstr_by_id(status));
-					ldns_pkt_free(query_pkt);
-					ldns_rdf_deep_free(stop_command);
-					return;
-				}
+				status = ldns_pkt2buffer_wire(scratch, answer_pkt);
 				ldns_pkt_free(answer_pkt);
 				answer_pkt = NULL;
-			} else {
-				verbose(3, "Could not parse hex data (%s), sending hex data directly.\n", ldns_get_errorstr_by_id(status));
-				/* still try to adjust ID */
-				answer_size = ldns_buffer_capacity(p->reply_from_hex);
-				outbuf = LDNS_XMALLOC(uint8_t, answer_size);
-				memcpy(outbuf, ldns_buffer_begin(p->reply_from_hex), answer_size);
-				if(entry->copy_id) {
-					ldns_write_uint16(outbuf, 
-						ldns_pkt_id(query_pkt));
-				}
 			}
-		} else {
-			answer_pkt = ldns_pkt_clone(p->reply);
-			adjust_packet(entry, answer_pkt, query_pkt);
-			if(verbose_out) ldns_pkt_print(verbose_out, answer_pkt);
-			status = ldns_pkt2wire(&outbuf, answer_pkt, &answer_size);
-			verbose(1, "Answer packet size: %u bytes.\n", (unsigned int)answer_size);
+			verbose(1, "Answer packet size: %u bytes.\n",
+				(unsigned int)ldns_buffer_position(scratch));
 			if (status != LDNS_STATUS_OK) {
 				verbose(1, "Error creating answer: %s\n", ldns_get_errorstr_by_id(status));
 				ldns_pkt_free(query_pkt);
-				ldns_rdf_deep_free(stop_command);
 				return;
 			}
-			ldns_pkt_free(answer_pkt);
-			answer_pkt = NULL;
+		}
+		if (!ldns_buffer_status_ok(scratch)) {
+			verbose(1, "Error creating answer: %s\n",
+				ldns_get_errorstr_by_id(ldns_buffer_status(scratch)));
+			ldns_pkt_free(query_pkt);
+			return;
 		}
 		if(p->packet_sleep) {
 			verbose(3, "sleeping for next packet %d secs\n", 
@@ -959,13 +1070,13 @@ handle_query(uint8_t* inbuf, ssize_t inlen, struct entry* entries, int* count,
 			verbose(3, "wakeup for next packet "
 				"(slept %d secs)\n", p->packet_sleep);
 		}
-		sendfunc(outbuf, answer_size, userdata);
-		LDNS_FREE(outbuf);
-		outbuf = NULL;
-		answer_size = 0;
+		sendfunc(ldns_buffer_begin(scratch),
+			ldns_buffer_position(scratch), userdata);
+		STATS_LOCK(state);
+		state->stats.replies++;
+		STATS_UNLOCK(state);
 	}
 	ldns_pkt_free(query_pkt);
-	ldns_rdf_deep_free(stop_command);
 }
 
 /** delete the list of reply packets */
@@ -976,6 +1087,7 @@ static void delete_replylist(struct reply_packet* replist)
 		np = p->next;
 		ldns_pkt_free(p->reply);
 		ldns_buffer_free(p->reply_from_hex);
+		LDNS_FREE(p->reply_wire);
 		free(p);
 		p=np;
 	}
@@ -157,6 +157,15 @@ struct reply_packet {
 	ldns_buffer* reply_from_hex;
 	/** seconds to sleep before giving packet */
 	unsigned int packet_sleep; 
+	/** the reply in wire format, prepared when the entry is read, so
+	 * it is sent with only the ID changed. NULL when the reply has to
+	 * be built for every query (copy_query). */
+	uint8_t* reply_wire;
+	/** length of reply_wire */
+	size_t reply_wire_len;
+	/** reply_wire is hex data that could not be parsed, to which the
+	 * ADJUST rules other than copy_id do not apply */
+	bool reply_wire_raw;
 };
 
 /** data structure to keep the canned queries in.
@@ -211,8 +220,57 @@ struct entry {
 	struct entry* next;
 };
 
+/** counters of one thread or process that answers queries. Each keeps
+ * its own, so they do not write to shared memory, and they are added
+ * up when they are needed. */
+struct handle_stats {
+	/** queries answered or not */
+	size_t queries;
+	/** packets that could not be parsed */
+	size_t malformed;
+	/** queries that matched no entry */
+	size_t unmatched;
+	/** reply packets sent */
+	size_t replies;
+	/** of those, the number sent from the prepared wire format */
+	size_t prepared;
+};
+
+/** the state of one thread or process that answers queries */
+struct handle_state {
+	/** the reply is built here, reused for every reply */
+	ldns_buffer* scratch;
+	/** counters */
+	struct handle_stats stats;
+#ifdef HAVE_PTHREAD
+	/** guards the counters, that another thread adds up */
+	pthread_mutex_t lock;
+#endif
+};
+
+/**
+ * Initialize the state of a thread that answers queries.
+ * does an exit on error.
+ */
+void handle_state_init(struct handle_state* state);
+
+/**
+ * Free the scratch buffer of a state.
+ */
+void handle_state_free(struct handle_state* state);
+
+/**
+ * Add the counters of a state to the total.
+ * The state may be in use by another thread.
+ * @param total: the total to add to.
+ * @param state: the state with the counters to add.
+ */
+void handle_stats_add(struct handle_stats* total, struct handle_state* state);
+
 /**
  * reads the canned reply file and returns a list of structs 
+ * The entries are not changed after this, so any number of threads
+ * can match and answer queries with them without locks.
  * does an exit on error.
  * @param name: name of the file to read.
  * @param skip_whitespace: skip leftside whitespace.
@@ -246,13 +304,13 @@ struct entry* read_entry(FILE* in, const char* name, int *lineno,
 /**
  * finds entry in list, or returns NULL.
  */
-struct entry* find_match(struct entry* entries, ldns_pkt* query_pkt,
-	enum transport_type transport);
+const struct entry* find_match(const struct entry* entries,
+	ldns_pkt* query_pkt, enum transport_type transport);
 
 /**
  * copy & adjust packet 
  */
-void adjust_packet(struct entry* match, ldns_pkt* answer_pkt, 
+void adjust_packet(const struct entry* match, ldns_pkt* answer_pkt, 
 	ldns_pkt* query_pkt);
 
 /**
@@ -262,14 +320,15 @@ void adjust_packet(struct entry* match, ldns_pkt* answer_pkt,
  * @param inbuf: the packet that came in
  * @param inlen: length of packet.
  * @param entries: entries read in from datafile.
- * @param count: is increased to count number of queries answered.
+ * @param state: the scratch buffer and counters of the caller. Every
+ *	thread must have its own.
  * @param transport: set to UDP or TCP to match some types of entries.
  * @param sendfunc: called to send answer (buffer, size, userarg).
  * @param userdata: userarg to give to sendfunc.
  * @param verbose_out: if not NULL, verbose messages are printed there.
  */
-void handle_query(uint8_t* inbuf, ssize_t inlen, struct entry* entries, 
-	int* count, enum transport_type transport, 
+void handle_query(uint8_t* inbuf, ssize_t inlen, const struct entry* entries,
+	struct handle_state* state, enum transport_type transport, 
 	void (*sendfunc)(uint8_t*, size_t, void*), void* userdata,
 	FILE* verbose_out);
 
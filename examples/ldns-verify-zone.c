@@ -167,6 +167,389 @@ rrsig_check_time_margins(ldns_rr* rrsig
 	return LDNS_STATUS_OK;
 }
 
+/*
+ * Incremental verification (-P): the rrsets of the zone are compared
+ * with those of a previous version that was verified, or with the
+ * manifest of digests that was written for it (-m). The signatures of
+ * rrsets that did not change are not verified again, when the DNSKEY
+ * rrset did not change either. One of them verified before, so when all
+ * of them are still within their validity period, the rrset is valid.
+ */
+#define MANIFEST_HEADER "; ldns-verify-zone manifest 1\n"
+
+typedef struct prev_rrset {
+	ldns_rr_type type;
+	uint8_t digest[LDNS_SHA256_DIGEST_LENGTH];
+} prev_rrset;
+
+typedef struct prev_version {
+	/* the previous version, as zone or as manifest */
+	ldns_dnssec_zone *zone;
+	ldns_rbnode_t *node;
+	FILE *manifest;
+	int line_nr;
+	/* the first line of the next name in the manifest */
+	ldns_rdf *next_name;
+	prev_rrset next_rrset;
+	/* the rrsets of the current name of the previous version */
+	ldns_rdf *name;
+	prev_rrset *rrsets;
+	size_t count;
+	size_t capacity;
+	/* whether the name being verified is the current name */
+	bool matched;
+} prev_version;
+
+static prev_version *prev = NULL;
+static size_t n_unchanged = 0;
+static size_t n_changed = 0;
+
+/* digest of the canonical wire format of an rrset and its signatures,
+ * fails when an rr does not fit in 64K */
+static ldns_status
+rrset_digest(ldns_rr_list *rrs, ldns_dnssec_rrs *sigs,
+		uint8_t digest[LDNS_SHA256_DIGEST_LENGTH])
+{
+	uint8_t data[65536];
+	ldns_buffer buf;
+	ldns_sha256_CTX ctx;
+	ldns_status status;
+	size_t i;
+
+	buf._data = data;
+	buf._capacity = sizeof(data);
+	buf._fixed = 1;
+
+	ldns_sha256_init(&ctx);
+	for (i = 0; i < ldns_rr_list_rr_count(rrs) || sigs; i++) {
+		buf._position = 0;
+		buf._limit = sizeof(data);
+		buf._status = LDNS_STATUS_OK;
+		if (i < ldns_rr_list_rr_count(rrs)) {
+			status = ldns_rr2buffer_wire_canonical(&buf,
+				ldns_rr_list_rr(rrs, i), LDNS_SECTION_ANSWER);
+		} else {
+			status = ldns_rr2buffer_wire_canonical(&buf,
+				sigs->rr, LDNS_SECTION_ANSWER);
+			sigs = sigs->next;
+		}
+		if (status != LDNS_STATUS_OK) {
+			return status;
+		}
+		ldns_sha256_update(&ctx, data, ldns_buffer_position(&buf));
+	}
+	ldns_sha256_final(digest, &ctx);
+	return LDNS_STATUS_OK;
+}
+
+static void
+dnssec_rrs2list(ldns_rr_list *list, ldns_dnssec_rrs *rrs)
+{
+	for (; rrs && rrs->rr; rrs = rrs->next) {
+		ldns_rr_list_push_rr(list, rrs->rr);
+	}
+}
+
+static bool
+prev_add(prev_version *pv, ldns_rr_type type, const uint8_t *digest)
+{
+	prev_rrset *rrsets;
+
+	if (pv->count == pv->capacity) {
+		rrsets = LDNS_XREALLOC(pv->rrsets, prev_rrset,
+				pv->capacity * 2 + 8);
+		if (!rrsets) {
+			return false;
+		}
+		pv->rrsets = rrsets;
+		pv->capacity = pv->capacity * 2 + 8;
+	}
+	pv->rrsets[pv->count].type = type;
+	memcpy(pv->rrsets[pv->count].digest, digest,
+			LDNS_SHA256_DIGEST_LENGTH);
+	pv->count++;
+	return true;
+}
+
+/* the signed rrsets of a name, with the NSEC(3) as the last one. An
+ * rrset without a digest is left out, so it counts as changed. */
+static bool
+prev_add_name(prev_version *pv, ldns_dnssec_name *name)
+{
+	ldns_dnssec_rrsets *rrset;
+	ldns_rr_list *rrs = ldns_rr_list_new();
+	uint8_t digest[LDNS_SHA256_DIGEST_LENGTH];
+	bool ok = rrs != NULL;
+
+	for (rrset = name->rrsets; ok && rrset; rrset = rrset->next) {
+		if (rrset->signatures) {
+			ldns_rr_list_set_rr_count(rrs, 0);
+			dnssec_rrs2list(rrs, rrset->rrs);
+			if (rrset_digest(rrs, rrset->signatures, digest)
+					== LDNS_STATUS_OK) {
+				ok = prev_add(pv, rrset->type, digest);
+			}
+		}
+	}
+	if (ok && name->nsec && name->nsec_signatures) {
+		ldns_rr_list_set_rr_count(rrs, 0);
+		ldns_rr_list_push_rr(rrs, name->nsec);
+		if (rrset_digest(rrs, name->nsec_signatures, digest)
+				== LDNS_STATUS_OK) {
+			ok = prev_add(pv, ldns_rr_get_type(name->nsec),
+					digest);
+		}
+	}
+	ldns_rr_list_free(rrs);
+	return ok;
+}
+
+/* reads a line of the manifest into next_name and next_rrset */
+static ldns_status
+prev_read_line(void)
+{
+	char line[LDNS_MAX_LINELEN];
+	char *type, *hex;
+	size_t i;
+
+	ldns_rdf_deep_free(prev->next_name);
+	prev->next_name = NULL;
+	if (!fgets(line, sizeof(line), prev->manifest)) {
+		return ferror(prev->manifest) ? LDNS_STATUS_FILE_ERR
+		                              : LDNS_STATUS_OK;
+	}
+	prev->line_nr++;
+	if (!(type = strchr(line, '\t')) || !(hex = strchr(type + 1, '\t'))
+	||  strlen(hex + 1) < LDNS_SHA256_DIGEST_LENGTH * 2) {
+		return LDNS_STATUS_SYNTAX_ERR;
+	}
+	*type++ = '\0';
+	*hex++ = '\0';
+	if (!(prev->next_name = ldns_dname_new_frm_str(line))) {
+		return LDNS_STATUS_SYNTAX_DNAME_ERR;
+	}
+	prev->next_rrset.type = ldns_get_rr_type_by_name(type);
+	for (i = 0; i < LDNS_SHA256_DIGEST_LENGTH; i++) {
+		if (!isxdigit((unsigned char) hex[2 * i])
+		||  !isxdigit((unsigned char) hex[2 * i + 1])) {
+			return LDNS_STATUS_SYNTAX_ERR;
+		}
+		prev->next_rrset.digest[i] = (uint8_t)
+			(ldns_hexdigit_to_int(hex[2 * i]) << 4 |
+			 ldns_hexdigit_to_int(hex[2 * i + 1]));
+	}
+	return LDNS_STATUS_OK;
+}
+
+/* makes the next name of the previous version the current name */
+static ldns_status
+prev_next_name(void)
+{
+	ldns_dnssec_name *name;
+	ldns_status s;
+
+	ldns_rdf_deep_free(prev->name);
+	prev->name = NULL;
+	prev->count = 0;
+	if (prev->zone) {
+		if (prev->node == LDNS_RBTREE_NULL) {
+			return LDNS_STATUS_OK;
+		}
+		name = (ldns_dnssec_name *) prev->node->data;
+		prev->node = ldns_rbtree_next(prev->node);
+		if (!(prev->name = ldns_rdf_clone(name->name))
+		||  !prev_add_name(prev, name)) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+		return LDNS_STATUS_OK;
+	}
+	if (!prev->next_name) {
+		return LDNS_STATUS_OK;
+	}
+	prev->name = prev->next_name;
+	prev->next_name = NULL;
+	do {
+		if (!prev_add(prev, prev->next_rrset.type,
+					prev->next_rrset.digest)) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+		if ((s = prev_read_line())) {
+			return s;
+		}
+	} while (prev->next_name &&
+	         ldns_dname_compare(prev->next_name, prev->name) == 0);
+	return LDNS_STATUS_OK;
+}
+
+static void
+prev_free(void)
+{
+	if (prev) {
+		ldns_dnssec_zone_deep_free(prev->zone);
+		if (prev->manifest) {
+			fclose(prev->manifest);
+		}
+		ldns_rdf_deep_free(prev->next_name);
+		ldns_rdf_deep_free(prev->name);
+		LDNS_FREE(prev->rrsets);
+		LDNS_FREE(prev);
+		prev = NULL;
+	}
+}
+
+/* opens the previous version, a zone file or a manifest */
+static ldns_status
+prev_open(const char *filename)
+{
+	char line[sizeof(MANIFEST_HEADER)];
+	FILE *fp;
+	ldns_status s;
+
+	if (!(fp = fopen(filename, "r"))) {
+		return LDNS_STATUS_FILE_ERR;
+	}
+	if (!(prev = LDNS_CALLOC(prev_version, 1))) {
+		fclose(fp);
+		return LDNS_STATUS_MEM_ERR;
+	}
+	if (fgets(line, sizeof(line), fp)
+	&&  strcmp(line, MANIFEST_HEADER) == 0) {
+		prev->manifest = fp;
+		prev->line_nr = 1;
+		if ((s = prev_read_line())) {
+			return s;
+		}
+	} else {
+		rewind(fp);
+		prev->line_nr = 0;
+		s = ldns_dnssec_zone_new_frm_fp_l(&prev->zone, fp, NULL, 0,
+				LDNS_RR_CLASS_IN, &prev->line_nr);
+		fclose(fp);
+		if (s) {
+			return s;
+		}
+		prev->node = ldns_rbtree_first(prev->zone->names);
+	}
+	return prev_next_name();
+}
+
+/* goes to the name in the previous version, if it is there */
+static ldns_status
+prev_seek(ldns_rdf *name)
+{
+	ldns_status s;
+	int cmp = 1;
+
+	while (prev->name && (cmp = ldns_dname_compare(prev->name, name)) < 0) {
+		if ((s = prev_next_name())) {
+			return s;
+		}
+	}
+	prev->matched = prev->name && cmp == 0;
+	return LDNS_STATUS_OK;
+}
+
+/* whether an rrset of the name that prev_seek() went to is the same in
+ * the previous version */
+static bool
+rrset_same(ldns_rr_type type, ldns_rr_list *rrs, ldns_dnssec_rrs *sigs)
+{
+	uint8_t digest[LDNS_SHA256_DIGEST_LENGTH];
+	size_t i;
+
+	if (!prev->matched || !sigs) {
+		return false;
+	}
+	for (i = 0; i < prev->count && prev->rrsets[i].type != type; i++)
+		;
+	if (i == prev->count) {
+		return false;
+	}
+	return rrset_digest(rrs, sigs, digest) == LDNS_STATUS_OK &&
+		memcmp(digest, prev->rrsets[i].digest, sizeof(digest)) == 0;
+}
+
+/* whether an rrset is the same in the previous version, and all its
+ * signatures are still within their validity period */
+static bool
+rrset_unchanged(ldns_rr_type type, ldns_rr_list *rrs, ldns_dnssec_rrs *sigs)
+{
+	ldns_dnssec_rrs *sig;
+
+	if (!prev || !sigs) {
+		return false;
+	}
+	if (!rrset_same(type, rrs, sigs)) {
+		n_changed++;
+		return false;
+	}
+	for (sig = sigs; sig; sig = sig->next) {
+		if (rrsig_check_time_margins(sig->rr)) {
+			n_changed++;
+			return false;
+		}
+	}
+	n_unchanged++;
+	return true;
+}
+
+/* stops the incremental verification, when the previous version cannot
+ * be used */
+static void
+prev_stop(ldns_status s)
+{
+	if (s && verbosity > 0) {
+		fprintf(myerr, "Error reading the previous version at line "
+				"%d: %s, verifying everything\n",
+				prev->line_nr, ldns_get_errorstr_by_id(s));
+	}
+	prev_free();
+}
+
+/* writes the digests of the signed rrsets of the zone, for -P */
+static ldns_status
+write_manifest(const char *filename, ldns_dnssec_zone *zone)
+{
+	ldns_rbnode_t *node;
+	ldns_dnssec_name *name;
+	prev_version manifest;
+	char *owner;
+	size_t i, j;
+	FILE *fp;
+	ldns_status s = LDNS_STATUS_OK;
+
+	if (!(fp = fopen(filename, "w"))) {
+		return LDNS_STATUS_FILE_ERR;
+	}
+	memset(&manifest, 0, sizeof(manifest));
+	fputs(MANIFEST_HEADER, fp);
+	for (node = ldns_rbtree_first(zone->names);
+	     node != LDNS_RBTREE_NULL && !s; node = ldns_rbtree_next(node)) {
+		name = (ldns_dnssec_name *) node->data;
+		manifest.count = 0;
+		if (!prev_add_name(&manifest, name) || !(owner = ldns_rdf2str(name->name))) {
+			s = LDNS_STATUS_MEM_ERR;
+			break;
+		}
+		for (i = 0; i < manifest.count; i++) {
+			fprintf(fp, "%s\t", owner);
+			print_type(fp, manifest.rrsets[i].type);
+			fputc('\t', fp);
+			for (j = 0; j < LDNS_SHA256_DIGEST_LENGTH; j++) {
+				fprintf(fp, "%02x",
+					(int) manifest.rrsets[i].digest[j]);
+			}
+			fputc('\n', fp);
+		}
+		LDNS_FREE(owner);
+	}
+	LDNS_FREE(manifest.rrsets);
+	if (fclose(fp) != 0 && !s) {
+		s = LDNS_STATUS_FILE_ERR;
+	}
+	return s;
+}
+
 static ldns_status
 verify_rrs(ldns_rr_list* rrset_rrs, ldns_dnssec_rrs* cur_sig,
 		ldns_rr_list* keys)
@@ -174,26 +557,34 @@ verify_rrs(ldns_rr_list* rrset_rrs, ldns_dnssec_rrs* cur_sig,
 	ldns_status status, result = LDNS_STATUS_OK;
 	int one_signature_verified = 0;
 	ldns_dnssec_rrs *cur_sig_bak = cur_sig;
+	ldns_verify_rrset *v;
 	int is_dnskey_rrset = ldns_rr_list_rr_count(rrset_rrs) > 0 &&
 	    ldns_rr_get_type(ldns_rr_list_rr(rrset_rrs, 0)) == LDNS_RR_TYPE_DNSKEY;
 
+	/* The canonical RRset is made once for all its signatures */
+	status = ldns_verify_rrset_new(&v, rrset_rrs, keys);
+	if (status != LDNS_STATUS_OK)
+		return status;
+
 	/* A single valid signature validates the RRset */
 	/* With check all sigs, it skips this, except for the DNSKEY RRset. */
 	if(!check_all_sigs || is_dnskey_rrset) {
 	    while (cur_sig) {
-		if (ldns_verify_rrsig_keylist_time( rrset_rrs, cur_sig->rr
-		                                  , keys, check_time, NULL)
+		if (ldns_verify_rrset_rrsig_time(v, cur_sig->rr
+		                                , check_time, NULL)
 		||  rrsig_check_time_margins(cur_sig->rr))
 			cur_sig = cur_sig->next;
-		else
+		else {
+			ldns_verify_rrset_free(v);
 			return LDNS_STATUS_OK;
+		}
 	    }
 	}
 	/* Without any valid signature, do print all errors.  */
 	/* When checking all sigs, keep track if one is valid. */
 	for (cur_sig = cur_sig_bak; cur_sig; cur_sig = cur_sig->next) {
-		status = ldns_verify_rrsig_keylist_time(rrset_rrs,
-		    cur_sig->rr, keys, check_time, NULL);
+		status = ldns_verify_rrset_rrsig_time(v,
+		    cur_sig->rr, check_time, NULL);
 		status = status ? status 
 		       : rrsig_check_time_margins(cur_sig->rr);
 		if(check_all_sigs && status == LDNS_STATUS_OK)
@@ -206,6 +597,7 @@ verify_rrs(ldns_rr_list* rrset_rrs, ldns_dnssec_rrs* cur_sig,
 			    myerr, rrset_rrs, status, cur_sig);
 		update_error(&result, status);
 	}
+	ldns_verify_rrset_free(v);
 	if(check_all_sigs && one_signature_verified)
 		return LDNS_STATUS_OK;
 	return result;
@@ -228,7 +620,11 @@ verify_dnssec_rrset(ldns_rdf *zone_name, ldns_rdf *name,
 		cur_rr = cur_rr->next;
 	}
 	cur_sig = rrset->signatures;
-	if (cur_sig) {
+	if (cur_sig && rrset->type != LDNS_RR_TYPE_DNSKEY &&
+	    rrset_unchanged(rrset->type, rrset_rrs, cur_sig)) {
+		status = LDNS_STATUS_OK;
+
+	} else if (cur_sig) {
 		status = verify_rrs(rrset_rrs, cur_sig, keys);
 
 	} else /* delegations may be unsigned (on opt out...) */
@@ -255,7 +651,10 @@ verify_single_rr(ldns_rr *rr, ldns_dnssec_rrs *signature_rrs,
 	rrset_rrs = ldns_rr_list_new();
 	ldns_rr_list_push_rr(rrset_rrs, rr);
 
-	status = verify_rrs(rrset_rrs, signature_rrs, keys);
+	if (rrset_unchanged(ldns_rr_get_type(rr), rrset_rrs, signature_rrs))
+		status = LDNS_STATUS_OK;
+	else
+		status = verify_rrs(rrset_rrs, signature_rrs, keys);
 
 	ldns_rr_list_free(rrset_rrs);
 
@@ -399,9 +798,9 @@ verify_nsec(ldns_dnssec_zone* zone, ldns_rbnode_t *cur_node,
 	} else {
 		if (zone_is_nsec3_optout(zone) &&
 		    (ldns_dnssec_name_is_glue(name) ||
-		     (    ldns_dnssec_rrsets_contains_type(name->rrsets,
+		     (    ldns_dnssec_name_has_type(name,
 							   LDNS_RR_TYPE_NS)
-		      && !ldns_dnssec_rrsets_contains_type(name->rrsets,
+		      && !ldns_dnssec_name_has_type(name,
 							   LDNS_RR_TYPE_DS)))) {
 			/* ok, no problem, but we need to remember to check
 			 * whether the chain does not actually point to this
@@ -470,9 +869,9 @@ verify_dnssec_name(ldns_rdf *zone_name, ldns_dnssec_zone* zone,
 		/* not glue, do real verify */
 
 		on_delegation_point =
-			    ldns_dnssec_rrsets_contains_type(name->rrsets,
+			    ldns_dnssec_name_has_type(name,
 					LDNS_RR_TYPE_NS)
-			&& !ldns_dnssec_rrsets_contains_type(name->rrsets,
+			&& !ldns_dnssec_name_has_type(name,
 					LDNS_RR_TYPE_SOA);
 		cur_rrset = name->rrsets;
 		while(cur_rrset) {
@@ -638,6 +1037,7 @@ verify_dnssec_zone(ldns_dnssec_zone *dnssec_zone, ldns_rdf *zone_name,
 	ldns_rbnode_t *cur_node;
 	ldns_dnssec_rrsets *cur_key_rrset;
 	ldns_dnssec_rrs *cur_key;
+	ldns_rr_list *key_rrs;
 	ldns_status status;
 	ldns_status result = LDNS_STATUS_OK;
 
@@ -660,6 +1060,25 @@ verify_dnssec_zone(ldns_dnssec_zone *dnssec_zone, ldns_rdf *zone_name,
 					cur_key = cur_key->next) 
 				ldns_rr_list_push_rr(keys, cur_key->rr);
 
+		/* signatures that verified before only do so with the
+		 * same keys */
+		if (prev) {
+			key_rrs = ldns_rr_list_new();
+			dnssec_rrs2list(key_rrs, cur_key_rrset->rrs);
+			if ((status = prev_seek(zone_name)))
+				prev_stop(status);
+			else if (!rrset_same(LDNS_RR_TYPE_DNSKEY, key_rrs,
+					cur_key_rrset->signatures)) {
+				if (verbosity >= 4) {
+					fprintf(myout, "The DNSKEY RRset "
+						"changed, verifying "
+						"everything\n");
+				}
+				prev_stop(LDNS_STATUS_OK);
+			}
+			ldns_rr_list_free(key_rrs);
+		}
+
 		cur_node = ldns_rbtree_first(dnssec_zone->names);
 		if (cur_node == LDNS_RBTREE_NULL) {
 			if (verbosity > 0) {
@@ -682,6 +1101,9 @@ verify_dnssec_zone(ldns_dnssec_zone *dnssec_zone, ldns_rdf *zone_name,
 		}
 		while (cur_node != LDNS_RBTREE_NULL) {
 			/* should we check this one? saves calls to random. */
+			if (prev && (status = prev_seek(((ldns_dnssec_name *)
+						cur_node->data)->name)))
+				prev_stop(status);
 			if (percentage == 100 
 			    || ((random() % 100) >= 100 - percentage)) {
 				status = verify_dnssec_name(zone_name,
@@ -722,6 +1144,13 @@ static void print_usage(FILE *out, const char *progname)
 	       "trusted DNSKEY or DS rr.\n\t\t\t"
 	       "This option may be given more than once.\n"
 	       "\t\t\tDefault is %s\n", LDNS_TRUST_ANCHOR_FILE);
+	fprintf(out, "\t-m <file>\twhen the zone is verified, write a "
+	       "manifest of\n\t\t\tits signed RRsets to file, "
+	       "for use with -P\n");
+	fprintf(out, "\t-P <file>\tthe previous version of the zone, that "
+	       "was verified,\n\t\t\tor its manifest. Signatures of "
+	       "RRsets that did not\n\t\t\tchange are only checked for "
+	       "their validity period\n");
 	fprintf(out, "\t-p [0-100]\tonly checks this percentage of "
 	       "the zone.\n\t\t\tDefaults to 100\n");
 	fprintf(out, "\t-s\t\tcheck all signature results, instead of one.\n");
@@ -767,12 +1196,14 @@ main(int argc, char **argv)
 	const char *progname = argv[0];
 	int zonemd_required = 0;
 	ldns_dnssec_rrsets *zonemd_rrset;
+	const char *prev_file = NULL;
+	const char *manifest_file = NULL;
 
 	check_time = ldns_time(NULL);
 	myout = stdout;
 	myerr = stderr;
 
-	while ((c = getopt(argc, argv, "ae:hi:k:vV:p:sSt:Z")) != -1) {
+	while ((c = getopt(argc, argv, "ae:hi:k:m:vV:p:P:sSt:Z")) != -1) {
 		switch(c) {
                 case 'a':
                         apexonly = true;
@@ -833,6 +1264,12 @@ main(int argc, char **argv)
 			}
 			nkeys = ldns_rr_list_rr_count(keys);
 			break;
+		case 'm':
+			manifest_file = optarg;
+			break;
+		case 'P':
+			prev_file = optarg;
+			break;
                 case 'p':
                         percentage = atoi(optarg);
                         if (percentage < 0 || percentage > 100) {
@@ -938,6 +1375,32 @@ main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	/* with -s all signatures are verified, to report every error */
+	if (prev_file && !check_all_sigs &&
+	    (s = prev_open(prev_file)) != LDNS_STATUS_OK) {
+		if (verbosity > 0) {
+			if (!prev && s == LDNS_STATUS_FILE_ERR) {
+				fprintf(myerr, "Unable to open %s: %s\n",
+					prev_file, strerror(errno));
+			} else if (!prev) {
+				fprintf(myerr, "%s\n",
+					ldns_get_errorstr_by_id(s));
+			} else if (s == LDNS_STATUS_FILE_ERR) {
+				fprintf(myerr, "Error reading %s after line "
+					"%d: %s\n", prev_file, prev->line_nr,
+					strerror(errno));
+			} else {
+				fprintf(myerr, "%s at line %d of %s\n",
+					ldns_get_errorstr_by_id(s),
+					prev->line_nr, prev_file);
+			}
+		}
+		prev_free();
+		ldns_dnssec_zone_deep_free(dnssec_zone);
+		ldns_rr_list_deep_free(keys);
+		exit(EXIT_FAILURE);
+	}
+
 	result = ldns_dnssec_zone_mark_glue(dnssec_zone);
 	if (result != LDNS_STATUS_OK) {
 		if (verbosity > 0) {
@@ -980,6 +1443,26 @@ main(int argc, char **argv)
 	} else if (zonemd_required)
 		result = LDNS_STATUS_NO_ZONEMD;
 
+	if (prev && verbosity >= 4) {
+		fprintf(myout, "Verified %zu changed RRsets, checked the "
+				"validity period of %zu unchanged RRsets\n",
+				n_changed, n_unchanged);
+	}
+	prev_free();
+
+	/* only a zone that is verified completely can be a previous
+	 * version */
+	if (manifest_file && result == LDNS_STATUS_OK && !apexonly &&
+	    percentage == 100 &&
+	    (s = write_manifest(manifest_file, dnssec_zone))) {
+		if (verbosity > 0) {
+			fprintf(myerr, "Error writing %s: %s\n", manifest_file,
+				s == LDNS_STATUS_FILE_ERR ? strerror(errno)
+				: ldns_get_errorstr_by_id(s));
+		}
+		result = s;
+	}
+
 	if (result == LDNS_STATUS_OK) {
 		if (verbosity >= 3) {
 			fprintf(myout, "Zone is verified and complete\n");
@@ -62,27 +62,97 @@ static int udp_bind(int sock, int port, const char *my_address)
     return bind(sock, (struct sockaddr *)&addr, (socklen_t) sizeof(addr));
 }
 
-/* this will probably be moved to a better place in the library itself */
+/* The rrs of the zone, sorted by owner, class and type once after the zone
+ * is read. It is not changed after that, so lookups need no locks and
+ * any number of readers can share it. */
+struct zone_index {
+	struct zone_index_rr {
+		const ldns_rr *rr;
+		/* the position in the zone file, to keep rrsets in order */
+		size_t pos;
+	} *rrs;
+	size_t count;
+};
+
+static int
+zone_index_key_compare(const ldns_rr *rr, const ldns_rdf *owner_name,
+		ldns_rr_class qclass, ldns_rr_type qtype)
+{
+	int c = ldns_dname_compare(ldns_rr_owner(rr), owner_name);
+
+	if (c != 0) {
+		return c;
+	}
+	if (ldns_rr_get_class(rr) != qclass) {
+		return ldns_rr_get_class(rr) < qclass ? -1 : 1;
+	}
+	if (ldns_rr_get_type(rr) != qtype) {
+		return ldns_rr_get_type(rr) < qtype ? -1 : 1;
+	}
+	return 0;
+}
+
+static int
+zone_index_compare(const void *a, const void *b)
+{
+	const struct zone_index_rr *ra = (const struct zone_index_rr *) a;
+	const struct zone_index_rr *rb = (const struct zone_index_rr *) b;
+	int c = zone_index_key_compare(ra->rr, ldns_rr_owner(rb->rr),
+			ldns_rr_get_class(rb->rr), ldns_rr_get_type(rb->rr));
+
+	if (c != 0) {
+		return c;
+	}
+	return ra->pos < rb->pos ? -1 : (ra->pos > rb->pos ? 1 : 0);
+}
+
+static bool
+zone_index_init(struct zone_index *index, const ldns_zone *zone)
+{
+	size_t i;
+
+	index->count = ldns_zone_rr_count(zone);
+	index->rrs = LDNS_XMALLOC(struct zone_index_rr,
+			index->count ? index->count : 1);
+	if (!index->rrs) {
+		return false;
+	}
+	for (i = 0; i < index->count; i++) {
+		index->rrs[i].rr = ldns_rr_list_rr(ldns_zone_rrs(zone), i);
+		index->rrs[i].pos = i;
+	}
+	qsort(index->rrs, index->count, sizeof(*index->rrs),
+			zone_index_compare);
+	return true;
+}
+
+/* the rrset is found with a binary search, and cloned for the answer */
 static ldns_rr_list *
-get_rrset(const ldns_zone *zone, const ldns_rdf *owner_name, const ldns_rr_type qtype, const ldns_rr_class qclass)
+get_rrset(const struct zone_index *index, const ldns_rdf *owner_name, const ldns_rr_type qtype, const ldns_rr_class qclass)
 {
-	uint16_t i;
 	ldns_rr_list *rrlist = ldns_rr_list_new();
-	ldns_rr *cur_rr;
-	if (!zone || !owner_name) {
+	size_t lo = 0, hi, mid;
+
+	if (!index || !owner_name) {
 		fprintf(stderr, "Warning: get_rrset called with NULL zone or owner name\n");
 		return rrlist;
 	}
-	
-	for (i = 0; i < ldns_zone_rr_count(zone); i++) {
-		cur_rr = ldns_rr_list_rr(ldns_zone_rrs(zone), i);
-		if (ldns_dname_compare(ldns_rr_owner(cur_rr), owner_name) == 0 &&
-		    ldns_rr_get_class(cur_rr) == qclass &&
-		    ldns_rr_get_type(cur_rr) == qtype
-		   ) {
-			ldns_rr_list_push_rr(rrlist, ldns_rr_clone(cur_rr));
+
+	/* the first rr that is not smaller than the key */
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (zone_index_key_compare(index->rrs[mid].rr, owner_name,
+				qclass, qtype) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
+	for (; lo < index->count && zone_index_key_compare(index->rrs[lo].rr,
+			owner_name, qclass, qtype) == 0; lo++) {
+		ldns_rr_list_push_rr(rrlist, ldns_rr_clone(index->rrs[lo].rr));
+	}
 	
 	printf("Found rrset of %u rrs\n", (unsigned int) ldns_rr_list_rr_count(rrlist));
 	
@@ -116,9 +186,13 @@ main(int argc, char **argv)
 	ldns_rr_list *answer_ns;
 	ldns_rr_list *answer_ad;
 	ldns_rdf *origin = NULL;
+	size_t client_size;
+	ldns_pkt_fit_stats fit_stats;
+	size_t fit_changed = 0;
 	
 	/* zone */
 	ldns_zone *zone;
+	struct zone_index index;
 	int line_nr;
 	FILE *zone_fp;
 	
@@ -175,6 +249,12 @@ main(int argc, char **argv)
 		exit(errno);
 	}
 
+	memset(&fit_stats, 0, sizeof(fit_stats));
+	if (!zone_index_init(&index, zone)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
 	/* Done. Now receive */
 	while (1) {
 		nb = recvfrom(sock, (void*)inbuf, INBUF_SIZE, 0, 
@@ -182,7 +262,7 @@ main(int argc, char **argv)
 		if (nb < 1) {
 			fprintf(stderr, "%s: recvfrom(): %s\n",
 			argv[0], strerror(errno));
-			exit(1);
+			break;
 		}
 
 		/*
@@ -203,7 +283,7 @@ main(int argc, char **argv)
 		answer_qr = ldns_rr_list_new();
 		ldns_rr_list_push_rr(answer_qr, ldns_rr_clone(query_rr));
 
-		answer_an = get_rrset(zone, ldns_rr_owner(query_rr), ldns_rr_get_type(query_rr), ldns_rr_get_class(query_rr));
+		answer_an = get_rrset(&index, ldns_rr_owner(query_rr), ldns_rr_get_type(query_rr), ldns_rr_get_class(query_rr));
 		answer_pkt = ldns_pkt_new();
 		answer_ns = ldns_rr_list_new();
 		answer_ad = ldns_rr_list_new();
@@ -217,6 +297,29 @@ main(int argc, char **argv)
 		ldns_pkt_push_rr_list(answer_pkt, LDNS_SECTION_AUTHORITY, answer_ns);
 		ldns_pkt_push_rr_list(answer_pkt, LDNS_SECTION_ADDITIONAL, answer_ad);
 
+		/* fit the answer in what the client can take; large
+		 * (post-quantum) keys and signatures easily exceed 512 */
+		client_size = LDNS_MIN_BUFLEN;
+		if (ldns_pkt_edns(query_pkt)) {
+			client_size = ldns_pkt_edns_udp_size(query_pkt);
+			ldns_pkt_set_edns_udp_size(answer_pkt, INBUF_SIZE);
+			ldns_pkt_set_edns_do(answer_pkt,
+				ldns_pkt_edns_do(query_pkt));
+		}
+		(void) ldns_pkt_fit(answer_pkt, client_size, &fit_stats);
+		if (fit_stats.additional_dropped + fit_stats.authority_dropped
+				+ fit_stats.truncated != fit_changed) {
+			fit_changed = fit_stats.additional_dropped
+				+ fit_stats.authority_dropped
+				+ fit_stats.truncated;
+			printf("Of %u answers, %u lost additional data, "
+				"%u lost authority data, %u were truncated\n",
+				(unsigned int) fit_stats.packets,
+				(unsigned int) fit_stats.additional_dropped,
+				(unsigned int) fit_stats.authority_dropped,
+				(unsigned int) fit_stats.truncated);
+		}
+
 		status = ldns_pkt2wire(&outbuf, answer_pkt, &answer_size);
 		
 		printf("Answer packet size: %u bytes.\n", (unsigned int) answer_size);
@@ -235,11 +338,10 @@ main(int argc, char **argv)
 		ldns_rr_list_free(answer_ns);
 		ldns_rr_list_free(answer_ad);
 	}
-	
-	/* No cleanup because of the infinite loop
-	 *
-	 * ldns_rdf_deep_free(origin);
-	 * ldns_zone_deep_free(zone);
-	 * return 0;
-	 */
+
+	/* only a receive error ends the loop */
+	LDNS_FREE(index.rrs);
+	ldns_rdf_deep_free(origin);
+	ldns_zone_deep_free(zone);
+	return 1;
 }
@@ -24,7 +24,10 @@ ldns_rr_list *
 ldns_get_rr_list_addr_by_name(ldns_resolver *res, const ldns_rdf *name,
 		ldns_rr_class c, uint16_t flags)
 {
-	ldns_pkt *pkt;
+	const ldns_rdf *names[2];
+	const ldns_rr_type types[2] = { LDNS_RR_TYPE_AAAA, LDNS_RR_TYPE_A };
+	ldns_pkt *pkts[2];
+	ldns_status statuses[2];
 	ldns_rr_list *aaaa;
 	ldns_rr_list *a;
 	ldns_rr_list *result = NULL;
@@ -66,21 +69,25 @@ ldns_get_rr_list_addr_by_name(ldns_resolver *res, const ldns_rdf *name,
 		return result;
 	}
 
-	/* add the RD flags, because we want an answer */
-	pkt = ldns_resolver_query(res, name, LDNS_RR_TYPE_AAAA, c, flags | LDNS_RD);
-	if (pkt) {
+	/* add the RD flags, because we want an answer; both families
+	 * are asked at the same time */
+	names[0] = name;
+	names[1] = name;
+	if (ldns_resolver_query_pkts_status(pkts, statuses, res, names, types,
+				2, c, flags | LDNS_RD, false)
+			== LDNS_STATUS_OK) {
 		/* extract the data we need */
-		aaaa = ldns_pkt_rr_list_by_type(pkt, LDNS_RR_TYPE_AAAA, 
-			LDNS_SECTION_ANSWER);
-		ldns_pkt_free(pkt);
-	} 
-
-	pkt = ldns_resolver_query(res, name, LDNS_RR_TYPE_A, c, flags | LDNS_RD);
-	if (pkt) {
-		/* extract the data we need */
-		a = ldns_pkt_rr_list_by_type(pkt, LDNS_RR_TYPE_A, LDNS_SECTION_ANSWER);
-		ldns_pkt_free(pkt);
-	} 
+		if (pkts[0]) {
+			aaaa = ldns_pkt_rr_list_by_type(pkts[0],
+					LDNS_RR_TYPE_AAAA, LDNS_SECTION_ANSWER);
+			ldns_pkt_free(pkts[0]);
+		}
+		if (pkts[1]) {
+			a = ldns_pkt_rr_list_by_type(pkts[1],
+					LDNS_RR_TYPE_A, LDNS_SECTION_ANSWER);
+			ldns_pkt_free(pkts[1]);
+		}
+	}
 	ldns_resolver_set_ip6(res, ip6);
 
 	if (aaaa && a) {
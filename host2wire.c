@@ -129,16 +129,11 @@ ldns_rdf2buffer_wire_compress(ldns_buffer *buffer, const ldns_rdf *rdf, ldns_rbt
 ldns_status
 ldns_rdf2buffer_wire_canonical(ldns_buffer *buffer, const ldns_rdf *rdf)
 {
-	size_t i;
-	uint8_t *rdf_data;
-
 	if (ldns_rdf_get_type(rdf) == LDNS_RDF_TYPE_DNAME) {
 		if (ldns_buffer_reserve(buffer, ldns_rdf_size(rdf))) {
-			rdf_data = ldns_rdf_data(rdf);
-			for (i = 0; i < ldns_rdf_size(rdf); i++) {
-				ldns_buffer_write_u8(buffer,
-				    (uint8_t) LDNS_DNAME_NORMALIZE((int)rdf_data[i]));
-			}
+			ldns_casefold_lower(ldns_buffer_current(buffer),
+					ldns_rdf_data(rdf), ldns_rdf_size(rdf));
+			ldns_buffer_skip(buffer, ldns_rdf_size(rdf));
 		}
 	} else {
 		/* direct copy for all other types */
@@ -167,6 +162,205 @@ ldns_rr_list2buffer_wire(ldns_buffer *buffer,const ldns_rr_list *rr_list)
 }
 
 
+/* an rr of an rrset in canonical wire format, for sorting */
+struct ldns_canonical_rr {
+	size_t offset;
+	size_t size;
+	const uint8_t *rdata;
+	size_t rdlen;
+};
+
+/* the rrsets up to this size are handled without allocations */
+#define LDNS_CANONICAL_RRSET_SMALL 8
+
+static int
+ldns_canonical_rr_compare(const void *a, const void *b)
+{
+	const struct ldns_canonical_rr *ra = a;
+	const struct ldns_canonical_rr *rb = b;
+	int c;
+
+	/* rdata as left-justified unsigned octet sequences, the shorter
+	 * one sorts first when the rest is equal */
+	c = memcmp(ra->rdata, rb->rdata,
+			ra->rdlen < rb->rdlen ? ra->rdlen : rb->rdlen);
+	if (c != 0) {
+		return c;
+	}
+	return ra->rdlen < rb->rdlen ? -1 : (ra->rdlen > rb->rdlen ? 1 : 0);
+}
+
+/* the way it was done before: a canonical clone, sorted */
+static ldns_status
+ldns_rrset2buffer_wire_canonical_clone(ldns_buffer *buffer,
+		const ldns_rr_list *rrset, const ldns_rdf *owner, uint32_t ttl)
+{
+	ldns_rr_list *clone;
+	ldns_rr *rr;
+	ldns_rdf *new_owner;
+	ldns_status status;
+	size_t i;
+
+	if (!(clone = ldns_rr_list_clone(rrset))) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	for (i = 0; i < ldns_rr_list_rr_count(clone); i++) {
+		rr = ldns_rr_list_rr(clone, i);
+		if (owner) {
+			if (!(new_owner = ldns_rdf_clone(owner))) {
+				ldns_rr_list_deep_free(clone);
+				return LDNS_STATUS_MEM_ERR;
+			}
+			ldns_rdf_deep_free(ldns_rr_owner(rr));
+			ldns_rr_set_owner(rr, new_owner);
+		}
+		ldns_rr_set_ttl(rr, ttl);
+		ldns_rr2canonical(rr);
+	}
+	ldns_rr_list_sort(clone);
+	status = ldns_rr_list2buffer_wire(buffer, clone);
+	ldns_rr_list_deep_free(clone);
+	return status;
+}
+
+ldns_status
+ldns_rrset2buffer_wire_canonical(ldns_buffer *buffer,
+		const ldns_rr_list *rrset, const ldns_rdf *owner, uint32_t ttl)
+{
+	struct ldns_canonical_rr small[LDNS_CANONICAL_RRSET_SMALL];
+	struct ldns_canonical_rr *rrs = small, tmp_rr;
+	size_t count = ldns_rr_list_rr_count(rrset);
+	size_t start = ldns_buffer_position(buffer);
+	size_t i, j, owner_size, total;
+	const ldns_rr *rr, *first;
+	const uint8_t *base;
+	uint8_t *copy = NULL;
+	bool sorted = true, same = true, rewrite;
+	ldns_status status;
+
+	if (count == 0) {
+		return ldns_buffer_status(buffer);
+	}
+	first = ldns_rr_list_rr(rrset, 0);
+	if (!first || !ldns_rr_owner(first)) {
+		return ldns_rrset2buffer_wire_canonical_clone(buffer, rrset,
+				owner, ttl);
+	}
+	owner_size = ldns_rdf_size(ldns_rr_owner(first));
+	if (count > LDNS_CANONICAL_RRSET_SMALL &&
+			!(rrs = LDNS_XMALLOC(struct ldns_canonical_rr, count))) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+
+	/* every rr in canonical form once, right where it ends up when
+	 * it is in order already */
+	for (i = 0; i < count; i++) {
+		rr = ldns_rr_list_rr(rrset, i);
+		if (!rr ||
+		    ldns_rr_get_type(rr) != ldns_rr_get_type(first) ||
+		    ldns_rr_get_class(rr) != ldns_rr_get_class(first) ||
+		    !ldns_rr_owner(rr) ||
+		    ldns_rdf_size(ldns_rr_owner(rr)) != owner_size) {
+			same = false;
+			break;
+		}
+		rrs[i].offset = ldns_buffer_position(buffer) - start;
+		(void) ldns_rr2buffer_wire_canonical(buffer, rr,
+				LDNS_SECTION_ANY);
+		rrs[i].size = ldns_buffer_position(buffer) - start
+			- rrs[i].offset;
+	}
+	status = ldns_buffer_status(buffer);
+	if (status != LDNS_STATUS_OK || !same) {
+		goto done;
+	}
+	base = ldns_buffer_at(buffer, start);
+	for (i = 0; i < count; i++) {
+		rrs[i].rdata = base + rrs[i].offset + owner_size + 10;
+		rrs[i].rdlen = rrs[i].size - owner_size - 10;
+		/* the owners in canonical form must be the same too */
+		if (i > 0 && memcmp(base + rrs[i].offset, base, owner_size)
+				!= 0) {
+			same = false;
+			goto done;
+		}
+		if (i > 0 && sorted &&
+		    ldns_canonical_rr_compare(&rrs[i - 1], &rrs[i]) > 0) {
+			sorted = false;
+		}
+	}
+
+	rewrite = !sorted || (owner && ldns_rdf_size(owner) != owner_size);
+	if (rewrite) {
+		total = ldns_buffer_position(buffer) - start;
+		if (!(copy = LDNS_XMALLOC(uint8_t, total))) {
+			status = LDNS_STATUS_MEM_ERR;
+			goto done;
+		}
+		memcpy(copy, base, total);
+		for (i = 0; i < count; i++) {
+			rrs[i].rdata = copy + rrs[i].offset + owner_size + 10;
+		}
+		if (count <= LDNS_CANONICAL_RRSET_SMALL) {
+			for (i = 1; i < count; i++) {
+				tmp_rr = rrs[i];
+				for (j = i; j > 0 && ldns_canonical_rr_compare(
+						&rrs[j - 1], &tmp_rr) > 0; j--) {
+					rrs[j] = rrs[j - 1];
+				}
+				rrs[j] = tmp_rr;
+			}
+		} else {
+			qsort(rrs, count, sizeof(*rrs),
+					ldns_canonical_rr_compare);
+		}
+		ldns_buffer_set_position(buffer, start);
+		for (i = 0; i < count; i++) {
+			if (owner) {
+				(void) ldns_rdf2buffer_wire_canonical(buffer,
+						owner);
+			} else if (ldns_buffer_reserve(buffer, owner_size)) {
+				ldns_buffer_write(buffer, copy, owner_size);
+			}
+			if (!ldns_buffer_reserve(buffer,
+					rrs[i].size - owner_size)) {
+				break;
+			}
+			ldns_buffer_write(buffer, copy + rrs[i].offset
+					+ owner_size, rrs[i].size - owner_size);
+			ldns_buffer_write_u32_at(buffer,
+					ldns_buffer_position(buffer)
+					- rrs[i].rdlen - 6, ttl);
+		}
+		status = ldns_buffer_status(buffer);
+	} else {
+		for (i = 0; i < count; i++) {
+			if (owner) {
+				ldns_buffer_set_position(buffer,
+						start + rrs[i].offset);
+				(void) ldns_rdf2buffer_wire_canonical(buffer,
+						owner);
+			}
+			ldns_buffer_write_u32_at(buffer, start + rrs[i].offset
+					+ owner_size + 4, ttl);
+		}
+		ldns_buffer_set_position(buffer, start + rrs[count - 1].offset
+				+ rrs[count - 1].size);
+	}
+done:
+	if (rrs != small) {
+		LDNS_FREE(rrs);
+	}
+	LDNS_FREE(copy);
+	if (status == LDNS_STATUS_OK && !same) {
+		/* not one rrset, sort it the generic way */
+		ldns_buffer_set_position(buffer, start);
+		return ldns_rrset2buffer_wire_canonical_clone(buffer, rrset,
+				owner, ttl);
+	}
+	return status;
+}
+
 ldns_status
 ldns_rr2buffer_wire_canonical(ldns_buffer *buffer,
 						const ldns_rr *rr,
@@ -100,6 +100,7 @@ ldns_key* ldns_key_new(void)
     ldns_key_set_keytag(newkey, 0);
     ldns_key_set_inception(newkey, 0);
     ldns_key_set_expiration(newkey, 0);
+    ldns_key_set_expiration_jitter(newkey, 0);
     ldns_key_set_pubkey_owner(newkey, NULL);
 #ifdef HAVE_SSL
     ldns_key_set_evp_key(newkey, NULL);
@@ -1590,6 +1591,11 @@ void ldns_key_set_expiration(ldns_key* k, uint32_t e)
   k->_extra.dnssec.expiration = e;
 }
 
+void ldns_key_set_expiration_jitter(ldns_key* k, uint32_t j)
+{
+  k->_expiration_jitter = j;
+}
+
 void ldns_key_set_pubkey_owner(ldns_key* k, ldns_rdf* r)
 {
   k->_pubkey_owner = r;
@@ -1705,6 +1711,11 @@ uint32_t ldns_key_expiration(const ldns_key* k)
   return k->_extra.dnssec.expiration;
 }
 
+uint32_t ldns_key_expiration_jitter(const ldns_key* k)
+{
+  return k->_expiration_jitter;
+}
+
 uint16_t ldns_key_keytag(const ldns_key* k) { return k->_extra.dnssec.keytag; }
 
 ldns_rdf* ldns_key_pubkey_owner(const ldns_key* k) { return k->_pubkey_owner; }
@@ -0,0 +1,90 @@
+/*
+ * casefold.h
+ *
+ * case insensitive primitives for domain names
+ *
+ * a Net::DNS like library for C
+ *
+ * (c) NLnet Labs, 2026
+ *
+ * See the file LICENSE for the license
+ */
+
+/**
+ * \file casefold.h
+ *
+ * Lowercasing, comparing and hashing of bytes with the ASCII letters
+ * A-Z taken as a-z, as domain names are compared (RFC 4343).
+ *
+ * The label length bytes of a domain name in wire format are at most 63,
+ * so they are never letters: a whole name can be passed at once, and is
+ * lowercased without walking the labels.
+ *
+ * The work is done 16 or 32 bytes at a time with the vector instructions
+ * of the CPU when available (SSE2 and AVX2 on x86, NEON on ARM), chosen
+ * at runtime, and 8 bytes at a time in a plain 64 bit word otherwise.
+ * All implementations give the same results. Unlike tolower(), the
+ * results do not depend on the locale.
+ */
+
+#ifndef LDNS_CASEFOLD_H
+#define LDNS_CASEFOLD_H
+
+#include <ldns/common.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copies len bytes from src to dst with the ASCII letters lowercased.
+ * \param[out] dst the lowercased bytes, may be the same as src
+ * \param[in] src the bytes to lowercase
+ * \param[in] len the number of bytes
+ */
+void ldns_casefold_lower(uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Compares len bytes ignoring the case of ASCII letters.
+ * \param[in] a the first bytes
+ * \param[in] b the second bytes
+ * \param[in] len the number of bytes
+ * \return 0 when equal, otherwise -1 or 1 as the first different byte,
+ * lowercased, of a is smaller or bigger than that of b
+ */
+int ldns_casefold_compare(const uint8_t *a, const uint8_t *b, size_t len);
+
+/**
+ * A 64 bit hash of bytes that ignores the case of ASCII letters, for
+ * hash tables and caches of names. The hash is the same on every
+ * platform, but is not cryptographically strong.
+ * \param[in] data the bytes to hash
+ * \param[in] len the number of bytes
+ * \param[in] seed the seed, or the hash of preceding data to continue it
+ * \return the hash
+ */
+uint64_t ldns_casefold_hash(const uint8_t *data, size_t len, uint64_t seed);
+
+/**
+ * The name of the implementation that is used: "avx2", "sse2", "neon"
+ * or "word".
+ * \return the name
+ */
+const char *ldns_casefold_impl(void);
+
+/**
+ * Selects an implementation, for testing and benchmarks.
+ * \param[in] name the name of the implementation, as returned by
+ * ldns_casefold_impl(), or NULL for the best one for this CPU
+ * \return false when the implementation is not available here
+ */
+bool ldns_casefold_use(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LDNS_CASEFOLD_H */
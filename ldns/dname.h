@@ -205,6 +205,152 @@ ldns_rdf * ldns_dname_label(const ldns_rdf *rdf, uint8_t labelpos);
  */
 int ldns_dname_is_wildcard(const ldns_rdf* dname);
 
+/**
+ * The maximum number of labels (not counting the root label) that a
+ * wire format domain name of at most 255 octets can hold.
+ */
+#define LDNS_DNAME_VIEW_MAX_LABELS 127
+
+/**
+ * A non-owning view on a domain name, or on one of its suffixes.
+ *
+ * The view points into the wire data of an existing dname and has the
+ * offset of every label precomputed, so taking suffixes, chopping labels
+ * and comparing names can be done without allocating new rdfs or
+ * rescanning the name. A view is only valid for as long as the data
+ * it was initialized from; it is usually kept on the stack.
+ */
+struct ldns_struct_dname_view
+{
+	/** Wire data of the complete name */
+	const uint8_t *_data;
+	/** Size of the complete name in octets */
+	uint16_t _size;
+	/** Offset of the first label in the view */
+	uint16_t _offset;
+	/** Number of labels in the view (not counting the root label) */
+	uint8_t _label_count;
+	/** Index in _offsets of the first label in the view */
+	uint8_t _first;
+	/** Offsets of all labels of the complete name, plus one
+	 *  entry for the end of the last label */
+	uint8_t _offsets[LDNS_DNAME_VIEW_MAX_LABELS + 1];
+};
+typedef struct ldns_struct_dname_view ldns_dname_view;
+
+/**
+ * Initializes a view on the given dname. No data is copied.
+ * \param[out] view the view to initialize
+ * \param[in] dname the dname rdf to look at
+ * \return LDNS_STATUS_OK on success, or an error when dname is not
+ *         a (well formed) dname
+ */
+ldns_status ldns_dname_view_init(ldns_dname_view *view, const ldns_rdf *dname);
+
+/**
+ * Initializes a view on a domain name in wire format. No data is copied.
+ * \param[out] view the view to initialize
+ * \param[in] data the wire format name
+ * \param[in] size the number of octets available at data
+ * \return LDNS_STATUS_OK on success, or an error when the data does
+ *         not hold a well formed name
+ */
+ldns_status ldns_dname_view_init_frm_data(ldns_dname_view *view,
+		const uint8_t *data, size_t size);
+
+/**
+ * Returns the number of labels in the view, not counting the root label
+ * \param[in] view the view
+ * \return the number of labels
+ */
+uint8_t ldns_dname_view_label_count(const ldns_dname_view *view);
+
+/**
+ * Returns the wire data of the name the view looks at, starting at
+ * its first label
+ * \param[in] view the view
+ * \return pointer to the first length octet
+ */
+const uint8_t *ldns_dname_view_data(const ldns_dname_view *view);
+
+/**
+ * Returns the size in octets of the wire data of the view
+ * \param[in] view the view
+ * \return the size
+ */
+size_t ldns_dname_view_size(const ldns_dname_view *view);
+
+/**
+ * Returns a pointer to the length octet of a label in the view. The
+ * labels are numbered starting from 0 (left most).
+ * \param[in] view the view
+ * \param[in] labelpos the label number
+ * \return pointer to the label, or NULL if there is no such label
+ */
+const uint8_t *ldns_dname_view_label(const ldns_dname_view *view,
+		uint8_t labelpos);
+
+/**
+ * Makes suffix a view on the given view from the nth label on. This is
+ * the view equivalent of ldns_dname_clone_from(); suffix may be view
+ * itself.
+ * \param[out] suffix the view to set
+ * \param[in] view the view to take the suffix of
+ * \param[in] n the number of labels to skip
+ * \return true on success, false if n is larger than the label count
+ */
+bool ldns_dname_view_suffix(ldns_dname_view *suffix,
+		const ldns_dname_view *view, uint8_t n);
+
+/**
+ * Chops one label off the left side of the view, in place. This is
+ * the view equivalent of ldns_dname_left_chop().
+ * \param[in] view the view to chop
+ * \return true on success, false if the view is the root
+ */
+bool ldns_dname_view_left_chop(ldns_dname_view *view);
+
+/**
+ * Compares two views according to the algorithm for ordering in
+ * RFC4034 Section 6 (like ldns_dname_compare()).
+ * \param[in] view1 first view
+ * \param[in] view2 second view
+ * \return -1 if view1 comes before view2, 1 if view1 comes after view2,
+ *         and 0 if they are equal.
+ */
+int ldns_dname_view_compare(const ldns_dname_view *view1,
+		const ldns_dname_view *view2);
+
+/**
+ * Tests whether the name in view sub falls under the name in view
+ * parent. Like ldns_dname_is_subdomain(), returns false if the names
+ * are equal.
+ * \param[in] sub the view to test
+ * \param[in] parent the parent's view
+ * \return true if sub falls under parent, otherwise false
+ */
+bool ldns_dname_view_is_subdomain(const ldns_dname_view *sub,
+		const ldns_dname_view *parent);
+
+/**
+ * Sets up rdf as a dname rdf that points at the data of the view,
+ * without copying. The rdf must not be freed with ldns_rdf_free() or
+ * ldns_rdf_deep_free(), and may only be passed to functions that take
+ * a const ldns_rdf.
+ * \param[out] rdf the (stack allocated) rdf to set
+ * \param[in] view the view to point at
+ * \return rdf
+ */
+const ldns_rdf *ldns_dname_view2rdf(ldns_rdf *rdf,
+		const ldns_dname_view *view);
+
+/**
+ * Creates a new dname rdf holding a copy of the name in the view
+ * \param[in] view the view to copy
+ * \return the new rdf, or NULL on error
+ */
+ldns_rdf *ldns_dname_view_clone(const ldns_dname_view *view);
+
 #ifdef __cplusplus
 }
 #endif
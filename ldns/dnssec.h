@@ -154,6 +154,45 @@ DSA *ldns_key_buf2dsa_raw(const unsigned char* key, size_t len);
 int ldns_digest_evp(const unsigned char* data, unsigned int len, 
 	unsigned char* dest, const EVP_MD* md);
 
+/**
+ * Returns the message digest with the given name. With OpenSSL 3 the
+ * common digests are fetched once for the process, so that using them
+ * does not fetch them again every time.
+ * \param[in] name the digest name, such as "SHA256".
+ * \return the digest, or NULL when it is not available.
+ */
+const EVP_MD *ldns_evp_md(const char *name);
+
+/**
+ * Returns a message digest context for one operation. With OpenSSL 3 this
+ * is the context of the calling thread, that is reused every time; it is
+ * freed when the thread exits.
+ * \return the context, or NULL on failure.
+ */
+EVP_MD_CTX *ldns_evp_md_ctx_get(void);
+
+/**
+ * Gives back a context from ldns_evp_md_ctx_get(), after the operation.
+ * \param[in] ctx the context.
+ */
+void ldns_evp_md_ctx_release(EVP_MD_CTX *ctx);
+
+/**
+ * Calculates a HMAC, with the MAC and context that are kept per thread
+ * with OpenSSL 3.
+ * \param[in] md the message digest to use.
+ * \param[in] key the key.
+ * \param[in] key_len length of the key.
+ * \param[in] data the data to authenticate.
+ * \param[in] len length of data.
+ * \param[out] dest the destination of the mac, EVP_MAX_MD_SIZE long.
+ * \param[out] dest_len the length of the mac.
+ * \return true if worked, false on failure.
+ */
+int ldns_evp_hmac(const EVP_MD *md, const unsigned char *key, size_t key_len,
+	const unsigned char *data, size_t len, unsigned char *dest,
+	unsigned int *dest_len);
+
 /**
  * Converts a holding buffer with key material to EVP PKEY in openssl.
  * Only available if ldns was compiled with GOST.
@@ -281,6 +320,78 @@ ldns_rr * ldns_create_nsec(ldns_rdf *cur_owner, ldns_rdf *next_owner, ldns_rr_li
  */
 ldns_rdf *ldns_nsec3_hash_name(const ldns_rdf *name, uint8_t algorithm, uint16_t iterations, uint8_t salt_length, const uint8_t *salt);
 
+/**
+ * A cache of NSEC3 hashed owner names for one set of NSEC3 parameters.
+ * It can be written to and read back from a file, so that a signer only
+ * has to hash the names that are new since its previous run.
+ */
+struct ldns_struct_nsec3_hash_cache
+{
+	/** NSEC3 hash algorithm of the cached hashes */
+	uint8_t algorithm;
+	/** NSEC3 iterations of the cached hashes */
+	uint16_t iterations;
+	/** length of salt */
+	uint8_t salt_length;
+	/** NSEC3 salt of the cached hashes */
+	uint8_t *salt;
+	/** tree of cache entries by owner name */
+	ldns_rbtree_t *names;
+	/** number of lookups answered from the cache */
+	size_t hits;
+	/** number of lookups that had to hash the name */
+	size_t misses;
+};
+
+/**
+ * Creates an empty NSEC3 hash cache for the given parameters
+ * \param[in] algorithm The hash algorithm
+ * \param[in] iterations The number of hash iterations
+ * \param[in] salt_length The length of the salt in bytes
+ * \param[in] salt The salt
+ * \return the new cache, or NULL on memory error
+ */
+ldns_nsec3_hash_cache *ldns_nsec3_hash_cache_new(uint8_t algorithm, uint16_t iterations, uint8_t salt_length, const uint8_t *salt);
+
+/**
+ * Frees the cache and all its entries
+ * \param[in] cache the cache to free
+ */
+void ldns_nsec3_hash_cache_free(ldns_nsec3_hash_cache *cache);
+
+/**
+ * Reads cache entries written by ldns_nsec3_hash_cache_write().
+ * When the file was written for other NSEC3 parameters, nothing is read.
+ * \param[in] cache the cache to add the entries to
+ * \param[in] fp the file to read from
+ * \return LDNS_STATUS_OK on success (also when the parameters differ),
+ *         an error code when the file is not a valid cache
+ */
+ldns_status ldns_nsec3_hash_cache_read(ldns_nsec3_hash_cache *cache, FILE *fp);
+
+/**
+ * Writes the parameters of the cache and the entries that were looked up
+ * since it was created or read, so names that left the zone are dropped.
+ * \param[in] cache the cache to write
+ * \param[in] fp the file to write to
+ * \return LDNS_STATUS_OK on success, an error code otherwise
+ */
+ldns_status ldns_nsec3_hash_cache_write(const ldns_nsec3_hash_cache *cache, FILE *fp);
+
+/**
+ * Like ldns_nsec3_hash_name(), but takes the hash from the cache when the
+ * parameters are those of the cache, and adds it to the cache if it
+ * was not there yet.
+ * \param[in] cache The cache, may be NULL
+ * \param[in] *name The owner name to calculate the hash for
+ * \param[in] algorithm The hash algorithm to use
+ * \param[in] iterations The number of hash iterations to use
+ * \param[in] salt_length The length of the salt in bytes
+ * \param[in] salt The salt to use
+ * \return The hashed owner name rdf, without the domain name
+ */
+ldns_rdf *ldns_nsec3_hash_name_cached(ldns_nsec3_hash_cache *cache, const ldns_rdf *name, uint8_t algorithm, uint16_t iterations, uint8_t salt_length, const uint8_t *salt);
+
 /**
  * Sets all the NSEC3 options. The rr to set them in must be initialized with _new() and
  * type LDNS_RR_TYPE_NSEC3
@@ -47,6 +47,32 @@ extern "C"
    */
   ldns_rr_list* ldns_sign_public(ldns_rr_list* rrset, ldns_key_list* keys);
 
+  /**
+   * A signature that signing a zone with a signer queues, see
+   * ldns_dnssec_zone_set_signer(). The signer makes it like
+   * ldns_sign_public_buffer() does.
+   */
+  struct ldns_struct_dnssec_sign_job
+  {
+    /** the wiredata of the empty rrsig and the rrset to sign */
+    ldns_buffer* data;
+    /** the key to sign with, from the key list of the zone signing */
+    ldns_key* key;
+    /** to be set by the signer to the signature data */
+    ldns_rdf* signature;
+  };
+
+  /**
+   * A signer for ldns_dnssec_zone_set_signer() that makes the signatures
+   * one by one with ldns_sign_public_buffer().
+   * \param[in] jobs the signatures to make
+   * \param[in] count the number of jobs
+   * \param[in] arg not used
+   * \return LDNS_STATUS_OK when all signatures are made
+   */
+  ldns_status ldns_dnssec_sign_jobs(ldns_dnssec_sign_job* jobs, size_t count,
+                                    void* arg);
+
 #if LDNS_BUILD_CONFIG_HAVE_SSL
   /**
    * Sign a buffer with the DSA key (hash with SHA1)
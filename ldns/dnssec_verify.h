@@ -687,6 +687,56 @@ ldns_status ldns_verify_rrsig_keylist_notime(const ldns_rr_list *rrset,
 							   const ldns_rr_list *keys,
 							   ldns_rr_list *good_keys);
 
+/**
+ * An rrset made ready to verify its signatures one by one. The sorted
+ * canonical wire format of the rrset, and the keytags and algorithms of
+ * the keys, are computed once for all signatures.
+ */
+typedef struct ldns_verify_rrset_struct ldns_verify_rrset;
+
+/**
+ * Makes an rrset ready to verify its signatures.
+ * \param[out] v the prepared rrset, free it with ldns_verify_rrset_free()
+ * \param[in] rrset the rrset, which is copied
+ * \param[in] keys the keys to try, which are not copied and must be kept
+ *                 until v is freed
+ * \return LDNS_STATUS_OK or an error
+ */
+ldns_status ldns_verify_rrset_new(ldns_verify_rrset **v,
+		const ldns_rr_list *rrset, const ldns_rr_list *keys);
+
+/**
+ * Verifies an rrsig over a prepared rrset. Only the keys with the keytag
+ * and algorithm of the rrsig are tried.
+ * \param[in] v the prepared rrset
+ * \param[in] rrsig the signature of the rrset
+ * \param[in] check_time the time for which the validation is performed
+ * \param[out] good_keys  if this is a (initialized) list, the pointer to keys
+ *                        that validate the signature are added to it
+ * \return status LDNS_STATUS_OK if at least one key matched. Else an error.
+ */
+ldns_status ldns_verify_rrset_rrsig_time(ldns_verify_rrset *v,
+		const ldns_rr *rrsig, time_t check_time,
+		ldns_rr_list *good_keys);
+
+/**
+ * Verifies an rrsig over a prepared rrset. Only the keys with the keytag
+ * and algorithm of the rrsig are tried. Time is not checked.
+ * \param[in] v the prepared rrset
+ * \param[in] rrsig the signature of the rrset
+ * \param[out] good_keys  if this is a (initialized) list, the pointer to keys
+ *                        that validate the signature are added to it
+ * \return status LDNS_STATUS_OK if at least one key matched. Else an error.
+ */
+ldns_status ldns_verify_rrset_rrsig_notime(ldns_verify_rrset *v,
+		const ldns_rr *rrsig, ldns_rr_list *good_keys);
+
+/**
+ * Frees a prepared rrset.
+ * \param[in] v the prepared rrset
+ */
+void ldns_verify_rrset_free(ldns_verify_rrset *v);
+
 /**
  * verify an rrsig with 1 key
  * \param[in] rrset the rrset
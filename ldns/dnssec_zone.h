@@ -15,14 +15,23 @@
 extern "C" {
 #endif
 
+/**
+ * An RRSIG kept in compact form, see ldns_dnssec_zone_compact_rrsigs()
+ */
+typedef struct ldns_struct_compact_rrsig ldns_compact_rrsig;
+
 /**
  * Singly linked list of rrs
  */
 typedef struct ldns_struct_dnssec_rrs ldns_dnssec_rrs;
 struct ldns_struct_dnssec_rrs
 {
+	/** the rr, or NULL when it is kept in compact form */
 	ldns_rr *rr;
 	ldns_dnssec_rrs *next;
+	/** the RRSIG in compact form when rr is NULL, use
+	 * ldns_dnssec_rrs_rr() to get it as an ldns_rr */
+	ldns_compact_rrsig *_compact;
 };
 
 /**
@@ -35,6 +44,12 @@ struct ldns_struct_dnssec_rrsets
 	ldns_rr_type type;
 	ldns_dnssec_rrs *signatures;
 	ldns_dnssec_rrsets *next;
+	/**
+	 * Counts the changes to the order of the list from here on made by
+	 * ldns_dnssec_rrsets_add_rr() and ldns_dnssec_rrsets_set_type().
+	 * The type index of a name uses it to see that it is out of date.
+	 */
+	size_t changes;
 };
 
 /**
@@ -83,8 +98,37 @@ struct ldns_struct_dnssec_name
 	 * pointer to store the hashed name (only used when in an NSEC3 zone
 	 */
 	ldns_rdf *hashed_name;
+	/**
+	 * Type index over the rrsets: the rrsets in the order of the list
+	 * (sorted by type), so a type can be found by binary search.
+	 * It is maintained by ldns_dnssec_name_add_rr(),
+	 * ldns_dnssec_name_insert_rrset() and ldns_dnssec_name_remove_rrset().
+	 * Code that links rrsets into the list itself must call
+	 * ldns_dnssec_name_reindex() afterwards.
+	 */
+	ldns_dnssec_rrsets **rrset_index;
+	/** number of rrsets in the index */
+	size_t rrset_count;
+	/** number of slots allocated for the index */
+	size_t rrset_capacity;
+	/** presence bitmap of the indexed rrset types below 256 */
+	uint8_t rrset_types[32];
+	/** changes of the first rrset when the index was made */
+	size_t rrset_changes;
 };
 
+/** Cache of NSEC3 hashed owner names, see ldns/dnssec.h */
+typedef struct ldns_struct_nsec3_hash_cache ldns_nsec3_hash_cache;
+
+/** A signature to make by a batch signer, see ldns/dnssec_sign.h */
+typedef struct ldns_struct_dnssec_sign_job ldns_dnssec_sign_job;
+
+/**
+ * Makes the signatures of a batch of jobs, see ldns/dnssec_sign.h
+ */
+typedef ldns_status (*ldns_dnssec_signer)(ldns_dnssec_sign_job *jobs,
+		size_t count, void *arg);
+
 /**
  * Structure containing a dnssec zone
  */
@@ -100,6 +144,16 @@ struct ldns_struct_dnssec_zone {
 	 *  to calculate hashed names
 	 */
 	ldns_rr *_nsec3params;
+	/** hashed names to reuse when creating NSEC3s (not owned), or NULL */
+	ldns_nsec3_hash_cache *_nsec3_hash_cache;
+	/** makes the signatures in batches instead of one by one, or NULL */
+	ldns_dnssec_signer _signer;
+	/** argument for the signer */
+	void *_signer_arg;
+	/** number of signatures handed to the signer at once */
+	size_t _signer_batch;
+	/** the fields that the compact RRSIGs share, or NULL */
+	ldns_rbtree_t *_rrsig_templates;
 };
 typedef struct ldns_struct_dnssec_zone ldns_dnssec_zone;
 
@@ -154,6 +208,28 @@ void ldns_dnssec_rrs_print(FILE *out, const ldns_dnssec_rrs *rrs);
 void ldns_dnssec_rrs_print_fmt(FILE *out, 
 		const ldns_output_format *fmt, const ldns_dnssec_rrs *rrs);
 
+/**
+ * Returns the rr of an entry in a list of rrs. An RRSIG that is kept in
+ * compact form is made into an ldns_rr first, which then stays in the
+ * entry and is freed with it.
+ *
+ * \param[in] rrs the entry
+ * \return the rr, or NULL when there is none or on memory error
+ */
+ldns_rr *ldns_dnssec_rrs_rr(ldns_dnssec_rrs *rrs);
+
+/**
+ * Returns a copy of the rr of an entry in a list of rrs, also when it is
+ * an RRSIG kept in compact form. The entry is not changed, so the
+ * signatures of a compact zone can be looked at one by one without
+ * making the zone large again.
+ *
+ * \param[in] rrs the entry
+ * \return the copy, to be freed by the caller, or NULL when there is
+ *         no rr or on memory error
+ */
+ldns_rr *ldns_dnssec_rrs_clone_rr(const ldns_dnssec_rrs *rrs);
+
 /**
  * Creates a new list (entry) of RRsets
  * \return the newly allocated structure
@@ -332,6 +408,49 @@ ldns_status ldns_dnssec_name_add_rr(ldns_dnssec_name *name,
 ldns_dnssec_rrsets *ldns_dnssec_name_find_rrset(const ldns_dnssec_name *name,
 									   ldns_rr_type type);
 
+/**
+ * Returns whether the name has an rrset of the given type.
+ * Uses the type index, so this does not walk the rrsets.
+ *
+ * \param[in] name the name to check
+ * \param[in] type the type of the rrset
+ * \return true if there is an rrset with that type
+ */
+bool ldns_dnssec_name_has_type(const ldns_dnssec_name *name,
+                               ldns_rr_type type);
+
+/**
+ * Links the given rrset into the rrsets of name at the place of its
+ * type, and updates the type index.
+ *
+ * \param[in] name the name to add the rrset to
+ * \param[in] rrset the rrset to add; its next pointer is overwritten
+ * \return LDNS_STATUS_OK on success, LDNS_STATUS_ERR if name already
+ *         has an rrset of that type
+ */
+ldns_status ldns_dnssec_name_insert_rrset(ldns_dnssec_name *name,
+                                          ldns_dnssec_rrsets *rrset);
+
+/**
+ * Unlinks the rrset of the given type from the rrsets of name, and
+ * updates the type index. The rrset itself is not freed.
+ *
+ * \param[in] name the name to remove the rrset from
+ * \param[in] type the type of the rrset
+ * \return the unlinked rrset, or NULL if there was none of that type
+ */
+ldns_dnssec_rrsets *ldns_dnssec_name_remove_rrset(ldns_dnssec_name *name,
+                                                  ldns_rr_type type);
+
+/**
+ * Rebuilds the type index of name from its list of rrsets. Only needed
+ * after the rrsets list has been modified directly.
+ *
+ * \param[in] name the name to reindex
+ * \return LDNS_STATUS_OK on success, an error code otherwise
+ */
+ldns_status ldns_dnssec_name_reindex(ldns_dnssec_name *name);
+
 /**
  * Find the RRset with the given name and type in the zone
  *
@@ -397,6 +516,31 @@ ldns_status ldns_dnssec_zone_new_frm_fp(ldns_dnssec_zone** z, FILE* fp,
 ldns_status ldns_dnssec_zone_new_frm_fp_l(ldns_dnssec_zone** z, FILE* fp,
 		const ldns_rdf* origin, uint32_t ttl, ldns_rr_class c, int* line_nr);
 
+/**
+ * Lets NSEC3 creation for the zone take hashed owner names from cache,
+ * and add the names it has to hash to it. The cache is not owned by
+ * the zone and must outlive the signing of it.
+ *
+ * \param[in] zone the zone to set the cache for
+ * \param[in] cache the cache, or NULL to hash every name
+ */
+void ldns_dnssec_zone_set_nsec3_hash_cache(ldns_dnssec_zone *zone,
+		ldns_nsec3_hash_cache *cache);
+
+/**
+ * Lets signing the zone queue the signatures to make, and hand them to
+ * signer batch at a time, so that it can make several of them at once,
+ * for example in threads or with parallel sessions on a HSM. The
+ * signatures end up in the zone in the same order as without a signer.
+ *
+ * \param[in] zone the zone to set the signer for
+ * \param[in] signer the signer, or NULL to make the signatures one by one
+ * \param[in] arg argument for the signer
+ * \param[in] batch the number of signatures to hand over at once
+ */
+void ldns_dnssec_zone_set_signer(ldns_dnssec_zone *zone,
+		ldns_dnssec_signer signer, void *arg, size_t batch);
+
 /**
  * Frees the given zone structure, and its rbtree of dnssec_names
  * Individual ldns_rr RRs within those names are *not* freed
@@ -411,6 +555,37 @@ void ldns_dnssec_zone_free(ldns_dnssec_zone *zone);
  */ 
 void ldns_dnssec_zone_deep_free(ldns_dnssec_zone *zone);
 
+/**
+ * Keeps the RRSIGs of the zone in compact form, to save memory.
+ * The fields that most signatures have in common (the class, type
+ * covered, algorithm, labels, original TTL, expiration, inception, key
+ * tag and signer name) are stored once in the zone and shared. Every
+ * compact RRSIG is one allocation, with its TTL and signature, and its
+ * owner name is shared with the name or NSEC(3) that it belongs to.
+ * The ldns_rr of the RRSIGs are freed, so the zone must own its RRs,
+ * like one read with ldns_dnssec_zone_new_frm_fp().
+ *
+ * The rr of a compact entry is NULL; use ldns_dnssec_rrs_rr() or
+ * ldns_dnssec_rrs_clone_rr() to get it. Printing, adding RRs, zone
+ * digests and signing handle compact entries; signing makes the RRSIGs
+ * of the zone full ldns_rr again first. RRSIGs that do not have the
+ * usual rdata fields are left as they are.
+ *
+ * \param[in] zone the zone
+ * \return LDNS_STATUS_OK, or an error when memory ran out, in which case
+ *         part of the RRSIGs may be compact
+ */
+ldns_status ldns_dnssec_zone_compact_rrsigs(ldns_dnssec_zone *zone);
+
+/**
+ * Makes the compact RRSIGs of the zone full ldns_rr again, see
+ * ldns_dnssec_zone_compact_rrsigs().
+ *
+ * \param[in] zone the zone
+ * \return LDNS_STATUS_OK or LDNS_STATUS_MEM_ERR
+ */
+ldns_status ldns_dnssec_zone_expand_rrsigs(ldns_dnssec_zone *zone);
+
 /**
  * Adds the given RR to the zone.
  * It find whether there is a dnssec_name with that name present.
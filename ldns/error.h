@@ -144,7 +144,9 @@ enum ldns_enum_status {
 	LDNS_STATUS_INVALID_SVCPARAM_VALUE,
 	LDNS_STATUS_NOT_EDE,
 	LDNS_STATUS_EDE_OPTION_MALFORMED,
-	LDNS_STATUS_EQUAL_RR
+	LDNS_STATUS_EQUAL_RR,
+	LDNS_STATUS_ZONE_NOT_SORTED,
+	LDNS_STATUS_ZONE_NO_SOA
 };
 typedef enum ldns_enum_status ldns_status;
 
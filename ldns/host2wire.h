@@ -163,6 +163,20 @@ ldns_status ldns_pkt2buffer_wire_compress(ldns_buffer *output, const ldns_pkt *p
  */
 ldns_status ldns_rr_list2buffer_wire(ldns_buffer *output, const ldns_rr_list *rrlist);
 
+/**
+ * Copies an rrset to the buffer in canonical wire format and in canonical
+ * order, as it is signed (RFC4034 section 6): the rrs are canonicalized
+ * and sorted on their rdata. The rrset itself is not changed.
+ * Every rr is converted once, right into the buffer, and rrsets that are
+ * in order already are not moved.
+ * \param[out] *output buffer to append the result to
+ * \param[in] *rrset the rrs with the same owner, class and type
+ * \param[in] *owner the owner name to use for every rr, NULL to keep it
+ * \param[in] ttl the ttl to use for every rr
+ * \return ldns_status
+ */
+ldns_status ldns_rrset2buffer_wire_canonical(ldns_buffer *output, const ldns_rr_list *rrset, const ldns_rdf *owner, uint32_t ttl);
+
 /**
  * Allocates an array of uint8_t at dest, and puts the wireformat of the
  * given rdf in that array. The result_size value contains the
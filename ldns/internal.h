@@ -0,0 +1,33 @@
+/*
+ * internal.h
+ *
+ * Functions shared by the sources of the library, that are not part of
+ * its API. This file is not installed and the functions are not exported.
+ *
+ * (c) NLnet Labs, 2004-2022
+ *
+ * See the file LICENSE for the license
+ */
+
+#ifndef LDNS_INTERNAL_H
+#define LDNS_INTERNAL_H
+
+#include <ldns/ldns.h>
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define LDNS_INTERNAL __attribute__((visibility("hidden")))
+#else
+#define LDNS_INTERNAL
+#endif
+
+/**
+ * Like ldns_dnssec_create_nsec3(), but takes the hashed owner name from
+ * cache when given, see ldns_nsec3_hash_name_cached().
+ */
+LDNS_INTERNAL ldns_rr *ldns_dnssec_create_nsec3_cached(
+		const ldns_dnssec_name *from, const ldns_dnssec_name *to,
+		const ldns_rdf *zone_name, uint8_t algorithm, uint8_t flags,
+		uint16_t iterations, uint8_t salt_length, const uint8_t *salt,
+		ldns_nsec3_hash_cache *cache);
+
+#endif /* LDNS_INTERNAL_H */
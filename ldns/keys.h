@@ -179,6 +179,10 @@ extern "C"
     } _extra;
     /** Owner name of the key */
     ldns_rdf* _pubkey_owner;
+    /** Spread the expiration dates of the signatures made with this key
+     *  over this many seconds before the expiration date. At the end,
+     *  so the members before it keep their place. */
+    uint32_t _expiration_jitter;
   };
   typedef struct ldns_struct_key ldns_key;
 
@@ -425,6 +429,15 @@ extern "C"
    * \param[in] e the expiration
    */
   void ldns_key_set_expiration(ldns_key* k, uint32_t e);
+  /**
+   * Set the key's expiration jitter. Signatures made with the key get
+   * an expiration date a random number of seconds, up to the jitter,
+   * before the key's expiration date. This spreads the moments at
+   * which the signatures of a zone expire, and have to be made again.
+   * \param[in] k the key
+   * \param[in] j the jitter in seconds, 0 to turn it off
+   */
+  void ldns_key_set_expiration_jitter(ldns_key* k, uint32_t j);
   /**
    * Set the key's pubkey owner
    * \param[in] k the key
@@ -549,6 +562,12 @@ extern "C"
    * \return the expiration date
    */
   uint32_t ldns_key_expiration(const ldns_key* k);
+  /**
+   * return the key's expiration jitter
+   * \param[in] k the key
+   * \return the expiration jitter in seconds
+   */
+  uint32_t ldns_key_expiration_jitter(const ldns_key* k);
   /**
    * return the keytag
    * \param[in] k the key
@@ -94,6 +94,7 @@ Or you can just use the menu above to browse through the API docs.
 
 #include <ldns/util.h>
 #include <ldns/buffer.h>
+#include <ldns/casefold.h>
 #include <ldns/common.h>
 #include <ldns/dane.h>
 #include <ldns/dname.h>
@@ -299,6 +299,23 @@ enum ldns_enum_pkt_type {
 };
 typedef enum ldns_enum_pkt_type ldns_pkt_type;
 
+/**
+ * Counters kept by ldns_pkt_fit(), to see how often answers did not
+ * fit the buffer size of the client.
+ */
+struct ldns_struct_pkt_fit_stats
+{
+	/** packets passed to ldns_pkt_fit() */
+	size_t packets;
+	/** packets that lost (some of) their additional section */
+	size_t additional_dropped;
+	/** packets that lost (some of) their authority section */
+	size_t authority_dropped;
+	/** packets that had to be truncated (TC set) */
+	size_t truncated;
+};
+typedef struct ldns_struct_pkt_fit_stats ldns_pkt_fit_stats;
+
 /* prototypes */
 
 /* read */
@@ -932,6 +949,32 @@ bool ldns_pkt_safe_push_rr_list(ldns_pkt *pkt, ldns_pkt_section sec, ldns_rr_lis
  */
 bool ldns_pkt_empty(ldns_pkt *p);
 
+/**
+ * Estimate the size of the wire format of a packet, before converting
+ * it.  Owner names that repeat the name written just before them are
+ * counted as compression pointers; other names are counted in full.
+ * The result is never smaller than what ldns_pkt2wire() produces.
+ * \param[in] p the packet
+ * \return the estimated size in octets
+ */
+size_t ldns_pkt_size_estimate(const ldns_pkt *p);
+
+/**
+ * Make a packet fit in max_size octets, the buffer size of the client
+ * (its EDNS udp size, or 512 without EDNS).  Whole rrsets (with their
+ * signatures) are dropped from the end of the additional section first,
+ * then from the authority section.  These are optional, so TC is only
+ * set if the answer section itself has to be cut, or if the authority
+ * section of a negative answer (the proof) does not fit.  Dropped rrs
+ * are freed.
+ * \param[in] p the packet to fit
+ * \param[in] max_size the number of octets available
+ * \param[in] stats if not NULL, the counters are updated
+ * \return LDNS_STATUS_OK, or LDNS_STATUS_NULL if there is no packet
+ */
+ldns_status ldns_pkt_fit(ldns_pkt *p, size_t max_size,
+		ldns_pkt_fit_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
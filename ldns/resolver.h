@@ -53,6 +53,62 @@ extern "C" {
 #define LDNS_RESOLV_RTT_INF             0       /* infinity */
 #define LDNS_RESOLV_RTT_MIN             1       /* reachable */
 
+/** Seconds that what was learned about the path to a nameserver is kept */
+#define LDNS_RESOLV_PATH_TTL            600
+/** EDNS size that is tried when a larger one timed out; it fits in the
+ * minimum IPv6 MTU, so the answers are not fragmented */
+#define LDNS_RESOLV_PATH_EDNS_SAFE      1232
+/** Number of query types per nameserver that are sent over TCP directly */
+#define LDNS_RESOLV_PATH_TYPES          8
+
+/**
+ * What the resolver learned about the path to a nameserver, when the
+ * fallback mechanism is used. It is forgotten after the path ttl of the
+ * resolver.
+ */
+struct ldns_struct_resolver_path
+{
+	/** Address of the nameserver */
+	ldns_rdf *address;
+	/** Largest answer received over UDP without truncation */
+	uint16_t max_udp_size;
+	/** EDNS size to use because larger ones timed out, 0 if none */
+	uint16_t edns_udp_size;
+	/** Query types whose answers were truncated with EDNS; these are
+	 * sent over TCP directly */
+	ldns_rr_type tcp_types[LDNS_RESOLV_PATH_TYPES];
+	/** Number of types in \c tcp_types */
+	size_t tcp_type_count;
+	/** When edns_udp_size, tcp_types or timeouts were last learned */
+	time_t learned;
+	/** Queries with a large EDNS size that got no answer since the last
+	 * answer; while there are any, a timeout is not asked again with
+	 * LDNS_RESOLV_PATH_EDNS_SAFE */
+	size_t timeouts;
+};
+typedef struct ldns_struct_resolver_path ldns_resolver_path;
+
+/**
+ * Counters of the learning of the paths to the nameservers
+ */
+struct ldns_struct_resolver_path_stats
+{
+	/** UDP answers that were truncated, and asked again */
+	size_t truncated;
+	/** Queries that timed out with a large EDNS size, and were answered
+	 * with LDNS_RESOLV_PATH_EDNS_SAFE */
+	size_t timeouts;
+	/** Queries that were sent over TCP directly */
+	size_t tcp_direct;
+	/** Queries that were sent with a learned smaller EDNS size */
+	size_t edns_reduced;
+	/** Round trips saved: a truncated UDP answer for every query sent
+	 * over TCP directly, and at least a timeout for every query sent
+	 * with a smaller EDNS size */
+	size_t round_trips_saved;
+};
+typedef struct ldns_struct_resolver_path_stats ldns_resolver_path_stats;
+
 /**
  * DNS stub resolver structure
  */
@@ -143,6 +199,18 @@ struct ldns_struct_resolver
 
 	/** Source address to query from */
 	ldns_rdf *_source;
+
+	/** Read buffer for the AXFR connection */
+	struct ldns_struct_tcp_reader *_axfr_reader;
+
+	/** What was learned about the paths to the nameservers */
+	ldns_resolver_path *_paths;
+	/** Number of entries in \c _paths */
+	size_t _path_count;
+	/** Seconds to keep what was learned, 0 to learn nothing */
+	uint32_t _path_ttl;
+	/** Counters of the learning */
+	ldns_resolver_path_stats _path_stats;
 };
 typedef struct ldns_struct_resolver ldns_resolver;
 
@@ -670,6 +738,25 @@ ldns_status ldns_resolver_send_pkt(ldns_pkt **answer, ldns_resolver *r, ldns_pkt
  */
 ldns_status ldns_resolver_query_status(ldns_pkt** pkt, ldns_resolver *r, const ldns_rdf *name, ldns_rr_type t, ldns_rr_class c, uint16_t flags);
 
+/**
+ * Send several queries to the nameservers at the same time, see
+ * ldns_send_pkts(). Like ldns_resolver_query_status() the default domain is
+ * added when _defnames is true, and truncated answers are asked again.
+ * \param[out] answers array of count answers, NULL where there is none
+ * \param[out] statuses array of count statuses, one for every query
+ * \param[in] *r operate using this resolver
+ * \param[in] names the count names to query for
+ * \param[in] types the count types to query for (may be 0, defaults to A)
+ * \param[in] count the number of queries
+ * \param[in] c query for this class (may be 0, default to IN)
+ * \param[in] flags the query flags
+ * \param[in] first_positive stop at the first query in order with a
+ *            NOERROR answer, the queries after it are cancelled
+ *
+ * \return ldns_status LDNS_STATUS_OK when the queries could be sent
+ */
+ldns_status ldns_resolver_query_pkts_status(ldns_pkt **answers, ldns_status *statuses, ldns_resolver *r, const ldns_rdf * const *names, const ldns_rr_type *types, size_t count, ldns_rr_class c, uint16_t flags, bool first_positive);
+
 
 /**
  * Send a query to a nameserver
@@ -751,6 +838,19 @@ void ldns_resolver_deep_free(ldns_resolver *res);
  */
 ldns_rr* ldns_axfr_next(ldns_resolver *resolver);
 
+/**
+ * Get the next message of an AXFR in wire format, without parsing it.
+ * Only the rrs are walked, to find the SOA rrs that end the transfer,
+ * so ldns_axfr_complete() works as with ldns_axfr_next(). Do not mix
+ * calls of the two for one transfer.
+ * \param[in] resolver the resolver to use. First ldns_axfr_start() must be
+ * called
+ * \param[out] size the size of the message
+ * \return the message, valid until the next call, or NULL at the end
+ * of the transfer, on a read error, an error rcode or a malformed message.
+ */
+const uint8_t *ldns_axfr_next_wire(ldns_resolver *resolver, size_t *size);
+
 /**
  * Abort a transfer that is in progress
  * \param[in] resolver the resolver that is used
@@ -801,6 +901,51 @@ void ldns_resolver_nameservers_randomize(ldns_resolver *r);
  */
 bool ldns_resolver_trusted_key(const ldns_resolver *r, ldns_rr_list * keys, ldns_rr_list * trusted_keys);
 
+/**
+ * Get the number of seconds that what was learned about the paths to the
+ * nameservers is kept
+ * \param[in] r the resolver
+ * \return the seconds, 0 when nothing is learned
+ */
+uint32_t ldns_resolver_path_ttl(const ldns_resolver *r);
+
+/**
+ * Set the number of seconds that what was learned about the paths to the
+ * nameservers is kept. With the fallback mechanism, the resolver learns
+ * per nameserver which query types were truncated even with EDNS, and
+ * sends those over TCP directly, and whether large EDNS sizes time out,
+ * and then uses LDNS_RESOLV_PATH_EDNS_SAFE. A query that times out is
+ * only asked again with LDNS_RESOLV_PATH_EDNS_SAFE when the nameserver
+ * answered before, so a nameserver that is down does not cost twice the
+ * timeout. The default is LDNS_RESOLV_PATH_TTL.
+ * \param[in] r the resolver
+ * \param[in] ttl the seconds, 0 to learn nothing
+ */
+void ldns_resolver_set_path_ttl(ldns_resolver *r, uint32_t ttl);
+
+/**
+ * Get what was learned about the path to a nameserver
+ * \param[in] r the resolver
+ * \param[in] address the address of the nameserver
+ * \return what was learned, NULL if nothing or if it was forgotten.
+ * Still owned by the resolver.
+ */
+const ldns_resolver_path *ldns_resolver_nameserver_path(const ldns_resolver *r, const ldns_rdf *address);
+
+/**
+ * Get the counters of the learning of the paths to the nameservers
+ * \param[in] r the resolver
+ * \return the counters
+ */
+const ldns_resolver_path_stats *ldns_resolver_get_path_stats(const ldns_resolver *r);
+
+/**
+ * Forget what was learned about the paths to the nameservers, and reset
+ * the counters
+ * \param[in] r the resolver
+ */
+void ldns_resolver_clear_paths(ldns_resolver *r);
+
 #ifdef __cplusplus
 }
 #endif
@@ -490,6 +490,30 @@ ldns_status ldns_rr_new_frm_fp(ldns_rr **rr, FILE *fp, uint32_t *default_ttl, ld
  */
 ldns_status ldns_rr_new_frm_fp_l(ldns_rr **rr, FILE *fp, uint32_t *default_ttl, ldns_rdf **origin, ldns_rdf **prev, int *line_nr);
 
+/**
+ * creates a new rr from a file containing a string, reading only the rrs
+ * of the given types. Of other rrs only the owner, ttl, class and type
+ * are read, their rdata is skipped without being parsed. So syntax errors
+ * in the rdata of those rrs are not found.
+ * \param[out] rr the new rr
+ * \param[in] fp the file pointer to use
+ * \param[in] default_ttl a default ttl for the rr. If NULL DEF_TTL will be used
+ *            the pointer will be updated if the file contains a $TTL directive
+ * \param[in] origin when the owner is relative add this
+ * 	      the pointer will be updated if the file contains a $ORIGIN directive
+ *	      The caller must ldns_rdf_deep_free it.
+ * \param[in] prev when the owner is whitespaces use this as the * ownername
+ *            the pointer will be updated after the call, also by skipped rrs
+ *	      The caller must ldns_rdf_deep_free it.
+ * \param[in] line_nr pointer to an integer containing the current line number (for debugging purposes)
+ * \param[in] types the types to read, as a type bitmap like in NSEC rrs
+ *            (see ldns_nsec_bitmap_covers_type()), or NULL for all types
+ * \return a ldns_status with an error or LDNS_STATUS_OK. As with
+ *         ldns_rr_new_frm_fp_l() LDNS_STATUS_SYNTAX_EMPTY is returned for
+ *         empty lines and at the end of the file.
+ */
+ldns_status ldns_rr_new_frm_fp_types_l(ldns_rr **rr, FILE *fp, uint32_t *default_ttl, ldns_rdf **origin, ldns_rdf **prev, int *line_nr, const ldns_rdf *types);
+
 /**
  * sets the owner in the rr structure.
  * \param[in] *rr rr to operate on
@@ -150,6 +150,48 @@ ldns_status ldns_zone_new_frm_fp(ldns_zone **z, FILE *fp, const ldns_rdf *origin
  */
 ldns_status ldns_zone_new_frm_fp_l(ldns_zone **z, FILE *fp, const ldns_rdf *origin, uint32_t ttl, ldns_rr_class c, int *line_nr);
 
+/**
+ * Create a new zone from a file with only the rrs of the given types.
+ * Of the other rrs only the owner, ttl, class and type are read, their
+ * rdata is skipped without being parsed, which makes this much faster
+ * than reading the whole zone when few types are wanted. Syntax errors
+ * in the rdata of the skipped rrs are not found. The SOA rr is always
+ * read.
+ * \param[out] z the new zone
+ * \param[in] *fp the filepointer to use
+ * \param[in] *origin the zones' origin
+ * \param[in] ttl default ttl to use
+ * \param[in] c default class to use (IN)
+ * \param[out] line_nr used for error msg, to get to the line number
+ * \param[in] types the types to read, as a type bitmap like in NSEC rrs
+ *            (see ldns_nsec_bitmap_covers_type()), or NULL for all types
+ *
+ * \return ldns_status mesg with an error or LDNS_STATUS_OK
+ */
+ldns_status ldns_zone_new_frm_fp_types_l(ldns_zone **z, FILE *fp, const ldns_rdf *origin, uint32_t ttl, ldns_rr_class c, int *line_nr, const ldns_rdf *types);
+
+/**
+ * Write the difference between two versions of a zone as an IXFR
+ * (RFC 1995) in text format, as in the IXFR files of masterdont: the new
+ * SOA, the old SOA, the deleted rrs, the new SOA, the added rrs and the
+ * new SOA again.
+ * Both versions are read rr by rr, in one pass, and must be sorted in
+ * canonical order, like ldns-read-zone -z writes them. The SOA may be
+ * anywhere. An rr of which only the TTL changed is deleted and added.
+ * \param[in] out the file to write the IXFR to
+ * \param[in] old_fp the old version of the zone
+ * \param[in] new_fp the new version of the zone
+ * \param[in] origin the zones' origin, or NULL to use the owner of the SOA
+ * \param[in] ttl default ttl to use
+ * \param[out] old_soa if not NULL, the SOA of the old version
+ * \param[out] new_soa if not NULL, the SOA of the new version
+ *
+ * \return LDNS_STATUS_OK, LDNS_STATUS_ZONE_NOT_SORTED when an rr is out of
+ * order, LDNS_STATUS_ZONE_NO_SOA when a version has no SOA, or another
+ * error
+ */
+ldns_status ldns_zone_diff_ixfr_fp(FILE *out, FILE *old_fp, FILE *new_fp, const ldns_rdf *origin, uint32_t ttl, ldns_rr **old_soa, ldns_rr **new_soa);
+
 /**
  * Frees the allocated memory for the zone, and the rr_list structure in it
  * \param[in] zone the zone to free
@@ -1,4 +1,4 @@
-/* 
+/*
  * Lua bindings
  *
  * (c) 2006, NLnet Labs
@@ -9,9 +9,18 @@
 #include <stddef.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <stdint.h>
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
 /* lua includes */
 #include <lua.h>
 #include <lualib.h>
@@ -20,14 +29,15 @@
 /* ldns include */
 #include <ldns/ldns.h>
 
-/* the Lua interpreter */
+/* the Lua interpreter of the main thread */
 lua_State* L;
 
 void
 usage(FILE *f, char *progname)
 {
-	fprintf(f, "Synopsis: %s lua-script\n", progname);
-	fprintf(f, "   No options are defined (yet)\n");
+	fprintf(f, "Synopsis: %s [-w workers] lua-script\n", progname);
+	fprintf(f, "   -w <n>\trun the script in n worker Lua states, each in\n");
+	fprintf(f, "         \tits own thread (0 is one per online CPU)\n");
 }
 
 void
@@ -42,6 +52,186 @@ version(FILE *f, char *progname)
 =====================================================
 */
 
+/*
+ * Every ldns object that crosses into Lua is a full userdata holding an
+ * l_obj, with a metatable per type whose __gc frees the object. Objects
+ * that live inside another object (an rr that was pushed into a packet)
+ * are borrowed: they hold a registry reference to their owner, so the
+ * owner stays alive while Lua can still reach them, and are never freed
+ * themselves. The free functions remain for scripts that want to release
+ * memory early; they are safe to call more than once.
+ */
+#define L_RDF_T		"ldns.rdf"
+#define L_RR_T		"ldns.rr"
+#define L_PKT_T		"ldns.packet"
+#define L_BUF_T		"ldns.buffer"
+#define L_ADDR_T	"ldns.sockaddr"
+#define L_UPSTREAM_T	"ldns.upstream"
+
+struct l_obj
+{
+	/* the ldns object, NULL once it is freed */
+	void *ptr;
+	/* registry reference to the owner of a borrowed object */
+	int owner_ref;
+};
+
+/* a socket address as received from, or to be sent to */
+struct l_addr
+{
+	struct sockaddr_storage ss;
+	socklen_t len;
+};
+
+static void
+l_obj_push(lua_State *L, void *ptr, const char *tname, int owner_idx)
+{
+	struct l_obj *o = (struct l_obj *)lua_newuserdata(L, sizeof(*o));
+
+	o->ptr = ptr;
+	o->owner_ref = LUA_NOREF;
+	if (owner_idx > 0) {
+		lua_pushvalue(L, owner_idx);
+		o->owner_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	luaL_getmetatable(L, tname);
+	lua_setmetatable(L, -2);
+}
+
+static struct l_obj *
+l_obj_check(lua_State *L, int idx, const char *tname)
+{
+	/* raises an error when idx is not a tname */
+	return (struct l_obj *)luaL_checkudata(L, idx, tname);
+}
+
+static void *
+l_obj_ptr(lua_State *L, int idx, const char *tname)
+{
+	return l_obj_check(L, idx, tname)->ptr;
+}
+
+/* like l_obj_ptr, but nil or none is allowed */
+static void *
+l_obj_opt(lua_State *L, int idx, const char *tname)
+{
+	if (lua_isnoneornil(L, idx)) {
+		return NULL;
+	}
+	return l_obj_ptr(L, idx, tname);
+}
+
+/* Releases the Lua side of an object. When the object is owned by Lua,
+ * free_func is called on it.
+ */
+static void
+l_obj_release(lua_State *L, struct l_obj *o, void (*free_func)(void *))
+{
+	if (o->owner_ref != LUA_NOREF) {
+		luaL_unref(L, LUA_REGISTRYINDEX, o->owner_ref);
+		o->owner_ref = LUA_NOREF;
+	} else if (o->ptr) {
+		free_func(o->ptr);
+	}
+	o->ptr = NULL;
+}
+
+static void l_rdf_release(void *p) { ldns_rdf_deep_free((ldns_rdf *)p); }
+static void l_rr_release(void *p) { ldns_rr_free((ldns_rr *)p); }
+static void l_pkt_release(void *p) { ldns_pkt_free((ldns_pkt *)p); }
+static void l_buf_release(void *p) { ldns_buffer_free((ldns_buffer *)p); }
+
+static int
+l_rdf_gc(lua_State *L)
+{
+	l_obj_release(L, (struct l_obj *)lua_touserdata(L, 1), l_rdf_release);
+	return 0;
+}
+
+static int
+l_rr_gc(lua_State *L)
+{
+	l_obj_release(L, (struct l_obj *)lua_touserdata(L, 1), l_rr_release);
+	return 0;
+}
+
+static int
+l_pkt_gc(lua_State *L)
+{
+	l_obj_release(L, (struct l_obj *)lua_touserdata(L, 1), l_pkt_release);
+	return 0;
+}
+
+static int
+l_buf_gc(lua_State *L)
+{
+	l_obj_release(L, (struct l_obj *)lua_touserdata(L, 1), l_buf_release);
+	return 0;
+}
+
+/* Takes the rr at rr_idx for insertion into the packet at pkt_idx. An rr
+ * owned by Lua is handed over to the packet; an rr that already lives in
+ * a packet is cloned, so no rr ends up with two owners.
+ */
+static ldns_rr *
+l_rr_take(lua_State *L, int rr_idx, int pkt_idx)
+{
+	struct l_obj *o = l_obj_check(L, rr_idx, L_RR_T);
+
+	if (!o->ptr) {
+		return NULL;
+	}
+	if (o->owner_ref != LUA_NOREF) {
+		return ldns_rr_clone((ldns_rr *)o->ptr);
+	}
+	lua_pushvalue(L, pkt_idx);
+	o->owner_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	return (ldns_rr *)o->ptr;
+}
+
+/* Undoes l_rr_take when the insertion failed */
+static void
+l_rr_untake(lua_State *L, int rr_idx, ldns_rr *rr)
+{
+	struct l_obj *o = l_obj_check(L, rr_idx, L_RR_T);
+
+	if (o->ptr != rr) {
+		ldns_rr_free(rr);
+	} else {
+		luaL_unref(L, LUA_REGISTRYINDEX, o->owner_ref);
+		o->owner_ref = LUA_NOREF;
+	}
+}
+
+static struct l_addr *
+l_addr_push(lua_State *L, const struct sockaddr_storage *ss, socklen_t len)
+{
+	struct l_addr *a = (struct l_addr *)lua_newuserdata(L, sizeof(*a));
+
+	memcpy(&a->ss, ss, sizeof(a->ss));
+	a->len = len;
+	luaL_getmetatable(L, L_ADDR_T);
+	lua_setmetatable(L, -2);
+	return a;
+}
+
+static struct l_addr *
+l_addr_check(lua_State *L, int idx)
+{
+	return (struct l_addr *)luaL_checkudata(L, idx, L_ADDR_T);
+}
+
+/* Packet buffers hold the wire packet from the start to the position */
+static ldns_buffer *
+l_buf_new_frm_wire(const uint8_t *wire, size_t size)
+{
+	ldns_buffer *b = ldns_buffer_new(size > 0 ? size : LDNS_MIN_BUFLEN);
+
+	if (b) {
+		ldns_buffer_write(b, wire, size);
+	}
+	return b;
+}
 
 /*
 ==========
@@ -52,14 +242,11 @@ static int
 l_rdf_new_frm_str(lua_State *L)
 {
 	uint16_t t = (uint16_t)lua_tonumber(L, 1);
-	char *str = strdup((char*)luaL_checkstring(L, 2));
-	if (!str) {
-		return 0;
-	}
-	
+	const char *str = luaL_checkstring(L, 2);
+
 	ldns_rdf *new_rdf = ldns_rdf_new_frm_str((ldns_rdf_type)t, str);
 	if (new_rdf) {
-		lua_pushlightuserdata(L, new_rdf);
+		l_obj_push(L, new_rdf, L_RDF_T, 0);
 		return 1;
 	} else {
 		return 0;
@@ -70,7 +257,7 @@ static int
 l_rdf_print(lua_State *L)
 {
 	/* we always print to stdout */
-	ldns_rdf *toprint = (ldns_rdf*)lua_touserdata(L, 1); /* pop from the stack */
+	ldns_rdf *toprint = (ldns_rdf*)l_obj_ptr(L, 1, L_RDF_T);
 	if (!toprint) {
 		return 0;
 	}
@@ -81,18 +268,14 @@ l_rdf_print(lua_State *L)
 static int
 l_rdf_free(lua_State *L)
 {
-	ldns_rdf *tofree = (ldns_rdf*)lua_touserdata(L, 1); /* pop from the stack */
-	if (!tofree) {
-		return 0;
-	}
-	ldns_rdf_free(tofree);
+	l_obj_release(L, l_obj_check(L, 1, L_RDF_T), l_rdf_release);
 	return 0;
 }
 
 
 /*
 ==========
- RR 
+ RR
 ==========
 */
 static int
@@ -101,18 +284,14 @@ l_rr_new_frm_str(lua_State *L)
 	/* pop string from stack, make new rr, push rr to
 	 * stack and return 1 - to signal the new pointer
 	 */
-	char *str = strdup((char*)luaL_checkstring(L, 1));
-	uint16_t ttl = (uint16_t)lua_tonumber(L, 2);
-	ldns_rdf *orig = (ldns_rdf*)lua_touserdata(L, 2);
-
-	if (!str) {
-		return 0;
-	}
-	
-	ldns_rr *new_rr = ldns_rr_new_frm_str(str, ttl, orig);
-
-	if (new_rr) {
-		lua_pushlightuserdata(L, new_rr);
+	const char *str = luaL_checkstring(L, 1);
+	uint32_t ttl = (uint32_t)luaL_optnumber(L, 2, 0);
+	ldns_rdf *orig = (ldns_rdf*)l_obj_opt(L, 3, L_RDF_T);
+	ldns_rr *new_rr = NULL;
+
+	if (ldns_rr_new_frm_str(&new_rr, str, ttl, orig, NULL)
+			== LDNS_STATUS_OK) {
+		l_obj_push(L, new_rr, L_RR_T, 0);
 		return 1;
 	} else {
 		return 0;
@@ -123,7 +302,7 @@ static int
 l_rr_print(lua_State *L)
 {
 	/* we always print to stdout */
-	ldns_rr *toprint = (ldns_rr*)lua_touserdata(L, 1); /* pop from the stack */
+	ldns_rr *toprint = (ldns_rr*)l_obj_ptr(L, 1, L_RR_T);
 	if (!toprint) {
 		return 0;
 	}
@@ -135,11 +314,7 @@ l_rr_print(lua_State *L)
 static int
 l_rr_free(lua_State *L)
 {
-	ldns_rr *tofree = (ldns_rr*)lua_touserdata(L, 1); /* pop from the stack */
-	if (!tofree) {
-		return 0;
-	}
-	ldns_rr_free(tofree);
+	l_obj_release(L, l_obj_check(L, 1, L_RR_T), l_rr_release);
 	return 0;
 }
 
@@ -148,12 +323,93 @@ l_rr_free(lua_State *L)
  PACKETS
 =========
 */
+
+/* The rrs of a packet are numbered from 0 over all sections in order.
+ * Returns the section list holding rr n and its index in that list.
+ */
+static ldns_rr_list *
+l_pkt_rr_pos(const ldns_pkt *p, size_t n, size_t *i, ldns_pkt_section *s)
+{
+	static const ldns_pkt_section sections[] = {
+		LDNS_SECTION_QUESTION, LDNS_SECTION_ANSWER,
+		LDNS_SECTION_AUTHORITY, LDNS_SECTION_ADDITIONAL
+	};
+	ldns_rr_list *list;
+	size_t k;
+
+	for (k = 0; k < sizeof(sections) / sizeof(sections[0]); k++) {
+		switch (sections[k]) {
+		case LDNS_SECTION_QUESTION:  list = ldns_pkt_question(p);   break;
+		case LDNS_SECTION_ANSWER:    list = ldns_pkt_answer(p);     break;
+		case LDNS_SECTION_AUTHORITY: list = ldns_pkt_authority(p);  break;
+		default:                     list = ldns_pkt_additional(p); break;
+		}
+		if (n < ldns_rr_list_rr_count(list)) {
+			*i = n;
+			*s = sections[k];
+			return list;
+		}
+		n -= ldns_rr_list_rr_count(list);
+	}
+	return NULL;
+}
+
+static ldns_rr *
+pkt_get_rr(const ldns_pkt *p, size_t n)
+{
+	ldns_pkt_section s;
+	ldns_rr_list *list;
+	size_t i;
+
+	if (!(list = l_pkt_rr_pos(p, n, &i, &s))) {
+		return NULL;
+	}
+	return ldns_rr_list_rr(list, i);
+}
+
+/* replaces rr n, returns the rr that was there */
+static ldns_rr *
+pkt_set_rr(ldns_pkt *p, ldns_rr *rr, size_t n)
+{
+	ldns_pkt_section s;
+	ldns_rr_list *list;
+	size_t i;
+
+	if (!(list = l_pkt_rr_pos(p, n, &i, &s))) {
+		return NULL;
+	}
+	return ldns_rr_list_set_rr(list, rr, i);
+}
+
+/* inserts rr before rr n, in the section of rr n */
+static bool
+pkt_insert_rr(ldns_pkt *p, ldns_rr *rr, size_t n)
+{
+	ldns_pkt_section s;
+	ldns_rr_list *list;
+	size_t i, j;
+
+	if (!(list = l_pkt_rr_pos(p, n, &i, &s))) {
+		return false;
+	}
+	if (!ldns_rr_list_push_rr(list, rr)) {
+		return false;
+	}
+	for (j = ldns_rr_list_rr_count(list) - 1; j > i; j--) {
+		(void) ldns_rr_list_set_rr(list,
+				ldns_rr_list_rr(list, j - 1), j);
+	}
+	(void) ldns_rr_list_set_rr(list, rr, i);
+	ldns_pkt_set_section_count(p, s, ldns_pkt_section_count(p, s) + 1);
+	return true;
+}
+
 static int
 l_pkt_new(lua_State *L)
 {
 	ldns_pkt *new_pkt = ldns_pkt_new();
 	if (new_pkt) {
-		lua_pushlightuserdata(L, new_pkt);
+		l_obj_push(L, new_pkt, L_PKT_T, 0);
 		return 1;
 	} else {
 		return 0;
@@ -164,18 +420,19 @@ l_pkt_new(lua_State *L)
 static int
 l_pkt_push_rr(lua_State *L)
 {
-	ldns_pkt *pkt = (ldns_pkt*)lua_touserdata(L, 1); /* get the packet */
+	ldns_pkt *pkt = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T); /* get the packet */
 	ldns_pkt_section s = (ldns_pkt_section)lua_tonumber(L, 2); /* the section where to put it */
-	ldns_rr *rr = (ldns_rr*)lua_touserdata(L, 3); /* the rr to put */
+	ldns_rr *rr;
 
-	if (!pkt) {
+	if (!pkt || !(rr = l_rr_take(L, 3, 1))) {
 		return 0;
 	}
 
 	if (ldns_pkt_push_rr(pkt, s, rr)) {
-		lua_pushlightuserdata(L, pkt);
+		lua_pushvalue(L, 1);
 		return 1;
 	} else {
+		l_rr_untake(L, 3, rr);
 		return 0;
 	}
 }
@@ -183,18 +440,19 @@ l_pkt_push_rr(lua_State *L)
 static int
 l_pkt_insert_rr(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
-	ldns_rr *rr = (ldns_rr*)lua_touserdata(L, 2);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	uint16_t n = (uint16_t)lua_tonumber(L, 3);
+	ldns_rr *rr;
 
-	if (!p) {
+	if (!p || !(rr = l_rr_take(L, 2, 1))) {
 		return 0;
 	}
 
-	if(ldns_pkt_insert_rr(p, rr, n)) {
-		lua_pushlightuserdata(L, p);
+	if(pkt_insert_rr(p, rr, n)) {
+		lua_pushvalue(L, 1);
 		return 1;
 	} else {
+		l_rr_untake(L, 2, rr);
 		return 0;
 	}
 }
@@ -202,7 +460,7 @@ l_pkt_insert_rr(lua_State *L)
 static int
 l_pkt_get_rr(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1); /* pop from the stack */
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	uint16_t n = (uint16_t) lua_tonumber(L, 2);
 	ldns_rr *r;
 
@@ -210,9 +468,10 @@ l_pkt_get_rr(lua_State *L)
 		return 0;
 	}
 
-	r = ldns_pkt_get_rr(p, n);
+	r = pkt_get_rr(p, n);
 	if (r) {
-		lua_pushlightuserdata(L, r);
+		/* the rr stays in the packet */
+		l_obj_push(L, r, L_RR_T, 1);
 		return 1;
 	} else {
 		return 0;
@@ -222,20 +481,22 @@ l_pkt_get_rr(lua_State *L)
 static int
 l_pkt_set_rr(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
-	ldns_rr *rr = (ldns_rr*)lua_touserdata(L, 2);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	uint16_t n = (uint16_t)lua_tonumber(L, 3);
+	ldns_rr *rr;
 	ldns_rr *r;
 
-	if (!p || !rr) {
+	if (!p || !(rr = l_rr_take(L, 2, 1))) {
 		return 0;
 	}
 
-	r = ldns_pkt_set_rr(p, rr, n);
+	r = pkt_set_rr(p, rr, n);
 	if (r) {
-		lua_pushlightuserdata(L, r);
+		/* the replaced rr is no longer in the packet */
+		l_obj_push(L, r, L_RR_T, 0);
 		return 1;
 	} else {
+		l_rr_untake(L, 2, rr);
 		return 0;
 	}
 }
@@ -243,11 +504,11 @@ l_pkt_set_rr(lua_State *L)
 static int
 l_pkt_rr_count(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
-	
+
 	lua_pushnumber(L, ldns_pkt_section_count(p, LDNS_SECTION_ANY));
 	return 1;
 }
@@ -256,7 +517,7 @@ static int
 l_pkt_print(lua_State *L)
 {
 	/* we always print to stdout */
-	ldns_pkt *toprint = (ldns_pkt*)lua_touserdata(L, 1); /* pop from the stack */
+	ldns_pkt *toprint = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!toprint) {
 		return 0;
 	}
@@ -264,41 +525,59 @@ l_pkt_print(lua_State *L)
 	return 0;
 }
 
+static int
+l_pkt_free(lua_State *L)
+{
+	l_obj_release(L, l_obj_check(L, 1, L_PKT_T), l_pkt_release);
+	return 0;
+}
+
 /*
 ===========
  NETWORKING
 ===========
  */
 
+/* Opens an UDP socket bound to ip and port. With SO_REUSEPORT every
+ * worker can bind its own socket to the same address, and the kernel
+ * spreads the incoming queries over them.
+ */
 static int
 l_server_socket_udp(lua_State *L)
 {
-	ldns_rdf *ip = (ldns_rdf*)lua_touserdata(L, 1); /* get the ip */
+	ldns_rdf *ip = (ldns_rdf*)l_obj_ptr(L, 1, L_RDF_T); /* get the ip */
 	uint16_t port = (uint16_t)lua_tonumber(L, 2); /* port number */
-	struct timeval timeout;
 	struct sockaddr_storage *to;
 	size_t socklen;
 	int sockfd;
+	int on = 1;
 
 	if (!ip || port == 0) {
 		return 0;
 	}
 
-	/* use default timeout - maybe this gets to be configurable */
-	timeout.tv_sec = LDNS_DEFAULT_TIMEOUT_SEC;
-	timeout.tv_usec = LDNS_DEFAULT_TIMEOUT_USEC;
-
-	/* socklen isn't really useful here */
 	to = ldns_rdf2native_sockaddr_storage(ip, port, &socklen);
 	if (!to) {
 		return 0;
 	}
 
-	/* get the socket */
-	sockfd = ldns_udp_server_connect(to, timeout);
-	if (sockfd == 0) {
+	sockfd = socket((int)((struct sockaddr*)to)->sa_family, SOCK_DGRAM,
+			IPPROTO_UDP);
+	if (sockfd == -1) {
+		LDNS_FREE(to);
 		return 0;
 	}
+#ifdef SO_REUSEPORT
+	(void) setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#else
+	(void) on;
+#endif
+	if (bind(sockfd, (struct sockaddr*)to, (socklen_t)socklen) == -1) {
+		close(sockfd);
+		LDNS_FREE(to);
+		return 0;
+	}
+	LDNS_FREE(to);
 	lua_pushnumber(L, (lua_Number)sockfd);
 	return 1;
 }
@@ -306,7 +585,7 @@ l_server_socket_udp(lua_State *L)
 static int
 l_client_socket_udp(lua_State *L)
 {
-	ldns_rdf *ip = (ldns_rdf*)lua_touserdata(L, 1); /* get the ip */
+	ldns_rdf *ip = (ldns_rdf*)l_obj_ptr(L, 1, L_RDF_T); /* get the ip */
 	uint16_t port = (uint16_t)lua_tonumber(L, 2); /* port number */
 	struct timeval timeout;
 	struct sockaddr_storage *to;
@@ -329,6 +608,7 @@ l_client_socket_udp(lua_State *L)
 
 	/* get the socket */
 	sockfd = ldns_udp_connect(to, timeout);
+	LDNS_FREE(to);
 	if (sockfd == 0) {
 		return 0;
 	}
@@ -346,14 +626,15 @@ l_server_socket_close_udp(lua_State *L)
 	}
 
 	close(sockfd);
+	return 0;
 }
 
 static int
 l_write_wire_udp(lua_State *L)
 {
 	int sockfd = (int)lua_tonumber(L, 1);
-	ldns_buffer *pktbuf = (ldns_buffer*)lua_touserdata(L, 2);
-	ldns_rdf *rdf_to = (ldns_rdf*)lua_touserdata(L, 3);
+	ldns_buffer *pktbuf = (ldns_buffer*)l_obj_ptr(L, 2, L_BUF_T);
+	ldns_rdf *rdf_to = (ldns_rdf*)l_obj_ptr(L, 3, L_RDF_T);
 	uint16_t port = (uint16_t)lua_tonumber(L, 4); /* port number */
 
 	struct sockaddr_storage *to;
@@ -363,7 +644,7 @@ l_write_wire_udp(lua_State *L)
 	if (!pktbuf || !rdf_to || port == 0) {
 		return 0;
 	}
-	
+
 	/* port number is handled in the socket */
 	to = ldns_rdf2native_sockaddr_storage(rdf_to, port, &socklen);
 	if (!to) {
@@ -371,6 +652,7 @@ l_write_wire_udp(lua_State *L)
 	}
 
 	bytes = ldns_udp_send_query(pktbuf, sockfd, to, (socklen_t)socklen);
+	LDNS_FREE(to);
 	if (bytes == 0) {
 		return 0;
 	} else {
@@ -379,53 +661,297 @@ l_write_wire_udp(lua_State *L)
 	}
 }
 
+/* write a buffer straight back to a sockaddr as returned by udp.read */
+static int
+l_reply_wire_udp(lua_State *L)
+{
+	int sockfd = (int)lua_tonumber(L, 1);
+	ldns_buffer *pktbuf = (ldns_buffer*)l_obj_ptr(L, 2, L_BUF_T);
+	struct l_addr *to = l_addr_check(L, 3);
+	ssize_t bytes;
+
+	if (!pktbuf) {
+		return 0;
+	}
+	bytes = ldns_udp_send_query(pktbuf, sockfd, &to->ss, to->len);
+	if (bytes == 0) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)bytes);
+	return 1;
+}
+
 static int
 l_read_wire_udp(lua_State *L)
 {
 	int sockfd = (int)lua_tonumber(L, 1);
-	size_t size;
-	uint8_t *pktbuf_raw;
+	uint8_t wire[LDNS_MAX_PACKETLEN];
+	ssize_t wire_size;
 	ldns_buffer *pktbuf;
-	struct sockaddr_storage *from;
+	struct sockaddr_storage from;
 	socklen_t from_len;
 
 	if (sockfd == 0) {
 		return 0;
 	}
-		
-	from = LDNS_MALLOC(struct sockaddr_storage);
-	if (!from) {
+
+	(void)memset(&from, 0, sizeof(from));
+	from_len = sizeof(from); /* set to predefined state */
+
+	wire_size = recvfrom(sockfd, (void*)wire, sizeof(wire), 0,
+			(struct sockaddr *)&from, &from_len);
+	if (wire_size <= 0) {
 		return 0;
 	}
-	(void)memset(from, 0, sizeof(struct sockaddr_storage));
-	from_len = sizeof(struct sockaddr_storage); /* set to predefined state */
-
-	pktbuf = ldns_buffer_new(LDNS_MIN_BUFLEN); /* this /should/ happen in buf_new_frm_data */
+	pktbuf = l_buf_new_frm_wire(wire, (size_t)wire_size);
 	if (!pktbuf) {
 		return 0;
 	}
-	
-	pktbuf_raw = ldns_udp_read_wire(sockfd, &size, from, &from_len);
 
-	if (!pktbuf_raw) {
-		return 0;
-	}
-	ldns_buffer_new_frm_data(pktbuf, pktbuf_raw, size);
-	
 	/* push our buffer onto the stack */
 	/* stack func lua cal in same order buf, from */
-	lua_pushlightuserdata(L, pktbuf);
-	lua_pushlightuserdata(L, from);
+	l_obj_push(L, pktbuf, L_BUF_T, 0);
+	(void) l_addr_push(L, &from, from_len);
 	return 2;
 }
 
+/* udp.wait(timeout_ms, fd, ...) returns the readable fds, or nothing on
+ * timeout, so one worker can serve its clients and its upstreams.
+ */
+static int
+l_wait_udp(lua_State *L)
+{
+	int timeout = (int)luaL_checknumber(L, 1);
+	int n = lua_gettop(L) - 1;
+	struct pollfd fds[16];
+	int i, r, ready = 0;
+
+	luaL_argcheck(L, n > 0 && n <= 16, 2, "1 to 16 sockets expected");
+	for (i = 0; i < n; i++) {
+		fds[i].fd = (int)luaL_checknumber(L, i + 2);
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	do {
+		r = poll(fds, (nfds_t)n, timeout);
+	} while (r == -1 && errno == EINTR);
+	if (r <= 0) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+			lua_pushnumber(L, (lua_Number)fds[i].fd);
+			ready++;
+		}
+	}
+	return ready;
+}
+
+/*
+==========
+ UPSTREAM
+==========
+ */
+
+/*
+ * A persistent, connected socket to an upstream nameserver. Queries of
+ * all clients are multiplexed over it: each forwarded query gets a fresh
+ * ID that indexes a slot remembering the original ID and the client, so
+ * the answer can be routed back without any per-query socket.
+ */
+#define L_UPSTREAM_SLOTS	4096
+#define L_UPSTREAM_SLOT_MASK	(L_UPSTREAM_SLOTS - 1)
+
+struct l_upstream_slot
+{
+	uint16_t wire_id;	/* ID used towards the upstream */
+	uint16_t orig_id;	/* ID of the client query */
+	bool used;
+	struct l_addr client;
+};
+
+struct l_upstream
+{
+	int sockfd;
+	uint16_t next;
+	size_t forwarded;
+	size_t answered;
+	size_t unmatched;
+	size_t evicted;
+	struct l_upstream_slot slots[L_UPSTREAM_SLOTS];
+};
+
+static void
+l_upstream_release(void *p)
+{
+	struct l_upstream *up = (struct l_upstream *)p;
+
+	if (up->sockfd != -1) {
+		close(up->sockfd);
+	}
+	LDNS_FREE(up);
+}
+
+static int
+l_upstream_gc(lua_State *L)
+{
+	l_obj_release(L, (struct l_obj *)lua_touserdata(L, 1),
+			l_upstream_release);
+	return 0;
+}
+
+static int
+l_upstream_open(lua_State *L)
+{
+	ldns_rdf *ip = (ldns_rdf*)l_obj_ptr(L, 1, L_RDF_T);
+	uint16_t port = (uint16_t)luaL_optnumber(L, 2, LDNS_PORT);
+	struct sockaddr_storage *to;
+	size_t socklen;
+	struct l_upstream *up;
+
+	if (!ip || port == 0) {
+		return 0;
+	}
+	to = ldns_rdf2native_sockaddr_storage(ip, port, &socklen);
+	if (!to) {
+		return 0;
+	}
+	up = LDNS_CALLOC(struct l_upstream, 1);
+	if (!up) {
+		LDNS_FREE(to);
+		return 0;
+	}
+	up->next = (uint16_t)ldns_get_random();
+	up->sockfd = socket((int)((struct sockaddr*)to)->sa_family,
+			SOCK_DGRAM, IPPROTO_UDP);
+	if (up->sockfd == -1 ||
+	    connect(up->sockfd, (struct sockaddr*)to, (socklen_t)socklen) == -1) {
+		LDNS_FREE(to);
+		l_upstream_release(up);
+		return 0;
+	}
+	LDNS_FREE(to);
+	l_obj_push(L, up, L_UPSTREAM_T, 0);
+	return 1;
+}
+
+/* upstream.forward(up, buf, client) - the ID in buf is rewritten */
+static int
+l_upstream_forward(lua_State *L)
+{
+	struct l_upstream *up = (struct l_upstream *)
+		l_obj_ptr(L, 1, L_UPSTREAM_T);
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 2, L_BUF_T);
+	struct l_addr *client = l_addr_check(L, 3);
+	struct l_upstream_slot *slot;
+	uint16_t wire_id;
+
+	if (!up || !b || ldns_buffer_position(b) < LDNS_HEADER_SIZE) {
+		return 0;
+	}
+	/* the low bits select the slot, the high bits make the ID
+	 * unpredictable for anything but the upstream
+	 */
+	up->next++;
+	wire_id = (uint16_t)((ldns_get_random() & ~L_UPSTREAM_SLOT_MASK)
+			| (up->next & L_UPSTREAM_SLOT_MASK));
+	slot = &up->slots[wire_id & L_UPSTREAM_SLOT_MASK];
+	if (slot->used) {
+		/* no answer came back before the ID space wrapped */
+		up->evicted++;
+	}
+	slot->used = true;
+	slot->wire_id = wire_id;
+	slot->orig_id = LDNS_ID_WIRE(ldns_buffer_begin(b));
+	slot->client = *client;
+	LDNS_ID_SET(ldns_buffer_begin(b), wire_id);
+
+	if (send(up->sockfd, ldns_buffer_begin(b), ldns_buffer_position(b), 0)
+			!= (ssize_t)ldns_buffer_position(b)) {
+		slot->used = false;
+		LDNS_ID_SET(ldns_buffer_begin(b), slot->orig_id);
+		return 0;
+	}
+	up->forwarded++;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/* upstream.receive(up) returns buf, client with the client's ID restored,
+ * or nothing when no (matching) answer is waiting
+ */
+static int
+l_upstream_receive(lua_State *L)
+{
+	struct l_upstream *up = (struct l_upstream *)
+		l_obj_ptr(L, 1, L_UPSTREAM_T);
+	uint8_t wire[LDNS_MAX_PACKETLEN];
+	struct l_upstream_slot *slot;
+	ldns_buffer *b;
+	ssize_t wire_size;
+	uint16_t wire_id;
+
+	if (!up) {
+		return 0;
+	}
+	wire_size = recv(up->sockfd, wire, sizeof(wire), MSG_DONTWAIT);
+	if (wire_size < LDNS_HEADER_SIZE) {
+		return 0;
+	}
+	wire_id = LDNS_ID_WIRE(wire);
+	slot = &up->slots[wire_id & L_UPSTREAM_SLOT_MASK];
+	if (!slot->used || slot->wire_id != wire_id) {
+		up->unmatched++;
+		return 0;
+	}
+	slot->used = false;
+	LDNS_ID_SET(wire, slot->orig_id);
+	if (!(b = l_buf_new_frm_wire(wire, (size_t)wire_size))) {
+		return 0;
+	}
+	up->answered++;
+	l_obj_push(L, b, L_BUF_T, 0);
+	(void) l_addr_push(L, &slot->client.ss, slot->client.len);
+	return 2;
+}
+
+static int
+l_upstream_fd(lua_State *L)
+{
+	struct l_upstream *up = (struct l_upstream *)
+		l_obj_ptr(L, 1, L_UPSTREAM_T);
+
+	if (!up) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)up->sockfd);
+	return 1;
+}
+
+/* returns forwarded, answered, unmatched and evicted counts */
+static int
+l_upstream_stats(lua_State *L)
+{
+	struct l_upstream *up = (struct l_upstream *)
+		l_obj_ptr(L, 1, L_UPSTREAM_T);
+
+	if (!up) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)up->forwarded);
+	lua_pushnumber(L, (lua_Number)up->answered);
+	lua_pushnumber(L, (lua_Number)up->unmatched);
+	lua_pushnumber(L, (lua_Number)up->evicted);
+	return 4;
+}
+
 /* header bits */
 
 /* read section counters */
 static int
 l_pkt_qdcount(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
@@ -436,7 +962,7 @@ l_pkt_qdcount(lua_State *L)
 static int
 l_pkt_ancount(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
@@ -447,7 +973,7 @@ l_pkt_ancount(lua_State *L)
 static int
 l_pkt_nscount(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
@@ -458,7 +984,7 @@ l_pkt_nscount(lua_State *L)
 static int
 l_pkt_arcount(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
@@ -469,7 +995,7 @@ l_pkt_arcount(lua_State *L)
 static int
 l_pkt_set_ancount(lua_State *L)
 {
-	ldns_pkt *p  = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p  = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	uint16_t count = (uint16_t)lua_tonumber(L, 2);
 	if (!p) {
 		return 0;
@@ -481,7 +1007,7 @@ l_pkt_set_ancount(lua_State *L)
 static int
 l_pkt_id(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	if (!p) {
 		return 0;
 	}
@@ -490,9 +1016,9 @@ l_pkt_id(lua_State *L)
 }
 
 static int
-l_pkt_set_id(lua_State *L) 
+l_pkt_set_id(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt*)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt*)l_obj_ptr(L, 1, L_PKT_T);
 	uint16_t id = (uint16_t)lua_tonumber(L, 2);
 	if (!p) {
 		return 0;
@@ -505,28 +1031,275 @@ l_pkt_set_id(lua_State *L)
 static int
 l_buf_free(lua_State *L)
 {
-	ldns_buffer *b = (ldns_buffer *)lua_touserdata(L, 1);
+	l_obj_release(L, l_obj_check(L, 1, L_BUF_T), l_buf_release);
+	return 0;
+}
+
+static int
+l_buf_info(lua_State *L)
+{
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 1, L_BUF_T);
 	if (!b) {
 		return 0;
 	}
-	ldns_buffer_free(b);
+	printf("capacity %d; position %d; limit %d\n",
+			(int)ldns_buffer_capacity(b),
+			(int)ldns_buffer_position(b),
+			(int)ldns_buffer_limit(b));
 	return 0;
 }
 
+/*
+============
+ WIRE
+============
+*/
+
+/*
+ * Accessors that read and patch the header and raw bytes of a packet
+ * buffer in place, so a proxy that only touches IDs, flags, counts or
+ * individual bytes does not pay for a full packet decode and encode.
+ */
+static uint8_t *
+l_wire_check(lua_State *L, int idx, size_t min_size)
+{
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, idx, L_BUF_T);
+
+	if (!b || ldns_buffer_position(b) < min_size) {
+		return NULL;
+	}
+	return ldns_buffer_begin(b);
+}
+
 static int
-l_buf_info(lua_State *L)
+l_wire_size(lua_State *L)
 {
-	ldns_buffer *b = (ldns_buffer *)lua_touserdata(L, 1);
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 1, L_BUF_T);
+
 	if (!b) {
 		return 0;
 	}
-	printf("capacity %d; position %d; limit %d\n",
-			ldns_buffer_capacity(b),
-			ldns_buffer_position(b),
-			ldns_buffer_limit(b));
+	lua_pushnumber(L, (lua_Number)ldns_buffer_position(b));
+	return 1;
+}
+
+static int
+l_wire_id(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)LDNS_ID_WIRE(wire));
+	return 1;
+}
+
+static int
+l_wire_set_id(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+
+	if (wire) {
+		LDNS_ID_SET(wire, (uint16_t)luaL_checknumber(L, 2));
+	}
+	return 0;
+}
+
+static int
+l_wire_flag_mask(lua_State *L, int idx, int *octet)
+{
+	const char *flag = luaL_checkstring(L, idx);
+
+	*octet = 2;
+	if (strcmp(flag, "qr") == 0) return LDNS_QR_MASK;
+	if (strcmp(flag, "aa") == 0) return LDNS_AA_MASK;
+	if (strcmp(flag, "tc") == 0) return LDNS_TC_MASK;
+	if (strcmp(flag, "rd") == 0) return LDNS_RD_MASK;
+	*octet = 3;
+	if (strcmp(flag, "ra") == 0) return LDNS_RA_MASK;
+	if (strcmp(flag, "z")  == 0) return LDNS_Z_MASK;
+	if (strcmp(flag, "ad") == 0) return LDNS_AD_MASK;
+	if (strcmp(flag, "cd") == 0) return LDNS_CD_MASK;
+	luaL_argerror(L, idx, "unknown flag");
+	return 0;
+}
+
+static int
+l_wire_flag(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+	int octet;
+	int mask = l_wire_flag_mask(L, 2, &octet);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushboolean(L, (wire[octet] & mask) != 0);
+	return 1;
+}
+
+static int
+l_wire_set_flag(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+	int octet;
+	int mask = l_wire_flag_mask(L, 2, &octet);
+
+	if (!wire) {
+		return 0;
+	}
+	if (lua_isnone(L, 3) || lua_toboolean(L, 3)) {
+		wire[octet] |= (uint8_t)mask;
+	} else {
+		wire[octet] &= (uint8_t)~mask;
+	}
 	return 0;
 }
 
+static int
+l_wire_rcode(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)LDNS_RCODE_WIRE(wire));
+	return 1;
+}
+
+static int
+l_wire_set_rcode(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+
+	if (wire) {
+		LDNS_RCODE_SET(wire,
+			(uint8_t)luaL_checknumber(L, 2) & LDNS_RCODE_MASK);
+	}
+	return 0;
+}
+
+static int
+l_wire_opcode(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)LDNS_OPCODE_WIRE(wire));
+	return 1;
+}
+
+/* section counters, the section is one of the LDNS_SECTION_ values */
+static size_t
+l_wire_count_off(lua_State *L, int idx)
+{
+	switch ((int)luaL_checknumber(L, idx)) {
+	case LDNS_SECTION_QUESTION:	return LDNS_QDCOUNT_OFF;
+	case LDNS_SECTION_ANSWER:	return LDNS_ANCOUNT_OFF;
+	case LDNS_SECTION_AUTHORITY:	return LDNS_NSCOUNT_OFF;
+	case LDNS_SECTION_ADDITIONAL:	return LDNS_ARCOUNT_OFF;
+	default:
+		luaL_argerror(L, idx, "unknown section");
+		return 0;
+	}
+}
+
+static int
+l_wire_count(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+	size_t off = l_wire_count_off(L, 2);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)ldns_read_uint16(wire + off));
+	return 1;
+}
+
+static int
+l_wire_set_count(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+	size_t off = l_wire_count_off(L, 2);
+
+	if (wire) {
+		ldns_write_uint16(wire + off, (uint16_t)luaL_checknumber(L, 3));
+	}
+	return 0;
+}
+
+/* raw octets, positions count from 0 */
+static int
+l_wire_byte(lua_State *L)
+{
+	size_t pos = (size_t)luaL_checknumber(L, 2);
+	uint8_t *wire = l_wire_check(L, 1, pos + 1);
+
+	if (!wire) {
+		return 0;
+	}
+	lua_pushnumber(L, (lua_Number)wire[pos]);
+	return 1;
+}
+
+static int
+l_wire_set_byte(lua_State *L)
+{
+	size_t pos = (size_t)luaL_checknumber(L, 2);
+	uint8_t *wire = l_wire_check(L, 1, pos + 1);
+
+	if (wire) {
+		wire[pos] = (uint8_t)luaL_checknumber(L, 3);
+	}
+	return 0;
+}
+
+static int
+l_wire_truncate(lua_State *L)
+{
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 1, L_BUF_T);
+	size_t size = (size_t)luaL_checknumber(L, 2);
+
+	if (b && size < ldns_buffer_position(b)) {
+		ldns_buffer_set_position(b, size);
+	}
+	return 0;
+}
+
+/* returns the question name as a string and the question type */
+static int
+l_wire_question(lua_State *L)
+{
+	uint8_t *wire = l_wire_check(L, 1, LDNS_HEADER_SIZE);
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 1, L_BUF_T);
+	size_t pos = LDNS_HEADER_SIZE;
+	ldns_rdf *qname;
+	char *str;
+
+	if (!wire || LDNS_QDCOUNT(wire) == 0 ||
+	    ldns_wire2dname(&qname, wire, ldns_buffer_position(b), &pos)
+	    != LDNS_STATUS_OK) {
+		return 0;
+	}
+	str = ldns_rdf2str(qname);
+	ldns_rdf_deep_free(qname);
+	if (!str) {
+		return 0;
+	}
+	lua_pushstring(L, str);
+	LDNS_FREE(str);
+	if (pos + 2 > ldns_buffer_position(b)) {
+		return 1;
+	}
+	lua_pushnumber(L, (lua_Number)ldns_read_uint16(wire + pos));
+	return 2;
+}
+
 /*
 ============
  CONVERSION
@@ -535,25 +1308,26 @@ l_buf_info(lua_State *L)
 static int
 l_buf2pkt(lua_State *L)
 {
-	ldns_buffer *b = (ldns_buffer *)lua_touserdata(L, 1);
+	ldns_buffer *b = (ldns_buffer *)l_obj_ptr(L, 1, L_BUF_T);
 	ldns_pkt *p;
 
 	if (!b) {
 		return 0;
 	}
 
-	if (ldns_buffer2pkt_wire(&p, b) != LDNS_STATUS_OK) {
+	if (ldns_wire2pkt(&p, ldns_buffer_begin(b), ldns_buffer_position(b))
+			!= LDNS_STATUS_OK) {
 		return 0;
 	}
-	
-	lua_pushlightuserdata(L, p);
+
+	l_obj_push(L, p, L_PKT_T, 0);
 	return 1;
 }
 
 static int
 l_pkt2buf(lua_State *L)
 {
-	ldns_pkt *p = (ldns_pkt *)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt *)l_obj_ptr(L, 1, L_PKT_T);
 	ldns_buffer *b;
 
 	if (!p) {
@@ -561,12 +1335,15 @@ l_pkt2buf(lua_State *L)
 	}
 
 	b = ldns_buffer_new(LDNS_MIN_BUFLEN);
+	if (!b) {
+		return 0;
+	}
 
 	if (ldns_pkt2buffer_wire(b, p) != LDNS_STATUS_OK) {
 		ldns_buffer_free(b);
 		return 0;
 	}
-	lua_pushlightuserdata(L, b);
+	l_obj_push(L, b, L_BUF_T, 0);
 	return 1;
 }
 
@@ -574,47 +1351,38 @@ static int
 l_pkt2string(lua_State *L)
 {
 	ldns_buffer *b;
-	luaL_Buffer lua_b;
-	ldns_pkt *p = (ldns_pkt *)lua_touserdata(L, 1);
+	ldns_pkt *p = (ldns_pkt *)l_obj_ptr(L, 1, L_PKT_T);
 
 	if (!p) {
 		return 0;
 	}
 
 	b = ldns_buffer_new(LDNS_MAX_PACKETLEN);
-	luaL_buffinit(L,&lua_b);
+	if (!b) {
+		return 0;
+	}
 
 	if (ldns_pkt2buffer_wire(b, p) != LDNS_STATUS_OK) {
 		ldns_buffer_free(b);
 		return 0;
 	}
-	/* this is a memcpy??? */
-	luaL_addlstring(&lua_b,
-			(char*)ldns_buffer_begin(b),
-			ldns_buffer_capacity(b)
-		       );
-	/* I hope so */
-	ldns_buffer_free(b); 
-
-	luaL_pushresult(&lua_b);
+	lua_pushlstring(L, (char*)ldns_buffer_begin(b), ldns_buffer_position(b));
+	ldns_buffer_free(b);
 	return 1;
 }
 
 static int
 l_sockaddr_storage2rdf(lua_State *L)
 {
-	struct sockaddr_storage *sock;
+	struct l_addr *sock;
 	uint16_t port;
 	ldns_rdf *addr;
 
-	sock = lua_touserdata(L, 1);
-	if (!sock) {
-		return 0;
-	}
-	
-	addr = ldns_sockaddr_storage2rdf(sock, &port);
+	sock = l_addr_check(L, 1);
+
+	addr = ldns_sockaddr_storage2rdf(&sock->ss, &port);
 	if (addr) {
-		lua_pushlightuserdata(L, addr);
+		l_obj_push(L, addr, L_RDF_T, 0);
 		lua_pushnumber(L, (lua_Number)port);
 		return 2;
 	} else {
@@ -628,7 +1396,7 @@ l_sockaddr_storage2rdf(lua_State *L)
 ============
 */
 
-static int 
+static int
 l_average(lua_State *L)
 {
 	int n = lua_gettop(L);
@@ -652,38 +1420,73 @@ l_average(lua_State *L)
 =====================================================
 */
 
+/* sets global name to a table with the functions of lib */
+static void
+register_lib(lua_State *L, const char *name, const luaL_Reg *lib)
+{
+#if LUA_VERSION_NUM >= 502
+	lua_newtable(L);
+	luaL_setfuncs(L, lib, 0);
+	lua_setglobal(L, name);
+#else
+	luaL_register(L, name, lib);
+	lua_pop(L, 1);
+#endif
+}
+
+static void
+register_metatable(lua_State *L, const char *tname, lua_CFunction gc)
+{
+	luaL_newmetatable(L, tname);
+	if (gc) {
+		lua_pushstring(L, "__gc");
+		lua_pushcfunction(L, gc);
+		lua_settable(L, -3);
+	}
+	lua_pop(L, 1);
+}
+
 void
-register_ldns_functions(void)
+register_ldns_functions(lua_State *L)
 {
+	/* metatables of the GC managed objects */
+	register_metatable(L, L_RDF_T, l_rdf_gc);
+	register_metatable(L, L_RR_T, l_rr_gc);
+	register_metatable(L, L_PKT_T, l_pkt_gc);
+	register_metatable(L, L_BUF_T, l_buf_gc);
+	register_metatable(L, L_ADDR_T, NULL);
+	register_metatable(L, L_UPSTREAM_T, l_upstream_gc);
+
         /* register our functions */
         lua_register(L, "l_average", l_average);
 	/* RDFs */
-	static const struct luaL_reg l_rdf_lib [] = {
+	static const luaL_Reg l_rdf_lib [] = {
 		{"new_frm_str", l_rdf_new_frm_str},
 		{"print", 	l_rdf_print},
 		{"free", 	l_rdf_free},
 		{"sockaddr_to_rdf", l_sockaddr_storage2rdf},
                 {NULL,          NULL}
 	};
-	luaL_openlib(L, "rdf", l_rdf_lib, 0);
+	register_lib(L, "rdf", l_rdf_lib);
 
 	/* RRs */
-	static const struct luaL_reg l_rr_lib [] = {
+	static const luaL_Reg l_rr_lib [] = {
 		{"new_frm_str", l_rr_new_frm_str},
 		{"print", 	l_rr_print},
 		{"free", 	l_rr_free},
                 {NULL,          NULL}
 	};
-	luaL_openlib(L, "record", l_rr_lib, 0);
+	register_lib(L, "record", l_rr_lib);
 
 	/* PKTs */
-	static const struct luaL_reg l_pkt_lib [] = {
+	static const luaL_Reg l_pkt_lib [] = {
                 {"new",         l_pkt_new},
                 {"push_rr",     l_pkt_push_rr},
                 {"get_rr",      l_pkt_get_rr},
                 {"set_rr",      l_pkt_set_rr},
                 {"insert_rr",   l_pkt_insert_rr},
                 {"print",       l_pkt_print},
+                {"free",        l_pkt_free},
                 {"qdcount",     l_pkt_qdcount},
                 {"ancount",     l_pkt_ancount},
                 {"nscount",     l_pkt_nscount},
@@ -701,53 +1504,188 @@ register_ldns_functions(void)
                 {"to_buf",      l_pkt2buf},
                 {NULL,          NULL}
 	};
-	luaL_openlib(L, "packet", l_pkt_lib, 0);
+	register_lib(L, "packet", l_pkt_lib);
 
 	/* BUFFERs */
-	static const struct luaL_reg l_buf_lib [] = {
+	static const luaL_Reg l_buf_lib [] = {
                 {"to_pkt",              l_buf2pkt},
 		{"free", 		l_buf_free},
 		{"info", 		l_buf_info},
                 {NULL,                  NULL}
         };
-	luaL_openlib(L, "buffer", l_buf_lib, 0);
+	register_lib(L, "buffer", l_buf_lib);
+
+	/* WIRE access on packet buffers */
+	static const luaL_Reg l_wire_lib [] = {
+		{"size",	l_wire_size},
+		{"id",		l_wire_id},
+		{"set_id",	l_wire_set_id},
+		{"flag",	l_wire_flag},
+		{"set_flag",	l_wire_set_flag},
+		{"rcode",	l_wire_rcode},
+		{"set_rcode",	l_wire_set_rcode},
+		{"opcode",	l_wire_opcode},
+		{"count",	l_wire_count},
+		{"set_count",	l_wire_set_count},
+		{"byte",	l_wire_byte},
+		{"set_byte",	l_wire_set_byte},
+		{"truncate",	l_wire_truncate},
+		{"question",	l_wire_question},
+		{NULL,		NULL}
+	};
+	register_lib(L, "wire", l_wire_lib);
 
 	/* NETWORKING */
-	static const struct luaL_reg l_udpnet_lib [] = {
+	static const luaL_Reg l_udpnet_lib [] = {
 		{"write", 	l_write_wire_udp},
-		{"read", 	l_read_wire_udp}, 
+		{"reply", 	l_reply_wire_udp},
+		{"read", 	l_read_wire_udp},
+		{"wait", 	l_wait_udp},
 		{"server_open", 	l_server_socket_udp},
 		{"open", 	l_client_socket_udp},
 		{"close", 	l_server_socket_close_udp},
                 {NULL,          NULL}
 	};
-	luaL_openlib(L, "udp", l_udpnet_lib, 0);
+	register_lib(L, "udp", l_udpnet_lib);
+
+	static const luaL_Reg l_upstream_lib [] = {
+		{"open",	l_upstream_open},
+		{"forward",	l_upstream_forward},
+		{"receive",	l_upstream_receive},
+		{"fd",		l_upstream_fd},
+		{"stats",	l_upstream_stats},
+		{NULL,		NULL}
+	};
+	register_lib(L, "upstream", l_upstream_lib);
+}
+
+/*
+=====================================================
+ Workers
+=====================================================
+*/
+
+struct worker
+{
+	pthread_t tid;
+	int id;
+	int count;
+	const char *script;
+};
+
+static lua_State *
+worker_state_new(int id, int count)
+{
+	lua_State *W = luaL_newstate();
+
+	if (!W) {
+		return NULL;
+	}
+	luaL_openlibs(W);
+
+	register_ldns_functions(W);
+
+	/* let the script know who it is */
+	lua_pushnumber(W, (lua_Number)id);
+	lua_setglobal(W, "WORKER_ID");
+	lua_pushnumber(W, (lua_Number)count);
+	lua_setglobal(W, "WORKER_COUNT");
+	return W;
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = (struct worker *)arg;
+	lua_State *W = worker_state_new(w->id, w->count);
+
+	if (!W) {
+		fprintf(stderr, "worker %d: cannot create Lua state\n", w->id);
+		return NULL;
+	}
+	if (luaL_dofile(W, w->script) != 0) {
+		fprintf(stderr, "worker %d: %s failed: %s\n", w->id, w->script,
+				lua_tostring(W, -1));
+	}
+	lua_close(W);
+	return NULL;
 }
 
 int
 main(int argc, char *argv[])
 {
-	if (argc != 2) {
-		usage(stderr, argv[0]);
-		exit(EXIT_FAILURE);
+	struct worker *workers;
+	char *progname = argv[0];
+	int nworkers = 1;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "w:")) != -1) {
+		switch (c) {
+		case 'w':
+			nworkers = atoi(optarg);
+			if (nworkers == 0) {
+				nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+			}
+			if (nworkers <= 0) {
+				nworkers = 1;
+			}
+			break;
+		default:
+			usage(stderr, progname);
+			exit(EXIT_FAILURE);
+		}
 	}
+	argc -= optind;
+	argv += optind;
 
-	if (access(argv[1], R_OK)) {
-		fprintf(stderr, "File %s is unavailable.\n", argv[1]);
+	if (argc != 1) {
+		usage(stderr, progname);
 		exit(EXIT_FAILURE);
 	}
-	
-        L = lua_open();
-        lua_baselibopen(L);
-	luaopen_math(L);
-	luaopen_io(L);
-	luaopen_string(L);
 
-	register_ldns_functions();
+	if (access(argv[0], R_OK)) {
+		fprintf(stderr, "File %s is unavailable.\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
 
-        /* run the script */
-        lua_dofile(L, argv[1]);
+	if (nworkers == 1) {
+		L = worker_state_new(0, 1);
+		if (!L) {
+			exit(EXIT_FAILURE);
+		}
+		/* run the script */
+		if (luaL_dofile(L, argv[0]) != 0) {
+			fprintf(stderr, "%s failed: %s\n", argv[0],
+					lua_tostring(L, -1));
+			lua_close(L);
+			exit(EXIT_FAILURE);
+		}
+		lua_close(L);
+		exit(EXIT_SUCCESS);
+	}
 
-        lua_close(L);
-        exit(EXIT_SUCCESS);
+	/* one independent Lua state per worker thread; a script that
+	 * opens its server socket with udp.server_open gets its own
+	 * SO_REUSEPORT socket in every worker
+	 */
+	workers = LDNS_XMALLOC(struct worker, nworkers);
+	if (!workers) {
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nworkers; i++) {
+		workers[i].id = i;
+		workers[i].count = nworkers;
+		workers[i].script = argv[0];
+		if (pthread_create(&workers[i].tid, NULL, worker_run,
+					&workers[i]) != 0) {
+			fprintf(stderr, "cannot start worker %d\n", i);
+			nworkers = i;
+			break;
+		}
+	}
+	for (i = 0; i < nworkers; i++) {
+		(void) pthread_join(workers[i].tid, NULL);
+	}
+	LDNS_FREE(workers);
+	exit(EXIT_SUCCESS);
 }
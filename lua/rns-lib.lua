@@ -37,8 +37,10 @@ LDNS_RDF_TYPE_NSAP		= 26
 LDNS_RDF_TYPE_ATMA		= 27
 LDNS_RDF_TYPE_IPSECKEY		= 28
 
+EXIT_FAILURE			= 1
+
 function lua_debug(...)
-	print("[lua]", unpack(arg))
+	print("[lua]", ...)
 end
 
 -- transpose 2 rrs in a pkt --
@@ -100,20 +102,29 @@ end
 
 -- write a buffer to a socket
 function lua_udp_write(socket, buffer_wire, sock_from)
-	-- convert the sockaddr_storage to something we
-	-- can work with
-	
 	-- checks
 	if socket == 0 then return -1 end
 	if buffer_wire == nil then return -1 end
 	if sock_from == nil then return -1 end
-	
-	rdf_listen, port_listen = rdf.sockaddr_to_rdf(sock_from)
 
-	bytes = udp.write(socket, buffer_wire, rdf_listen, port_listen) 
+	bytes = udp.reply(socket, buffer_wire, sock_from)
 	return bytes
 end
 
+-- flip a random bit of a random byte after the header, in place
+function lua_wire_flip_byte(wirebuf)
+	local size = wire.size(wirebuf)
+	if size <= 12 then return end
+	local pos = math.random(12, size - 1)
+	local b = wire.byte(wirebuf, pos)
+	local bit = 2 ^ math.random(0, 7)
+	if math.floor(b / bit) % 2 == 1 then
+		wire.set_byte(wirebuf, pos, b - bit)
+	else
+		wire.set_byte(wirebuf, pos, b + bit)
+	end
+end
+
 
 -- initialize the pseudo random number generator
 -- frm: http://lua-users.org/wiki/MathLibraryTutorial
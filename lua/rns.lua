@@ -1,14 +1,19 @@
 -- source the lib file with the function
 dofile("rns-lib.lua")
 
--- echo whatever is received
-
--- this function disfigures the packet
-function lua_packet_mangle(orig_packet)
+-- forward everything to our nameserver and mangle the answers
+--
+-- Run it with lua-rns -w 0 rns.lua to get a worker per CPU. Every worker
+-- opens its own SO_REUSEPORT socket on the listen address and keeps one
+-- persistent upstream socket, so nothing is shared between them.
+
+-- this function disfigures the answer, in place on the wire
+function lua_packet_mangle(wirebuf)
 	-- MANGLE IT
-	local rr1 = record.new_frm_str("www.miek.nl IN A 127.0.0.1")
-	packet.push_rr(orig_packet, LDNS_SECTION_ANSWER, rr1)
-	return(packet.to_buf(orig_packet))
+	if math.random(0, 9) == 0 then
+		lua_wire_flip_byte(wirebuf)
+	end
+	return(wirebuf)
 end
 
 rdf_ip = rdf.new_frm_str(LDNS_RDF_TYPE_A, "127.0.0.1")
@@ -18,51 +23,35 @@ if socket == nil then
 end
 
 rdf_ip_nameserver = rdf.new_frm_str(LDNS_RDF_TYPE_A, "213.154.224.39")
+nameserver = upstream.open(rdf_ip_nameserver, 53)
+if nameserver == nil then
+	os.exit(EXIT_FAILURE)
+end
+nameserver_fd = upstream.fd(nameserver)
 
 while true do
-	-- read from the socket, this blocks...
-	wirebuf, sockaddr_from  = udp.read(socket)
-
-	-- wrap this in new functions
-	if wirebuf == nil then
-		lua_debug("nothing received")
-	else
-		-- somebody is writing
-		wirepkt = buffer.to_pkt(wirebuf)
-		packet.print(wirepkt)
-
-		wirebuf2 = packet.to_buf(wirepkt)
-
-		-- send it to /our/ nameserver
-		socket_nameserver = udp.open(rdf_ip_nameserver, 53)
-		if socket_nameserver == nil then
-			os.exit(EXIT_FAILURE)
+	-- wait for a client query or a nameserver answer
+	fd1, fd2 = udp.wait(1000, socket, nameserver_fd)
+
+	if fd1 == socket or fd2 == socket then
+		-- somebody is writing, send it to /our/ nameserver
+		wirebuf, sockaddr_from = udp.read(socket)
+		if wirebuf ~= nil then
+			if upstream.forward(nameserver, wirebuf, sockaddr_from) == nil then
+				lua_debug("ns write error")
+			end
 		end
+	end
 
-		nameserver_bytes = udp.write(socket_nameserver, wirebuf2, rdf_ip_nameserver, 53)
-		if nameserver_bytes == nil then
-			lua_debug("ns write error")
-		end
-
-		nameserver_buf, sockaddr_from_nameserver  = udp.read(socket_nameserver)
-		udp.close(socket_nameserver)
-
-		nameserver_pkt = buffer.to_pkt(nameserver_buf)
-		packet.print(nameserver_pkt)
-		
-		-- make a new buf and write that back to the client
-		nsbuf2 = lua_packet_mangle(nameserver_pkt)
-		bytes = lua_udp_write(socket, nsbuf2, sockaddr_from) --this works
-
-		if bytes == nil then
-			lua_debug("write error")
+	if fd1 == nameserver_fd or fd2 == nameserver_fd then
+		-- the answer has the id of the client query again
+		nameserver_buf, sockaddr_client = upstream.receive(nameserver)
+		if nameserver_buf ~= nil then
+			nsbuf2 = lua_packet_mangle(nameserver_buf)
+			if udp.reply(socket, nsbuf2, sockaddr_client) == nil then
+				lua_debug("write error")
+			end
 		end
-
-		buffer.free(nsbuf2)
-		buffer.free(nameserver_buf)
-		buffer.free(wirebuf2)
-		buffer.free(wirebuf)
-		
 	end
 end
 udp.close(socket)
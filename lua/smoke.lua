@@ -0,0 +1,48 @@
+-- runs the ldns bindings without the network, for make test
+LDNS_SECTION_QUESTION	= 0
+LDNS_SECTION_ANSWER	= 1
+LDNS_RDF_TYPE_DNAME	= 1
+
+origin = rdf.new_frm_str(LDNS_RDF_TYPE_DNAME, "example.org.")
+assert(origin ~= nil, "rdf.new_frm_str")
+
+q = record.new_frm_str("www.example.org. IN A 192.0.2.1")
+a1 = record.new_frm_str("www.example.org. 300 IN A 192.0.2.1")
+a2 = record.new_frm_str("www 300 IN A 192.0.2.2", 0, origin)
+assert(q and a1 and a2, "record.new_frm_str")
+
+pkt = packet.new()
+assert(packet.push_rr(pkt, LDNS_SECTION_QUESTION, q), "push question")
+assert(packet.push_rr(pkt, LDNS_SECTION_ANSWER, a1), "push answer")
+assert(packet.insert_rr(pkt, a2, 1), "insert answer")
+assert(packet.rrcount(pkt) == 3, "rrcount")
+assert(packet.ancount(pkt) == 2, "ancount")
+packet.set_id(pkt, 1505)
+assert(packet.id(pkt) == 1505, "id")
+
+buf = packet.to_buf(pkt)
+assert(buf ~= nil, "packet.to_buf")
+assert(wire.id(buf) == 1505, "wire.id")
+assert(wire.count(buf, LDNS_SECTION_ANSWER) == 2, "wire.count")
+name, qtype = wire.question(buf)
+assert(name == "www.example.org." and qtype == 1, "wire.question")
+
+wire.set_flag(buf, "qr")
+wire.set_id(buf, 4242)
+wire.set_rcode(buf, 3)
+assert(wire.flag(buf, "qr") and not wire.flag(buf, "tc"), "wire.flag")
+
+back = buffer.to_pkt(buf)
+assert(back ~= nil, "buffer.to_pkt")
+assert(packet.id(back) == 4242, "id after round trip")
+assert(packet.ancount(back) == 2, "answers after round trip")
+
+-- the rrs stay valid after the packet is collected
+rr = packet.get_rr(back, 2)
+back = nil
+collectgarbage()
+assert(rr ~= nil, "get_rr")
+record.free(rr)
+packet.free(pkt)
+
+print("lua smoke test ok")
@@ -33,6 +33,9 @@
 #ifdef HAVE_POLL
 #include <poll.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 ldns_status
 ldns_send(ldns_pkt **result_packet, ldns_resolver *r, const ldns_pkt *query_pkt)
@@ -188,6 +191,24 @@ ldns_sock_wait(int sockfd, struct timeval timeout, int write)
 }
 
 
+/** receive what is there, and wait for the socket only when nothing is */
+static ssize_t
+ldns_sock_recv(int sockfd, uint8_t *buf, size_t len, struct timeval timeout)
+{
+	ssize_t rc;
+
+#ifdef MSG_DONTWAIT
+	rc = recv(sockfd, (void*)buf, len, MSG_DONTWAIT);
+	if (rc != -1 || (errno != EAGAIN && errno != EWOULDBLOCK
+				&& errno != EINTR))
+		return rc;
+#endif
+	if(!ldns_sock_wait(sockfd, timeout, 0))
+		return -1;
+	return recv(sockfd, (void*)buf, len, 0);
+}
+
+
 static int
 ldns_tcp_connect_from(const struct sockaddr_storage *to, socklen_t tolen, 
 	       	const struct sockaddr_storage *from, socklen_t fromlen,
@@ -677,10 +698,372 @@ ldns_send_buffer(ldns_pkt **result, ldns_resolver *r, ldns_buffer *qb, ldns_rdf
 	return status;
 }
 
+/** a query of ldns_send_pkts() */
+struct ldns_send_slot
+{
+	ldns_buffer *qb;
+	ldns_rdf *tsig_mac;
+	int sockfd;
+	size_t attempt;
+	size_t server;
+	struct timeval sent;
+	bool done;
+};
+
+static long
+ldns_tv_msec_diff(const struct timeval *a, const struct timeval *b)
+{
+	return (long)(a->tv_sec - b->tv_sec) * 1000
+		+ (long)(a->tv_usec - b->tv_usec) / 1000;
+}
+
+/* done when every query has finished, or when the first positive answer
+ * in query order is known */
+static bool
+ldns_send_pkts_decided(ldns_pkt **answers, const ldns_status *statuses,
+		const struct ldns_send_slot *slots, size_t count,
+		bool first_positive)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (!slots[i].done) {
+			return false;
+		}
+		if (first_positive && statuses[i] == LDNS_STATUS_OK &&
+		    answers[i] && ldns_pkt_get_rcode(answers[i])
+		    == LDNS_RCODE_NOERROR) {
+			return true;
+		}
+	}
+	return true;
+}
+
+/* handle a datagram on the socket of slot; ignored when not the answer */
+static void
+ldns_send_slot_answer(ldns_pkt **answer, ldns_status *status,
+		ldns_resolver *r, struct ldns_send_slot *slot,
+		ldns_rdf *server, uint8_t *wire, size_t size)
+{
+	struct timeval now;
+	ldns_pkt *reply = NULL;
+
+	if (size < LDNS_HEADER_SIZE || ldns_read_uint16(wire)
+			!= ldns_read_uint16(ldns_buffer_begin(slot->qb))) {
+		LDNS_FREE(wire);
+		return;
+	}
+	*status = ldns_wire2pkt(&reply, wire, size);
+#ifdef HAVE_SSL
+	if (*status == LDNS_STATUS_OK && slot->tsig_mac &&
+	    !ldns_pkt_tsig_verify(reply, wire, size,
+			    ldns_resolver_tsig_keyname(r),
+			    ldns_resolver_tsig_keydata(r), slot->tsig_mac)) {
+		*status = LDNS_STATUS_CRYPTO_TSIG_BOGUS;
+	}
+#else
+	(void)r;
+#endif /* HAVE_SSL */
+	LDNS_FREE(wire);
+	if (reply) {
+		gettimeofday(&now, NULL);
+		ldns_pkt_set_querytime(reply,
+				(uint32_t)ldns_tv_msec_diff(&now, &slot->sent));
+		ldns_pkt_set_answerfrom(reply, ldns_rdf_clone(server));
+		ldns_pkt_set_timestamp(reply, slot->sent);
+		ldns_pkt_set_size(reply, size);
+	}
+	*answer = reply;
+	close_socket(slot->sockfd);
+	slot->done = true;
+}
+
+ldns_status
+ldns_send_pkts(ldns_pkt **answers, ldns_status *statuses, ldns_resolver *r,
+		ldns_pkt * const *queries, size_t count, bool first_positive)
+{
+	struct ldns_send_slot *slots;
+	struct sockaddr_storage **ns;
+	socklen_t *ns_len;
+	size_t *ns_index;
+	bool *ns_answered;
+	size_t ns_count = 0;
+	struct sockaddr_storage *src = NULL;
+	size_t src_len = 0;
+	ldns_rdf **ns_array;
+	size_t *rtt;
+	size_t tries, attempts, i, len;
+	struct timeval timeout, now;
+	long wait, left;
+	uint8_t *wire;
+	size_t size;
+#ifdef HAVE_POLL
+	struct pollfd *pfds;
+	nfds_t npfds;
+#else
+	fd_set fds;
+	int maxfd;
+	struct timeval tv;
+#endif
+	ldns_status status = LDNS_STATUS_OK;
+
+	assert(r != NULL);
+
+	for (i = 0; i < count; i++) {
+		answers[i] = NULL;
+		statuses[i] = LDNS_STATUS_NETWORK_ERR;
+	}
+	if (count == 0) {
+		return LDNS_STATUS_OK;
+	}
+	/* over tcp the queries are sent one after the other */
+	if (ldns_resolver_usevc(r)) {
+		for (i = 0; i < count; i++) {
+			statuses[i] = ldns_send(&answers[i], r, queries[i]);
+			if (first_positive && statuses[i] == LDNS_STATUS_OK &&
+			    answers[i] && ldns_pkt_get_rcode(answers[i])
+			    == LDNS_RCODE_NOERROR) {
+				break;
+			}
+		}
+		return LDNS_STATUS_OK;
+	}
+
+	if (ldns_resolver_random(r)) {
+		ldns_resolver_nameservers_randomize(r);
+	}
+	ns_array = ldns_resolver_nameservers(r);
+	rtt = ldns_resolver_rtt(r);
+	ns = LDNS_XMALLOC(struct sockaddr_storage *,
+			ldns_resolver_nameserver_count(r) + 1);
+	ns_len = LDNS_XMALLOC(socklen_t, ldns_resolver_nameserver_count(r) + 1);
+	ns_index = LDNS_XMALLOC(size_t, ldns_resolver_nameserver_count(r) + 1);
+	ns_answered = LDNS_CALLOC(bool, ldns_resolver_nameserver_count(r) + 1);
+	slots = LDNS_CALLOC(struct ldns_send_slot, count);
+#ifdef HAVE_POLL
+	pfds = LDNS_XMALLOC(struct pollfd, count);
+	if (!pfds) {
+		status = LDNS_STATUS_MEM_ERR;
+	}
+#endif
+	if (!ns || !ns_len || !ns_index || !ns_answered || !slots) {
+		status = LDNS_STATUS_MEM_ERR;
+	}
+	for (i = 0; slots && i < count; i++) {
+		slots[i].sockfd = -1;
+	}
+	for (i = 0; status == LDNS_STATUS_OK &&
+			i < ldns_resolver_nameserver_count(r); i++) {
+		if (rtt[i] == LDNS_RESOLV_RTT_INF) {
+			continue;
+		}
+		ns[ns_count] = ldns_rdf2native_sockaddr_storage(ns_array[i],
+				ldns_resolver_port(r), &len);
+		if (!ns[ns_count]) {
+			continue;
+		}
+#ifndef S_SPLINT_S
+		if ((ns[ns_count]->ss_family == AF_INET &&
+		     ldns_resolver_ip6(r) == LDNS_RESOLV_INET6) ||
+		    (ns[ns_count]->ss_family == AF_INET6 &&
+		     ldns_resolver_ip6(r) == LDNS_RESOLV_INET)) {
+			LDNS_FREE(ns[ns_count]);
+			continue;
+		}
+#endif
+		ns_len[ns_count] = (socklen_t)len;
+		ns_index[ns_count++] = i;
+		/* obey the fail directive: only the first one */
+		if (ldns_resolver_fail(r)) {
+			break;
+		}
+	}
+	if (status == LDNS_STATUS_OK && ns_count == 0) {
+		status = LDNS_STATUS_RES_NO_NS;
+	}
+	if(status == LDNS_STATUS_OK && ldns_resolver_source(r)) {
+		src = ldns_rdf2native_sockaddr_storage_port(
+				ldns_resolver_source(r), 0, &src_len);
+	}
+	for (i = 0; status == LDNS_STATUS_OK && i < count; i++) {
+		slots[i].qb = ldns_buffer_new(LDNS_MIN_BUFLEN);
+		if (!slots[i].qb) {
+			status = LDNS_STATUS_MEM_ERR;
+		} else if (ldns_pkt2buffer_wire(slots[i].qb, queries[i])
+				!= LDNS_STATUS_OK) {
+			slots[i].done = true;
+			statuses[i] = LDNS_STATUS_ERR;
+		}
+		if (ldns_pkt_tsig(queries[i])) {
+			slots[i].tsig_mac = ldns_rr_rdf(
+					ldns_pkt_tsig(queries[i]), 3);
+		}
+	}
+
+	/* every server is tried retry times, each for timeout */
+	tries = ldns_resolver_retry(r) > 0 ? ldns_resolver_retry(r) : 1;
+	attempts = ns_count * tries;
+	timeout = ldns_resolver_timeout(r);
+	while (status == LDNS_STATUS_OK) {
+		gettimeofday(&now, NULL);
+		for (i = 0; i < count; i++) {
+			while (!slots[i].done && slots[i].sockfd == -1) {
+				/* a server that answered none of its tries
+				 * is not reachable, like in ldns_send() */
+				if (slots[i].attempt > 0 &&
+				    slots[i].attempt % tries == 0 &&
+				    !ns_answered[slots[i].server]) {
+					ldns_resolver_set_nameserver_rtt(r,
+						ns_index[slots[i].server],
+						LDNS_RESOLV_RTT_INF);
+				}
+				if (slots[i].attempt == attempts) {
+					slots[i].done = true;
+					break;
+				}
+				slots[i].server = slots[i].attempt++ / tries;
+				slots[i].sockfd = ldns_udp_bgsend_from(
+						slots[i].qb,
+						ns[slots[i].server],
+						ns_len[slots[i].server],
+						src, (socklen_t)src_len,
+						timeout);
+				if (slots[i].sockfd != -1) {
+					ldns_sock_nonblock(slots[i].sockfd);
+					slots[i].sent = now;
+				}
+			}
+		}
+		if (ldns_send_pkts_decided(answers, statuses, slots, count,
+					first_positive)) {
+			break;
+		}
+
+		/* wait for an answer, or until the first one times out */
+		wait = (long)timeout.tv_sec * 1000 + timeout.tv_usec / 1000;
+#ifdef HAVE_POLL
+		npfds = 0;
+#else
+		FD_ZERO(&fds);
+		maxfd = -1;
+#endif
+		for (i = 0; i < count; i++) {
+			if (slots[i].done) {
+				continue;
+			}
+			left = (long)timeout.tv_sec * 1000
+				+ timeout.tv_usec / 1000
+				- ldns_tv_msec_diff(&now, &slots[i].sent);
+			if (left < wait) {
+				wait = left > 0 ? left : 0;
+			}
+#ifdef HAVE_POLL
+			pfds[npfds].fd = slots[i].sockfd;
+			pfds[npfds].events = POLLIN;
+			pfds[npfds].revents = 0;
+			npfds++;
+#else
+			FD_SET(FD_SET_T slots[i].sockfd, &fds);
+			if (slots[i].sockfd > maxfd) {
+				maxfd = slots[i].sockfd;
+			}
+#endif
+		}
+#ifdef HAVE_POLL
+		(void) poll(pfds, npfds, (int)wait);
+#else
+		tv.tv_sec = wait / 1000;
+		tv.tv_usec = (wait % 1000) * 1000;
+		(void) select(maxfd + 1, &fds, NULL, NULL, &tv);
+#endif
+
+		/* the sockets are non-blocking, so just read what is there */
+		gettimeofday(&now, NULL);
+		for (i = 0; i < count; i++) {
+			while (!slots[i].done && (wire = ldns_udp_read_wire(
+					slots[i].sockfd, &size, NULL, NULL))) {
+				ldns_send_slot_answer(&answers[i],
+						&statuses[i], r, &slots[i],
+						ns_array[ns_index[
+							slots[i].server]],
+						wire, size);
+				if (slots[i].done) {
+					ns_answered[slots[i].server] = true;
+				}
+			}
+			if (!slots[i].done && ldns_tv_msec_diff(&now,
+					&slots[i].sent) >= (long)timeout.tv_sec
+					* 1000 + timeout.tv_usec / 1000) {
+				close_socket(slots[i].sockfd);
+			}
+		}
+	}
+
+	/* what is still in flight is not needed anymore */
+	for (i = 0; slots && i < count; i++) {
+		if (slots[i].sockfd != -1) {
+			close_socket(slots[i].sockfd);
+		}
+		ldns_buffer_free(slots[i].qb);
+	}
+	for (i = 0; i < ns_count; i++) {
+		LDNS_FREE(ns[i]);
+	}
+	LDNS_FREE(ns);
+	LDNS_FREE(ns_len);
+	LDNS_FREE(ns_index);
+	LDNS_FREE(ns_answered);
+	LDNS_FREE(slots);
+#ifdef HAVE_POLL
+	LDNS_FREE(pfds);
+#endif
+	if (src) {
+		LDNS_FREE(src);
+	}
+
+	return status;
+}
+
 ssize_t
 ldns_tcp_send_query(ldns_buffer *qbin, int sockfd, 
                     const struct sockaddr_storage *to, socklen_t tolen)
 {
+#ifdef HAVE_WRITEV
+	uint8_t lenbuf[2];
+	struct iovec iov[2], *v = iov;
+	int n = 2;
+	ssize_t bytes;
+
+	/* the socket is connected already */
+	(void)to;
+	(void)tolen;
+
+	/* put the length in front of the packet without copying it */
+	ldns_write_uint16(lenbuf, ldns_buffer_position(qbin));
+	iov[0].iov_base = (void*)lenbuf;
+	iov[0].iov_len = 2;
+	iov[1].iov_base = (void*)ldns_buffer_begin(qbin);
+	iov[1].iov_len = ldns_buffer_position(qbin);
+
+	while (n > 0) {
+		bytes = writev(sockfd, v, n);
+		if (bytes == -1 && errno == EINTR)
+			continue;
+		if (bytes <= 0)
+			return 0;
+		/* continue after the part that was written */
+		while (n > 0 && (size_t) bytes >= v->iov_len) {
+			bytes -= (ssize_t) v->iov_len;
+			v++;
+			n--;
+		}
+		if (n > 0) {
+			v->iov_base = (uint8_t*)v->iov_base + bytes;
+			v->iov_len -= (size_t) bytes;
+		}
+	}
+	return (ssize_t) ldns_buffer_position(qbin) + 2;
+#else
 	uint8_t *sendbuf;
 	ssize_t bytes;
 
@@ -699,6 +1082,7 @@ ldns_tcp_send_query(ldns_buffer *qbin, int sockfd,
 		return 0;
 	}
 	return bytes;
+#endif /* HAVE_WRITEV */
 }
 
 /* don't wait for an answer */
@@ -750,37 +1134,26 @@ ldns_udp_read_wire(int sockfd, size_t *size, struct sockaddr_storage *from,
 uint8_t *
 ldns_tcp_read_wire_timeout(int sockfd, size_t *size, struct timeval timeout)
 {
+	uint8_t lenbuf[2];
 	uint8_t *wire;
 	uint16_t wire_size;
 	ssize_t bytes = 0, rc = 0;
 
 	if(sockfd < 0)
 		return NULL;
-	wire = LDNS_XMALLOC(uint8_t, 2);
-	if (!wire) {
-		*size = 0;
-		return NULL;
-	}
 	
 	while (bytes < 2) {
-		if(!ldns_sock_wait(sockfd, timeout, 0)) {
-			*size = 0;
-			LDNS_FREE(wire);
-			return NULL;
-		}
-		rc = recv(sockfd, (void*) (wire + bytes), 
-				(size_t) (2 - bytes), 0);
+		rc = ldns_sock_recv(sockfd, lenbuf + bytes,
+				(size_t) (2 - bytes), timeout);
 		if (rc == -1 || rc == 0) {
 			*size = 0;
-			LDNS_FREE(wire);
 			return NULL;
 		}
                 bytes += rc;
 	}
 
-	wire_size = ldns_read_uint16(wire);
+	wire_size = ldns_read_uint16(lenbuf);
 	
-	LDNS_FREE(wire);
 	wire = LDNS_XMALLOC(uint8_t, wire_size);
 	if (!wire) {
 		*size = 0;
@@ -789,13 +1162,8 @@ ldns_tcp_read_wire_timeout(int sockfd, size_t *size, struct timeval timeout)
 	bytes = 0;
 
 	while (bytes < (ssize_t) wire_size) {
-		if(!ldns_sock_wait(sockfd, timeout, 0)) {
-			*size = 0;
-			LDNS_FREE(wire);
-			return NULL;
-		}
-		rc = recv(sockfd, (void*) (wire + bytes), 
-				(size_t) (wire_size - bytes), 0);
+		rc = ldns_sock_recv(sockfd, wire + bytes,
+				(size_t) (wire_size - bytes), timeout);
 		if (rc == -1 || rc == 0) {
 			LDNS_FREE(wire);
 			*size = 0;
@@ -811,30 +1179,23 @@ ldns_tcp_read_wire_timeout(int sockfd, size_t *size, struct timeval timeout)
 uint8_t *
 ldns_tcp_read_wire(int sockfd, size_t *size)
 {
+	uint8_t lenbuf[2];
 	uint8_t *wire;
 	uint16_t wire_size;
 	ssize_t bytes = 0, rc = 0;
 
-	wire = LDNS_XMALLOC(uint8_t, 2);
-	if (!wire) {
-		*size = 0;
-		return NULL;
-	}
-	
 	while (bytes < 2) {
-		rc = recv(sockfd, (void*) (wire + bytes), 
+		rc = recv(sockfd, (void*) (lenbuf + bytes), 
 				(size_t) (2 - bytes), 0);
 		if (rc == -1 || rc == 0) {
 			*size = 0;
-			LDNS_FREE(wire);
 			return NULL;
 		}
                 bytes += rc;
 	}
 
-	wire_size = ldns_read_uint16(wire);
+	wire_size = ldns_read_uint16(lenbuf);
 	
-	LDNS_FREE(wire);
 	wire = LDNS_XMALLOC(uint8_t, wire_size);
 	if (!wire) {
 		*size = 0;
@@ -857,6 +1218,90 @@ ldns_tcp_read_wire(int sockfd, size_t *size)
 	return wire;
 }
 
+/* room for the largest message with its length, and as much again to
+ * read ahead into */
+#define LDNS_TCP_READER_SIZE (2 * (LDNS_MAX_PACKETLEN + 2))
+
+ldns_tcp_reader *
+ldns_tcp_reader_new(int sockfd)
+{
+	ldns_tcp_reader *reader;
+
+	reader = LDNS_MALLOC(ldns_tcp_reader);
+	if (!reader) {
+		return NULL;
+	}
+	reader->_data = LDNS_XMALLOC(uint8_t, LDNS_TCP_READER_SIZE);
+	if (!reader->_data) {
+		LDNS_FREE(reader);
+		return NULL;
+	}
+	reader->_capacity = LDNS_TCP_READER_SIZE;
+	ldns_tcp_reader_reset(reader, sockfd);
+	return reader;
+}
+
+void
+ldns_tcp_reader_reset(ldns_tcp_reader *reader, int sockfd)
+{
+	reader->_sockfd = sockfd;
+	reader->_start = 0;
+	reader->_end = 0;
+}
+
+void
+ldns_tcp_reader_free(ldns_tcp_reader *reader)
+{
+	if (reader) {
+		LDNS_FREE(reader->_data);
+		LDNS_FREE(reader);
+	}
+}
+
+const uint8_t *
+ldns_tcp_reader_next(ldns_tcp_reader *reader, size_t *size,
+		struct timeval timeout)
+{
+	size_t avail, need;
+	ssize_t rc;
+
+	*size = 0;
+	if (!reader || reader->_sockfd < 0) {
+		return NULL;
+	}
+	for (;;) {
+		avail = reader->_end - reader->_start;
+		if (avail >= 2) {
+			need = 2 + (size_t) ldns_read_uint16(
+					reader->_data + reader->_start);
+			if (avail >= need) {
+				*size = need - 2;
+				reader->_start += need;
+				return reader->_data + reader->_start - *size;
+			}
+		}
+		/* keep room behind the partial message for the largest
+		 * one, so a single read can complete it */
+		if (avail == 0) {
+			reader->_start = 0;
+			reader->_end = 0;
+		} else if (reader->_capacity - reader->_start
+				< LDNS_MAX_PACKETLEN + 2) {
+			memmove(reader->_data, reader->_data + reader->_start,
+					avail);
+			reader->_start = 0;
+			reader->_end = avail;
+		}
+		rc = ldns_sock_recv(reader->_sockfd,
+				reader->_data + reader->_end,
+				reader->_capacity - reader->_end, timeout);
+		if (rc == -1 || rc == 0) {
+			return NULL;
+		}
+		reader->_end += (size_t) rc;
+	}
+}
+
 #ifndef S_SPLINT_S
 ldns_rdf *
 ldns_sockaddr_storage2rdf(const struct sockaddr_storage *sock, uint16_t *port)
@@ -1030,6 +1475,16 @@ ldns_axfr_start(ldns_resolver *resolver, const ldns_rdf *domain, ldns_rr_class c
         ldns_buffer_free(query_wire);
         LDNS_FREE(ns);
 
+	/* the answers are read through a buffer that is kept with the
+	 * resolver, to be reused by the next transfer */
+	if (resolver->_axfr_reader) {
+		ldns_tcp_reader_reset(resolver->_axfr_reader, resolver->_socket);
+	} else if (!(resolver->_axfr_reader =
+				ldns_tcp_reader_new(resolver->_socket))) {
+		close_socket(resolver->_socket);
+		return LDNS_STATUS_MEM_ERR;
+	}
+
         /*
          * The AXFR is done once the second SOA record is sent
          */
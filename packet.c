@@ -1289,3 +1289,168 @@ ldns_pkt_clone(const ldns_pkt *pkt)
 	new_pkt->_additional = ldns_rr_list_clone(ldns_pkt_additional(pkt));
 	return new_pkt;
 }
+
+static ldns_rr_list *
+ldns_pkt_section_list(const ldns_pkt *pkt, ldns_pkt_section s)
+{
+	switch (s) {
+	case LDNS_SECTION_QUESTION:
+		return ldns_pkt_question(pkt);
+	case LDNS_SECTION_ANSWER:
+		return ldns_pkt_answer(pkt);
+	case LDNS_SECTION_AUTHORITY:
+		return ldns_pkt_authority(pkt);
+	case LDNS_SECTION_ADDITIONAL:
+		return ldns_pkt_additional(pkt);
+	default:
+		return NULL;
+	}
+}
+
+size_t
+ldns_pkt_size_estimate(const ldns_pkt *pkt)
+{
+	size_t size, rr_size, i;
+	ldns_pkt_section s;
+	const ldns_rr_list *list;
+	const ldns_rdf *prev_owner = NULL;
+	ldns_rr *rr;
+
+	size = LDNS_HEADER_SIZE;
+	for (s = LDNS_SECTION_QUESTION; s <= LDNS_SECTION_ADDITIONAL; s++) {
+		list = ldns_pkt_section_list(pkt, s);
+		for (i = 0; i < ldns_rr_list_rr_count(list); i++) {
+			rr = ldns_rr_list_rr(list, i);
+			rr_size = ldns_rr_uncompressed_size(rr);
+			if (s == LDNS_SECTION_QUESTION) {
+				/* no ttl and rdata length */
+				rr_size -= 6;
+			}
+			/* the earlier name went in the compression tree,
+			 * which only takes names in the first 16k */
+			if (prev_owner && ldns_rr_owner(rr) && size < 16384
+			    && ldns_rdf_size(ldns_rr_owner(rr)) > 2
+			    && ldns_dname_compare(prev_owner,
+					ldns_rr_owner(rr)) == 0) {
+				rr_size -= ldns_rdf_size(ldns_rr_owner(rr)) - 2;
+			}
+			prev_owner = ldns_rr_owner(rr);
+			size += rr_size;
+		}
+	}
+	if (ldns_pkt_edns(pkt)) {
+		/* root owner, type, class, ttl and rdata length */
+		size += 1 + LDNS_RR_OVERHEAD;
+		if (pkt->_edns_list) {
+			size += ldns_edns_option_list_get_options_size(
+					pkt->_edns_list);
+		} else if (ldns_pkt_edns_data(pkt)) {
+			size += ldns_rdf_size(ldns_pkt_edns_data(pkt));
+		}
+	}
+	if (ldns_pkt_tsig(pkt)) {
+		size += ldns_rr_uncompressed_size(ldns_pkt_tsig(pkt));
+	}
+	return size;
+}
+
+/* the type an rrsig belongs with, its own type for other rrs */
+static ldns_rr_type
+ldns_pkt_fit_rrset_type(const ldns_rr *rr)
+{
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG
+	    && ldns_rr_rrsig_typecovered(rr)) {
+		return ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(rr));
+	}
+	return ldns_rr_get_type(rr);
+}
+
+/* remove the last rrset of a section, together with its signatures */
+static void
+ldns_pkt_fit_drop_rrset(ldns_pkt *pkt, ldns_pkt_section s)
+{
+	ldns_rr_list *list = ldns_pkt_section_list(pkt, s);
+	size_t count = ldns_rr_list_rr_count(list);
+	size_t i, j;
+	ldns_rr *last, *rr;
+
+	if (count == 0) {
+		return;
+	}
+	last = ldns_rr_list_rr(list, count - 1);
+	for (i = 0, j = 0; i < count - 1; i++) {
+		rr = ldns_rr_list_rr(list, i);
+		if (ldns_rr_get_class(rr) == ldns_rr_get_class(last)
+		    && ldns_pkt_fit_rrset_type(rr)
+		    == ldns_pkt_fit_rrset_type(last)
+		    && ldns_dname_compare(ldns_rr_owner(rr),
+				ldns_rr_owner(last)) == 0) {
+			ldns_rr_free(rr);
+		} else {
+			(void) ldns_rr_list_set_rr(list, rr, j++);
+		}
+	}
+	ldns_rr_free(last);
+	ldns_rr_list_set_rr_count(list, j);
+	ldns_pkt_set_section_count(pkt, s, (uint16_t) j);
+}
+
+ldns_status
+ldns_pkt_fit(ldns_pkt *pkt, size_t max_size, ldns_pkt_fit_stats *stats)
+{
+	bool dropped;
+
+	if (!pkt) {
+		return LDNS_STATUS_NULL;
+	}
+	if (max_size < LDNS_MIN_BUFLEN) {
+		max_size = LDNS_MIN_BUFLEN;
+	}
+	if (stats) {
+		stats->packets++;
+	}
+	if (ldns_pkt_size_estimate(pkt) <= max_size) {
+		return LDNS_STATUS_OK;
+	}
+
+	/* additional data is optional */
+	dropped = false;
+	while (ldns_pkt_size_estimate(pkt) > max_size
+	       && ldns_rr_list_rr_count(ldns_pkt_additional(pkt)) > 0) {
+		ldns_pkt_fit_drop_rrset(pkt, LDNS_SECTION_ADDITIONAL);
+		dropped = true;
+	}
+	if (dropped && stats) {
+		stats->additional_dropped++;
+	}
+	if (ldns_pkt_size_estimate(pkt) <= max_size) {
+		return LDNS_STATUS_OK;
+	}
+
+	/* so is the authority section, unless it has the proof for a
+	 * negative answer */
+	dropped = false;
+	while (ldns_pkt_size_estimate(pkt) > max_size
+	       && ldns_rr_list_rr_count(ldns_pkt_authority(pkt)) > 0) {
+		ldns_pkt_fit_drop_rrset(pkt, LDNS_SECTION_AUTHORITY);
+		dropped = true;
+	}
+	if (dropped && stats) {
+		stats->authority_dropped++;
+	}
+	if (ldns_pkt_size_estimate(pkt) <= max_size && (!dropped
+	    || ldns_rr_list_rr_count(ldns_pkt_answer(pkt)) > 0)) {
+		return LDNS_STATUS_OK;
+	}
+
+	/* the answer itself does not fit, send what does and set TC */
+	while (ldns_pkt_size_estimate(pkt) > max_size
+	       && ldns_rr_list_rr_count(ldns_pkt_answer(pkt)) > 0) {
+		ldns_pkt_fit_drop_rrset(pkt, LDNS_SECTION_ANSWER);
+	}
+	ldns_pkt_set_tc(pkt, true);
+	if (stats) {
+		stats->truncated++;
+	}
+	return LDNS_STATUS_OK;
+}
@@ -227,6 +227,40 @@ ldns_resolver_random(const ldns_resolver *r)
 	return r->_random;
 }
 
+uint32_t
+ldns_resolver_path_ttl(const ldns_resolver *r)
+{
+	return r->_path_ttl;
+}
+
+const ldns_resolver_path_stats *
+ldns_resolver_get_path_stats(const ldns_resolver *r)
+{
+	return &r->_path_stats;
+}
+
+const ldns_resolver_path *
+ldns_resolver_nameserver_path(const ldns_resolver *r, const ldns_rdf *address)
+{
+	size_t i;
+	const ldns_resolver_path *p;
+
+	if (!address) {
+		return NULL;
+	}
+	for (i = 0; i < r->_path_count; i++) {
+		p = &r->_paths[i];
+		if (ldns_rdf_compare(p->address, address) == 0) {
+			if (p->learned && time(NULL) - p->learned
+					>= (time_t)r->_path_ttl) {
+				return NULL;
+			}
+			return p;
+		}
+	}
+	return NULL;
+}
+
 size_t
 ldns_resolver_searchlist_count(const ldns_resolver *r)
 {
@@ -603,6 +637,26 @@ ldns_resolver_set_random(ldns_resolver *r, bool b)
 	r->_random = b;
 }
 
+void
+ldns_resolver_set_path_ttl(ldns_resolver *r, uint32_t ttl)
+{
+	r->_path_ttl = ttl;
+}
+
+void
+ldns_resolver_clear_paths(ldns_resolver *r)
+{
+	size_t i;
+
+	for (i = 0; i < r->_path_count; i++) {
+		ldns_rdf_deep_free(r->_paths[i].address);
+	}
+	LDNS_FREE(r->_paths);
+	r->_paths = NULL;
+	r->_path_count = 0;
+	memset(&r->_path_stats, 0, sizeof(r->_path_stats));
+}
+
 /* more sophisticated functions */
 ldns_resolver *
 ldns_resolver_new(void)
@@ -654,10 +708,16 @@ ldns_resolver_new(void)
 	r->_axfr_soa_count = 0;
 	r->_axfr_i = 0;
 	r->_cur_axfr_pkt = NULL;
+	r->_axfr_reader = NULL;
 
 	r->_tsig_keyname = NULL;
 	r->_tsig_keydata = NULL;
 	r->_tsig_algorithm = NULL;
+
+	r->_paths = NULL;
+	r->_path_count = 0;
+	r->_path_ttl = LDNS_RESOLV_PATH_TTL;
+	memset(&r->_path_stats, 0, sizeof(r->_path_stats));
 	return r;
 }
 
@@ -671,6 +731,7 @@ ldns_resolver_clone(ldns_resolver *src)
 
 	if (!(dst = LDNS_MALLOC(ldns_resolver))) return NULL;
 	(void) memcpy(dst, src, sizeof(ldns_resolver));
+	dst->_axfr_reader = NULL;
 
 	if (dst->_searchlist_count == 0)
 		dst->_searchlist = NULL;
@@ -727,8 +788,30 @@ ldns_resolver_clone(ldns_resolver *src)
 	    (!(dst->_dnssec_anchors=ldns_rr_list_clone(src->_dnssec_anchors))))
 		goto error_cur_axfr_pkt;
 
+	if (dst->_path_count == 0)
+		dst->_paths = NULL;
+	else {
+		if (!(dst->_paths =
+		    LDNS_XMALLOC(ldns_resolver_path, dst->_path_count)))
+			goto error_dnssec_anchors;
+		(void) memcpy(dst->_paths, src->_paths,
+		    sizeof(ldns_resolver_path) * dst->_path_count);
+		for (i = 0; i < dst->_path_count; i++)
+			if (!(dst->_paths[i].address =
+			    ldns_rdf_clone(src->_paths[i].address))) {
+				dst->_path_count = i;
+				goto error_paths;
+			}
+	}
+
 	return dst;
 
+error_paths:
+	for (i = 0; i < dst->_path_count; i++)
+		ldns_rdf_deep_free(dst->_paths[i].address);
+	LDNS_FREE(dst->_paths);
+error_dnssec_anchors:
+	ldns_rr_list_deep_free(dst->_dnssec_anchors);
 error_cur_axfr_pkt:
 	ldns_pkt_free(dst->_cur_axfr_pkt);
 error_tsig_algorithm:
@@ -1036,6 +1119,7 @@ ldns_resolver_deep_free(ldns_resolver *res)
 		if (res->_cur_axfr_pkt) {
 			ldns_pkt_free(res->_cur_axfr_pkt);
 		}
+		ldns_tcp_reader_free(res->_axfr_reader);
 
 		if (res->_rtt) {
 			LDNS_FREE(res->_rtt);
@@ -1043,6 +1127,7 @@ ldns_resolver_deep_free(ldns_resolver *res)
 		if (res->_dnssec_anchors) {
 			ldns_rr_list_deep_free(res->_dnssec_anchors);
 		}
+		ldns_resolver_clear_paths(res);
 		LDNS_FREE(res);
 	}
 }
@@ -1052,9 +1137,12 @@ ldns_resolver_search_status(ldns_pkt** pkt,
 		ldns_resolver *r, const  ldns_rdf *name,
 		ldns_rr_type t, ldns_rr_class c, uint16_t flags)
 {
-	ldns_rdf *new_name;
+	ldns_rdf **names;
+	ldns_rr_type *types;
+	ldns_pkt **answers;
+	ldns_status *statuses;
 	ldns_rdf **search_list;
-	size_t i;
+	size_t i, count, winner;
 	ldns_status s = LDNS_STATUS_OK;
 	ldns_rdf root_dname = { 1, LDNS_RDF_TYPE_DNAME, (void *)"" };
 
@@ -1062,37 +1150,62 @@ ldns_resolver_search_status(ldns_pkt** pkt,
 		/* query as-is */
 		return ldns_resolver_query_status(pkt, r, name, t, c, flags);
 	} else if (ldns_resolver_dnsrch(r)) {
-		ldns_pkt *return_pkt = NULL;
-
+		/* all candidates are asked at once, the first one in
+		 * search order with an answer wins */
 		search_list = ldns_resolver_searchlist(r);
-		for (i = 0; i <= ldns_resolver_searchlist_count(r); i++) {
-			if (i == ldns_resolver_searchlist_count(r)) {
-				new_name = ldns_dname_cat_clone(name,
+		count = ldns_resolver_searchlist_count(r) + 1;
+		names = LDNS_CALLOC(ldns_rdf *, count);
+		types = LDNS_XMALLOC(ldns_rr_type, count);
+		answers = LDNS_XMALLOC(ldns_pkt *, count);
+		statuses = LDNS_XMALLOC(ldns_status, count);
+		if (!names || !types || !answers || !statuses) {
+			s = LDNS_STATUS_MEM_ERR;
+		}
+		for (i = 0; s == LDNS_STATUS_OK && i < count; i++) {
+			if (i == count - 1) {
+				names[i] = ldns_dname_cat_clone(name,
 						&root_dname);
 			} else {
-				new_name = ldns_dname_cat_clone(name,
+				names[i] = ldns_dname_cat_clone(name,
 						search_list[i]);
 			}
-
-			s = ldns_resolver_query_status(&return_pkt, r,
-					new_name, t, c, flags);
-			ldns_rdf_deep_free(new_name);
-
-			if (return_pkt) {
-				if (s == LDNS_STATUS_OK && 
-						ldns_pkt_get_rcode(return_pkt)
-						== LDNS_RCODE_NOERROR) {
-
-					return LDNS_STATUS_OK;
-				} else if (i < ldns_resolver_searchlist_count(r)) {
-					ldns_pkt_free(return_pkt);
-					return_pkt = NULL;
+			types[i] = t;
+			if (!names[i]) {
+				s = LDNS_STATUS_MEM_ERR;
+			}
+		}
+		if (s == LDNS_STATUS_OK) {
+			s = ldns_resolver_query_pkts_status(answers, statuses,
+					r, (const ldns_rdf * const *)names,
+					types, count, c, flags, true);
+		}
+		if (s == LDNS_STATUS_OK) {
+			/* without a positive answer the last one counts */
+			winner = count - 1;
+			for (i = 0; i < count; i++) {
+				if (statuses[i] == LDNS_STATUS_OK &&
+				    answers[i] && ldns_pkt_get_rcode(
+				    answers[i]) == LDNS_RCODE_NOERROR) {
+					winner = i;
+					break;
 				}
 			}
+			s = statuses[winner];
+			if (pkt && answers[winner]) {
+				*pkt = answers[winner];
+				answers[winner] = NULL;
+			}
+			for (i = 0; i < count; i++) {
+				ldns_pkt_free(answers[i]);
+			}
 		}
-		if (pkt && return_pkt) {
-			*pkt = return_pkt;
+		for (i = 0; names && i < count; i++) {
+			ldns_rdf_deep_free(names[i]);
 		}
+		LDNS_FREE(names);
+		LDNS_FREE(types);
+		LDNS_FREE(answers);
+		LDNS_FREE(statuses);
 	}
 	return s;
 }
@@ -1173,55 +1286,349 @@ ldns_resolver_restore_rtt(ldns_resolver *r, size_t *old_rtt)
 	ldns_resolver_set_rtt(r, old_rtt);
 }
 
+/* the path of a nameserver, or a new one when create and there is none;
+ * what was learned longer than the path ttl ago is forgotten */
+static ldns_resolver_path *
+ldns_resolver_path_find(ldns_resolver *r, const ldns_rdf *address,
+		bool create)
+{
+	ldns_resolver_path *paths;
+	ldns_resolver_path *p;
+	size_t i;
+
+	if (!address || r->_path_ttl == 0) {
+		return NULL;
+	}
+	for (i = 0; i < r->_path_count; i++) {
+		p = &r->_paths[i];
+		if (ldns_rdf_compare(p->address, address) != 0) {
+			continue;
+		}
+		if (p->learned && time(NULL) - p->learned
+				>= (time_t)r->_path_ttl) {
+			p->max_udp_size = 0;
+			p->edns_udp_size = 0;
+			p->tcp_type_count = 0;
+			p->timeouts = 0;
+			p->learned = 0;
+		}
+		return p;
+	}
+	if (!create) {
+		return NULL;
+	}
+	paths = LDNS_XREALLOC(r->_paths, ldns_resolver_path,
+			r->_path_count + 1);
+	if (!paths) {
+		return NULL;
+	}
+	r->_paths = paths;
+	p = &paths[r->_path_count];
+	memset(p, 0, sizeof(*p));
+	if (!(p->address = ldns_rdf_clone(address))) {
+		return NULL;
+	}
+	r->_path_count++;
+	return p;
+}
+
+static bool
+ldns_resolver_path_tcp_type(const ldns_resolver_path *p, ldns_rr_type t)
+{
+	size_t i;
+
+	for (i = 0; i < p->tcp_type_count; i++) {
+		if (p->tcp_types[i] == t) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static ldns_rr_type
+ldns_resolver_path_qtype(const ldns_pkt *pkt)
+{
+	if (ldns_pkt_qdcount(pkt) == 0 ||
+	    ldns_rr_list_rr_count(ldns_pkt_question(pkt)) == 0) {
+		return 0;
+	}
+	return ldns_rr_get_type(ldns_rr_list_rr(ldns_pkt_question(pkt), 0));
+}
+
+/* what was learned about the nameservers that query_pkt will be sent
+ * to: the first reachable one, or any when they are randomized. Only
+ * when all of them learned it, the query goes to TCP directly or gets
+ * a smaller EDNS size. A timeout may be fragment loss when one of them
+ * answered before, and did not time out since. */
+static void
+ldns_resolver_path_query(ldns_resolver *r, const ldns_pkt *query_pkt,
+		bool *tcp, uint16_t *edns_udp_size, bool *answered)
+{
+	ldns_rdf **ns_array = ldns_resolver_nameservers(r);
+	ldns_resolver_path *p;
+	ldns_rr_type t = ldns_resolver_path_qtype(query_pkt);
+	bool any = false, all_tcp = true, all_edns = true;
+	uint16_t edns = 0;
+	size_t i;
+
+	*tcp = false;
+	*edns_udp_size = 0;
+	*answered = false;
+	if (r->_path_count == 0) {
+		return;
+	}
+	for (i = 0; i < ldns_resolver_nameserver_count(r); i++) {
+		if (ldns_resolver_nameserver_rtt(r, i) == LDNS_RESOLV_RTT_INF) {
+			continue;
+		}
+		if ((ldns_rdf_get_type(ns_array[i]) == LDNS_RDF_TYPE_A &&
+		     ldns_resolver_ip6(r) == LDNS_RESOLV_INET6) ||
+		    (ldns_rdf_get_type(ns_array[i]) == LDNS_RDF_TYPE_AAAA &&
+		     ldns_resolver_ip6(r) == LDNS_RESOLV_INET)) {
+			continue;
+		}
+		any = true;
+		p = ldns_resolver_path_find(r, ns_array[i], false);
+		if (!p || !ldns_resolver_path_tcp_type(p, t)) {
+			all_tcp = false;
+		}
+		if (!p || p->edns_udp_size == 0) {
+			all_edns = false;
+		} else if (p->edns_udp_size > edns) {
+			edns = p->edns_udp_size;
+		}
+		if (p && p->timeouts == 0 &&
+		    (p->max_udp_size || p->tcp_type_count)) {
+			*answered = true;
+		}
+		if (!ldns_resolver_random(r)) {
+			break;
+		}
+	}
+	*tcp = any && all_tcp;
+	*edns_udp_size = any && all_edns ? edns : 0;
+}
+
+/* answers of type t from the nameserver did not fit in UDP with EDNS */
+static void
+ldns_resolver_path_learn_tcp(ldns_resolver *r, const ldns_rdf *address,
+		ldns_rr_type t)
+{
+	ldns_resolver_path *p = ldns_resolver_path_find(r, address, true);
+
+	if (!p) {
+		return;
+	}
+	if (!ldns_resolver_path_tcp_type(p, t)) {
+		if (p->tcp_type_count == LDNS_RESOLV_PATH_TYPES) {
+			/* forget the oldest */
+			memmove(&p->tcp_types[0], &p->tcp_types[1],
+					sizeof(ldns_rr_type)
+					* (LDNS_RESOLV_PATH_TYPES - 1));
+			p->tcp_type_count--;
+		}
+		p->tcp_types[p->tcp_type_count++] = t;
+	}
+	p->timeouts = 0;
+	p->learned = time(NULL);
+}
+
+static void
+ldns_resolver_path_learn_edns(ldns_resolver *r, const ldns_rdf *address,
+		uint16_t edns_udp_size)
+{
+	ldns_resolver_path *p = ldns_resolver_path_find(r, address, true);
+
+	if (p) {
+		p->edns_udp_size = edns_udp_size;
+		p->learned = time(NULL);
+	}
+}
+
+static void
+ldns_resolver_path_learn_size(ldns_resolver *r, const ldns_pkt *answer_pkt)
+{
+	ldns_resolver_path *p;
+	size_t size = ldns_pkt_size(answer_pkt);
+
+	if (r->_path_ttl == 0) {
+		return;
+	}
+	p = ldns_resolver_path_find(r, ldns_pkt_answerfrom(answer_pkt), true);
+	if (p && size > p->max_udp_size) {
+		p->max_udp_size = size > 65535 ? 65535 : (uint16_t)size;
+	}
+	if (p) {
+		p->timeouts = 0;
+	}
+}
+
+/* the nameservers that were reachable before a query with a large EDNS
+ * size, and are not anymore, timed out */
+static void
+ldns_resolver_path_learn_timeouts(ldns_resolver *r, const size_t *rtt)
+{
+	ldns_rdf **ns_array = ldns_resolver_nameservers(r);
+	ldns_resolver_path *p;
+	size_t i;
+
+	for (i = 0; i < ldns_resolver_nameserver_count(r); i++) {
+		if (rtt[i] == LDNS_RESOLV_RTT_INF ||
+		    ldns_resolver_nameserver_rtt(r, i)
+				!= LDNS_RESOLV_RTT_INF) {
+			continue;
+		}
+		p = ldns_resolver_path_find(r, ns_array[i], true);
+		if (p) {
+			p->timeouts++;
+			p->learned = time(NULL);
+		}
+	}
+}
+
+/* if tc=1 fall back to EDNS and/or TCP */
+static ldns_status
+ldns_resolver_fallback_pkt(ldns_pkt **answer_pkt, ldns_resolver *r,
+		ldns_pkt *query_pkt)
+{
+	ldns_status stat = LDNS_STATUS_OK;
+	size_t *rtt;
+	ldns_rdf *from;
+
+	/* check for tcp first (otherwise we don't care about tc=1) */
+	if (ldns_resolver_usevc(r) || !ldns_resolver_fallback(r)) {
+		return LDNS_STATUS_OK;
+	}
+	if (!ldns_pkt_tc(*answer_pkt)) {
+		ldns_resolver_path_learn_size(r, *answer_pkt);
+		return LDNS_STATUS_OK;
+	}
+	r->_path_stats.truncated++;
+	/* was EDNS0 set? */
+	if (ldns_pkt_edns_udp_size(query_pkt) == 0) {
+		ldns_pkt_set_edns_udp_size(query_pkt
+				, 4096);
+		ldns_pkt_free(*answer_pkt);
+		*answer_pkt = NULL;
+		/* Nameservers should not become 
+		 * unreachable because fragments are
+		 * dropped (network error). We might
+		 * still have success with TCP.
+		 * Therefore maintain reachability
+		 * statuses of the nameservers by
+		 * backup and restore the rtt list.
+		 */
+		rtt = ldns_resolver_backup_rtt(r);
+		stat = ldns_send(answer_pkt, r
+				, query_pkt);
+		ldns_resolver_restore_rtt(r, rtt);
+		if (stat == LDNS_STATUS_OK) {
+			if (ldns_pkt_tc(*answer_pkt)) {
+				r->_path_stats.truncated++;
+			} else {
+				ldns_resolver_path_learn_size(r, *answer_pkt);
+			}
+		}
+	}
+	/* either way, if it is still truncated, use TCP */
+	if (stat != LDNS_STATUS_OK ||
+	    ldns_pkt_tc(*answer_pkt)) {
+		/* truncated with EDNS, next time go to TCP directly */
+		from = NULL;
+		if (stat == LDNS_STATUS_OK && r->_path_ttl &&
+		    ldns_pkt_answerfrom(*answer_pkt)) {
+			from = ldns_rdf_clone(ldns_pkt_answerfrom(*answer_pkt));
+		}
+		ldns_resolver_set_usevc(r, true);
+		ldns_pkt_free(*answer_pkt);
+		*answer_pkt = NULL;
+		stat = ldns_send(answer_pkt, r, query_pkt);
+		ldns_resolver_set_usevc(r, false);
+		if (stat == LDNS_STATUS_OK && from) {
+			ldns_resolver_path_learn_tcp(r, from,
+					ldns_resolver_path_qtype(query_pkt));
+		}
+		ldns_rdf_deep_free(from);
+	}
+	return stat;
+}
+
 ldns_status
 ldns_resolver_send_pkt(ldns_pkt **answer, ldns_resolver *r,
 				   ldns_pkt *query_pkt)
 {
 	ldns_pkt *answer_pkt = NULL;
 	ldns_status stat = LDNS_STATUS_OK;
-	size_t *rtt;
-
-	stat = ldns_send(&answer_pkt, (ldns_resolver *)r, query_pkt);
+	bool path_tcp = false;
+	uint16_t path_edns = 0;
+	bool path_answered = false;
+	uint16_t edns_udp_size = ldns_pkt_edns_udp_size(query_pkt);
+	size_t *rtt = NULL;
+
+	if (ldns_resolver_fallback(r) && !ldns_resolver_usevc(r)) {
+		ldns_resolver_path_query(r, query_pkt, &path_tcp, &path_edns,
+				&path_answered);
+	}
+	if (path_tcp) {
+		r->_path_stats.tcp_direct++;
+		r->_path_stats.round_trips_saved++;
+		ldns_resolver_set_usevc(r, true);
+		stat = ldns_send(&answer_pkt, r, query_pkt);
+		ldns_resolver_set_usevc(r, false);
+	} else {
+		/* the EDNS size cannot change when the query is signed */
+		if (path_edns && ldns_pkt_edns_udp_size(query_pkt) > path_edns
+				&& !ldns_pkt_tsig(query_pkt)) {
+			ldns_pkt_set_edns_udp_size(query_pkt, path_edns);
+			r->_path_stats.edns_reduced++;
+			r->_path_stats.round_trips_saved++;
+		}
+		/* answers to a large EDNS size may time out when fragments
+		 * are dropped; keep the reachability of the nameservers to
+		 * learn which ones timed out */
+		if (r->_path_ttl && ldns_resolver_fallback(r) &&
+		    !ldns_resolver_usevc(r) && !ldns_pkt_tsig(query_pkt) &&
+		    ldns_pkt_edns_udp_size(query_pkt)
+				> LDNS_RESOLV_PATH_EDNS_SAFE) {
+			rtt = ldns_resolver_backup_rtt(r);
+		}
+		stat = ldns_send(&answer_pkt, (ldns_resolver *)r, query_pkt);
+		/* ask again with a size that is not fragmented, but only
+		 * a nameserver that answered before; one that is down
+		 * would cost the timeout twice */
+		if (rtt && stat == LDNS_STATUS_NETWORK_ERR && path_answered) {
+			ldns_resolver_restore_rtt(r, rtt);
+			rtt = ldns_resolver_backup_rtt(r);
+			ldns_pkt_set_edns_udp_size(query_pkt,
+					LDNS_RESOLV_PATH_EDNS_SAFE);
+			if (answer_pkt) {
+				ldns_pkt_free(answer_pkt);
+				answer_pkt = NULL;
+			}
+			stat = ldns_send(&answer_pkt, r, query_pkt);
+			if (stat == LDNS_STATUS_OK && answer_pkt) {
+				r->_path_stats.timeouts++;
+				ldns_resolver_path_learn_edns(r,
+						ldns_pkt_answerfrom(answer_pkt),
+						LDNS_RESOLV_PATH_EDNS_SAFE);
+			}
+		}
+		if (rtt && stat == LDNS_STATUS_NETWORK_ERR) {
+			ldns_resolver_path_learn_timeouts(r, rtt);
+		}
+		if (rtt) {
+			LDNS_FREE(rtt);
+		}
+	}
 	if (stat != LDNS_STATUS_OK) {
 		if(answer_pkt) {
 			ldns_pkt_free(answer_pkt);
 			answer_pkt = NULL;
 		}
-	} else {
-		/* if tc=1 fall back to EDNS and/or TCP */
-		/* check for tcp first (otherwise we don't care about tc=1) */
-		if (!ldns_resolver_usevc(r) && ldns_resolver_fallback(r)) {
-			if (ldns_pkt_tc(answer_pkt)) {
-				/* was EDNS0 set? */
-				if (ldns_pkt_edns_udp_size(query_pkt) == 0) {
-					ldns_pkt_set_edns_udp_size(query_pkt
-							, 4096);
-					ldns_pkt_free(answer_pkt);
-					answer_pkt = NULL;
-					/* Nameservers should not become 
-					 * unreachable because fragments are
-					 * dropped (network error). We might
-					 * still have success with TCP.
-					 * Therefore maintain reachability
-					 * statuses of the nameservers by
-					 * backup and restore the rtt list.
-					 */
-					rtt = ldns_resolver_backup_rtt(r);
-					stat = ldns_send(&answer_pkt, r
-							, query_pkt);
-					ldns_resolver_restore_rtt(r, rtt);
-				}
-				/* either way, if it is still truncated, use TCP */
-				if (stat != LDNS_STATUS_OK ||
-				    ldns_pkt_tc(answer_pkt)) {
-					ldns_resolver_set_usevc(r, true);
-					ldns_pkt_free(answer_pkt);
-					answer_pkt = NULL;
-					stat = ldns_send(&answer_pkt, r, query_pkt);
-					ldns_resolver_set_usevc(r, false);
-				}
-			}
-		}
+		/* the query goes out as it came in, when it is sent again */
+		ldns_pkt_set_edns_udp_size(query_pkt, edns_udp_size);
+	} else if (!path_tcp) {
+		stat = ldns_resolver_fallback_pkt(&answer_pkt, r, query_pkt);
 	}
 
 	if (answer && answer_pkt) {
@@ -1342,22 +1749,17 @@ ldns_resolver_prepare_query_pkt(ldns_pkt **query_pkt, ldns_resolver *r,
 	return LDNS_STATUS_OK;
 }
 
-ldns_status
-ldns_resolver_send(ldns_pkt **answer, ldns_resolver *r, const ldns_rdf *name,
-		ldns_rr_type t, ldns_rr_class c, uint16_t flags)
+/* a query packet for name, signed when the resolver has a TSIG key */
+static ldns_status
+ldns_resolver_new_query_pkt(ldns_pkt **query_pkt, ldns_resolver *r,
+		const ldns_rdf *name, ldns_rr_type t, ldns_rr_class c,
+		uint16_t flags)
 {
-	ldns_pkt *query_pkt;
-	ldns_pkt *answer_pkt;
 	ldns_status status;
 
 	assert(r != NULL);
 	assert(name != NULL);
 
-	answer_pkt = NULL;
-
-	/* do all the preprocessing here, then fire of an query to
-	 * the network */
-
 	if (0 == t) {
 		t= LDNS_RR_TYPE_A;
 	}
@@ -1371,7 +1773,7 @@ ldns_resolver_send(ldns_pkt **answer, ldns_resolver *r, const ldns_rdf *name,
 		return LDNS_STATUS_RES_QUERY;
 	}
 
-	status = ldns_resolver_prepare_query_pkt(&query_pkt, r, name,
+	status = ldns_resolver_prepare_query_pkt(query_pkt, r, name,
 	                                         t, c, flags);
 	if (status != LDNS_STATUS_OK) {
 		return status;
@@ -1385,19 +1787,39 @@ ldns_resolver_send(ldns_pkt **answer, ldns_resolver *r, const ldns_rdf *name,
 	*/
 	if (ldns_resolver_tsig_keyname(r) && ldns_resolver_tsig_keydata(r)) {
 #ifdef HAVE_SSL
-		status = ldns_pkt_tsig_sign(query_pkt,
+		status = ldns_pkt_tsig_sign(*query_pkt,
 		                            ldns_resolver_tsig_keyname(r),
 		                            ldns_resolver_tsig_keydata(r),
 		                            300, ldns_resolver_tsig_algorithm(r), NULL);
 		if (status != LDNS_STATUS_OK) {
-			ldns_pkt_free(query_pkt);
+			ldns_pkt_free(*query_pkt);
 			return LDNS_STATUS_CRYPTO_TSIG_ERR;
 		}
 #else
-		ldns_pkt_free(query_pkt);
+		ldns_pkt_free(*query_pkt);
 	        return LDNS_STATUS_CRYPTO_TSIG_ERR;
 #endif /* HAVE_SSL */
 	}
+	return LDNS_STATUS_OK;
+}
+
+ldns_status
+ldns_resolver_send(ldns_pkt **answer, ldns_resolver *r, const ldns_rdf *name,
+		ldns_rr_type t, ldns_rr_class c, uint16_t flags)
+{
+	ldns_pkt *query_pkt;
+	ldns_pkt *answer_pkt;
+	ldns_status status;
+
+	answer_pkt = NULL;
+
+	/* do all the preprocessing here, then fire of an query to
+	 * the network */
+	status = ldns_resolver_new_query_pkt(&query_pkt, r, name,
+	                                     t, c, flags);
+	if (status != LDNS_STATUS_OK) {
+		return status;
+	}
 
 	status = ldns_resolver_send_pkt(&answer_pkt, r, query_pkt);
 	ldns_pkt_free(query_pkt);
@@ -1409,11 +1831,70 @@ ldns_resolver_send(ldns_pkt **answer, ldns_resolver *r, const ldns_rdf *name,
 	return status;
 }
 
+ldns_status
+ldns_resolver_query_pkts_status(ldns_pkt **answers, ldns_status *statuses,
+		ldns_resolver *r, const ldns_rdf * const *names,
+		const ldns_rr_type *types, size_t count,
+		ldns_rr_class c, uint16_t flags, bool first_positive)
+{
+	ldns_pkt **query_pkts;
+	ldns_rdf *newname;
+	size_t i;
+	ldns_status status = LDNS_STATUS_OK;
+
+	assert(r != NULL);
+
+	for (i = 0; i < count; i++) {
+		answers[i] = NULL;
+		statuses[i] = LDNS_STATUS_ERR;
+	}
+	query_pkts = LDNS_CALLOC(ldns_pkt *, count);
+	if (!query_pkts) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	for (i = 0; status == LDNS_STATUS_OK && i < count; i++) {
+		if (!ldns_resolver_defnames(r) || !ldns_resolver_domain(r)) {
+			status = ldns_resolver_new_query_pkt(&query_pkts[i],
+					r, names[i], types[i], c, flags);
+		} else if ((newname = ldns_dname_cat_clone(names[i],
+					ldns_resolver_domain(r)))) {
+			status = ldns_resolver_new_query_pkt(&query_pkts[i],
+					r, newname, types[i], c, flags);
+			ldns_rdf_free(newname);
+		} else {
+			status = LDNS_STATUS_MEM_ERR;
+		}
+		if (status != LDNS_STATUS_OK) {
+			/* nothing is left of a failed query */
+			query_pkts[i] = NULL;
+		}
+	}
+	if (status == LDNS_STATUS_OK) {
+		status = ldns_send_pkts(answers, statuses, r, query_pkts,
+				count, first_positive);
+	}
+	for (i = 0; status == LDNS_STATUS_OK && i < count; i++) {
+		if (statuses[i] == LDNS_STATUS_OK) {
+			statuses[i] = ldns_resolver_fallback_pkt(&answers[i],
+					r, query_pkts[i]);
+		}
+		if (statuses[i] != LDNS_STATUS_OK && answers[i]) {
+			ldns_pkt_free(answers[i]);
+			answers[i] = NULL;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		ldns_pkt_free(query_pkts[i]);
+	}
+	LDNS_FREE(query_pkts);
+	return status;
+}
+
 ldns_rr *
 ldns_axfr_next(ldns_resolver *resolver)
 {
 	ldns_rr *cur_rr;
-	uint8_t *packet_wire;
+	const uint8_t *packet_wire;
 	size_t packet_wire_size;
 	ldns_status status;
 
@@ -1444,13 +1925,13 @@ ldns_axfr_next(ldns_resolver *resolver)
 		}
 		return cur_rr;
 	} else {
-               packet_wire = ldns_tcp_read_wire_timeout(resolver->_socket, &packet_wire_size, resolver->_timeout);
+		packet_wire = ldns_tcp_reader_next(resolver->_axfr_reader,
+				&packet_wire_size, resolver->_timeout);
 		if(!packet_wire)
 			return NULL;
 
 		status = ldns_wire2pkt(&resolver->_cur_axfr_pkt, packet_wire,
 				     packet_wire_size);
-		LDNS_FREE(packet_wire);
 
 		resolver->_axfr_i = 0;
 		if (status != LDNS_STATUS_OK) {
@@ -1496,6 +1977,72 @@ ldns_axfr_next(ldns_resolver *resolver)
 
 }
 
+/* the position after the dname at pos, or 0 when it does not fit */
+static size_t
+ldns_wire_skip_dname(const uint8_t *wire, size_t size, size_t pos)
+{
+	while (pos < size) {
+		if ((wire[pos] & 0xc0) == 0xc0) {
+			return pos + 2 <= size ? pos + 2 : 0;
+		} else if (wire[pos] & 0xc0) {
+			return 0;
+		} else if (wire[pos] == 0) {
+			return pos + 1;
+		}
+		pos += 1 + (size_t) wire[pos];
+	}
+	return 0;
+}
+
+const uint8_t *
+ldns_axfr_next_wire(ldns_resolver *resolver, size_t *size)
+{
+	const uint8_t *wire;
+	size_t pos;
+	uint16_t i;
+
+	*size = 0;
+	if (!resolver || resolver->_socket == -1) {
+		return NULL;
+	}
+	wire = ldns_tcp_reader_next(resolver->_axfr_reader, size,
+			resolver->_timeout);
+	if (!wire || *size < LDNS_HEADER_SIZE || LDNS_RCODE_WIRE(wire) != 0) {
+		goto error;
+	}
+	/* only walk the rrs, to find the SOAs that end the transfer */
+	pos = LDNS_HEADER_SIZE;
+	for (i = 0; i < LDNS_QDCOUNT(wire); i++) {
+		pos = ldns_wire_skip_dname(wire, *size, pos);
+		if (pos == 0 || pos + 4 > *size) {
+			goto error;
+		}
+		pos += 4;
+	}
+	for (i = 0; i < LDNS_ANCOUNT(wire); i++) {
+		pos = ldns_wire_skip_dname(wire, *size, pos);
+		if (pos == 0 || pos + 10 > *size) {
+			goto error;
+		}
+		if (ldns_read_uint16(wire + pos) == LDNS_RR_TYPE_SOA) {
+			resolver->_axfr_soa_count++;
+		}
+		pos += 10 + (size_t) ldns_read_uint16(wire + pos + 8);
+		if (pos > *size) {
+			goto error;
+		}
+	}
+	if (resolver->_axfr_soa_count >= 2) {
+		close_socket(resolver->_socket);
+	}
+	return wire;
+
+error:
+	close_socket(resolver->_socket);
+	*size = 0;
+	return NULL;
+}
+
 /* this function is needed to abort a transfer that is in progress;
  * without it an aborted transfer will lead to the AXFR code in the
  * library staying in an indetermined state because the socket for the
@@ -693,6 +693,95 @@ ldns_rr_new_question_frm_str(ldns_rr **newrr, const char *str,
 					    NULL);
 }
 
+/*
+ * Reads only the owner, ttl, class and type of the rr in str, the same
+ * way as ldns_rr_new_frm_str_internal() does, and updates prev like it.
+ * The rdata is not looked at, so no rdfs are built for it.
+ */
+static ldns_status
+ldns_rr_head_frm_str(const char *str, uint32_t default_ttl,
+		const ldns_rdf *origin, ldns_rdf **prev,
+		ldns_rr_type *type, uint32_t *ttl, bool *explicit_ttl)
+{
+	char owner[LDNS_MAX_DOMAINLEN + 1];
+	char tok[LDNS_TTL_DATALEN];
+	char clas[LDNS_SYNTAX_DATALEN];
+	const char *type_str;
+	const char *endptr;
+	ldns_buffer rr_buf;
+	ldns_rdf *owner_dname;
+
+	rr_buf._data = (uint8_t *) str;
+	rr_buf._position = 0;
+	rr_buf._limit = strlen(str);
+	rr_buf._capacity = rr_buf._limit;
+	rr_buf._fixed = 1;
+	rr_buf._status = LDNS_STATUS_OK;
+
+	if (ldns_bget_token(&rr_buf, owner, "\t\n ", LDNS_MAX_DOMAINLEN) == -1) {
+		return LDNS_STATUS_SYNTAX_ERR;
+	}
+	if (ldns_bget_token(&rr_buf, tok, "\t\n ", LDNS_TTL_DATALEN) == -1) {
+		return LDNS_STATUS_SYNTAX_TTL_ERR;
+	}
+	if (strlen(tok) > 0 && !isdigit((int) tok[0])) {
+		*ttl = default_ttl == 0 ? LDNS_DEFAULT_TTL : default_ttl;
+		*explicit_ttl = false;
+		/* the token is the class, or the type */
+		type_str = ldns_get_rr_class_by_name(tok) == 0 ? tok : NULL;
+	} else {
+		*ttl = (uint32_t) ldns_str2period(tok, &endptr);
+		*explicit_ttl = true;
+		if (ldns_bget_token(&rr_buf, clas, "\t\n ",
+					LDNS_SYNTAX_DATALEN) == -1) {
+			return LDNS_STATUS_SYNTAX_CLASS_ERR;
+		}
+		type_str = ldns_get_rr_class_by_name(clas) == 0 ? clas : NULL;
+	}
+	if (!type_str) {
+		if (ldns_bget_token(&rr_buf, clas, "\t\n ",
+					LDNS_SYNTAX_DATALEN) == -1) {
+			return LDNS_STATUS_SYNTAX_TYPE_ERR;
+		}
+		type_str = clas;
+	}
+	*type = ldns_get_rr_type_by_name(type_str);
+
+	if (!prev) {
+		return LDNS_STATUS_OK;
+	}
+	if (strncmp(owner, "@", 1) == 0) {
+		/* @ also overrides prev */
+		if (origin) {
+			owner_dname = ldns_rdf_clone(origin);
+		} else if (*prev) {
+			owner_dname = ldns_rdf_clone(*prev);
+		} else {
+			owner_dname = ldns_dname_new_frm_str(".");
+		}
+	} else if (strlen(owner) == 0) {
+		/* prev stays as it is */
+		return LDNS_STATUS_OK;
+	} else {
+		owner_dname = ldns_dname_new_frm_str(owner);
+		if (!owner_dname) {
+			return LDNS_STATUS_SYNTAX_ERR;
+		}
+		if (!ldns_dname_str_absolute(owner) && origin &&
+				ldns_dname_cat(owner_dname, origin)
+				!= LDNS_STATUS_OK) {
+			ldns_rdf_deep_free(owner_dname);
+			return LDNS_STATUS_SYNTAX_ERR;
+		}
+	}
+	if (!owner_dname) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	ldns_rdf_deep_free(*prev);
+	*prev = owner_dname;
+	return LDNS_STATUS_OK;
+}
+
 /* Strip whitespace from the start and the end of <line>.  */
 static char *
 ldns_strip_ws(char *line)
@@ -718,19 +807,29 @@ ldns_rr_new_frm_fp(ldns_rr **newrr, FILE *fp, uint32_t *ttl, ldns_rdf **origin,
 ldns_status
 _ldns_rr_new_frm_fp_l_internal(ldns_rr **newrr, FILE *fp,
 		uint32_t *default_ttl, ldns_rdf **origin, ldns_rdf **prev,
-		int *line_nr, bool *explicit_ttl);
+		int *line_nr, bool *explicit_ttl,
+		const ldns_rdf *types, uint32_t *skipped_ttl);
+/*
+ * With types, rrs of which the type is not in the bitmap, other than the
+ * SOA, are skipped after reading their type: *newrr is set to NULL and
+ * their ttl is returned in skipped_ttl.
+ */
 ldns_status
 _ldns_rr_new_frm_fp_l_internal(ldns_rr **newrr, FILE *fp,
 		uint32_t *default_ttl, ldns_rdf **origin, ldns_rdf **prev,
-		int *line_nr, bool *explicit_ttl)
+		int *line_nr, bool *explicit_ttl,
+		const ldns_rdf *types, uint32_t *skipped_ttl)
 {
 	char *line = NULL;
 	size_t limit = 0;
 	const char *endptr;  /* unused */
-	ldns_rr *rr;
+	ldns_rr *rr = NULL;
 	uint32_t ttl;
 	ldns_rdf *tmp;
 	ldns_status s;
+	ldns_rr_type type = 0;
+	uint32_t head_ttl = 0;
+	bool explicit = false;
 
 	if (default_ttl) {
 		ttl = *default_ttl;
@@ -769,6 +868,19 @@ _ldns_rr_new_frm_fp_l_internal(ldns_rr **newrr, FILE *fp,
 	} else if (!*ldns_strip_ws(line)) {
 		LDNS_FREE(line);
 		return LDNS_STATUS_SYNTAX_EMPTY;
+	} else if (types && (s = ldns_rr_head_frm_str(line, ttl,
+			origin ? *origin : NULL, prev, &type, &head_ttl,
+			&explicit)) != LDNS_STATUS_OK) {
+		/* syntax error in the owner, ttl, class or type */
+	} else if (types && type != LDNS_RR_TYPE_SOA &&
+			!ldns_nsec_bitmap_covers_type(types, type)) {
+		/* not wanted, skip the rdata */
+		if (explicit_ttl) {
+			*explicit_ttl = explicit;
+		}
+		if (skipped_ttl) {
+			*skipped_ttl = head_ttl;
+		}
 	} else {
 		if (origin && *origin) {
 			s = ldns_rr_new_frm_str_internal(&rr, (const char*)line,
@@ -795,7 +907,41 @@ ldns_rr_new_frm_fp_l(ldns_rr **newrr, FILE *fp, uint32_t *default_ttl,
 		ldns_rdf **origin, ldns_rdf **prev, int *line_nr)
 {
 	return _ldns_rr_new_frm_fp_l_internal(newrr, fp, default_ttl, origin,
-			prev, line_nr, NULL);
+			prev, line_nr, NULL, NULL, NULL);
+}
+
+ldns_status
+ldns_rr_new_frm_fp_types_l(ldns_rr **newrr, FILE *fp, uint32_t *default_ttl,
+		ldns_rdf **origin, ldns_rdf **prev, int *line_nr,
+		const ldns_rdf *types)
+{
+	ldns_rr *rr;
+	ldns_status s;
+
+	do {
+		s = _ldns_rr_new_frm_fp_l_internal(&rr, fp, default_ttl,
+				origin, prev, line_nr, NULL, types, NULL);
+		if (s == LDNS_STATUS_OK && rr && types &&
+				!ldns_nsec_bitmap_covers_type(types,
+					ldns_rr_get_type(rr))) {
+			/* an SOA, that is only kept for the zone */
+			ldns_rr_free(rr);
+			rr = NULL;
+		}
+	} while (s == LDNS_STATUS_OK && !rr && !feof(fp));
+
+	if (s == LDNS_STATUS_OK && !rr) {
+		/* the file ended with skipped rrs */
+		s = LDNS_STATUS_SYNTAX_EMPTY;
+	}
+	if (s == LDNS_STATUS_OK) {
+		if (newrr) {
+			*newrr = rr;
+		} else {
+			ldns_rr_free(rr);
+		}
+	}
+	return s;
 }
 
 void
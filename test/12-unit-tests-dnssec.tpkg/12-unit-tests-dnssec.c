@@ -121,6 +121,410 @@ check_ldns_canonicalization(void)
 	return status;
 }
 
+ldns_status
+check_ldns_dnssec_name_index(void)
+{
+	const char *rr_strs[] = {
+		"example.nl. 3600 IN TXT \"x\"",
+		"example.nl. 3600 IN SOA ns.example.nl. h.example.nl. 1 2 3 4 5",
+		"example.nl. 3600 IN TYPE65280 \\# 1 00",
+		"example.nl. 3600 IN A 192.0.2.1",
+		"example.nl. 3600 IN NS ns.example.nl.",
+		"example.nl. 3600 IN A 192.0.2.2",
+		NULL
+	};
+	ldns_rr_type order[] = { LDNS_RR_TYPE_A, LDNS_RR_TYPE_NS,
+		LDNS_RR_TYPE_SOA, LDNS_RR_TYPE_TXT, 65280 };
+	ldns_dnssec_name *name = ldns_dnssec_name_new();
+	ldns_dnssec_rrsets *cur, rrset;
+	ldns_status status = LDNS_STATUS_OK;
+	ldns_rr *rr;
+	size_t i;
+
+	for (i = 0; rr_strs[i]; i++) {
+		if (ldns_rr_new_frm_str(&rr, rr_strs[i], 0, NULL, NULL)
+				!= LDNS_STATUS_OK
+		    || ldns_dnssec_name_add_rr(name, rr) != LDNS_STATUS_OK) {
+			printf("Error adding rr: %s\n", rr_strs[i]);
+			status = LDNS_STATUS_ERR;
+		}
+	}
+	for (i = 0, cur = name->rrsets; cur; i++, cur = cur->next) {
+		if (i >= 5 || cur->type != order[i]
+		    || ldns_dnssec_name_find_rrset(name, cur->type) != cur
+		    || !ldns_dnssec_name_has_type(name, cur->type)) {
+			printf("Error, rrsets not in type order\n");
+			status = LDNS_STATUS_ERR;
+		}
+	}
+	if (ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_MX)
+	    || ldns_dnssec_name_find_rrset(name, LDNS_RR_TYPE_MX)) {
+		printf("Error, found a type that is not there\n");
+		status = LDNS_STATUS_ERR;
+	}
+
+	/* insert and remove an rrset like the signer does for ZONEMD */
+	memset(&rrset, 0, sizeof(rrset));
+	rrset.type = LDNS_RR_TYPE_ZONEMD;
+	if (ldns_dnssec_name_insert_rrset(name, &rrset) != LDNS_STATUS_OK
+	    || ldns_dnssec_name_insert_rrset(name, &rrset) == LDNS_STATUS_OK
+	    || ldns_dnssec_name_find_rrset(name, LDNS_RR_TYPE_ZONEMD) != &rrset
+	    || rrset.next != ldns_dnssec_name_find_rrset(name, 65280)
+	    || ldns_dnssec_name_remove_rrset(name, LDNS_RR_TYPE_ZONEMD)
+			!= &rrset
+	    || ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_ZONEMD)
+	    || ldns_dnssec_name_find_rrset(name, LDNS_RR_TYPE_TXT)->next
+			!= ldns_dnssec_name_find_rrset(name, 65280)) {
+		printf("Error, inserting or removing an rrset\n");
+		status = LDNS_STATUS_ERR;
+	}
+
+	ldns_dnssec_name_deep_free(name);
+	return status;
+}
+
+ldns_status
+check_ldns_nsec3_hash_cache(void)
+{
+	uint8_t salt[] = { 0xab, 0xcd };
+	ldns_rdf *name = ldns_dname_new_frm_str("www.Example.org.");
+	ldns_rdf *expected = ldns_nsec3_hash_name(name, 1, 5, 2, salt);
+	ldns_nsec3_hash_cache *cache = ldns_nsec3_hash_cache_new(1, 5, 2, salt);
+	ldns_nsec3_hash_cache *other = ldns_nsec3_hash_cache_new(1, 6, 2, salt);
+	ldns_status status = LDNS_STATUS_OK;
+	ldns_rdf *hashed;
+	FILE *fp = tmpfile();
+
+	/* miss, then hit, both equal to the uncached hash */
+	hashed = ldns_nsec3_hash_name_cached(cache, name, 1, 5, 2, salt);
+	if (!hashed || ldns_rdf_compare(hashed, expected) != 0) {
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rdf_deep_free(hashed);
+	hashed = ldns_nsec3_hash_name_cached(cache, name, 1, 5, 2, salt);
+	if (!hashed || ldns_rdf_compare(hashed, expected) != 0
+	    || cache->hits != 1 || cache->misses != 1) {
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rdf_deep_free(hashed);
+	ldns_nsec3_hash_cache_free(cache);
+	if (status != LDNS_STATUS_OK) {
+		printf("Error, cached NSEC3 hash differs\n");
+	}
+
+	/* write, read back, and ignore for other parameters */
+	cache = ldns_nsec3_hash_cache_new(1, 5, 2, salt);
+	hashed = ldns_nsec3_hash_name_cached(cache, name, 1, 5, 2, salt);
+	ldns_rdf_deep_free(hashed);
+	if (!fp || ldns_nsec3_hash_cache_write(cache, fp) != LDNS_STATUS_OK) {
+		printf("Error writing NSEC3 hash cache\n");
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_nsec3_hash_cache_free(cache);
+	cache = ldns_nsec3_hash_cache_new(1, 5, 2, salt);
+	if (fp) {
+		rewind(fp);
+		if (ldns_nsec3_hash_cache_read(cache, fp) != LDNS_STATUS_OK) {
+			status = LDNS_STATUS_ERR;
+		}
+		rewind(fp);
+		if (ldns_nsec3_hash_cache_read(other, fp) != LDNS_STATUS_OK
+		    || other->names->count != 0) {
+			status = LDNS_STATUS_ERR;
+		}
+		fclose(fp);
+	}
+	hashed = ldns_nsec3_hash_name_cached(cache, name, 1, 5, 2, salt);
+	if (!hashed || ldns_rdf_compare(hashed, expected) != 0
+	    || cache->hits != 1 || cache->misses != 0) {
+		printf("Error reading NSEC3 hash cache\n");
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rdf_deep_free(hashed);
+
+	ldns_nsec3_hash_cache_free(cache);
+	ldns_nsec3_hash_cache_free(other);
+	ldns_rdf_deep_free(expected);
+	ldns_rdf_deep_free(name);
+	return status;
+}
+
+ldns_status
+check_ldns_expiration_jitter(void)
+{
+	ldns_key *key = ldns_key_new();
+	ldns_rr_list *rrset = ldns_rr_list_new();
+	ldns_status status = LDNS_STATUS_OK;
+	uint32_t expiration, lowest = 20000, highest = 0;
+	ldns_rr *rr, *sig;
+	size_t i;
+
+	if (ldns_rr_new_frm_str(&rr, "www.example.org. 3600 IN A 192.0.2.1",
+			0, NULL, NULL) != LDNS_STATUS_OK) {
+		ldns_key_free(key);
+		ldns_rr_list_free(rrset);
+		return LDNS_STATUS_ERR;
+	}
+	ldns_rr_list_push_rr(rrset, rr);
+	ldns_key_set_pubkey_owner(key, ldns_dname_new_frm_str("example.org."));
+	ldns_key_set_inception(key, 10000);
+	ldns_key_set_expiration(key, 20000);
+	ldns_key_set_expiration_jitter(key, 100);
+
+	for (i = 0; i < 200; i++) {
+		sig = ldns_create_empty_rrsig(rrset, key);
+		expiration = ldns_rdf2native_int32(
+				ldns_rr_rrsig_expiration(sig));
+		if (expiration > 20000 || expiration < 19900) {
+			printf("Error, expiration %u out of range\n",
+					(unsigned)expiration);
+			status = LDNS_STATUS_ERR;
+		}
+		if (expiration < lowest)
+			lowest = expiration;
+		if (expiration > highest)
+			highest = expiration;
+		ldns_rr_free(sig);
+	}
+	if (highest == lowest) {
+		printf("Error, expiration dates not spread\n");
+		status = LDNS_STATUS_ERR;
+	}
+	/* the jitter never reaches the inception date */
+	ldns_key_set_expiration_jitter(key, 50000);
+	for (i = 0; i < 200; i++) {
+		sig = ldns_create_empty_rrsig(rrset, key);
+		if (ldns_rdf2native_int32(ldns_rr_rrsig_expiration(sig))
+				<= 10000) {
+			printf("Error, expiration before inception\n");
+			status = LDNS_STATUS_ERR;
+		}
+		ldns_rr_free(sig);
+	}
+	ldns_rdf_deep_free(ldns_key_pubkey_owner(key));
+	ldns_key_set_pubkey_owner(key, NULL);
+	ldns_key_free(key);
+	ldns_rr_list_deep_free(rrset);
+	return status;
+}
+
+ldns_status
+check_ldns_verify_wildcard_rrsigs(void)
+{
+#ifdef USE_ED25519
+	const char *signed_strs[] = {
+		"*.example. 300 IN A 192.0.2.1",
+		"*.example. 300 IN A 192.0.2.2",
+		NULL
+	};
+	/* expanded, with another ttl, order and case */
+	const char *expanded_strs[] = {
+		"a.B.example. 60 IN A 192.0.2.2",
+		"A.b.example. 60 IN A 192.0.2.1",
+		NULL
+	};
+	ldns_rr_list *rrset = ldns_rr_list_new();
+	ldns_rr_list *expanded = ldns_rr_list_new();
+	ldns_rr_list *dnskeys = ldns_rr_list_new();
+	ldns_rr_list *good_keys = ldns_rr_list_new();
+	ldns_rr_list *sigs = NULL;
+	ldns_key_list *keys = ldns_key_list_new();
+	ldns_status status = LDNS_STATUS_OK;
+	ldns_key *key;
+	ldns_rr *rr;
+	size_t i;
+
+	for (i = 0; i < 2; i++) {
+		key = ldns_key_new_frm_algorithm(LDNS_SIGN_ED25519, 256);
+		if (!key) {
+			printf("Error creating key\n");
+			status = LDNS_STATUS_ERR;
+			goto done;
+		}
+		ldns_key_set_pubkey_owner(key,
+			ldns_dname_new_frm_str("example."));
+		ldns_key_set_flags(key, LDNS_KEY_ZONE_KEY);
+		rr = ldns_key2rr(key);
+		ldns_key_set_keytag(key, ldns_calc_keytag(rr));
+		ldns_key_list_push_key(keys, key);
+		ldns_rr_list_push_rr(dnskeys, rr);
+	}
+	for (i = 0; signed_strs[i]; i++) {
+		ldns_rr_new_frm_str(&rr, signed_strs[i], 0, NULL, NULL);
+		ldns_rr_list_push_rr(rrset, rr);
+		ldns_rr_new_frm_str(&rr, expanded_strs[i], 0, NULL, NULL);
+		ldns_rr_list_push_rr(expanded, rr);
+	}
+	sigs = ldns_sign_public(rrset, keys);
+	if (ldns_rr_list_rr_count(sigs) != 2) {
+		printf("Error signing wildcard rrset\n");
+		status = LDNS_STATUS_ERR;
+		goto done;
+	}
+	/* every signature over the shared rrset finds its own key */
+	if (ldns_verify_time(expanded, sigs, dnskeys, ldns_time(NULL),
+			good_keys) != LDNS_STATUS_OK
+	    || ldns_rr_list_rr_count(good_keys) != 2) {
+		printf("Error verifying expanded wildcard rrset\n");
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rr_list_free(good_keys);
+	good_keys = ldns_rr_list_new();
+	rr = ldns_rr_list_pop_rr(dnskeys);
+	if (ldns_verify_rrsig_keylist_time(expanded,
+			ldns_rr_list_rr(sigs, 1), dnskeys, ldns_time(NULL),
+			good_keys) != LDNS_STATUS_CRYPTO_NO_MATCHING_KEYTAG_DNSKEY
+	    || ldns_rr_list_rr_count(good_keys) != 0) {
+		printf("Error, verified without the signing key\n");
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rr_list_push_rr(dnskeys, rr);
+	(void) ldns_rdf_deep_free(ldns_rr_set_rdf(
+		ldns_rr_list_rr(expanded, 0),
+		ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, "192.0.2.3"), 0));
+	if (ldns_verify_time(expanded, sigs, dnskeys, ldns_time(NULL),
+			NULL) == LDNS_STATUS_OK) {
+		printf("Error, verified a modified rrset\n");
+		status = LDNS_STATUS_ERR;
+	}
+done:
+	ldns_rr_list_deep_free(sigs);
+	ldns_rr_list_deep_free(rrset);
+	ldns_rr_list_deep_free(expanded);
+	ldns_rr_list_deep_free(dnskeys);
+	ldns_rr_list_free(good_keys);
+	ldns_key_list_free(keys);
+	return status;
+#else
+	return LDNS_STATUS_OK;
+#endif
+}
+
+/* the zone printed to a string, to be freed by the caller */
+static char *
+dnssec_zone2str(ldns_dnssec_zone *zone)
+{
+	FILE *fp = tmpfile();
+	char *str;
+	long size;
+
+	if (!fp) {
+		return NULL;
+	}
+	ldns_dnssec_zone_print(fp, zone);
+	size = ftell(fp);
+	rewind(fp);
+	if (size < 0 || !(str = malloc((size_t) size + 1))) {
+		fclose(fp);
+		return NULL;
+	}
+	str[fread(str, 1, (size_t) size, fp)] = '\0';
+	fclose(fp);
+	return str;
+}
+
+ldns_status
+check_ldns_dnssec_zone_compact_rrsigs(void)
+{
+	/* the RRSIG comes before the A, so it owns the name of www */
+	const char *zone_str =
+		"example. 3600 IN SOA ns.example. h.example. 1 2 3 4 5\n"
+		"example. 3600 IN RRSIG SOA 15 1 3600 20360101000000 "
+			"20260101000000 12345 example. AAECAwQFBgc=\n"
+		"example. 3600 IN NS ns.example.\n"
+		"example. 3600 IN RRSIG NS 15 1 3600 20360101000000 "
+			"20260101000000 12345 example. CAkKCwwNDg8=\n"
+		"example. 3600 IN NSEC www.example. NS SOA RRSIG NSEC\n"
+		"example. 3600 IN RRSIG NSEC 15 1 3600 20360101000000 "
+			"20260101000000 12345 example. EBESExQVFhc=\n"
+		"www.example. 300 IN RRSIG A 15 2 300 20360101000000 "
+			"20260101000000 12345 example. GBkaGxwdHh8=\n"
+		"www.example. 300 IN A 192.0.2.1\n"
+		"www.example. 3600 IN NSEC example. A RRSIG NSEC\n"
+		"www.example. 3600 IN RRSIG NSEC 15 2 3600 20360101000000 "
+			"20260101000000 12345 example. ICEiIyQlJic=\n";
+	const char *add_str =
+		"www.example. 300 IN RRSIG A 15 2 300 20360101000000 "
+			"20260101000000 54321 example. KCkqKywtLi8=";
+	ldns_dnssec_zone *zone = NULL;
+	ldns_dnssec_rrsets *rrset;
+	ldns_dnssec_rrs *rrs;
+	ldns_status status = LDNS_STATUS_OK;
+	char *before = NULL, *after = NULL;
+	ldns_rr *rr = NULL, *clone = NULL;
+	ldns_rdf *www;
+	FILE *fp;
+
+	if (!(fp = tmpfile())) {
+		printf("Error creating a temporary file\n");
+		return LDNS_STATUS_ERR;
+	}
+	fputs(zone_str, fp);
+	rewind(fp);
+	if (ldns_dnssec_zone_new_frm_fp(&zone, fp, NULL, 0, LDNS_RR_CLASS_IN)
+			!= LDNS_STATUS_OK) {
+		printf("Error reading zone\n");
+		fclose(fp);
+		return LDNS_STATUS_ERR;
+	}
+	fclose(fp);
+	before = dnssec_zone2str(zone);
+	www = ldns_dname_new_frm_str("www.example.");
+	rrset = ldns_dnssec_zone_find_rrset(zone, www, LDNS_RR_TYPE_A);
+	ldns_rdf_deep_free(www);
+	rr = ldns_rr_clone(rrset->signatures->rr);
+
+	if (ldns_dnssec_zone_compact_rrsigs(zone) != LDNS_STATUS_OK
+	    || rrset->signatures->rr != NULL
+	    || zone->soa->nsec_signatures->rr != NULL) {
+		printf("Error making the RRSIGs compact\n");
+		status = LDNS_STATUS_ERR;
+		goto done;
+	}
+	after = dnssec_zone2str(zone);
+	if (!before || !after || strcmp(before, after) != 0) {
+		printf("Error, compact zone prints differently\n");
+		status = LDNS_STATUS_ERR;
+	}
+	clone = ldns_dnssec_rrs_clone_rr(rrset->signatures);
+	if (ldns_rr_compare(clone, rr) != 0 || rrset->signatures->rr) {
+		printf("Error, copy of a compact RRSIG differs\n");
+		status = LDNS_STATUS_ERR;
+	}
+	ldns_rr_free(clone);
+
+	/* adding to a compact signature list */
+	ldns_rr_new_frm_str(&clone, add_str, 0, NULL, NULL);
+	if (ldns_dnssec_zone_add_rr(zone, clone) != LDNS_STATUS_OK
+	    || !(rrs = rrset->signatures->next)
+	    || rrs->rr != clone
+	    || ldns_rr_compare(rrset->signatures->rr, rr) != 0) {
+		printf("Error adding to compact RRSIGs\n");
+		status = LDNS_STATUS_ERR;
+	}
+
+	free(before);
+	before = dnssec_zone2str(zone);
+	if (ldns_dnssec_zone_expand_rrsigs(zone) != LDNS_STATUS_OK
+	    || !zone->soa->nsec_signatures->rr
+	    || zone->soa->nsec_signatures->_compact) {
+		printf("Error expanding the RRSIGs\n");
+		status = LDNS_STATUS_ERR;
+	}
+	free(after);
+	after = dnssec_zone2str(zone);
+	if (!before || !after || strcmp(before, after) != 0) {
+		printf("Error, expanded zone prints differently\n");
+		status = LDNS_STATUS_ERR;
+	}
+done:
+	free(before);
+	free(after);
+	ldns_rr_free(rr);
+	ldns_dnssec_zone_deep_free(zone);
+	return status;
+}
+
 int main(void)
 {
 	int result = EXIT_SUCCESS;
@@ -135,5 +539,30 @@ int main(void)
 		result = EXIT_FAILURE;
 	}
 
+	if (check_ldns_dnssec_name_index() != LDNS_STATUS_OK) {
+		printf("ldns_dnssec_name type index failed.\n");
+		result = EXIT_FAILURE;
+	}
+
+	if (check_ldns_nsec3_hash_cache() != LDNS_STATUS_OK) {
+		printf("ldns_nsec3_hash_cache failed.\n");
+		result = EXIT_FAILURE;
+	}
+
+	if (check_ldns_expiration_jitter() != LDNS_STATUS_OK) {
+		printf("ldns_create_empty_rrsig() with jitter failed.\n");
+		result = EXIT_FAILURE;
+	}
+
+	if (check_ldns_verify_wildcard_rrsigs() != LDNS_STATUS_OK) {
+		printf("ldns_verify_time() with several signatures failed.\n");
+		result = EXIT_FAILURE;
+	}
+
+	if (check_ldns_dnssec_zone_compact_rrsigs() != LDNS_STATUS_OK) {
+		printf("ldns_dnssec_zone_compact_rrsigs() failed.\n");
+		result = EXIT_FAILURE;
+	}
+
 	exit(result);
 }
@@ -4,6 +4,15 @@
 #include "ldns/config.h"
 
 #include <ldns/ldns.h>
+#include <ctype.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 int test_duration(void)
 {
@@ -56,6 +65,1148 @@ int test_duration(void)
 }
 
 
+int test_dname_view(void)
+{
+	ldns_rdf *name = ldns_dname_new_frm_str("www.Example.NL.");
+	ldns_rdf *parent = ldns_dname_new_frm_str("example.nl.");
+	ldns_rdf *other = ldns_dname_new_frm_str("a.example.org.");
+	ldns_rdf *wildcard = ldns_dname_new_frm_str("*.example.nl.");
+	ldns_rdf *suffix_clone = NULL;
+	ldns_dname_view v_name, v_parent, v_other, v_suffix;
+	ldns_rdf tmp;
+	int r = -1;
+
+	if (!name || !parent || !other || !wildcard)
+		fprintf(stderr, "could not create test names\n");
+
+	else if (ldns_dname_view_init(&v_name, name) != LDNS_STATUS_OK
+	      || ldns_dname_view_init(&v_parent, parent) != LDNS_STATUS_OK
+	      || ldns_dname_view_init(&v_other, other) != LDNS_STATUS_OK)
+		fprintf(stderr, "ldns_dname_view_init() failed\n");
+
+	else if (ldns_dname_view_label_count(&v_name) != 3)
+		fprintf(stderr, "view label count should have been 3\n");
+
+	else if (!ldns_dname_view_is_subdomain(&v_name, &v_parent))
+		fprintf(stderr, "www.Example.NL. should be below example.nl.\n");
+
+	else if (ldns_dname_view_is_subdomain(&v_parent, &v_name))
+		fprintf(stderr, "example.nl. should not be below www.Example.NL.\n");
+
+	else if (!ldns_dname_view_suffix(&v_suffix, &v_name, 1))
+		fprintf(stderr, "ldns_dname_view_suffix() failed\n");
+
+	else if (ldns_dname_view_compare(&v_suffix, &v_parent) != 0)
+		fprintf(stderr, "Example.NL. should equal example.nl.\n");
+
+	else if (ldns_dname_compare(ldns_dname_view2rdf(&tmp, &v_suffix),
+				parent) != 0)
+		fprintf(stderr, "ldns_dname_view2rdf() mismatch\n");
+
+	else if (ldns_dname_view_compare(&v_other, &v_name) !=
+	         ldns_dname_compare(other, name))
+		fprintf(stderr, "view compare differs from dname compare\n");
+
+	else if (ldns_dname_view_suffix(&v_suffix, &v_name, 4))
+		fprintf(stderr, "suffix beyond label count should fail\n");
+
+	else if (!ldns_dname_view_suffix(&v_suffix, &v_name, 3)
+	      || ldns_dname_view_size(&v_suffix) != 1
+	      || ldns_dname_view_left_chop(&v_suffix))
+		fprintf(stderr, "root suffix handling error\n");
+
+	else if (!(suffix_clone = ldns_dname_view_clone(&v_suffix)))
+		fprintf(stderr, "ldns_dname_view_clone() returned NULL\n");
+
+	else if (ldns_dname_label_count(suffix_clone) != 0)
+		fprintf(stderr, "root clone should have no labels\n");
+
+	else if (!ldns_dname_match_wildcard(name, wildcard))
+		fprintf(stderr, "www.Example.NL. should match *.example.nl.\n");
+	else
+		r = 0;
+
+	ldns_rdf_deep_free(name);
+	ldns_rdf_deep_free(parent);
+	ldns_rdf_deep_free(other);
+	ldns_rdf_deep_free(wildcard);
+	ldns_rdf_deep_free(suffix_clone);
+	return r;
+}
+
+int test_pkt_fit(void)
+{
+	char txt[200], rr_str[512];
+	const char *extra[] = {
+		"example.com. 3600 IN NS ns1.example.com.",
+		"ns1.example.com. 3600 IN A 192.0.2.1",
+		"ns1.example.com. 3600 IN AAAA 2001:db8::1",
+		NULL
+	};
+	ldns_pkt_fit_stats stats;
+	ldns_pkt *pkt = NULL;
+	ldns_rr *rr;
+	uint8_t *wire = NULL;
+	size_t wire_size = 0, i;
+	int r = -1;
+
+	memset(&stats, 0, sizeof(stats));
+	memset(txt, 'x', sizeof(txt) - 1);
+	txt[sizeof(txt) - 1] = 0;
+	if (ldns_pkt_query_new_frm_str(&pkt, "example.com.",
+			LDNS_RR_TYPE_TXT, LDNS_RR_CLASS_IN, 0)
+			!= LDNS_STATUS_OK) {
+		fprintf(stderr, "could not create test packet\n");
+		return -1;
+	}
+	/* two answer rrs, and optional data that together do not fit */
+	for (i = 0; i < 2; i++) {
+		snprintf(rr_str, sizeof(rr_str),
+			"example.com. 3600 IN TXT \"%u%s\"", (unsigned)i, txt);
+		if (ldns_rr_new_frm_str(&rr, rr_str, 0, NULL, NULL)
+				== LDNS_STATUS_OK)
+			ldns_pkt_push_rr(pkt, LDNS_SECTION_ANSWER, rr);
+	}
+	for (i = 0; extra[i]; i++) {
+		if (ldns_rr_new_frm_str(&rr, extra[i], 0, NULL, NULL)
+				== LDNS_STATUS_OK)
+			ldns_pkt_push_rr(pkt, i == 0 ? LDNS_SECTION_AUTHORITY
+				: LDNS_SECTION_ADDITIONAL, rr);
+	}
+
+	if (ldns_pkt2wire(&wire, pkt, &wire_size) != LDNS_STATUS_OK
+	 || ldns_pkt_size_estimate(pkt) < wire_size)
+		fprintf(stderr, "size estimate below the wire size\n");
+
+	else if (wire_size <= 512)
+		fprintf(stderr, "test packet should not fit in 512\n");
+
+	else if (ldns_pkt_fit(pkt, 512, &stats) != LDNS_STATUS_OK
+	      || ldns_pkt_size_estimate(pkt) > 512
+	      || ldns_pkt_tc(pkt)
+	      || ldns_pkt_ancount(pkt) != 2
+	      || ldns_pkt_nscount(pkt) != 1
+	      || stats.additional_dropped != 1
+	      || stats.truncated != 0)
+		fprintf(stderr, "additional data not dropped first\n");
+
+	/* a third txt makes the answer too large, the whole rrset goes */
+	else if (ldns_rr_new_frm_str(&rr, rr_str, 0, NULL, NULL)
+			!= LDNS_STATUS_OK
+	      || !ldns_pkt_push_rr(pkt, LDNS_SECTION_ANSWER, rr)
+	      || ldns_pkt_fit(pkt, 512, &stats) != LDNS_STATUS_OK
+	      || !ldns_pkt_tc(pkt)
+	      || ldns_pkt_ancount(pkt) != 0
+	      || ldns_pkt_nscount(pkt) != 0
+	      || ldns_pkt_arcount(pkt) != 0
+	      || stats.packets != 2
+	      || stats.truncated != 1)
+		fprintf(stderr, "answer should have been truncated\n");
+	else
+		r = 0;
+
+	LDNS_FREE(wire);
+	ldns_pkt_free(pkt);
+	return r;
+}
+
+int test_rrset_canonical(void)
+{
+	/* unsorted, mixed case, with differing ttls */
+	const char *rr_strs[] = {
+		"WWW.Example.com. 300 IN MX 20 MX2.Example.com.",
+		"www.example.COM. 600 IN MX 10 mx1.example.com.",
+		"www.example.com. 300 IN MX 10 MX.example.com.",
+		NULL
+	};
+	ldns_rr_list *rrset = ldns_rr_list_new();
+	ldns_rr_list *clone = NULL;
+	ldns_buffer *got = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	ldns_buffer *expect = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	ldns_rdf *owner = ldns_dname_new_frm_str("*.example.com.");
+	ldns_rr *rr;
+	size_t i;
+	int r = -1;
+
+	for (i = 0; rr_strs[i]; i++) {
+		if (ldns_rr_new_frm_str(&rr, rr_strs[i], 0, NULL, NULL)
+				== LDNS_STATUS_OK)
+			ldns_rr_list_push_rr(rrset, rr);
+	}
+	/* the reference: clone, canonicalize, sort and write */
+	clone = ldns_rr_list_clone(rrset);
+	for (i = 0; i < ldns_rr_list_rr_count(clone); i++) {
+		rr = ldns_rr_list_rr(clone, i);
+		ldns_rr_set_ttl(rr, 3600);
+		ldns_rdf_deep_free(ldns_rr_owner(rr));
+		ldns_rr_set_owner(rr, ldns_rdf_clone(owner));
+		ldns_rr2canonical(rr);
+	}
+	ldns_rr_list_sort(clone);
+
+	if (ldns_rr_list_rr_count(rrset) != 3)
+		fprintf(stderr, "could not create test rrset\n");
+
+	else if (ldns_rr_list2buffer_wire(expect, clone) != LDNS_STATUS_OK
+	      || ldns_rrset2buffer_wire_canonical(got, rrset, owner, 3600)
+			!= LDNS_STATUS_OK)
+		fprintf(stderr, "could not write canonical rrset\n");
+
+	else if (ldns_buffer_position(got) != ldns_buffer_position(expect)
+	      || memcmp(ldns_buffer_begin(got), ldns_buffer_begin(expect),
+			ldns_buffer_position(expect)) != 0)
+		fprintf(stderr, "canonical rrset differs from sorted clone\n");
+	else
+		r = 0;
+
+	ldns_rdf_deep_free(owner);
+	ldns_buffer_free(got);
+	ldns_buffer_free(expect);
+	ldns_rr_list_deep_free(clone);
+	ldns_rr_list_deep_free(rrset);
+	return r;
+}
+
+static FILE *
+zone_fp(const char *str)
+{
+	FILE *fp = tmpfile();
+
+	if (fp) {
+		fputs(str, fp);
+		rewind(fp);
+	}
+	return fp;
+}
+
+int test_zone_diff_ixfr(void)
+{
+	const char *old_zone =
+		"$ORIGIN example.com.\n$TTL 3600\n"
+		"@ SOA ns hostmaster 1 7200 3600 1209600 3600\n"
+		"@ NS ns\n"
+		"a A 192.0.2.1\n"
+		"b A 192.0.2.2\n"
+		"b A 192.0.2.3\n"
+		"c TXT \"old\"\n";
+	/* a deleted, b ttl changed, c unchanged, d added */
+	const char *new_zone =
+		"$ORIGIN example.com.\n"
+		"@ 3600 NS ns\n"
+		"@ 3600 SOA ns hostmaster 2 7200 3600 1209600 3600\n"
+		"B 60 A 192.0.2.2\n"
+		"b 60 A 192.0.2.3\n"
+		"c 3600 TXT \"old\"\n"
+		"d 3600 AAAA 2001:db8::1\n";
+	const char *expect =
+		"example.com.\t3600\tIN\tSOA\tns.example.com. hostmaster.example.com. 2 7200 3600 1209600 3600\n"
+		"example.com.\t3600\tIN\tSOA\tns.example.com. hostmaster.example.com. 1 7200 3600 1209600 3600\n"
+		"a.example.com.\t3600\tIN\tA\t192.0.2.1\n"
+		"b.example.com.\t3600\tIN\tA\t192.0.2.2\n"
+		"b.example.com.\t3600\tIN\tA\t192.0.2.3\n"
+		"example.com.\t3600\tIN\tSOA\tns.example.com. hostmaster.example.com. 2 7200 3600 1209600 3600\n"
+		"B.example.com.\t60\tIN\tA\t192.0.2.2\n"
+		"b.example.com.\t60\tIN\tA\t192.0.2.3\n"
+		"d.example.com.\t3600\tIN\tAAAA\t2001:db8::1\n"
+		"example.com.\t3600\tIN\tSOA\tns.example.com. hostmaster.example.com. 2 7200 3600 1209600 3600\n";
+	const char *unsorted =
+		"$ORIGIN example.com.\n$TTL 3600\n"
+		"@ SOA ns hostmaster 2 7200 3600 1209600 3600\n"
+		"b A 192.0.2.2\n"
+		"a A 192.0.2.1\n";
+	FILE *old_fp = zone_fp(old_zone);
+	FILE *new_fp = zone_fp(new_zone);
+	FILE *out = tmpfile();
+	char got[2048];
+	size_t n = 0;
+	ldns_status s;
+	int r = -1;
+
+	if (!old_fp || !new_fp || !out) {
+		fprintf(stderr, "could not create test zone files\n");
+		goto done;
+	}
+	s = ldns_zone_diff_ixfr_fp(out, old_fp, new_fp, NULL, 0, NULL, NULL);
+	if (s == LDNS_STATUS_OK) {
+		rewind(out);
+		n = fread(got, 1, sizeof(got) - 1, out);
+	}
+	got[n] = 0;
+	if (s != LDNS_STATUS_OK)
+		fprintf(stderr, "zone diff failed: %s\n",
+				ldns_get_errorstr_by_id(s));
+	else if (strcmp(got, expect) != 0)
+		fprintf(stderr, "zone diff is:\n%s\nexpected:\n%s\n", got, expect);
+	else
+		r = 0;
+
+	fclose(old_fp);
+	fclose(new_fp);
+	old_fp = zone_fp(old_zone);
+	new_fp = zone_fp(unsorted);
+	if (r == 0 && (!old_fp || !new_fp ||
+	    ldns_zone_diff_ixfr_fp(out, old_fp, new_fp, NULL, 0, NULL, NULL)
+			!= LDNS_STATUS_ZONE_NOT_SORTED)) {
+		fprintf(stderr, "unsorted zone not detected\n");
+		r = -1;
+	}
+done:
+	if (old_fp)
+		fclose(old_fp);
+	if (new_fp)
+		fclose(new_fp);
+	if (out)
+		fclose(out);
+	return r;
+}
+
+static int
+casefold_ref_compare(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (tolower(a[i]) != tolower(b[i]))
+			return tolower(a[i]) < tolower(b[i]) ? -1 : 1;
+	}
+	return 0;
+}
+
+int test_casefold(void)
+{
+	static const char *impls[] = { "avx2", "sse2", "neon", "word" };
+	uint8_t a[300], b[300], lower[300], expect[300];
+	size_t i, j, len, off, p;
+	uint8_t save;
+	uint64_t h;
+	int r = 0;
+
+	/* all byte values, and many letters */
+	for (i = 0; i < sizeof(a); i++)
+		a[i] = (i % 3) ? (uint8_t) ('A' + i % 60) : (uint8_t) (i * 7);
+	for (i = 0; i < sizeof(a); i++)
+		b[i] = isalpha(a[i]) ? a[i] ^ 0x20 : a[i];
+
+	for (j = 0; j < sizeof(impls) / sizeof(impls[0]); j++) {
+		if (!ldns_casefold_use(impls[j]))
+			continue;
+		for (off = 0; off < 4; off++)
+		for (len = 0; off + len <= sizeof(a); len++) {
+			for (i = 0; i < len; i++)
+				expect[i] = (uint8_t) tolower(a[off + i]);
+			ldns_casefold_lower(lower, a + off, len);
+			if (memcmp(lower, expect, len) != 0) {
+				fprintf(stderr, "casefold %s: lower of %d bytes "
+						"wrong\n", impls[j], (int) len);
+				r = -1;
+			}
+			if (ldns_casefold_compare(a + off, b + off, len) != 0) {
+				fprintf(stderr, "casefold %s: %d bytes not "
+						"equal\n", impls[j], (int) len);
+				r = -1;
+			}
+			/* a difference at every position, either way */
+			for (p = 0; p < len; p += 1 + p / 8) {
+				save = b[off + p];
+				b[off + p] = (uint8_t) (save + 1 + p % 200);
+				if (ldns_casefold_compare(a + off, b + off, len) !=
+				    casefold_ref_compare(a + off, b + off, len)) {
+					fprintf(stderr, "casefold %s: compare of "
+							"%d bytes at %d wrong\n",
+							impls[j], (int) len,
+							(int) p);
+					r = -1;
+				}
+				b[off + p] = save;
+			}
+		}
+	}
+	ldns_casefold_use(NULL);
+
+	for (len = 0; len < sizeof(a); len++) {
+		if (ldns_casefold_hash(a, len, 1) !=
+		    ldns_casefold_hash(b, len, 1)) {
+			fprintf(stderr, "casefold hash of %d bytes depends on "
+					"case\n", (int) len);
+			r = -1;
+		}
+	}
+	/* the same on every platform */
+	h = ldns_casefold_hash((const uint8_t *) "\007Example\003COM", 13, 0);
+	if (h != 0x8c0cd9bd5998224aULL) {
+		fprintf(stderr, "casefold hash is %016llx\n",
+				(unsigned long long) h);
+		r = -1;
+	}
+	return r;
+}
+
+/* reading only some types gives the same rrs as reading everything */
+int test_zone_types(void)
+{
+	static const char *zone =
+		"$ORIGIN example.org.\n"
+		"@ 3600 IN SOA ns hostmaster ( 1 7200 3600\n"
+		"\t\t1209600 300 )\n"
+		"\tNS ns\n"
+		"\tTXT \"a ( quoted ; text\" ( \"over\"\n"
+		"\t\t\"lines\" ) ; and a ) comment\n"
+		"\tRRSIG SOA 8 2 3600 20300101000000 20200101000000 1 "
+		"example.org. AAAA\n"
+		"$TTL 600\n"
+		"ns A 192.0.2.1\n"
+		"  600 A 192.0.2.2\n"
+		"\tRRSIG A 8 3 600 ( 20300101000000\n"
+		"\t\t20200101000000 1 example.org. AAAA )\n"
+		"\n"
+		"$ORIGIN sub.example.org.\n"
+		"www 60 TXT \"x\"\n"
+		"\tRRSIG TXT 8 4 60 20300101000000 20200101000000 1 "
+		"example.org. AAAA\n"
+		"@ DNSKEY 256 3 8 AwEAAQ==\n";
+	ldns_rr_type wanted[] = { LDNS_RR_TYPE_RRSIG, LDNS_RR_TYPE_DNSKEY };
+	ldns_rdf *types;
+	ldns_zone *all = NULL, *some = NULL;
+	ldns_rr *rr;
+	size_t i, j;
+	FILE *fp;
+	int r = 0;
+
+	types = ldns_dnssec_create_nsec_bitmap(wanted, 2, LDNS_RR_TYPE_NSEC);
+	if (!types || !(fp = tmpfile()))
+		return -1;
+	fputs(zone, fp);
+	rewind(fp);
+	if (ldns_zone_new_frm_fp_l(&all, fp, NULL, 0, LDNS_RR_CLASS_IN, NULL)
+	    != LDNS_STATUS_OK) {
+		fprintf(stderr, "zone with all types does not load\n");
+		r = -1;
+	}
+	rewind(fp);
+	if (ldns_zone_new_frm_fp_types_l(&some, fp, NULL, 0, LDNS_RR_CLASS_IN,
+			NULL, types) != LDNS_STATUS_OK) {
+		fprintf(stderr, "zone with some types does not load\n");
+		r = -1;
+	}
+	fclose(fp);
+	if (r == 0 && (!ldns_zone_soa(some) || ldns_rr_compare(
+			ldns_zone_soa(some), ldns_zone_soa(all)) != 0)) {
+		fprintf(stderr, "zone with some types has no SOA\n");
+		r = -1;
+	}
+	for (i = 0, j = 0; r == 0 && i < ldns_zone_rr_count(all); i++) {
+		rr = ldns_rr_list_rr(ldns_zone_rrs(all), i);
+		if (!ldns_nsec_bitmap_covers_type(types, ldns_rr_get_type(rr)))
+			continue;
+		if (j >= ldns_zone_rr_count(some) ||
+		    ldns_rr_compare(rr, ldns_rr_list_rr(
+				ldns_zone_rrs(some), j)) != 0 ||
+		    ldns_rr_ttl(rr) != ldns_rr_ttl(ldns_rr_list_rr(
+				ldns_zone_rrs(some), j))) {
+			fprintf(stderr, "zone with some types differs at "
+					"rr %d\n", (int) j);
+			r = -1;
+		}
+		j++;
+	}
+	if (r == 0 && (j != 4 || j != ldns_zone_rr_count(some))) {
+		fprintf(stderr, "zone with some types has %d rrs\n",
+				(int) ldns_zone_rr_count(some));
+		r = -1;
+	}
+	ldns_zone_deep_free(all);
+	ldns_zone_deep_free(some);
+	ldns_rdf_deep_free(types);
+	return r;
+}
+
+/* the type index of a name follows rrsets added to its list directly */
+int test_name_index(void)
+{
+	static const char *rrs[] = {
+		"x.example.org. MX 10 mx.example.org.",
+		"x.example.org. TXT \"t\"",
+		"x.example.org. A 192.0.2.1",		/* before the head */
+		"x.example.org. NS ns.example.org.",	/* after the head */
+		"x.example.org. AAAA 2001:db8::1"
+	};
+	ldns_rr_type types[] = { LDNS_RR_TYPE_A, LDNS_RR_TYPE_NS,
+		LDNS_RR_TYPE_MX, LDNS_RR_TYPE_TXT, LDNS_RR_TYPE_AAAA };
+	ldns_dnssec_name *name;
+	ldns_dnssec_rrsets *rrset;
+	ldns_status s;
+	ldns_rr *rr;
+	size_t i;
+	int r = 0;
+
+	if (!(name = ldns_dnssec_name_new()))
+		return -1;
+	for (i = 0; i < sizeof(rrs) / sizeof(rrs[0]); i++) {
+		if (ldns_rr_new_frm_str(&rr, rrs[i], 3600, NULL, NULL)
+		    != LDNS_STATUS_OK) {
+			fprintf(stderr, "cannot parse %s\n", rrs[i]);
+			r = -1;
+			break;
+		}
+		if (i == 2 || i == 3)
+			s = ldns_dnssec_rrsets_add_rr(name->rrsets, rr);
+		else
+			s = ldns_dnssec_name_add_rr(name, rr);
+		if (s != LDNS_STATUS_OK) {
+			fprintf(stderr, "cannot add %s\n", rrs[i]);
+			ldns_rr_free(rr);
+			r = -1;
+			break;
+		}
+	}
+	for (i = 0; r == 0 && i < sizeof(types) / sizeof(types[0]); i++) {
+		rrset = ldns_dnssec_name_find_rrset(name, types[i]);
+		if (!rrset || rrset->type != types[i]
+		    || !ldns_dnssec_name_has_type(name, types[i])) {
+			fprintf(stderr, "type %d not found in the name\n",
+					(int) types[i]);
+			r = -1;
+		}
+	}
+	for (rrset = name->rrsets, i = 0; r == 0 && rrset;
+	     rrset = rrset->next, i++) {
+		if (i >= sizeof(types) / sizeof(types[0])
+		    || rrset->type != types[i]) {
+			fprintf(stderr, "rrsets of the name out of order\n");
+			r = -1;
+		}
+	}
+	if (r == 0 && ldns_dnssec_name_has_type(name, LDNS_RR_TYPE_SOA)) {
+		fprintf(stderr, "name has a SOA that was never added\n");
+		r = -1;
+	}
+	ldns_dnssec_name_deep_free(name);
+	return r;
+}
+
+/* a socket of type on addr, on port or on any port when it is 0 */
+static int
+test_socket(int type, const char *addr, uint16_t *port)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int on = 1;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(*port);
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1 ||
+	    (fd = socket(AF_INET, type, 0)) == -1)
+		return -1;
+	(void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *)&sin, len) == -1 ||
+	    getsockname(fd, (struct sockaddr *)&sin, &len) == -1 ||
+	    (type == SOCK_STREAM && listen(fd, 5) == -1)) {
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(sin.sin_port);
+	return fd;
+}
+
+/* how the test server answers over udp */
+enum test_server_mode {
+	/* with the query itself, as a response */
+	TEST_SERVER_ECHO,
+	/* truncated; the full answer is over tcp */
+	TEST_SERVER_TC,
+	/* not at all when the EDNS size is larger than
+	 * LDNS_RESOLV_PATH_EDNS_SAFE, as when fragments are dropped */
+	TEST_SERVER_SMALL
+};
+
+static void
+test_server_tcp(int fd)
+{
+	uint8_t wire[LDNS_MAX_PACKETLEN + 2];
+	size_t len, n = 0;
+	ssize_t got;
+	int s;
+
+	if ((s = accept(fd, NULL, NULL)) == -1)
+		return;
+	while (n < 2 || n < 2 + (size_t)ldns_read_uint16(wire)) {
+		if ((got = read(s, wire + n, sizeof(wire) - n)) <= 0) {
+			close(s);
+			return;
+		}
+		n += (size_t)got;
+	}
+	len = ldns_read_uint16(wire);
+	if (len >= LDNS_HEADER_SIZE) {
+		LDNS_QR_SET(wire + 2);
+		(void) write(s, wire, len + 2);
+	}
+	close(s);
+}
+
+/* a server on udp_fd, and on tcp_fd when it is not -1, until killed */
+static pid_t
+test_server(int udp_fd, int tcp_fd, enum test_server_mode mode)
+{
+	uint8_t wire[LDNS_MAX_PACKETLEN];
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct pollfd pfd[2];
+	ldns_pkt *query;
+	ssize_t n;
+	pid_t pid;
+
+	if ((pid = fork()) != 0)
+		return pid;
+	pfd[0].fd = udp_fd;
+	pfd[1].fd = tcp_fd;
+	pfd[0].events = pfd[1].events = POLLIN;
+	for (;;) {
+		if (poll(pfd, tcp_fd == -1 ? 1 : 2, -1) <= 0)
+			continue;
+		if (tcp_fd != -1 && (pfd[1].revents & POLLIN))
+			test_server_tcp(tcp_fd);
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+		fromlen = sizeof(from);
+		n = recvfrom(udp_fd, wire, sizeof(wire), 0,
+				(struct sockaddr *)&from, &fromlen);
+		if (n < LDNS_HEADER_SIZE)
+			continue;
+		if (mode == TEST_SERVER_SMALL) {
+			query = NULL;
+			if (ldns_wire2pkt(&query, wire, (size_t)n)
+					!= LDNS_STATUS_OK ||
+			    ldns_pkt_edns_udp_size(query)
+					> LDNS_RESOLV_PATH_EDNS_SAFE) {
+				ldns_pkt_free(query);
+				continue;
+			}
+			ldns_pkt_free(query);
+		}
+		LDNS_QR_SET(wire);
+		if (mode == TEST_SERVER_TC)
+			LDNS_TC_SET(wire);
+		(void) sendto(udp_fd, wire, (size_t)n, 0,
+				(struct sockaddr *)&from, fromlen);
+	}
+}
+
+static void
+test_server_stop(pid_t pid)
+{
+	kill(pid, SIGTERM);
+	(void) waitpid(pid, NULL, 0);
+}
+
+/* a resolver for the test server(s) at addr and port */
+static ldns_resolver *
+test_resolver(const char *addr, uint16_t port)
+{
+	struct timeval timeout = { 1, 0 };
+	ldns_resolver *res = ldns_resolver_new();
+	ldns_rdf *ns = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, addr);
+
+	if (!res || !ns ||
+	    ldns_resolver_push_nameserver(res, ns) != LDNS_STATUS_OK) {
+		ldns_rdf_deep_free(ns);
+		ldns_resolver_deep_free(res);
+		return NULL;
+	}
+	ldns_rdf_deep_free(ns);
+	ldns_resolver_set_port(res, port);
+	ldns_resolver_set_timeout(res, timeout);
+	ldns_resolver_set_retry(res, 1);
+	ldns_resolver_set_random(res, false);
+	return res;
+}
+
+static ldns_pkt *
+test_query(void)
+{
+	ldns_rdf *qname = ldns_dname_new_frm_str("example.");
+	ldns_pkt *query = qname ? ldns_pkt_query_new(qname, LDNS_RR_TYPE_A,
+			LDNS_RR_CLASS_IN, LDNS_RD) : NULL;
+
+	if (!query)
+		ldns_rdf_deep_free(qname);
+	return query;
+}
+
+static long
+test_msec_since(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (long)(now.tv_sec - start->tv_sec) * 1000
+		+ (long)(now.tv_usec - start->tv_usec) / 1000;
+}
+
+/* answers that are truncated with EDNS too go to tcp directly next time */
+int test_resolver_path_tcp(void)
+{
+	ldns_resolver *res = NULL;
+	ldns_rdf *ns = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, "127.0.0.1");
+	ldns_pkt *query = test_query(), *answer = NULL;
+	const ldns_resolver_path *path;
+	const ldns_resolver_path_stats *stats;
+	uint16_t port = 0;
+	int udp_fd, tcp_fd = -1;
+	pid_t pid = -1;
+	int r = 0;
+
+	if ((udp_fd = test_socket(SOCK_DGRAM, "127.0.0.1", &port)) == -1 ||
+	    (tcp_fd = test_socket(SOCK_STREAM, "127.0.0.1", &port)) == -1 ||
+	    (pid = test_server(udp_fd, tcp_fd, TEST_SERVER_TC)) == -1 ||
+	    !ns || !query || !(res = test_resolver("127.0.0.1", port))) {
+		r = -1;
+		goto done;
+	}
+	stats = ldns_resolver_get_path_stats(res);
+
+	/* udp, udp with EDNS, and then tcp */
+	if (ldns_resolver_send_pkt(&answer, res, query) != LDNS_STATUS_OK ||
+	    !answer || ldns_pkt_tc(answer)) {
+		fprintf(stderr, "no answer over tcp\n");
+		r = -1;
+	} else if (stats->truncated != 2 || stats->tcp_direct != 0 ||
+		   !(path = ldns_resolver_nameserver_path(res, ns)) ||
+		   path->tcp_type_count != 1 ||
+		   path->tcp_types[0] != LDNS_RR_TYPE_A) {
+		fprintf(stderr, "truncation with EDNS is not learned\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+	answer = NULL;
+
+	if (r == 0 && (ldns_resolver_send_pkt(&answer, res, query)
+			!= LDNS_STATUS_OK || !answer || ldns_pkt_tc(answer) ||
+	    stats->truncated != 2 || stats->tcp_direct != 1 ||
+	    stats->round_trips_saved != 1)) {
+		fprintf(stderr, "the second query did not go to tcp\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+
+	/* and with a path ttl of 0 nothing is learned */
+	ldns_resolver_set_path_ttl(res, 0);
+	if (r == 0 && ldns_resolver_nameserver_path(res, ns) != NULL) {
+		fprintf(stderr, "path is kept without a path ttl\n");
+		r = -1;
+	}
+done:
+	if (pid > 0)
+		test_server_stop(pid);
+	if (udp_fd != -1)
+		close(udp_fd);
+	if (tcp_fd != -1)
+		close(tcp_fd);
+	ldns_pkt_free(query);
+	ldns_rdf_deep_free(ns);
+	ldns_resolver_deep_free(res);
+	return r;
+}
+
+/* a large EDNS size that times out is asked again with the safe size,
+ * which is used directly next time; but only for a server that answered
+ * before, a server that is down costs the timeout once */
+int test_resolver_path_edns(void)
+{
+	ldns_resolver *res = NULL, *dead_res = NULL;
+	ldns_rdf *ns = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, "127.0.0.1");
+	ldns_pkt *query = test_query(), *answer = NULL;
+	const ldns_resolver_path *path;
+	const ldns_resolver_path_stats *stats;
+	struct timeval start;
+	uint16_t port = 0, dead_port = 0;
+	int udp_fd, dead_fd = -1;
+	pid_t pid = -1;
+	int r = 0;
+
+	if ((udp_fd = test_socket(SOCK_DGRAM, "127.0.0.1", &port)) == -1 ||
+	    (dead_fd = test_socket(SOCK_DGRAM, "127.0.0.1", &dead_port))
+			== -1 ||
+	    (pid = test_server(udp_fd, -1, TEST_SERVER_SMALL)) == -1 ||
+	    !ns || !query || !(res = test_resolver("127.0.0.1", port)) ||
+	    !(dead_res = test_resolver("127.0.0.1", dead_port))) {
+		r = -1;
+		goto done;
+	}
+	stats = ldns_resolver_get_path_stats(res);
+
+	/* the server answers without EDNS */
+	if (ldns_resolver_send_pkt(&answer, res, query) != LDNS_STATUS_OK ||
+	    !answer) {
+		fprintf(stderr, "no answer without EDNS\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+	answer = NULL;
+
+	/* then times out with 4096, and answers with the safe size */
+	ldns_pkt_set_edns_udp_size(query, 4096);
+	if (r == 0 && (ldns_resolver_send_pkt(&answer, res, query)
+			!= LDNS_STATUS_OK || !answer)) {
+		fprintf(stderr, "no answer with the safe EDNS size\n");
+		r = -1;
+	} else if (r == 0 && (stats->timeouts != 1 ||
+		   !(path = ldns_resolver_nameserver_path(res, ns)) ||
+		   path->edns_udp_size != LDNS_RESOLV_PATH_EDNS_SAFE)) {
+		fprintf(stderr, "the safe EDNS size is not learned\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+	answer = NULL;
+
+	/* which is used right away next time */
+	ldns_pkt_set_edns_udp_size(query, 4096);
+	gettimeofday(&start, NULL);
+	if (r == 0 && (ldns_resolver_send_pkt(&answer, res, query)
+			!= LDNS_STATUS_OK || !answer ||
+	    stats->edns_reduced != 1 || stats->timeouts != 1 ||
+	    test_msec_since(&start) >= 1000)) {
+		fprintf(stderr, "the safe EDNS size is not used\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+	answer = NULL;
+
+	/* a server that never answered is asked once, and the query keeps
+	 * its EDNS size */
+	ldns_pkt_set_edns_udp_size(query, 4096);
+	gettimeofday(&start, NULL);
+	if (r == 0 && ldns_resolver_send_pkt(&answer, dead_res, query)
+			== LDNS_STATUS_OK) {
+		fprintf(stderr, "answer from a server that is down\n");
+		r = -1;
+	} else if (r == 0 && test_msec_since(&start) >= 2000) {
+		fprintf(stderr, "a server that is down is asked twice\n");
+		r = -1;
+	} else if (r == 0 && ldns_pkt_edns_udp_size(query) != 4096) {
+		fprintf(stderr, "the EDNS size of the query is changed\n");
+		r = -1;
+	} else if (r == 0 &&
+		   (!(path = ldns_resolver_nameserver_path(dead_res, ns)) ||
+		    path->timeouts != 1 ||
+		    ldns_resolver_get_path_stats(dead_res)->timeouts != 0)) {
+		fprintf(stderr, "the timeout is not recorded\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+done:
+	if (pid > 0)
+		test_server_stop(pid);
+	if (udp_fd != -1)
+		close(udp_fd);
+	if (dead_fd != -1)
+		close(dead_fd);
+	ldns_pkt_free(query);
+	ldns_rdf_deep_free(ns);
+	ldns_resolver_deep_free(res);
+	ldns_resolver_deep_free(dead_res);
+	return r;
+}
+
+int test_server_order(void)
+{
+	ldns_resolver *res = NULL;
+	ldns_rdf *alive = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_A, "127.0.0.2");
+	ldns_pkt *query = test_query(), *answer = NULL;
+	ldns_status status;
+	struct timeval start;
+	uint16_t port = 0;
+	int dead_fd = -1, alive_fd;
+	pid_t pid = -1;
+	int r = 0;
+
+	/* the resolver has one port for all its servers, so they are told
+	 * apart by address; the silent one is a socket nobody reads */
+	if ((alive_fd = test_socket(SOCK_DGRAM, "127.0.0.2", &port)) == -1 ||
+	    (dead_fd = test_socket(SOCK_DGRAM, "127.0.0.1", &port)) == -1) {
+		/* no 127.0.0.2 on this system */
+		goto done;
+	}
+	if ((pid = test_server(alive_fd, -1, TEST_SERVER_ECHO)) == -1 ||
+	    !alive || !query || !(res = test_resolver("127.0.0.1", port)) ||
+	    ldns_resolver_push_nameserver(res, alive) != LDNS_STATUS_OK) {
+		r = -1;
+		goto done;
+	}
+
+	/* the first query waits for the silent server, then asks the next */
+	if (ldns_send_pkts(&answer, &status, res, &query, 1, false)
+			!= LDNS_STATUS_OK || status != LDNS_STATUS_OK ||
+	    !answer || ldns_rdf_compare(ldns_pkt_answerfrom(answer),
+		    alive) != 0) {
+		fprintf(stderr, "no answer from the server that is up\n");
+		r = -1;
+	} else if (ldns_resolver_nameserver_rtt(res, 0)
+			!= LDNS_RESOLV_RTT_INF ||
+		   ldns_resolver_nameserver_rtt(res, 1)
+			== LDNS_RESOLV_RTT_INF) {
+		fprintf(stderr, "the silent server keeps its rtt\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+	answer = NULL;
+
+	/* and the next one goes to the server that answered right away */
+	gettimeofday(&start, NULL);
+	if (r == 0 && (ldns_send_pkts(&answer, &status, res, &query, 1,
+			false) != LDNS_STATUS_OK || status != LDNS_STATUS_OK ||
+	    !answer)) {
+		fprintf(stderr, "no second answer\n");
+		r = -1;
+	} else if (r == 0 && test_msec_since(&start) >= 1000) {
+		fprintf(stderr, "the second query waited for the silent "
+				"server\n");
+		r = -1;
+	}
+	ldns_pkt_free(answer);
+done:
+	if (pid > 0)
+		test_server_stop(pid);
+	if (alive_fd != -1)
+		close(alive_fd);
+	if (dead_fd != -1)
+		close(dead_fd);
+	ldns_pkt_free(query);
+	ldns_rdf_deep_free(alive);
+	ldns_resolver_deep_free(res);
+	return r;
+}
+
+/* messages on a tcp connection come out of the reader whole, however
+ * they are split over the reads; a message cut off by the end of the
+ * connection does not */
+int test_tcp_reader(void)
+{
+	struct timeval timeout = { 2, 0 };
+	/* the messages: three queries, a short one, an empty one, and
+	 * one of the largest size */
+	uint8_t *msgs[6] = { NULL, NULL, NULL, (uint8_t *)"abc", (uint8_t *)"",
+		NULL };
+	size_t lens[6] = { 0, 0, 0, 3, 0, LDNS_MAX_PACKETLEN };
+	/* they are sent in pieces that end here, with a pause in between */
+	size_t cuts[6];
+	ldns_tcp_reader *reader = NULL;
+	ldns_pkt *query = test_query(), *pkt;
+	uint8_t *stream = NULL, *p;
+	const uint8_t *msg;
+	size_t size, i, sent;
+	ssize_t n;
+	int fds[2] = { -1, -1 };
+	pid_t pid = -1;
+	int r = 0;
+
+	if (!query || !(msgs[5] = LDNS_XMALLOC(uint8_t, lens[5]))) {
+		r = -1;
+		goto done;
+	}
+	for (i = 0; i < 3; i++) {
+		ldns_pkt_set_id(query, (uint16_t)(i + 1));
+		if (ldns_pkt2wire(&msgs[i], query, &lens[i]) != LDNS_STATUS_OK) {
+			r = -1;
+			goto done;
+		}
+	}
+	for (i = 0; i < lens[5]; i++)
+		msgs[5][i] = (uint8_t)i;
+	for (size = 2 + 10, i = 0; i < 6; i++)
+		size += 2 + lens[i];
+	if (!(stream = LDNS_XMALLOC(uint8_t, size))) {
+		r = -1;
+		goto done;
+	}
+	p = stream;
+	for (i = 0; i < 6; i++) {
+		ldns_write_uint16(p, (uint16_t)lens[i]);
+		memcpy(p + 2, msgs[i], lens[i]);
+		p += 2 + lens[i];
+	}
+	/* the first query split within the length and within the message;
+	 * the other messages coalesced, up to the first byte of the large
+	 * one */
+	cuts[0] = 1;
+	cuts[1] = 6;
+	cuts[2] = 2 + lens[0];
+	cuts[3] = (size_t)(p - stream) - lens[5] - 1;
+	cuts[4] = (size_t)(p - stream);
+	/* and then a message of 100 bytes of which only 10 are sent */
+	ldns_write_uint16(p, 100);
+	memset(p + 2, 0, 10);
+	cuts[5] = cuts[4] + 12;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1 ||
+	    (pid = fork()) == -1) {
+		r = -1;
+		goto done;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (sent = 0, i = 0; i < 6; i++) {
+			while (sent < cuts[i]) {
+				if ((n = write(fds[1], stream + sent,
+						cuts[i] - sent)) <= 0)
+					_exit(1);
+				sent += (size_t)n;
+			}
+			usleep(20000);
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	fds[1] = -1;
+
+	if (!(reader = ldns_tcp_reader_new(fds[0]))) {
+		r = -1;
+		goto done;
+	}
+	for (i = 0; r == 0 && i < 6; i++) {
+		if (!(msg = ldns_tcp_reader_next(reader, &size, timeout)) ||
+		    size != lens[i] || memcmp(msg, msgs[i], size) != 0) {
+			fprintf(stderr, "tcp reader message %d is wrong\n",
+					(int)i);
+			r = -1;
+		} else if (i < 3) {
+			pkt = NULL;
+			if (ldns_wire2pkt(&pkt, msg, size) != LDNS_STATUS_OK ||
+			    ldns_pkt_id(pkt) != i + 1) {
+				fprintf(stderr, "tcp reader query %d is "
+						"wrong\n", (int)i);
+				r = -1;
+			}
+			ldns_pkt_free(pkt);
+		}
+	}
+	if (r == 0 && ((msg = ldns_tcp_reader_next(reader, &size, timeout))
+			|| size != 0)) {
+		fprintf(stderr, "tcp reader gives a truncated message\n");
+		r = -1;
+	}
+done:
+	if (pid > 0)
+		(void) waitpid(pid, NULL, 0);
+	if (fds[0] != -1)
+		close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+	ldns_tcp_reader_free(reader);
+	for (i = 0; i < 3; i++)
+		LDNS_FREE(msgs[i]);
+	LDNS_FREE(msgs[5]);
+	LDNS_FREE(stream);
+	ldns_pkt_free(query);
+	return r;
+}
+
+static ldns_status
+failing_signer(ldns_dnssec_sign_job *jobs, size_t count, void *arg)
+{
+	(void) jobs;
+	(void) count;
+	(void) arg;
+	return LDNS_STATUS_ERR;
+}
+
+/* the rrs added by signing are in the zone, and freed with it */
+static ldns_status
+sign_test_zone(ldns_dnssec_zone **z, ldns_rr_list *added,
+		ldns_key_list *keys, ldns_dnssec_signer signer, size_t batch)
+{
+	static const char *zone =
+		"$ORIGIN example.org.\n"
+		"$TTL 3600\n"
+		"@ SOA ns hostmaster 1 7200 3600 1209600 300\n"
+		"\tNS ns\n"
+		"\tMX 10 mail\n"
+		"ns A 192.0.2.1\n"
+		"mail A 192.0.2.2\n"
+		"\tAAAA 2001:db8::2\n"
+		"sub NS ns.sub\n"
+		"\tDS 1 8 2 "
+		"0000000000000000000000000000000000000000000000000000000000000000\n"
+		"ns.sub A 192.0.2.3\n"
+		"www CNAME @\n";
+	ldns_status s;
+	FILE *fp;
+
+	if (!(fp = tmpfile()))
+		return LDNS_STATUS_ERR;
+	fputs(zone, fp);
+	rewind(fp);
+	s = ldns_dnssec_zone_new_frm_fp(z, fp, NULL, 0, LDNS_RR_CLASS_IN);
+	fclose(fp);
+	if (s != LDNS_STATUS_OK)
+		return s;
+	if (signer)
+		ldns_dnssec_zone_set_signer(*z, signer, NULL, batch);
+	return ldns_dnssec_zone_sign(*z, added, keys,
+			ldns_dnssec_default_replace_signatures, NULL);
+}
+
+/* a zone signed in batches has the same signatures in the same order */
+int test_zone_signer(void)
+{
+	ldns_rr_list *one = ldns_rr_list_new();
+	ldns_rr_list *batched = ldns_rr_list_new();
+	ldns_rr_list *failed = ldns_rr_list_new();
+	ldns_dnssec_zone *zones[3] = { NULL, NULL, NULL };
+	ldns_key_list *keys = ldns_key_list_new();
+	ldns_key *key;
+	ldns_rdf *owner;
+	size_t i;
+	int r = 0;
+
+	key = ldns_key_new_frm_algorithm(LDNS_SIGN_RSASHA256, 1024);
+	owner = ldns_dname_new_frm_str("example.org.");
+	if (!one || !batched || !failed || !keys || !key || !owner)
+		return -1;
+	ldns_key_set_pubkey_owner(key, owner);
+	ldns_key_set_flags(key, LDNS_KEY_ZONE_KEY);
+	ldns_key_set_inception(key, 1767225600);
+	ldns_key_set_expiration(key, 1798761600);
+	ldns_key_list_push_key(keys, key);
+
+	if (sign_test_zone(&zones[0], one, keys, NULL, 0) != LDNS_STATUS_OK ||
+	    sign_test_zone(&zones[1], batched, keys, ldns_dnssec_sign_jobs, 3)
+	    != LDNS_STATUS_OK) {
+		fprintf(stderr, "zone does not sign\n");
+		r = -1;
+	}
+	if (r == 0 && (ldns_rr_list_rr_count(one) < 10 ||
+	    ldns_rr_list_rr_count(one) != ldns_rr_list_rr_count(batched))) {
+		fprintf(stderr, "zone signed in batches has %d rrs, not %d\n",
+				(int) ldns_rr_list_rr_count(batched),
+				(int) ldns_rr_list_rr_count(one));
+		r = -1;
+	}
+	for (i = 0; r == 0 && i < ldns_rr_list_rr_count(one); i++) {
+		if (ldns_rr_compare(ldns_rr_list_rr(one, i),
+				ldns_rr_list_rr(batched, i)) != 0) {
+			fprintf(stderr, "zone signed in batches differs at "
+					"rr %d\n", (int) i);
+			r = -1;
+		}
+	}
+	if (sign_test_zone(&zones[2], failed, keys, failing_signer, 2)
+	    == LDNS_STATUS_OK) {
+		fprintf(stderr, "zone signs with a failing signer\n");
+		r = -1;
+	}
+	for (i = 0; i < 3; i++)
+		ldns_dnssec_zone_deep_free(zones[i]);
+	ldns_rr_list_free(one);
+	ldns_rr_list_free(batched);
+	ldns_rr_list_free(failed);
+	ldns_key_list_free(keys);
+	return r;
+}
+
 void print_data_ar(const uint8_t *data, const size_t len) {
 	size_t i;
 	
@@ -878,6 +2029,38 @@ main(void)
 	if (test_duration())
 		result = EXIT_FAILURE;
 
+	if (test_dname_view())
+		result = EXIT_FAILURE;
+
+	if (test_pkt_fit())
+		result = EXIT_FAILURE;
+
+	if (test_rrset_canonical())
+		result = EXIT_FAILURE;
+
+	if (test_zone_diff_ixfr())
+		result = EXIT_FAILURE;
+
+	if (test_casefold())
+		result = EXIT_FAILURE;
+	if (test_zone_types())
+		result = EXIT_FAILURE;
+
+	if (test_name_index())
+		result = EXIT_FAILURE;
+
+	if (test_resolver_path_tcp())
+		result = EXIT_FAILURE;
+	if (test_resolver_path_edns())
+		result = EXIT_FAILURE;
+	if (test_server_order())
+		result = EXIT_FAILURE;
+	if (test_tcp_reader())
+		result = EXIT_FAILURE;
+
+	if (test_zone_signer())
+		result = EXIT_FAILURE;
+
 	printf("unit test is %s\n", result==EXIT_SUCCESS?"ok":"fail");
 	exit(result);
 }
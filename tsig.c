@@ -136,26 +136,26 @@ ldns_digest_function(char *name)
 	/* The optional algorithms are not yet implemented */
 	if (strcasecmp(name, "hmac-sha512.") == 0) {
 #ifdef HAVE_EVP_SHA512
-		return EVP_sha512();
+		return ldns_evp_md("SHA512");
 #else
 		return NULL;
 #endif
 	} else if (strcasecmp(name, "hmac-shac384.") == 0) {
 #ifdef HAVE_EVP_SHA384
-		return EVP_sha384();
+		return ldns_evp_md("SHA384");
 #else
 		return NULL;
 #endif
 	} else if (strcasecmp(name, "hmac-sha256.") == 0) {
 #ifdef HAVE_EVP_SHA256
-		return EVP_sha256();
+		return ldns_evp_md("SHA256");
 #else
 		return NULL;
 #endif
 	} else if (strcasecmp(name, "hmac-sha1.") == 0) {
-		return EVP_sha1();
+		return ldns_evp_md("SHA1");
 	} else if (strcasecmp(name, "hmac-md5.sig-alg.reg.int.") == 0) {
-		return EVP_md5();
+		return ldns_evp_md("MD5");
 	} else {
 		return NULL;
 	}
@@ -259,8 +259,9 @@ ldns_tsig_mac_new(ldns_rdf **tsig_mac, const uint8_t *pkt_wire, size_t pkt_wire_
 	digester = ldns_digest_function(algorithm_name);
 
 	if (digester) {
-		(void) HMAC(digester, key_bytes, key_size, (void *)wireformat,
-		            (size_t) wiresize, mac_bytes + 2, &md_len);
+		(void) ldns_evp_hmac(digester, key_bytes, (size_t)key_size,
+		            (void *)wireformat, (size_t) wiresize, mac_bytes + 2,
+		            &md_len);
 
 		ldns_write_uint16(mac_bytes, md_len);
 		result = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_INT16_DATA, md_len + 2,
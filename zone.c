@@ -191,12 +191,22 @@ ldns_zone_new_frm_fp(ldns_zone **z, FILE *fp, const ldns_rdf *origin, uint32_t t
 
 ldns_status _ldns_rr_new_frm_fp_l_internal(ldns_rr **newrr, FILE *fp,
 		uint32_t *default_ttl, ldns_rdf **origin, ldns_rdf **prev,
-		int *line_nr, bool *explicit_ttl);
+		int *line_nr, bool *explicit_ttl,
+		const ldns_rdf *types, uint32_t *skipped_ttl);
 
-/* XXX: class is never used */
 ldns_status
 ldns_zone_new_frm_fp_l(ldns_zone **z, FILE *fp, const ldns_rdf *origin,
-	uint32_t default_ttl, ldns_rr_class ATTR_UNUSED(c), int *line_nr)
+	uint32_t default_ttl, ldns_rr_class c, int *line_nr)
+{
+	return ldns_zone_new_frm_fp_types_l(z, fp, origin, default_ttl, c,
+			line_nr, NULL);
+}
+
+/* XXX: class is never used */
+ldns_status
+ldns_zone_new_frm_fp_types_l(ldns_zone **z, FILE *fp,
+	const ldns_rdf *origin, uint32_t default_ttl,
+	ldns_rr_class ATTR_UNUSED(c), int *line_nr, const ldns_rdf *types)
 {
 	ldns_zone *newzone;
 	ldns_rr *rr, *prev_rr = NULL;
@@ -211,6 +221,7 @@ ldns_zone_new_frm_fp_l(ldns_zone **z, FILE *fp, const ldns_rdf *origin,
 	 */
 	bool ttl_from_TTL = false;
 	bool explicit_ttl = false;
+	uint32_t skipped_ttl;
 
 	/* most cases of error are memory problems */
 	ret = LDNS_STATUS_MEM_ERR;
@@ -241,9 +252,18 @@ ldns_zone_new_frm_fp_l(ldns_zone **z, FILE *fp, const ldns_rdf *origin,
 		if (ttl_from_TTL)
 			my_ttl = default_ttl;
 		s = _ldns_rr_new_frm_fp_l_internal(&rr, fp, &my_ttl, &my_origin,
-				&my_prev, line_nr, &explicit_ttl);
+				&my_prev, line_nr, &explicit_ttl,
+				types, &skipped_ttl);
 		switch (s) {
 		case LDNS_STATUS_OK:
+			if (!rr) {
+				/* skipped, but its ttl may be the default */
+				if (explicit_ttl && !ttl_from_TTL) {
+					my_ttl = skipped_ttl;
+				}
+				prev_rr = NULL;
+				break;
+			}
 			if (explicit_ttl) {
 				if (!ttl_from_TTL) {
 					/* No $TTL, so ttl "defaults to the
@@ -355,6 +375,303 @@ error:
 	return ret;
 }
 
+/* a zone file that is read rr by rr, for ldns_zone_diff_ixfr_fp() */
+typedef struct ldns_zone_stream_struct {
+	FILE *fp;
+	uint32_t ttl;
+	uint32_t default_ttl;
+	bool ttl_from_TTL;
+	ldns_rdf *origin;
+	ldns_rdf *prev;
+	ldns_rr *soa;
+	/* the current rr, NULL at the end, and its canonical wire format */
+	ldns_rr *rr;
+	ldns_buffer *wire;
+	/* the rr before it, for the order and for implicit ttls */
+	ldns_rr *last;
+	ldns_buffer *last_wire;
+} ldns_zone_stream;
+
+/* compare rrs in canonical order, like ldns_rr_compare(), but on the
+ * wire format that is already there */
+static int
+ldns_zone_stream_compare(const ldns_rr *rr1, const ldns_buffer *wire1,
+		const ldns_rr *rr2, const ldns_buffer *wire2)
+{
+	size_t offset1, offset2, len1, len2;
+	int c;
+
+	c = ldns_dname_compare(ldns_rr_owner(rr1), ldns_rr_owner(rr2));
+	if (c != 0) {
+		return c;
+	}
+	if (ldns_rr_get_class(rr1) != ldns_rr_get_class(rr2)) {
+		return ldns_rr_get_class(rr1) < ldns_rr_get_class(rr2) ? -1 : 1;
+	}
+	if (ldns_rr_get_type(rr1) != ldns_rr_get_type(rr2)) {
+		return ldns_rr_get_type(rr1) < ldns_rr_get_type(rr2) ? -1 : 1;
+	}
+	offset1 = ldns_rdf_size(ldns_rr_owner(rr1)) + 10;
+	offset2 = ldns_rdf_size(ldns_rr_owner(rr2)) + 10;
+	len1 = ldns_buffer_position(wire1) - offset1;
+	len2 = ldns_buffer_position(wire2) - offset2;
+	c = memcmp(ldns_buffer_at(wire1, offset1), ldns_buffer_at(wire2, offset2),
+			len1 < len2 ? len1 : len2);
+	if (c != 0) {
+		return c;
+	}
+	if (len1 != len2) {
+		return len1 < len2 ? -1 : 1;
+	}
+	return 0;
+}
+
+static ldns_status
+ldns_zone_stream_init(ldns_zone_stream *zs, FILE *fp, const ldns_rdf *origin,
+		uint32_t default_ttl)
+{
+	memset(zs, 0, sizeof(*zs));
+	zs->fp = fp;
+	zs->ttl = default_ttl;
+	zs->default_ttl = default_ttl;
+	if (origin) {
+		zs->origin = ldns_rdf_clone(origin);
+		zs->prev = ldns_rdf_clone(origin);
+		if (!zs->origin || !zs->prev) {
+			return LDNS_STATUS_MEM_ERR;
+		}
+	}
+	zs->wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	zs->last_wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	if (!zs->wire || !zs->last_wire) {
+		return LDNS_STATUS_MEM_ERR;
+	}
+	return LDNS_STATUS_OK;
+}
+
+static void
+ldns_zone_stream_free(ldns_zone_stream *zs)
+{
+	ldns_rdf_deep_free(zs->origin);
+	ldns_rdf_deep_free(zs->prev);
+	ldns_rr_free(zs->soa);
+	ldns_rr_free(zs->rr);
+	ldns_rr_free(zs->last);
+	ldns_buffer_free(zs->wire);
+	ldns_buffer_free(zs->last_wire);
+}
+
+/* Read the next rr that is not the SOA, with the ttl rules of
+ * ldns_zone_new_frm_fp_l(). Duplicate rrs are skipped. */
+static ldns_status
+ldns_zone_stream_next(ldns_zone_stream *zs)
+{
+	ldns_buffer *wire;
+	ldns_rr *rr;
+	bool explicit_ttl = false;
+	ldns_status s;
+	int c;
+
+	if (zs->rr) {
+		ldns_rr_free(zs->last);
+		zs->last = zs->rr;
+		zs->rr = NULL;
+		wire = zs->last_wire;
+		zs->last_wire = zs->wire;
+		zs->wire = wire;
+	}
+	while (!feof(zs->fp)) {
+		if (zs->ttl_from_TTL) {
+			zs->ttl = zs->default_ttl;
+		}
+		s = _ldns_rr_new_frm_fp_l_internal(&rr, zs->fp, &zs->ttl,
+				&zs->origin, &zs->prev, NULL, &explicit_ttl,
+				NULL, NULL);
+		switch (s) {
+		case LDNS_STATUS_OK:
+			break;
+		case LDNS_STATUS_SYNTAX_EMPTY:
+		case LDNS_STATUS_SYNTAX_TTL:
+			zs->default_ttl = zs->ttl;
+			zs->ttl_from_TTL = true;
+			continue;
+		case LDNS_STATUS_SYNTAX_ORIGIN:
+			continue;
+		case LDNS_STATUS_SYNTAX_INCLUDE:
+			return LDNS_STATUS_SYNTAX_INCLUDE_ERR_NOTIMPL;
+		default:
+			return s;
+		}
+		if (explicit_ttl) {
+			if (!zs->ttl_from_TTL) {
+				zs->ttl = ldns_rr_ttl(rr);
+			}
+		} else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SIG
+		       ||  ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG) {
+			if (ldns_rr_rd_count(rr) >= 4
+			&&  ldns_rdf_get_type(ldns_rr_rdf(rr, 3)) == LDNS_RDF_TYPE_INT32)
+				ldns_rr_set_ttl(rr, ldns_rdf2native_int32(
+						ldns_rr_rdf(rr, 3)));
+		} else if (zs->last
+		       &&  ldns_rr_get_type(zs->last) == ldns_rr_get_type(rr)
+		       &&  ldns_dname_compare(ldns_rr_owner(zs->last),
+		                              ldns_rr_owner(rr)) == 0) {
+			ldns_rr_set_ttl(rr, ldns_rr_ttl(zs->last));
+		}
+
+		if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+			/* a second SOA is skipped, like in a zone */
+			if (zs->soa) {
+				ldns_rr_free(rr);
+				continue;
+			}
+			zs->soa = rr;
+			if (!zs->origin) {
+				zs->origin = ldns_rdf_clone(ldns_rr_owner(rr));
+				if (!zs->origin) {
+					return LDNS_STATUS_MEM_ERR;
+				}
+			}
+			continue;
+		}
+
+		ldns_buffer_clear(zs->wire);
+		s = ldns_rr2buffer_wire_canonical(zs->wire, rr, LDNS_SECTION_ANY);
+		if (s != LDNS_STATUS_OK) {
+			ldns_rr_free(rr);
+			return s;
+		}
+		if (zs->last) {
+			c = ldns_zone_stream_compare(zs->last, zs->last_wire,
+					rr, zs->wire);
+			if (c > 0) {
+				ldns_rr_free(rr);
+				return LDNS_STATUS_ZONE_NOT_SORTED;
+			} else if (c == 0) {
+				ldns_rr_free(rr);
+				continue;
+			}
+		}
+		zs->rr = rr;
+		return LDNS_STATUS_OK;
+	}
+	return LDNS_STATUS_OK;
+}
+
+static bool
+ldns_zone_copy_fp(FILE *out, FILE *in)
+{
+	char buf[8192];
+	size_t n;
+
+	rewind(in);
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if (fwrite(buf, 1, n, out) != n) {
+			return false;
+		}
+	}
+	return !ferror(in);
+}
+
+ldns_status
+ldns_zone_diff_ixfr_fp(FILE *out, FILE *old_fp, FILE *new_fp,
+		const ldns_rdf *origin, uint32_t ttl,
+		ldns_rr **old_soa, ldns_rr **new_soa)
+{
+	ldns_zone_stream old_zs, new_zs;
+	FILE *deleted = NULL;
+	FILE *added = NULL;
+	ldns_status s;
+	int c;
+
+	s = ldns_zone_stream_init(&old_zs, old_fp, origin, ttl);
+	if (s == LDNS_STATUS_OK) {
+		s = ldns_zone_stream_init(&new_zs, new_fp, origin, ttl);
+	} else {
+		memset(&new_zs, 0, sizeof(new_zs));
+	}
+	if (s != LDNS_STATUS_OK) {
+		goto done;
+	}
+	/* the SOAs come first, so the rrs are kept in files until then */
+	deleted = tmpfile();
+	added = tmpfile();
+	if (!deleted || !added) {
+		s = LDNS_STATUS_FILE_ERR;
+		goto done;
+	}
+	if ((s = ldns_zone_stream_next(&old_zs)) != LDNS_STATUS_OK ||
+	    (s = ldns_zone_stream_next(&new_zs)) != LDNS_STATUS_OK) {
+		goto done;
+	}
+	while (old_zs.rr || new_zs.rr) {
+		if (!old_zs.rr) {
+			c = 1;
+		} else if (!new_zs.rr) {
+			c = -1;
+		} else {
+			c = ldns_zone_stream_compare(old_zs.rr, old_zs.wire,
+					new_zs.rr, new_zs.wire);
+		}
+		/* an rr of which the ttl changed is deleted and added */
+		if (c < 0 || (c == 0 &&
+		    ldns_rr_ttl(old_zs.rr) != ldns_rr_ttl(new_zs.rr))) {
+			ldns_rr_print(deleted, old_zs.rr);
+		}
+		if (c > 0 || (c == 0 &&
+		    ldns_rr_ttl(old_zs.rr) != ldns_rr_ttl(new_zs.rr))) {
+			ldns_rr_print(added, new_zs.rr);
+		}
+		if (c <= 0 &&
+		    (s = ldns_zone_stream_next(&old_zs)) != LDNS_STATUS_OK) {
+			goto done;
+		}
+		if (c >= 0 &&
+		    (s = ldns_zone_stream_next(&new_zs)) != LDNS_STATUS_OK) {
+			goto done;
+		}
+	}
+	if (!old_zs.soa || !new_zs.soa) {
+		s = LDNS_STATUS_ZONE_NO_SOA;
+		goto done;
+	}
+	/* RFC 1995: new SOA, old SOA, deleted, new SOA, added, new SOA */
+	ldns_rr_print(out, new_zs.soa);
+	ldns_rr_print(out, old_zs.soa);
+	if (!ldns_zone_copy_fp(out, deleted)) {
+		s = LDNS_STATUS_FILE_ERR;
+		goto done;
+	}
+	ldns_rr_print(out, new_zs.soa);
+	if (!ldns_zone_copy_fp(out, added)) {
+		s = LDNS_STATUS_FILE_ERR;
+		goto done;
+	}
+	ldns_rr_print(out, new_zs.soa);
+	if (ferror(out)) {
+		s = LDNS_STATUS_FILE_ERR;
+		goto done;
+	}
+	if (old_soa) {
+		*old_soa = old_zs.soa;
+		old_zs.soa = NULL;
+	}
+	if (new_soa) {
+		*new_soa = new_zs.soa;
+		new_zs.soa = NULL;
+	}
+done:
+	if (deleted) {
+		fclose(deleted);
+	}
+	if (added) {
+		fclose(added);
+	}
+	ldns_zone_stream_free(&old_zs);
+	ldns_zone_stream_free(&new_zs);
+	return s;
+}
+
 void
 ldns_zone_sort(ldns_zone *zone)
 {